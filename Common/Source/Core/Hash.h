@@ -0,0 +1,22 @@
+#ifndef CORE_HASH_H
+#define CORE_HASH_H
+
+#include <stddef.h>
+#include "Types.h"
+
+const u64 HASH_FNV1A64_INIT = 14695981039346656037ULL;
+
+// 64-bit FNV-1a. To hash several pieces of data in turn, pass the result of
+// hashing the previous piece as the hash parameter.
+inline u64 HashFNV1a64(const void* data, size_t size,
+                       u64 hash = HASH_FNV1A64_INIT)
+{
+    const u8* bytes = (const u8*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#endif // CORE_HASH_H
@@ -0,0 +1,159 @@
+#ifndef CORE_LOCKFREEQUEUE_H
+#define CORE_LOCKFREEQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "Macros.h"
+
+struct MpscQueueNode {
+    std::atomic<MpscQueueNode*> next;
+};
+
+// Intrusive, unbounded multi-producer single-consumer queue (this is Dmitry
+// Vyukov's algorithm). Push() is wait-free and may be called from any thread.
+// Pop() must only ever be called from one thread at a time.
+//
+// N.B. Pop() may return NULL while a producer is part-way through a Push(),
+// even if other nodes have been pushed after it. Consumers should therefore
+// rely on some other signal (that producers raise after pushing) to know when
+// to try again.
+class MpscQueue {
+public:
+    MpscQueue()
+        : m_head(&m_stub)
+        , m_tail(&m_stub)
+    {
+        m_stub.next.store(NULL, std::memory_order_relaxed);
+    }
+
+    void Push(MpscQueueNode* node)
+    {
+        ASSERT(node);
+        node->next.store(NULL, std::memory_order_relaxed);
+        MpscQueueNode* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Returns NULL if the queue is empty.
+    MpscQueueNode* Pop()
+    {
+        MpscQueueNode* tail = m_tail;
+        MpscQueueNode* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (!next)
+                return NULL;
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        if (tail != m_head.load(std::memory_order_acquire))
+            return NULL; // A producer is in the middle of pushing.
+        Push(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return NULL;
+    }
+
+private:
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+
+    std::atomic<MpscQueueNode*> m_head;
+    MpscQueueNode* m_tail;
+    MpscQueueNode m_stub;
+};
+
+// Bounded multi-producer multi-consumer queue of values (again, this is one
+// of Dmitry Vyukov's algorithms). Neither operation blocks: TryPush() fails if
+// the queue is full, and TryPop() fails if it's empty.
+template<class T>
+class BoundedMpmcQueue {
+public:
+    // capacity must be a power of two.
+    explicit BoundedMpmcQueue(size_t capacity)
+        : m_cells(new Cell[capacity])
+        , m_mask(capacity - 1)
+        , m_enqueuePos(0)
+        , m_dequeuePos(0)
+    {
+        ASSERT(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+        for (size_t i = 0; i < capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~BoundedMpmcQueue()
+    {
+        delete[] m_cells;
+    }
+
+    bool TryPush(const T& value)
+    {
+        Cell* cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T* value)
+    {
+        ASSERT(value);
+        Cell* cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        *value = cell->value;
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    BoundedMpmcQueue(const BoundedMpmcQueue&);
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue&);
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell* m_cells;
+    size_t m_mask;
+    std::atomic<size_t> m_enqueuePos;
+    std::atomic<size_t> m_dequeuePos;
+};
+
+#endif // CORE_LOCKFREEQUEUE_H
@@ -0,0 +1,97 @@
+#ifndef CORE_RINGBUFFER_H
+#define CORE_RINGBUFFER_H
+
+#include <stddef.h>
+#include <utility>
+#include "Macros.h"
+
+// Fixed-capacity FIFO queue. Its storage is allocated up front, and values
+// are reset as they're popped, so that whatever they own is freed straight
+// away.
+template<class T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity)
+        : m_items(new T[capacity])
+        , m_capacity(capacity)
+        , m_head(0)
+        , m_size(0)
+    {
+        ASSERT(capacity > 0);
+    }
+
+    ~RingBuffer()
+    {
+        delete[] m_items;
+    }
+
+    size_t Capacity() const { return m_capacity; }
+    size_t Size() const { return m_size; }
+    bool IsEmpty() const { return m_size == 0; }
+    bool IsFull() const { return m_size == m_capacity; }
+
+    // index 0 is the front of the queue.
+    T& operator[](size_t index)
+    {
+        ASSERT(index < m_size);
+        return m_items[(m_head + index) % m_capacity];
+    }
+
+    const T& operator[](size_t index) const
+    {
+        ASSERT(index < m_size);
+        return m_items[(m_head + index) % m_capacity];
+    }
+
+    T& Front() { return (*this)[0]; }
+    const T& Front() const { return (*this)[0]; }
+
+    void PushBack(const T& value)
+    {
+        ASSERT(!IsFull());
+        m_items[(m_head + m_size) % m_capacity] = value;
+        ++m_size;
+    }
+
+    void PopFront()
+    {
+        ASSERT(!IsEmpty());
+        m_items[m_head] = T();
+        m_head = (m_head + 1) % m_capacity;
+        --m_size;
+    }
+
+    void Clear()
+    {
+        while (!IsEmpty())
+            PopFront();
+    }
+
+    // Keeps the newest values that fit in the new capacity.
+    void SetCapacity(size_t capacity)
+    {
+        ASSERT(capacity > 0);
+        while (m_size > capacity)
+            PopFront();
+
+        T* items = new T[capacity];
+        for (size_t i = 0; i < m_size; ++i)
+            items[i] = std::move((*this)[i]);
+        delete[] m_items;
+
+        m_items = items;
+        m_capacity = capacity;
+        m_head = 0;
+    }
+
+private:
+    RingBuffer(const RingBuffer&);
+    RingBuffer& operator=(const RingBuffer&);
+
+    T* m_items;
+    size_t m_capacity;
+    size_t m_head;
+    size_t m_size;
+};
+
+#endif // CORE_RINGBUFFER_H
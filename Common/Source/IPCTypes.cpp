@@ -0,0 +1,205 @@
+#include "IPCTypes.h"
+
+#include <string.h>
+#include <Core/Macros.h>
+#include <Core/Endian.h>
+
+const u32 BUILD_STATUS_FINISHED = 1;
+const u32 BUILD_STATUS_CANCELLED = 2;
+
+IPCWriter::IPCWriter(std::vector<u8>* buffer)
+    : m_buffer(buffer)
+    , m_messageStart(0)
+{
+    ASSERT(buffer);
+}
+
+void IPCWriter::BeginMessage(u32 type)
+{
+    m_messageStart = m_buffer->size();
+    // The size is filled in by EndMessage().
+    WriteU32(0);
+    WriteU32(type);
+}
+
+void IPCWriter::EndMessage()
+{
+    size_t size = m_buffer->size() - m_messageStart - sizeof(u32);
+    if (size > IPC_MAX_MESSAGE_SIZE)
+        FATAL("IPC message too big (%zu bytes)", size);
+    u32 value = EndianSwapLE32((u32)size);
+    memcpy(&(*m_buffer)[m_messageStart], &value, sizeof value);
+}
+
+void IPCWriter::WriteU32(u32 value)
+{
+    value = EndianSwapLE32(value);
+    const u8* bytes = (const u8*)&value;
+    m_buffer->insert(m_buffer->end(), bytes, bytes + sizeof value);
+}
+
+void IPCWriter::WriteString(const std::string& str)
+{
+    WriteU32((u32)str.length());
+    m_buffer->insert(m_buffer->end(), str.begin(), str.end());
+}
+
+void IPCWriter::WriteStringList(const std::vector<std::string>& list)
+{
+    WriteU32((u32)list.size());
+    for (size_t i = 0; i < list.size(); ++i)
+        WriteString(list[i]);
+}
+
+void IPCWriter::WriteBuildStatus(const IPCBuildStatus& status)
+{
+    WriteU32((u32)status.projectID);
+    WriteU32(status.nSucceeded);
+    WriteU32(status.nFailed);
+    WriteU32(status.nPathsDone);
+    WriteU32(status.nPathsTotal);
+    WriteU32(status.nJobsRunning);
+    WriteU32(status.msRemaining);
+    WriteU32((status.finished ? BUILD_STATUS_FINISHED : 0) |
+             (status.cancelled ? BUILD_STATUS_CANCELLED : 0));
+}
+
+void IPCWriter::WriteErrorChange(const IPCErrorChange& change)
+{
+    WriteU32((u32)change.errorID);
+    WriteU32(change.added ? 1 : 0);
+    if (change.added) {
+        WriteStringList(change.inputPaths);
+        WriteStringList(change.outputPaths);
+        WriteString(change.message);
+    }
+}
+
+static size_t StringListSize(const std::vector<std::string>& list)
+{
+    size_t size = sizeof(u32);
+    for (size_t i = 0; i < list.size(); ++i)
+        size += sizeof(u32) + list[i].length();
+    return size;
+}
+
+size_t IPCErrorChangeSize(const IPCErrorChange& change)
+{
+    size_t size = 2 * sizeof(u32);
+    if (change.added) {
+        size += StringListSize(change.inputPaths);
+        size += StringListSize(change.outputPaths);
+        size += sizeof(u32) + change.message.length();
+    }
+    return size;
+}
+
+IPCReader::IPCReader(const u8* data, size_t size)
+    : m_pos(data)
+    , m_end(data + size)
+{}
+
+bool IPCReader::ReadU32(u32* value)
+{
+    ASSERT(value);
+    if ((size_t)(m_end - m_pos) < sizeof(u32)) {
+        m_pos = m_end;
+        return false;
+    }
+    memcpy(value, m_pos, sizeof(u32));
+    *value = EndianSwapLE32(*value);
+    m_pos += sizeof(u32);
+    return true;
+}
+
+bool IPCReader::ReadString(std::string* str)
+{
+    ASSERT(str);
+    u32 length;
+    if (!ReadU32(&length))
+        return false;
+    if ((size_t)(m_end - m_pos) < length) {
+        m_pos = m_end;
+        return false;
+    }
+    str->assign((const char*)m_pos, length);
+    m_pos += length;
+    return true;
+}
+
+bool IPCReader::ReadStringList(std::vector<std::string>* list)
+{
+    ASSERT(list);
+    u32 count;
+    if (!ReadU32(&count))
+        return false;
+    // N.B. Each string takes at least 4 bytes, so a bad count can't make us
+    // allocate much more than the message's size.
+    if ((size_t)(m_end - m_pos) / sizeof(u32) < count) {
+        m_pos = m_end;
+        return false;
+    }
+    list->resize(count);
+    for (u32 i = 0; i < count; ++i) {
+        if (!ReadString(&(*list)[i]))
+            return false;
+    }
+    return true;
+}
+
+bool IPCReader::ReadBuildStatus(IPCBuildStatus* status)
+{
+    ASSERT(status);
+    u32 projectID, flags;
+    if (!ReadU32(&projectID) || !ReadU32(&status->nSucceeded) ||
+        !ReadU32(&status->nFailed) || !ReadU32(&status->nPathsDone) ||
+        !ReadU32(&status->nPathsTotal) || !ReadU32(&status->nJobsRunning) ||
+        !ReadU32(&status->msRemaining) || !ReadU32(&flags))
+        return false;
+    status->projectID = (int)projectID;
+    status->finished = (flags & BUILD_STATUS_FINISHED) != 0;
+    status->cancelled = (flags & BUILD_STATUS_CANCELLED) != 0;
+    return true;
+}
+
+bool IPCReader::ReadErrorChange(IPCErrorChange* change)
+{
+    ASSERT(change);
+    u32 errorID, added;
+    if (!ReadU32(&errorID) || !ReadU32(&added))
+        return false;
+    change->errorID = (int)errorID;
+    change->added = added != 0;
+    change->inputPaths.clear();
+    change->outputPaths.clear();
+    change->message.clear();
+    if (change->added) {
+        if (!ReadStringList(&change->inputPaths) ||
+            !ReadStringList(&change->outputPaths) ||
+            !ReadString(&change->message))
+            return false;
+    }
+    return true;
+}
+
+size_t IPCParseMessage(const u8* data, size_t size, u32* type, const u8** payload,
+                       size_t* payloadBytes)
+{
+    ASSERT(type);
+    ASSERT(payload);
+    ASSERT(payloadBytes);
+
+    IPCReader header(data, size);
+    u32 messageSize;
+    if (!header.ReadU32(&messageSize))
+        return 0;
+    if (messageSize < sizeof(u32) || messageSize > IPC_MAX_MESSAGE_SIZE)
+        FATAL("Bad IPC message size (%u bytes)", messageSize);
+    if (size - sizeof(u32) < messageSize)
+        return 0;
+
+    header.ReadU32(type);
+    *payload = data + 2 * sizeof(u32);
+    *payloadBytes = messageSize - sizeof(u32);
+    return sizeof(u32) + messageSize;
+}
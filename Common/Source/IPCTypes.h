@@ -1,12 +1,27 @@
 #ifndef IPCTYPES_H
 #define IPCTYPES_H
 
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <Core/Types.h>
+
+// Messages between the app and the helper are framed as
+//
+//     <u32 size><u32 type><payload>
+//
+// where size counts the type and the payload. Integers are little-endian,
+// strings are <u32 length><chars>, and lists are <u32 count><items>.
+
 enum IPCAppToHelperAction {
     IPCAPPTOHELPER_SHOW_PROJECTS_WINDOW,
     IPCAPPTOHELPER_SHOW_ERRORS_WINDOW,
     IPCAPPTOHELPER_SHOW_ABOUT_WINDOW,
 
-    IPCAPPTOHELPER_REFRESH_ERRORS,
+    // Payload: an IPCBuildStatus.
+    IPCAPPTOHELPER_BUILD_STATUS,
+    // Payload: the project ID, then a list of IPCErrorChanges.
+    IPCAPPTOHELPER_ERRORS_CHANGED,
 
     IPCAPPTOHELPER_QUIT,
 };
@@ -15,4 +30,86 @@ enum IPCHelperToAppAction {
     IPCHELPERTOAPP_QUIT,
 };
 
+// Anything bigger than this is taken to be a corrupt stream.
+const u32 IPC_MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+// Longer error messages are cut short before they're sent, so that an error
+// change always fits in a message with room to spare.
+const u32 IPC_MAX_ERROR_MESSAGE_LENGTH = 1024 * 1024;
+
+const u32 IPC_UNKNOWN_TIME = 0xFFFFFFFF;
+
+struct IPCBuildStatus {
+    int projectID;
+    // Totals for the current build (or recompile) so far.
+    u32 nSucceeded;
+    u32 nFailed;
+    // See AssetBuildStatusInfo.
+    u32 nPathsDone;
+    u32 nPathsTotal;
+    u32 nJobsRunning;
+    // IPC_UNKNOWN_TIME if there's no estimate.
+    u32 msRemaining;
+    bool finished;
+    bool cancelled;
+};
+
+struct IPCErrorChange {
+    int errorID;
+    bool added;
+    // The following are only sent for added errors. The additional input
+    // paths come after the others, as they do in the database.
+    std::vector<std::string> inputPaths;
+    std::vector<std::string> outputPaths;
+    std::string message;
+};
+
+// The number of bytes IPCWriter::WriteErrorChange() writes for the change.
+size_t IPCErrorChangeSize(const IPCErrorChange& change);
+
+class IPCWriter {
+public:
+    explicit IPCWriter(std::vector<u8>* buffer);
+
+    void BeginMessage(u32 type);
+    void EndMessage();
+
+    void WriteU32(u32 value);
+    void WriteString(const std::string& str);
+    void WriteStringList(const std::vector<std::string>& list);
+    void WriteBuildStatus(const IPCBuildStatus& status);
+    void WriteErrorChange(const IPCErrorChange& change);
+
+private:
+    IPCWriter(const IPCWriter&);
+    IPCWriter& operator=(const IPCWriter&);
+
+    std::vector<u8>* m_buffer;
+    size_t m_messageStart;
+};
+
+// Reads a message's payload. Reading past the end fails, and leaves the
+// reader failed.
+class IPCReader {
+public:
+    IPCReader(const u8* data, size_t size);
+
+    bool ReadU32(u32* value);
+    bool ReadString(std::string* str);
+    bool ReadStringList(std::vector<std::string>* list);
+    bool ReadBuildStatus(IPCBuildStatus* status);
+    bool ReadErrorChange(IPCErrorChange* change);
+
+private:
+    IPCReader(const IPCReader&);
+    IPCReader& operator=(const IPCReader&);
+
+    const u8* m_pos;
+    const u8* m_end;
+};
+
+// If a whole message is at the start of data, returns its total size, and
+// writes its type and the location of its payload. Otherwise returns 0.
+size_t IPCParseMessage(const u8* data, size_t size, u32* type, const u8** payload,
+                       size_t* payloadBytes);
+
 #endif // IPCTYPES_H
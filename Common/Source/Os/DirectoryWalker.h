@@ -0,0 +1,30 @@
+#ifndef OS_DIRECTORYWALKER_H
+#define OS_DIRECTORYWALKER_H
+
+#include <string>
+#include <vector>
+
+// Lists the regular files below a directory. Each subdirectory is read as a
+// separate task, and the tasks are shared between several threads: on a big
+// tree, most of the time is spent waiting for the file system, so reading a
+// number of directories at once is much faster than reading them in turn.
+class DirectoryWalker {
+public:
+    // A thread count of zero means one thread per hardware thread.
+    explicit DirectoryWalker(unsigned nThreads = 0);
+
+    // Appends the paths of the files found to files. The paths are relative
+    // to dirPath, use '/' as the separator, and are in no particular order.
+    // Symbolic links aren't followed. Returns false if dirPath can't be
+    // opened as a directory (subdirectories that can't be opened are just
+    // skipped).
+    bool ListFiles(const char* dirPath, std::vector<std::string>* files) const;
+
+private:
+    DirectoryWalker(const DirectoryWalker&);
+    DirectoryWalker& operator=(const DirectoryWalker&);
+
+    unsigned m_nThreads;
+};
+
+#endif // OS_DIRECTORYWALKER_H
@@ -0,0 +1,154 @@
+#include "Os/DirectoryWalker.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iterator>
+
+#include "Core/Macros.h"
+
+namespace {
+    struct WalkState {
+        // Every directory is opened relative to this, so that the tasks don't
+        // depend on each other's file descriptors.
+        int rootFD;
+
+        std::mutex mutex;
+        std::condition_variable condVar;
+        // The following are protected by mutex.
+        std::vector<std::string> pendingDirs;
+        unsigned nBusyThreads;
+    };
+}
+
+static void ReadDirectory(int rootFD, const std::string& relDir,
+                          std::vector<std::string>* subdirs,
+                          std::vector<std::string>* files)
+{
+    const char* openPath = relDir.empty() ? "." : relDir.c_str();
+    int fd = openat(rootFD, openPath, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1)
+        return;
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return;
+    }
+
+    while (dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            // Some file systems don't fill in d_type.
+            struct stat st;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+                continue;
+            if (S_ISDIR(st.st_mode))
+                type = DT_DIR;
+            else if (S_ISREG(st.st_mode))
+                type = DT_REG;
+        }
+        if (type != DT_DIR && type != DT_REG)
+            continue;
+
+        std::string path;
+        path.reserve(relDir.length() + strlen(name) + 1);
+        if (!relDir.empty()) {
+            path.append(relDir);
+            path.push_back('/');
+        }
+        path.append(name);
+
+        if (type == DT_DIR)
+            subdirs->push_back(path);
+        else
+            files->push_back(path);
+    }
+
+    // N.B. This closes fd too.
+    closedir(dir);
+}
+
+static void WorkerProc(WalkState* state, std::vector<std::string>* files)
+{
+    std::vector<std::string> subdirs;
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    for (;;) {
+        // Once there's nothing left to read and no thread is busy (and so
+        // could find more directories), the walk is finished.
+        state->condVar.wait(lock, [=] {
+            return !state->pendingDirs.empty() || state->nBusyThreads == 0;
+        });
+        if (state->pendingDirs.empty())
+            break;
+
+        std::string dir;
+        dir.swap(state->pendingDirs.back());
+        state->pendingDirs.pop_back();
+        ++state->nBusyThreads;
+        lock.unlock();
+
+        subdirs.clear();
+        ReadDirectory(state->rootFD, dir, &subdirs, files);
+
+        lock.lock();
+        --state->nBusyThreads;
+        state->pendingDirs.insert(state->pendingDirs.end(),
+                                  std::make_move_iterator(subdirs.begin()),
+                                  std::make_move_iterator(subdirs.end()));
+        if (!subdirs.empty() || state->nBusyThreads == 0)
+            state->condVar.notify_all();
+    }
+}
+
+DirectoryWalker::DirectoryWalker(unsigned nThreads)
+    : m_nThreads(nThreads)
+{
+    if (m_nThreads == 0)
+        m_nThreads = std::thread::hardware_concurrency();
+    if (m_nThreads == 0)
+        m_nThreads = 1;
+}
+
+bool DirectoryWalker::ListFiles(const char* dirPath,
+                                std::vector<std::string>* files) const
+{
+    ASSERT(dirPath);
+    ASSERT(files);
+
+    WalkState state;
+    state.rootFD = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.rootFD == -1)
+        return false;
+    state.pendingDirs.push_back(std::string());
+    state.nBusyThreads = 0;
+
+    // Each thread collects its own list of files, to keep the time spent
+    // holding the lock down. The calling thread does its share of the work.
+    std::vector<std::vector<std::string> > threadFiles(m_nThreads - 1);
+    std::vector<std::thread> threads;
+    threads.reserve(m_nThreads - 1);
+    for (unsigned i = 0; i < m_nThreads - 1; ++i)
+        threads.push_back(std::thread(WorkerProc, &state, &threadFiles[i]));
+
+    WorkerProc(&state, files);
+
+    for (unsigned i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+        files->insert(files->end(),
+                      std::make_move_iterator(threadFiles[i].begin()),
+                      std::make_move_iterator(threadFiles[i].end()));
+    }
+
+    close(state.rootFD);
+    return true;
+}
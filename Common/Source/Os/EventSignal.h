@@ -0,0 +1,36 @@
+#ifndef OS_EVENTSIGNAL_H
+#define OS_EVENTSIGNAL_H
+
+#include <atomic>
+
+// A signal that stays raised until it's cleared. Besides blocking in Wait(),
+// a thread can wait for the signal by polling its OS handle for readability,
+// which allows the signal to be plugged into other event loops.
+class EventSignal {
+public:
+    typedef int OsHandle;
+
+    EventSignal();
+    ~EventSignal();
+
+    OsHandle GetOsHandle() const;
+
+    // Set() may be called from any thread, and is cheap if the signal is
+    // already raised.
+    void Set();
+    void Clear();
+
+    // Returns false if the timeout expired before the signal was raised.
+    // A negative timeout waits indefinitely.
+    bool Wait(int timeoutMs);
+
+private:
+    EventSignal(const EventSignal&);
+    EventSignal& operator=(const EventSignal&);
+
+    std::atomic<bool> m_raised;
+    OsHandle m_readHandle;
+    OsHandle m_writeHandle;
+};
+
+#endif // OS_EVENTSIGNAL_H
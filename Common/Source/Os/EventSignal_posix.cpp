@@ -0,0 +1,114 @@
+#include "Os/EventSignal.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#ifdef __linux__
+#  include <sys/eventfd.h>
+#endif
+
+#include "Core/Macros.h"
+#include "Core/Types.h"
+
+// On Linux, an eventfd is used. Elsewhere, we fall back to a non-blocking
+// pipe; m_raised ensures that it never holds more than a byte or two.
+
+#ifndef __linux__
+static void SetNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+        FATAL("fcntl");
+}
+#endif
+
+EventSignal::EventSignal()
+    : m_raised(false)
+    , m_readHandle(-1)
+    , m_writeHandle(-1)
+{
+#ifdef __linux__
+    m_readHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_readHandle == -1)
+        FATAL("eventfd: %s", strerror(errno));
+    m_writeHandle = m_readHandle;
+#else
+    int fds[2];
+    if (pipe(fds) != 0)
+        FATAL("pipe: %s", strerror(errno));
+    SetNonBlocking(fds[0]);
+    SetNonBlocking(fds[1]);
+    m_readHandle = fds[0];
+    m_writeHandle = fds[1];
+#endif
+}
+
+EventSignal::~EventSignal()
+{
+    close(m_readHandle);
+    if (m_writeHandle != m_readHandle)
+        close(m_writeHandle);
+}
+
+EventSignal::OsHandle EventSignal::GetOsHandle() const
+{
+    return m_readHandle;
+}
+
+void EventSignal::Set()
+{
+    if (m_raised.exchange(true))
+        return;
+#ifdef __linux__
+    u64 value = 1;
+#else
+    u8 value = 1;
+#endif
+    while (write(m_writeHandle, &value, sizeof value) == -1) {
+        if (errno == EINTR)
+            continue;
+        // A full pipe/counter is still readable, so that's fine.
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        FATAL("write: %s", strerror(errno));
+    }
+}
+
+void EventSignal::Clear()
+{
+    // N.B. The handle must be drained before lowering the flag. The other way
+    // around, the write made by a Set() in between could be drained, leaving
+    // the flag raised with nothing to read, so later Set() calls would never
+    // wake the waiter.
+    //
+    // A Set() that raised the flag just before we lower it may not have
+    // written yet; its write causes one spurious wakeup later on.
+    u8 buffer[64];
+    for (;;) {
+        ssize_t ret = read(m_readHandle, buffer, sizeof buffer);
+        if (ret > 0)
+            continue;
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+            FATAL("read: %s", strerror(errno));
+        break;
+    }
+    m_raised.store(false);
+}
+
+bool EventSignal::Wait(int timeoutMs)
+{
+    pollfd fd = { m_readHandle, POLLIN, 0 };
+    for (;;) {
+        int ret = poll(&fd, 1, timeoutMs);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            FATAL("poll: %s", strerror(errno));
+        }
+        return ret > 0;
+    }
+}
@@ -10,9 +10,17 @@ public:
         FILE_REMOVED,
         FILE_RENAMED,
         FILE_MODIFIED,
+        // Events for the directory, or anything below it, have been missed
+        // (e.g. because the system's event queue overflowed), so any of it
+        // may have changed.
+        RESCAN_REQUIRED,
     };
 
-    typedef std::function<void(EventType, const char*)> OnFileChangedFunc;
+    // For FILE_RENAMED, oldPath is the file's previous path; otherwise, it's
+    // NULL. (A file that is moved into or out of the watched directory is
+    // reported as being created or removed.)
+    typedef std::function<void(EventType, const char* path, const char* oldPath)>
+        OnFileChangedFunc;
 
     static FileSystemWatcher* Create();
     static void Destroy(FileSystemWatcher* watcher);
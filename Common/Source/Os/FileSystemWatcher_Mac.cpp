@@ -2,6 +2,7 @@
 
 #include "FileSystemWatcher.h"
 #include <stdio.h>
+#include <sys/stat.h>
 #include <CoreServices/CoreServices.h>
 
 #include <Core/Macros.h>
@@ -14,7 +15,8 @@ public:
     void SetOnFileChanged(const FileSystemWatcher::OnFileChangedFunc& func);
     void WatchDirectory(const char* path);
 
-    void FileChangedInternal(FileSystemWatcher::EventType event, const char* path);
+    void FileChangedInternal(FileSystemWatcher::EventType event, const char* path,
+                             const char* oldPath);
 
 private:
     FileSystemWatcherMac(const FileSystemWatcherMac&);
@@ -39,6 +41,12 @@ void FileSystemWatcherMac::SetOnFileChanged(const FileSystemWatcher::OnFileChang
     m_onFileChanged = func;
 }
 
+static bool PathExists(const char* path)
+{
+    struct stat st;
+    return lstat(path, &st) == 0;
+}
+
 static void EventCallback(ConstFSEventStreamRef streamRef,
                           void *clientCallBackInfo,
                           size_t numEvents,
@@ -46,25 +54,53 @@ static void EventCallback(ConstFSEventStreamRef streamRef,
                           const FSEventStreamEventFlags eventFlags[],
                           const FSEventStreamEventId eventIds[])
 {
+    static const FSEventStreamEventFlags ITEM_FLAGS =
+        kFSEventStreamEventFlagItemCreated |
+        kFSEventStreamEventFlagItemRemoved |
+        kFSEventStreamEventFlagItemRenamed |
+        kFSEventStreamEventFlagItemModified;
+
     FileSystemWatcherMac* watcher = (FileSystemWatcherMac*)clientCallBackInfo;
+    const char** paths = (const char**)eventPaths;
     for (size_t i = 0; i < numEvents; ++i) {
-        const char* path = ((const char**)eventPaths)[i];
-        if (eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs) {
-            DebugPrint("FileSystemWatcher: an error occurred.\n");
+        const char* path = paths[i];
+        FSEventStreamEventFlags flags = eventFlags[i];
+        // N.B. The dropped event flags are always set along with this one.
+        if (flags & kFSEventStreamEventFlagMustScanSubDirs) {
+            DebugPrint("FileSystemWatcher: events were missed: %s\n", path);
+            watcher->FileChangedInternal(FileSystemWatcher::RESCAN_REQUIRED,
+                                         path, NULL);
             continue;
         }
-        if (eventFlags[i] & kFSEventStreamEventFlagItemCreated) {
-            watcher->FileChangedInternal(FileSystemWatcher::FILE_CREATED, path);
-        }
-        else if (eventFlags[i] & kFSEventStreamEventFlagItemRemoved) {
-            watcher->FileChangedInternal(FileSystemWatcher::FILE_REMOVED, path);
-        }
-        else if (eventFlags[i] & kFSEventStreamEventFlagItemRenamed) {
-            watcher->FileChangedInternal(FileSystemWatcher::FILE_RENAMED, path);
+        if (!(flags & ITEM_FLAGS))
+            continue;
+
+        // A rename within the watched directory arrives as two consecutive
+        // events: one for the old path, followed by one for the new path.
+        if ((flags & kFSEventStreamEventFlagItemRenamed) && i + 1 < numEvents &&
+            (eventFlags[i + 1] & kFSEventStreamEventFlagItemRenamed) &&
+            eventIds[i + 1] == eventIds[i] + 1 &&
+            !PathExists(path) && PathExists(paths[i + 1])) {
+            watcher->FileChangedInternal(FileSystemWatcher::FILE_RENAMED,
+                                         paths[i + 1], path);
+            ++i;
+            continue;
         }
-        else if (eventFlags[i] & kFSEventStreamEventFlagItemModified) {
-            watcher->FileChangedInternal(FileSystemWatcher::FILE_MODIFIED, path);
+
+        // Events for the same path are coalesced, so one event can have
+        // several flags set (e.g. a file that was created and then removed).
+        // Whether the file exists now says what the overall change was.
+        FileSystemWatcher::EventType type;
+        if (!PathExists(path)) {
+            type = FileSystemWatcher::FILE_REMOVED;
+        } else if (flags & (kFSEventStreamEventFlagItemCreated |
+                            kFSEventStreamEventFlagItemRemoved |
+                            kFSEventStreamEventFlagItemRenamed)) {
+            type = FileSystemWatcher::FILE_CREATED;
+        } else {
+            type = FileSystemWatcher::FILE_MODIFIED;
         }
+        watcher->FileChangedInternal(type, path, NULL);
     }
 }
 
@@ -111,10 +147,11 @@ void FileSystemWatcherMac::WatchDirectory(const char* path)
 }
 
 void FileSystemWatcherMac::FileChangedInternal(FileSystemWatcher::EventType event,
-                                               const char* path)
+                                               const char* path,
+                                               const char* oldPath)
 {
     if (m_onFileChanged)
-        m_onFileChanged(event, path);
+        m_onFileChanged(event, path, oldPath);
 }
 
 static FileSystemWatcherMac* Cast(FileSystemWatcher* watcher)
@@ -0,0 +1,29 @@
+#ifndef OS_MAPPEDFILE_H
+#define OS_MAPPEDFILE_H
+
+#include <stddef.h>
+
+// A read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Returns false if the file doesn't exist, is empty, or can't be mapped.
+    // Any previously opened file is closed first.
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const;
+    const void* GetData() const;
+    size_t GetSize() const;
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    void* m_data;
+    size_t m_size;
+};
+
+#endif // OS_MAPPEDFILE_H
@@ -0,0 +1,70 @@
+#include "Os/MappedFile.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Core/Macros.h"
+
+MappedFile::MappedFile()
+    : m_data(NULL)
+    , m_size(0)
+{}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+    ASSERT(path);
+
+    Close();
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // N.B. The mapping stays valid after the file is closed.
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = data;
+    m_size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (!m_data)
+        return;
+    if (munmap(m_data, m_size) != 0)
+        FATAL("munmap");
+    m_data = NULL;
+    m_size = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+    return m_data != NULL;
+}
+
+const void* MappedFile::GetData() const
+{
+    return m_data;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return m_size;
+}
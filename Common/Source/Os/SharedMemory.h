@@ -0,0 +1,40 @@
+#ifndef OS_SHAREDMEMORY_H
+#define OS_SHAREDMEMORY_H
+
+#include <stddef.h>
+#include <string>
+
+// A named region of memory that other processes on the same machine can map
+// (with shm_open() and mmap(), or the equivalent).
+class SharedMemory {
+public:
+    SharedMemory();
+    ~SharedMemory();
+
+    // Returns false if a region with the name already exists, or it can't be
+    // created. The name should start with a '/', and be short (macOS allows
+    // 31 characters). The memory is zero-filled.
+    bool Create(const char* name, size_t size);
+    // Unmaps the region, and unlinks the name if it hasn't been already.
+    void Close();
+
+    // Removes the name, so no more processes can open the region. Processes
+    // that already have it mapped are unaffected.
+    void Unlink();
+
+    bool IsOpen() const;
+    void* GetData() const;
+    size_t GetSize() const;
+    const char* GetName() const;
+
+private:
+    SharedMemory(const SharedMemory&);
+    SharedMemory& operator=(const SharedMemory&);
+
+    void* m_data;
+    size_t m_size;
+    std::string m_name;
+    bool m_linked;
+};
+
+#endif // OS_SHAREDMEMORY_H
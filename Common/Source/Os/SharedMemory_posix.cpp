@@ -0,0 +1,88 @@
+#include "Os/SharedMemory.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Core/Macros.h"
+
+SharedMemory::SharedMemory()
+    : m_data(NULL)
+    , m_size(0)
+    , m_name()
+    , m_linked(false)
+{}
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+bool SharedMemory::Create(const char* name, size_t size)
+{
+    ASSERT(name);
+    ASSERT(size > 0);
+
+    Close();
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd == -1)
+        return false;
+
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0)
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // N.B. The mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    m_name = name;
+    m_linked = true;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (!m_data)
+        return;
+    Unlink();
+    if (munmap(m_data, m_size) != 0)
+        FATAL("munmap");
+    m_data = NULL;
+    m_size = 0;
+    m_name.clear();
+}
+
+void SharedMemory::Unlink()
+{
+    if (!m_linked)
+        return;
+    shm_unlink(m_name.c_str());
+    m_linked = false;
+}
+
+bool SharedMemory::IsOpen() const
+{
+    return m_data != NULL;
+}
+
+void* SharedMemory::GetData() const
+{
+    return m_data;
+}
+
+size_t SharedMemory::GetSize() const
+{
+    return m_size;
+}
+
+const char* SharedMemory::GetName() const
+{
+    return m_name.c_str();
+}
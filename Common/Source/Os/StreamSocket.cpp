@@ -0,0 +1,512 @@
+#include "Os/StreamSocket.h"
+
+#include <string.h> // for memset
+#include <unistd.h> // for close()
+#include <errno.h>
+#include <sys/file.h> // for flock()
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "Core/Macros.h"
+
+const u32 FLAG_NONBLOCKING = 1;
+const u32 FLAG_LISTENING = 2;
+
+// A peer that has gone away shouldn't raise SIGPIPE (which would kill the
+// process); send() should just fail with EPIPE instead.
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+static void DisableSigPipe(int fd)
+{
+#ifdef SO_NOSIGPIPE
+    int value = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof value) != 0)
+        FATAL("setsockopt: %s", strerror(errno));
+#else
+    (void)fd;
+#endif
+}
+
+static void ProcessSocketError(int error)
+{
+    switch (error) {
+        // Errors that should not occur -- indicating a programming error in
+        // this file.
+        case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+        case EWOULDBLOCK:
+#endif
+        case EBADF:
+        case EDESTADDRREQ:
+        case EMSGSIZE:
+        case ENOTCONN:
+        case ENOTSOCK:
+        case EOPNOTSUPP:
+        case EPIPE:
+        case EALREADY:
+        case EINPROGRESS:
+        case EISCONN:
+        case EINVAL:
+        case EFAULT:
+            FATAL("StreamSocket: programming error: %s", strerror(error));
+            break;
+
+        // Errors relating to the address
+        case EAFNOSUPPORT:
+            FATAL("StreamSocket: address invalid or unavailable");
+            break;
+
+        case EADDRNOTAVAIL:
+        // Errors relating to the path of a LOCAL socket
+        case ENOENT:
+        case ENOTDIR:
+        case ELOOP:
+        case ENAMETOOLONG:
+        case EROFS:
+            break;
+
+        // Too many file descriptors open
+        case EMFILE:
+        case ENFILE:
+            break;
+
+        // Errors indicating a problem with the network or system -- these are
+        // not under our control.
+        case EACCES:
+        case EIO:
+        case EADDRINUSE:
+        case ECONNRESET:
+        case ECONNREFUSED:
+        case EHOSTUNREACH:
+        case ENETDOWN:
+        case ENETUNREACH:
+        case ENOBUFS:
+        case ENOMEM:
+        case EPROTOTYPE:
+        case ETIMEDOUT:
+        case EPROTONOSUPPORT: // not sure whether this is in the right place
+            break;
+
+        default:
+            FATAL("StreamSocket: error: %s", strerror(error));
+            break;
+    }
+}
+
+// Returns false if the path is too long.
+static bool MakeLocalAddress(const char* path, sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr->sun_path)
+        return false;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+StreamSocket::StreamSocket()
+    : m_handle(-1)
+    , m_flags(0)
+    , m_family(TCP)
+    , m_boundPath()
+    , m_lockHandle(-1)
+{
+}
+
+StreamSocket::~StreamSocket()
+{
+    Disconnect();
+}
+
+StreamSocket::OsHandle StreamSocket::GetOsHandle() const
+{
+    return m_handle;
+}
+
+StreamSocket::Family StreamSocket::GetFamily() const
+{
+    return m_family;
+}
+
+StreamSocket::BlockingMode StreamSocket::GetBlockingMode() const
+{
+    return (m_flags & FLAG_NONBLOCKING) ? NONBLOCKING : BLOCKING;
+}
+
+void StreamSocket::SetBlockingMode(BlockingMode blockingMode)
+{
+    if (blockingMode == NONBLOCKING)
+        m_flags |= FLAG_NONBLOCKING;
+    else
+        m_flags &= ~(FLAG_NONBLOCKING);
+    if (m_handle != -1)
+        ApplyBlockingMode();
+}
+
+void StreamSocket::ApplyBlockingMode()
+{
+    ASSERT(m_handle != -1);
+
+    int flags = fcntl(m_handle, F_GETFL, 0);
+    if (flags < 0)
+        FATAL("fcntl");
+    if (m_flags & FLAG_NONBLOCKING)
+        flags |= O_NONBLOCK;
+    else
+        flags &= ~(O_NONBLOCK);
+    if (fcntl(m_handle, F_SETFL, flags) != 0)
+        FATAL("fcntl");
+}
+
+void StreamSocket::CheckErrorStatus(bool* result)
+{
+    ASSERT(m_handle != -1);
+
+    int error = 0;
+    socklen_t len = sizeof error;
+    int retval = getsockopt(m_handle, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (retval != 0)
+        FATAL("getsockopt: %s", strerror(retval));
+
+    if (error == 0) {
+        if (result) *result = true;
+    } else {
+        if (result) *result = false;
+        ProcessSocketError(error);
+    }
+}
+
+StreamSocket::SocketResult StreamSocket::Connect(u32 address, u16 port)
+{
+    Create(TCP);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(address);
+    for (;;) {
+        if (connect(m_handle, (sockaddr*)&addr, sizeof addr) != 0) {
+            if (errno == EINTR)
+                continue;
+            // TODO: Do we need to check for EWOULDBLOCK as well?
+            if (errno == EINPROGRESS || errno == EWOULDBLOCK) {
+                return WOULDBLOCK;
+            }
+            ProcessSocketError(errno);
+            Disconnect();
+            return FAILURE;
+        }
+        break;
+    }
+
+    return SUCCESS;
+}
+
+StreamSocket::SocketResult StreamSocket::ConnectLocal(const char* path)
+{
+    ASSERT(path);
+
+    sockaddr_un addr;
+    if (!MakeLocalAddress(path, &addr))
+        return FAILURE;
+
+    Create(LOCAL);
+    for (;;) {
+        if (connect(m_handle, (sockaddr*)&addr, sizeof addr) != 0) {
+            if (errno == EINTR)
+                continue;
+            // N.B. A LOCAL socket fails with EAGAIN if the listener's
+            // backlog is full.
+            if (errno == EINPROGRESS || errno == EWOULDBLOCK || errno == EAGAIN)
+                return WOULDBLOCK;
+            ProcessSocketError(errno);
+            Disconnect();
+            return FAILURE;
+        }
+        break;
+    }
+
+    return SUCCESS;
+}
+
+void StreamSocket::Disconnect()
+{
+    if (m_handle != -1) {
+        if (close(m_handle) == -1)
+            FATAL("close");
+        m_handle = -1;
+    }
+    if (!m_boundPath.empty()) {
+        unlink(m_boundPath.c_str());
+        m_boundPath.clear();
+    }
+    // The lock file itself stays; removing it would let a second process
+    // lock a new file while a third still holds the old one.
+    if (m_lockHandle != -1) {
+        close(m_lockHandle);
+        m_lockHandle = -1;
+    }
+}
+
+bool StreamSocket::Send(const void* data, size_t bytes, size_t* sent)
+{
+    ASSERT(m_handle != -1);
+
+    bool succeeded = true;
+    size_t remaining = bytes;
+    const u8* p = (const u8*)data;
+
+    while (remaining > 0) {
+        ssize_t bytesJustSent = send(m_handle, p, remaining, SEND_FLAGS);
+        if (bytesJustSent == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            // The remote end has closed the connection.
+            if (errno != EPIPE)
+                ProcessSocketError(errno);
+            Disconnect();
+            succeeded = false;
+            break;
+        }
+        remaining -= (size_t)bytesJustSent;
+        p = p + (size_t)bytesJustSent;
+    }
+
+    if (sent)
+        *sent = p - (const u8*)data;
+
+    return succeeded;
+}
+
+bool StreamSocket::SendWithHandle(const void* data, size_t bytes, OsHandle handle, size_t* sent)
+{
+    ASSERT(m_handle != -1);
+    ASSERT(m_family == LOCAL);
+    ASSERT(bytes > 0);
+
+    iovec iov;
+    iov.iov_base = (void*)data;
+    iov.iov_len = bytes;
+
+    union {
+        cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof control);
+
+    msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof control.buffer;
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &handle, sizeof handle);
+
+    if (sent)
+        *sent = 0;
+
+    ssize_t ret;
+    do {
+        ret = sendmsg(m_handle, &msg, SEND_FLAGS);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+        if (errno != EPIPE)
+            ProcessSocketError(errno);
+        Disconnect();
+        return false;
+    }
+
+    // The handle has gone, so the rest is sent as usual.
+    size_t rest = 0;
+    bool succeeded = true;
+    if ((size_t)ret < bytes)
+        succeeded = Send((const u8*)data + ret, bytes - (size_t)ret, &rest);
+    if (sent)
+        *sent = (size_t)ret + rest;
+    return succeeded;
+}
+
+StreamSocket::SocketResult StreamSocket::Recv(void* buf, size_t bufLen, size_t* received)
+{
+    ASSERT(m_handle != -1);
+
+    SocketResult result = SUCCESS;
+    ssize_t ret;
+    for (;;) {
+        ret = recv(m_handle, buf, bufLen, 0);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
+            else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                result = WOULDBLOCK;
+            } else {
+                ProcessSocketError(errno);
+                Disconnect();
+                result = FAILURE;
+            }
+        }
+        break;
+    }
+    if (ret == 0)
+        Disconnect(); // orderly shutdown on remote end
+    if (received)
+        *received = (result == SUCCESS) ? (size_t)ret : 0;
+    return result;
+}
+
+void StreamSocket::Create(Family family)
+{
+    if (m_handle != -1) {
+        ASSERT(m_family == family);
+        return;
+    }
+
+    m_handle = socket(family == LOCAL ? PF_UNIX : PF_INET, SOCK_STREAM, 0);
+    if (m_handle == -1)
+        FATAL("Failed to create socket: %s", strerror(errno));
+    m_family = family;
+    DisableSigPipe(m_handle);
+    if (m_flags & FLAG_NONBLOCKING)
+        ApplyBlockingMode();
+}
+
+void StreamSocket::Create(Family family, OsHandle handle)
+{
+    ASSERT(m_handle == -1);
+    m_handle = handle;
+    m_family = family;
+    DisableSigPipe(m_handle);
+    if (m_flags & FLAG_NONBLOCKING)
+        ApplyBlockingMode();
+}
+
+bool StreamSocket::Bind(u32 address, u16 port)
+{
+    Create(TCP);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(address);
+
+    // Otherwise, connections left in TIME_WAIT by a previous run would stop
+    // us binding to the port for a minute or so.
+    int reuse = 1;
+    if (setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse) != 0)
+        FATAL("setsockopt: %s", strerror(errno));
+
+    if (bind(m_handle, (sockaddr*)&addr, sizeof addr) == -1) {
+        ProcessSocketError(errno);
+        Disconnect();
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamSocket::BindLocal(const char* path)
+{
+    ASSERT(path);
+    ASSERT(m_lockHandle == -1);
+
+    sockaddr_un addr;
+    if (!MakeLocalAddress(path, &addr))
+        return false;
+
+    // The lock is held for as long as the socket is bound. Without it two
+    // processes could both find a left-over socket and replace each other's,
+    // or one could find a socket that has been bound but isn't listening yet
+    // and remove it.
+    std::string lockPath(path);
+    lockPath += ".lock";
+    int lockHandle = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lockHandle == -1)
+        return false;
+    if (flock(lockHandle, LOCK_EX | LOCK_NB) == -1) {
+        close(lockHandle);
+        return false;
+    }
+
+    // A socket that nothing is listening on was left behind by a process
+    // that has exited. Anything else at the path is left alone.
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        StreamSocket probe;
+        if (!S_ISSOCK(st.st_mode) || probe.ConnectLocal(path) != FAILURE) {
+            close(lockHandle);
+            return false;
+        }
+        unlink(path);
+    }
+
+    Create(LOCAL);
+    m_lockHandle = lockHandle;
+    if (bind(m_handle, (sockaddr*)&addr, sizeof addr) == -1) {
+        ProcessSocketError(errno);
+        Disconnect();
+        return false;
+    }
+
+    m_boundPath = path;
+    return true;
+}
+
+bool StreamSocket::Listen(int backlog)
+{
+    ASSERT(m_handle != -1);
+
+    if (listen(m_handle, backlog) == -1) {
+        ProcessSocketError(errno);
+        Disconnect();
+        return false;
+    }
+
+    m_flags |= FLAG_LISTENING;
+
+    return true;
+}
+
+bool StreamSocket::Accept(StreamSocket* socket)
+{
+    ASSERT(socket);
+    ASSERT(m_handle != -1);
+    ASSERT(m_flags & FLAG_LISTENING);
+
+    int fd;
+    do {
+        fd = accept(m_handle, NULL, NULL);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        // No connection is waiting (on a non-blocking socket), or it was
+        // reset before it could be accepted. The socket is still listening.
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)
+            return false;
+        ProcessSocketError(errno);
+        Disconnect();
+        return false;
+    }
+
+    socket->Disconnect();
+    socket->Create(m_family, fd);
+
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef OS_STREAMSOCKET_H
+#define OS_STREAMSOCKET_H
+
+#include <stddef.h>
+#include <string>
+#include "Core/Types.h"
+
+// A stream socket, either over TCP or between processes on the same machine
+// (an AF_UNIX socket, named by a path in the filesystem). The family is
+// chosen by the first call to Connect*() or Bind*().
+class StreamSocket {
+public:
+    enum Family {
+        TCP,
+        LOCAL,
+    };
+
+    enum BlockingMode {
+        BLOCKING,
+        NONBLOCKING,
+    };
+
+    enum SocketResult {
+        SUCCESS,
+        FAILURE,
+        WOULDBLOCK,
+    };
+
+    typedef int OsHandle;
+
+    StreamSocket();
+    ~StreamSocket();
+
+    OsHandle GetOsHandle() const;
+    Family GetFamily() const;
+
+    BlockingMode GetBlockingMode() const;
+    // May be called before the socket is connected or bound.
+    void SetBlockingMode(BlockingMode blockingMode);
+
+    void CheckErrorStatus(bool* result);
+    SocketResult Connect(u32 address, u16 port);
+    SocketResult ConnectLocal(const char* path);
+    void Disconnect();
+
+    bool Send(const void* data, size_t bytes, size_t* sent);
+    // As Send(), but the handle is passed to the peer along with the first
+    // byte, if that byte is sent. Only for LOCAL sockets; the caller still
+    // owns the handle afterwards.
+    bool SendWithHandle(const void* data, size_t bytes, OsHandle handle, size_t* sent);
+    SocketResult Recv(void* buf, size_t bufLen, size_t* received);
+
+    bool Bind(u32 address, u16 port);
+    // Fails if another process is listening at the path. A socket left
+    // behind by a process that has exited is replaced. The path is removed
+    // when the socket is disconnected. "<path>.lock" is created and locked
+    // while the socket is bound.
+    bool BindLocal(const char* path);
+    bool Listen(int backlog);
+    bool Accept(StreamSocket* socket);
+
+private:
+    StreamSocket(const StreamSocket&);
+    StreamSocket& operator=(const StreamSocket&);
+
+    void Create(Family family);
+    void Create(Family family, OsHandle handle);
+    void ApplyBlockingMode();
+
+    OsHandle m_handle;
+    u32 m_flags;
+    Family m_family;
+    // The path that BindLocal() created, if any.
+    std::string m_boundPath;
+    // Lock on "<m_boundPath>.lock", held until Disconnect().
+    OsHandle m_lockHandle;
+};
+
+#endif // OS_STREAMSOCKET_H
@@ -0,0 +1,129 @@
+#include "AssetCostHistory.h"
+
+#include <algorithm>
+#include <Core/Macros.h>
+
+#include "ProjectDBConn.h"
+
+AssetCostHistory::Entry::Entry()
+    : wallMs(-1)
+    , cpuMs(0)
+    , maxRssKB(0)
+    , criticalPathMs(-1)
+    , changed(false)
+{}
+
+AssetCostHistory::AssetCostHistory()
+    : m_projID(-1)
+    , m_paths()
+    , m_entries()
+    , m_totalCriticalPathMs(0)
+    , m_nKnown(0)
+{}
+
+void AssetCostHistory::BeginBuild(ProjectDBConn& dbConn, int projID)
+{
+    ASSERT(projID >= 0);
+
+    // The costs are kept from one build to the next, and only reloaded if
+    // the project changes.
+    if (projID == m_projID)
+        return;
+    m_projID = projID;
+    m_paths.Clear();
+    m_entries.clear();
+    m_totalCriticalPathMs = 0;
+    m_nKnown = 0;
+
+    std::vector<AssetCost> costs;
+    dbConn.QueryAssetCosts(projID, &costs);
+    for (size_t i = 0; i < costs.size(); ++i) {
+        const AssetCost& cost = costs[i];
+        PathID id = m_paths.Intern(cost.path.c_str(), cost.path.length());
+        if (id >= m_entries.size())
+            m_entries.resize(id + 1);
+        Entry& entry = m_entries[id];
+        entry.wallMs = cost.wallMs;
+        entry.cpuMs = cost.cpuMs;
+        entry.maxRssKB = cost.maxRssKB;
+        entry.criticalPathMs = cost.criticalPathMs;
+        m_totalCriticalPathMs += cost.criticalPathMs;
+        ++m_nKnown;
+    }
+}
+
+void AssetCostHistory::Invalidate()
+{
+    m_projID = -1;
+}
+
+void AssetCostHistory::EndBuild(ProjectDBConn& dbConn)
+{
+    ASSERT(m_projID >= 0);
+
+    std::vector<AssetCost> costs;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        Entry& entry = m_entries[i];
+        if (!entry.changed)
+            continue;
+        entry.changed = false;
+        AssetCost cost;
+        cost.path.assign(m_paths.GetPath((PathID)i), m_paths.GetPathLength((PathID)i));
+        cost.wallMs = entry.wallMs;
+        cost.cpuMs = entry.cpuMs;
+        cost.maxRssKB = entry.maxRssKB;
+        cost.criticalPathMs = entry.criticalPathMs;
+        costs.push_back(cost);
+    }
+    dbConn.SetAssetCosts(m_projID, costs);
+}
+
+void AssetCostHistory::RecordAsset(const char* path, const std::vector<std::string>& inputs,
+                                   i64 wallMs, i64 cpuMs, u64 maxRssKB)
+{
+    ASSERT(path);
+    ASSERT(m_projID >= 0);
+
+    // N.B. The inputs are built before the asset is, so their costs are
+    // already up to date.
+    i64 inputsMs = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        i64 ms = GetCriticalPathMs(inputs[i].c_str(), inputs[i].length());
+        inputsMs = std::max(inputsMs, ms);
+    }
+
+    PathID id = m_paths.Intern(path);
+    if (id >= m_entries.size())
+        m_entries.resize(id + 1);
+    Entry& entry = m_entries[id];
+    if (entry.criticalPathMs < 0)
+        ++m_nKnown;
+    else
+        m_totalCriticalPathMs -= entry.criticalPathMs;
+    m_totalCriticalPathMs += inputsMs + wallMs;
+    entry.wallMs = wallMs;
+    entry.cpuMs = cpuMs;
+    entry.maxRssKB = maxRssKB;
+    entry.criticalPathMs = inputsMs + wallMs;
+    entry.changed = true;
+}
+
+i64 AssetCostHistory::GetCriticalPathMs(const char* path, size_t length) const
+{
+    ASSERT(path);
+    PathID id = m_paths.Find(path, length);
+    if (id == INVALID_PATH_ID || id >= m_entries.size())
+        return -1;
+    return m_entries[id].criticalPathMs;
+}
+
+i64 AssetCostHistory::GetPriorityMs(const char* path, size_t length) const
+{
+    i64 ms = GetCriticalPathMs(path, length);
+    if (ms >= 0)
+        return ms;
+    // Nothing to go on, so all the paths are equal and keep their order.
+    if (m_nKnown == 0)
+        return 0;
+    return m_totalCriticalPathMs / (i64)m_nKnown;
+}
@@ -0,0 +1,65 @@
+#ifndef PIPELINE_ASSETCOSTHISTORY_H
+#define PIPELINE_ASSETCOSTHISTORY_H
+
+#include <string>
+#include <vector>
+#include <Core/Types.h>
+#include "PathTable.h"
+
+class ProjectDBConn;
+
+// Remembers what each asset took to build the last time it was built, so
+// that a build can start with the assets that will hold it up the longest.
+//
+// An asset's priority is the length of its critical path: the time it takes
+// to build, plus that of the slowest chain of built assets among its inputs.
+// Starting the assets with the longest critical paths first means that the
+// build isn't left waiting for a single huge asset that was started last
+// (and with no chains, it's just longest-processing-time-first ordering).
+class AssetCostHistory {
+public:
+    AssetCostHistory();
+
+    void BeginBuild(ProjectDBConn& dbConn, int projID);
+    // Makes the next build reload the costs, e.g. after some have been
+    // removed from the database.
+    void Invalidate();
+    // Records the costs of the assets that were built since BeginBuild().
+    void EndBuild(ProjectDBConn& dbConn);
+
+    // inputs are the asset's inputs (which may themselves have been built).
+    void RecordAsset(const char* path, const std::vector<std::string>& inputs,
+                     i64 wallMs, i64 cpuMs, u64 maxRssKB);
+
+    // Returns -1 if the asset has never been built.
+    i64 GetCriticalPathMs(const char* path, size_t length) const;
+
+    // Returns the asset's critical path, or for an asset that has never been
+    // built, the average of those that have (so it isn't put off for ever).
+    i64 GetPriorityMs(const char* path, size_t length) const;
+
+private:
+    AssetCostHistory(const AssetCostHistory&);
+    AssetCostHistory& operator=(const AssetCostHistory&);
+
+    struct Entry {
+        Entry();
+
+        // -1 if the asset has never been built.
+        i64 wallMs;
+        i64 cpuMs;
+        u64 maxRssKB;
+        i64 criticalPathMs;
+        bool changed;
+    };
+
+    int m_projID;
+    // Entries are indexed by the interned path.
+    PathTable m_paths;
+    std::vector<Entry> m_entries;
+    // The total and number of the critical paths that are known.
+    i64 m_totalCriticalPathMs;
+    size_t m_nKnown;
+};
+
+#endif // PIPELINE_ASSETCOSTHISTORY_H
@@ -1,152 +1,1027 @@
 #include "AssetEventService.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <unordered_set>
 
 #include <Core/Endian.h>
 #include <Core/Macros.h>
-#include <Os/TcpSocket.h>
-#include <Os/SocketOsFunctions.h>
-
-// TODO: There is quite possibly a cleaner way to cleanup the thread in the
-// destructor, other than using a timeout for accept().
+#include "AssetPipelineEvents.h"
 
 static u32 Address(u32 a, u32 b, u32 c, u32 d)
 {
     return (a << 24) | (b << 16) | (c << 8) | d;
 }
 
+// Every message starts with its size (not counting the size itself) and its
+// type, as little-endian u32s. Strings are sent as their length, followed by
+// their characters and a null terminator.
+//
+// MSG_ASSET_COMPILED: string path
+// MSG_HELLO: u32 capabilities
+//     A client may send this to say what it supports, and the service
+//     replies with what it supports.
+// MSG_ASSETS_COMPILED: u32 count, count * string path
+//     Only sent to clients that have said they support CAP_BATCHES. Each
+//     path appears at most once in a batch.
+// MSG_SUBSCRIBE, MSG_UNSUBSCRIBE: u32 filterKind, string pattern
+//     Sent by clients. filterKind is an AssetFilterKind.
+// MSG_SHARED_RING: u32 dataBytes, string name
+//     Sent after the hello to clients that support CAP_SHARED_RING. The
+//     client maps the shared memory with that name (see
+//     SharedNotificationRing.h), and replies with MSG_SHARED_RING_ATTACHED,
+//     after which notifications are written to the ring rather than the
+//     socket. N.B. Notifications sent on the socket before then come before
+//     those in the ring.
+// MSG_RING_DOORBELL
+//     Sent to a client that said it was asleep when the ring was written to.
+// MSG_RING_CONSUMED
+//     Sent by a client when it finds that the service is waiting for room in
+//     the ring.
+// MSG_SET_PAYLOAD_LIMIT: u32 maxBytes
+//     Sent by clients that support CAP_PAYLOADS. From then on, compiled
+//     files of up to maxBytes (at most MAX_PAYLOAD_BYTES) are sent with
+//     MSG_ASSET_DATA instead of MSG_ASSET_COMPILED. 0 turns this off again.
+// MSG_ASSET_DATA: string path, u32 dataBytes, dataBytes * u8 data
+//     Never part of a batch.
+// MSG_ASSET_FILE: string path, u32 fileBytes
+//     Sent instead of MSG_ASSET_COMPILED to clients on the local socket that
+//     support CAP_FILE_HANDLES, for files that aren't sent as payloads. A
+//     read-only descriptor for the file is attached (with SCM_RIGHTS) to the
+//     first byte of the message. Never part of a batch.
+// MSG_BUILD_STATUS: i32 projectID, u32 flags, u32 pathsDone, u32 pathsTotal,
+//                   u32 jobsRunning, u32 msRemaining,
+//                   u32 count, count * string runningPath
+//     Sent to clients that support CAP_BUILD_STATUS while a build is going,
+//     at most a few times a second. Only the latest status is sent, so a
+//     client that's slow to read misses some. flags has BUILD_STATUS_FINISHED
+//     and BUILD_STATUS_CANCELLED, msRemaining is 0xFFFFFFFF if it isn't
+//     known, and not every running path is necessarily listed.
 const u32 MSG_ASSET_COMPILED = 1;
+const u32 MSG_HELLO = 2;
+const u32 MSG_ASSETS_COMPILED = 3;
+const u32 MSG_SUBSCRIBE = 4;
+const u32 MSG_UNSUBSCRIBE = 5;
+const u32 MSG_SHARED_RING = 6;
+const u32 MSG_SHARED_RING_ATTACHED = 7;
+const u32 MSG_RING_DOORBELL = 8;
+const u32 MSG_RING_CONSUMED = 9;
+const u32 MSG_SET_PAYLOAD_LIMIT = 10;
+const u32 MSG_ASSET_DATA = 11;
+const u32 MSG_ASSET_FILE = 12;
+const u32 MSG_BUILD_STATUS = 13;
+
+const u32 CAP_BATCHES = 1;
+const u32 CAP_FILTERS = 2;
+const u32 CAP_SHARED_RING = 4;
+const u32 CAP_PAYLOADS = 8;
+const u32 CAP_FILE_HANDLES = 16;
+const u32 CAP_BUILD_STATUS = 32;
+const u32 SERVICE_CAPABILITIES =
+    CAP_BATCHES | CAP_FILTERS | CAP_SHARED_RING | CAP_PAYLOADS | CAP_FILE_HANDLES |
+    CAP_BUILD_STATUS;
+
+const u32 BUILD_STATUS_FINISHED = 1;
+const u32 BUILD_STATUS_CANCELLED = 2;
+const u32 BUILD_STATUS_UNKNOWN_TIME = 0xFFFFFFFF;
+
+const char* const LOCAL_SOCKET_PATH_VARIABLE = "ASSET_PIPELINE_SOCKET";
 
 const u32 PORT = 6789;
 const u32 LOCALHOST = Address(127, 0, 0, 1);
 
-const unsigned SOCKET_ACCEPT_TIMEOUT_MS = 20;
+const int LISTEN_BACKLOG = 8;
+const size_t RECV_BUFFER_SIZE = 256;
+// Clients only send small messages, so anything bigger is an error.
+const u32 MAX_CLIENT_MESSAGE_SIZE = 1024;
+const size_t MAX_CLIENT_FILTER_PATTERNS = 4096;
+
+// Messages are moved from a client's queue into its send buffer a chunk at a
+// time, and a send buffer that has grown larger than this is freed once
+// everything in it has been sent.
+const size_t SEND_CHUNK_BYTES = 64 * 1024;
+const size_t MAX_IDLE_SEND_BUFFER_BYTES = 2 * SEND_CHUNK_BYTES;
+
+const size_t SHARED_RING_BYTES = 1024 * 1024;
+// N.B. This must leave room for the path in half of the shared ring.
+const u32 MAX_PAYLOAD_BYTES = 256 * 1024;
+// Each one holds a file open until the client has been sent it.
+const size_t MAX_PENDING_HANDLES_PER_CLIENT = 64;
+
+const NotificationOverflowPolicy AssetEventService::DEFAULT_OVERFLOW_POLICY;
+const size_t AssetEventService::DEFAULT_QUEUE_CAPACITY;
+
+AssetEventServiceStats::AssetEventServiceStats()
+    : nClients(0)
+    , nQueued(0)
+    , memoryBytes(0)
+    , peakMemoryBytes(0)
+    , nDropped(0)
+    , nCoalesced(0)
+    , nFiltered(0)
+    , nProducerWaits(0)
+{}
+
+AssetEventService::Client::Client(size_t queueCapacity)
+    : socket()
+    , queue(queueCapacity)
+    , sendBuffer()
+    , sendOffset(0)
+    , recvBuffer()
+    , capabilities(0)
+    , filter()
+    , subscribed(false)
+    , ring()
+    , ringAttached(false)
+    , payloadLimit(0)
+    , handles()
+    , buildStatusVersion(0)
+{}
+
+AssetEventService::Client::~Client()
+{
+    for (size_t i = 0; i < handles.size(); ++i)
+        close(handles[i].handle);
+}
 
 AssetEventService::AssetEventService()
     : m_thread()
-    , m_messageQueueMutex()
-    , m_messageQueue()
     , m_shouldExit(false)
-    , m_condVar()
+    , m_signal()
+
+    , m_mutex()
+    , m_intakeNotFull()
+    , m_intake(DEFAULT_QUEUE_CAPACITY)
+    , m_policy(DEFAULT_OVERFLOW_POLICY)
+    , m_queueCapacity(DEFAULT_QUEUE_CAPACITY)
+    , m_nClients(0)
+    , m_nQueuedForClients(0)
+    , m_clientMemoryBytes(0)
+    , m_stats()
+    , m_latestBuildStatus()
+    , m_latestBuildStatusVersion(0)
+
+    , m_clients()
+    , m_nextRingId(0)
+    , m_buildStatusMessage()
+    , m_buildStatusVersion(0)
+    , m_payload()
 {
     m_thread = std::thread(&AssetEventService::ThreadProc, this);
 }
 
 AssetEventService::~AssetEventService()
 {
-    m_shouldExit = true;
-    m_condVar.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shouldExit = true;
+    }
+    m_intakeNotFull.notify_all();
+    m_signal.Set();
 
     m_thread.join();
 }
 
-static u8* Write(u8* ptr, u32 value)
+static void Append(std::vector<u8>* buffer, u32 value)
+{
+    value = EndianSwapLE32(value);
+    const u8* bytes = (const u8*)&value;
+    buffer->insert(buffer->end(), bytes, bytes + sizeof value);
+}
+
+static void Append(std::vector<u8>* buffer, const char* str, u32 len)
+{
+    buffer->insert(buffer->end(), (const u8*)str, (const u8*)str + len + 1);
+}
+
+static void Overwrite(std::vector<u8>* buffer, size_t offset, u32 value)
 {
     value = EndianSwapLE32(value);
-    memcpy(ptr, &value, sizeof value);
-    return ptr + sizeof value;
+    memcpy(&(*buffer)[offset], &value, sizeof value);
+}
+
+static u32 Read(const u8* ptr)
+{
+    u32 value;
+    memcpy(&value, ptr, sizeof value);
+    return EndianSwapLE32(value);
 }
 
-static u8* Write(u8* ptr, const char* str, u32 len)
+static void AppendBytes(std::vector<u8>* buffer, const void* data, u32 bytes)
 {
-    memcpy(ptr, str, len + 1);
-    return ptr + len + 1;
+    buffer->insert(buffer->end(), (const u8*)data, (const u8*)data + bytes);
 }
 
-void AssetEventService::NotifyAssetCompiled(const char* asset)
+static void AppendAssetCompiledMessage(std::vector<u8>* buffer, const std::string& asset)
 {
-    u32 strLen = (u32)strlen(asset);
+    u32 strLen = (u32)asset.length();
     u32 strBytes = strLen + 1;
 
     u32 msgSize = strBytes + 8;
-    u8* data = (u8*)malloc(msgSize);
+    Append(buffer, msgSize);
+    Append(buffer, MSG_ASSET_COMPILED);
+    Append(buffer, strLen);
+    Append(buffer, asset.c_str(), strLen);
+}
+
+static void AppendAssetDataMessage(std::vector<u8>* buffer, const std::string& asset,
+                                   const u8* data, u32 dataBytes)
+{
+    u32 strLen = (u32)asset.length();
+
+    u32 msgSize = strLen + 1 + 12 + dataBytes;
+    Append(buffer, msgSize);
+    Append(buffer, MSG_ASSET_DATA);
+    Append(buffer, strLen);
+    Append(buffer, asset.c_str(), strLen);
+    Append(buffer, dataBytes);
+    AppendBytes(buffer, data, dataBytes);
+}
+
+// Returns the offset of the batch, to be passed to EndBatch().
+static size_t BeginBatch(std::vector<u8>* buffer)
+{
+    // The size and count are filled in at the end.
+    size_t start = buffer->size();
+    Append(buffer, 0);
+    Append(buffer, MSG_ASSETS_COMPILED);
+    Append(buffer, 0);
+    return start;
+}
+
+static void EndBatch(std::vector<u8>* buffer, size_t start, u32 count)
+{
+    if (count == 0) {
+        buffer->resize(start);
+        return;
+    }
+    Overwrite(buffer, start, (u32)(buffer->size() - start - sizeof(u32)));
+    Overwrite(buffer, start + 2 * sizeof(u32), count);
+}
+
+// Reads the compiled file into data if the client wants it sent with the
+// notification. The file is read rather than mapped, because another job (or
+// a recompile) may be truncating it, and reading a mapping past the new end
+// of the file would crash.
+static bool ReadPayload(const Notification& notification, u32 payloadLimit,
+                        std::vector<u8>* data, u32* dataBytes)
+{
+    if (payloadLimit == 0 || notification.filePath.empty())
+        return false;
+
+    int fd;
+    do {
+        fd = open(notification.filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > payloadLimit) {
+        close(fd);
+        return false;
+    }
+
+    // One byte more than the limit is asked for, to tell whether the file
+    // has grown past it since it was stat'ed.
+    if (data->size() < (size_t)payloadLimit + 1)
+        data->resize((size_t)payloadLimit + 1);
+    size_t nRead = 0;
+    while (nRead <= payloadLimit) {
+        ssize_t n = pread(fd, &(*data)[nRead], (size_t)payloadLimit + 1 - nRead,
+                          (off_t)nRead);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        nRead += (size_t)n;
+    }
+    close(fd);
+
+    // N.B. Empty files (and files that couldn't be read) are sent without a
+    // payload.
+    if (nRead == 0 || nRead > payloadLimit)
+        return false;
+    *dataBytes = (u32)nRead;
+    return true;
+}
+
+// Returns -1 if the file can't be opened.
+static int OpenFileHandle(const Notification& notification, u32* fileBytes)
+{
+    if (notification.filePath.empty())
+        return -1;
+    int fd;
+    do {
+        fd = open(notification.filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > 0xFFFFFFFF) {
+        close(fd);
+        return -1;
+    }
+    *fileBytes = (u32)st.st_size;
+    return fd;
+}
+
+static void AppendAssetFileMessage(std::vector<u8>* buffer, const std::string& asset,
+                                   u32 fileBytes)
+{
+    u32 strLen = (u32)asset.length();
+
+    u32 msgSize = strLen + 1 + 12;
+    Append(buffer, msgSize);
+    Append(buffer, MSG_ASSET_FILE);
+    Append(buffer, strLen);
+    Append(buffer, asset.c_str(), strLen);
+    Append(buffer, fileBytes);
+}
+
+static void AppendHelloMessage(std::vector<u8>* buffer, u32 capabilities)
+{
+    Append(buffer, 8);
+    Append(buffer, MSG_HELLO);
+    Append(buffer, capabilities);
+}
 
-    u8* ptr = data;
-    ptr = Write(ptr, MSG_ASSET_COMPILED);
-    ptr = Write(ptr, strLen);
-    ptr = Write(ptr, asset, strLen + 1);
+static void AppendSharedRingMessage(std::vector<u8>* buffer, const SharedNotificationRing& ring)
+{
+    u32 strLen = (u32)strlen(ring.GetName());
+    Append(buffer, strLen + 1 + 12);
+    Append(buffer, MSG_SHARED_RING);
+    Append(buffer, (u32)ring.GetDataBytes());
+    Append(buffer, strLen);
+    Append(buffer, ring.GetName(), strLen);
+}
 
-    Message message;
-    message.size = msgSize;
-    message.bytes = data;
+static void AppendDoorbellMessage(std::vector<u8>* buffer)
+{
+    Append(buffer, 4);
+    Append(buffer, MSG_RING_DOORBELL);
+}
 
+static void AppendBuildStatusMessage(std::vector<u8>* buffer, const AssetBuildStatusInfo& info)
+{
+    size_t start = buffer->size();
+    // The size is filled in at the end.
+    Append(buffer, 0);
+    Append(buffer, MSG_BUILD_STATUS);
+    Append(buffer, (u32)info.projectID);
+    Append(buffer, (info.finished ? BUILD_STATUS_FINISHED : 0) |
+                   (info.cancelled ? BUILD_STATUS_CANCELLED : 0));
+    Append(buffer, info.nPathsDone);
+    Append(buffer, info.nPathsTotal);
+    Append(buffer, info.nJobsRunning);
+    if (info.msRemaining < 0)
+        Append(buffer, BUILD_STATUS_UNKNOWN_TIME);
+    else
+        Append(buffer, (u32)std::min(info.msRemaining, (i64)BUILD_STATUS_UNKNOWN_TIME - 1));
+    Append(buffer, (u32)info.runningPaths.size());
+    for (size_t i = 0; i < info.runningPaths.size(); ++i) {
+        u32 strLen = (u32)info.runningPaths[i].length();
+        Append(buffer, strLen);
+        Append(buffer, info.runningPaths[i].c_str(), strLen);
+    }
+    Overwrite(buffer, start, (u32)(buffer->size() - start - sizeof(u32)));
+}
+
+void AssetEventService::NotifyAssetCompiled(const char* asset, const char* filePath)
+{
+    ASSERT(asset);
+
+    Notification notification;
+    notification.asset = asset;
+    if (filePath)
+        notification.filePath = filePath;
     {
-        std::lock_guard<std::mutex> lock(m_messageQueueMutex);
-        bool empty = m_messageQueue.empty();
-        m_messageQueue.push(message);
-        if (empty)
-            m_condVar.notify_all();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        NotificationQueue::PushResult result = m_intake.Push(notification, GetIntakePolicy());
+        if (result == NotificationQueue::FULL) {
+            ++m_stats.nProducerWaits;
+            m_intakeNotFull.wait(lock, [this] {
+                return m_shouldExit || !m_intake.IsFull() ||
+                       GetIntakePolicy() != OVERFLOW_BLOCK;
+            });
+            if (m_shouldExit)
+                return;
+            result = m_intake.Push(notification, GetIntakePolicy());
+        }
+        RecordPushResult(result);
+        UpdateStats();
+    }
+    m_signal.Set();
+}
+
+void AssetEventService::NotifyBuildStatus(const AssetBuildStatusInfo& info)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_latestBuildStatus.clear();
+        AppendBuildStatusMessage(&m_latestBuildStatus, info);
+        ++m_latestBuildStatusVersion;
+    }
+    m_signal.Set();
+}
+
+void AssetEventService::SetQueueLimits(NotificationOverflowPolicy policy, size_t capacity)
+{
+    ASSERT(capacity > 0);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_policy = policy;
+        m_queueCapacity = capacity;
+        size_t nQueued = m_intake.Size();
+        m_intake.SetCapacity(capacity);
+        m_stats.nDropped += nQueued - m_intake.Size();
+        UpdateStats();
+    }
+    // The thread resizes the clients' queues when it next wakes up.
+    m_intakeNotFull.notify_all();
+    m_signal.Set();
+}
+
+AssetEventServiceStats AssetEventService::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+NotificationOverflowPolicy AssetEventService::GetIntakePolicy() const
+{
+    // With no clients connected, there's nobody to wait for.
+    if (m_policy == OVERFLOW_BLOCK && m_nClients == 0)
+        return OVERFLOW_DROP_OLDEST;
+    return m_policy;
+}
+
+void AssetEventService::RecordPushResult(NotificationQueue::PushResult result)
+{
+    ASSERT(result != NotificationQueue::FULL);
+    if (result == NotificationQueue::COALESCED)
+        ++m_stats.nCoalesced;
+    else if (result == NotificationQueue::DROPPED_OLDEST)
+        ++m_stats.nDropped;
+}
+
+void AssetEventService::UpdateStats()
+{
+    m_stats.nClients = m_nClients;
+    m_stats.nQueued = m_intake.Size() + m_nQueuedForClients;
+    m_stats.memoryBytes = m_intake.GetMemoryUsage() + m_clientMemoryBytes;
+    m_stats.peakMemoryBytes = std::max(m_stats.peakMemoryBytes, m_stats.memoryBytes);
+}
+
+void AssetEventService::UpdateClientStats()
+{
+    size_t nQueued = 0;
+    size_t memoryBytes = 0;
+    for (size_t i = 0; i < m_clients.size(); ++i) {
+        const Client& client = *m_clients[i];
+        nQueued += client.queue.Size();
+        memoryBytes += client.queue.GetMemoryUsage() + client.sendBuffer.capacity();
+        if (client.ring)
+            memoryBytes += client.ring->GetDataBytes();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_nClients = (int)m_clients.size();
+    m_nQueuedForClients = nQueued;
+    m_clientMemoryBytes = memoryBytes;
+    UpdateStats();
+}
+
+static std::string GetTempDirectory()
+{
+    const char* dir = getenv("TMPDIR");
+    std::string ret = (dir && *dir != '\0') ? dir : "/tmp";
+    if (ret.back() != '/')
+        ret.push_back('/');
+    return ret;
+}
+
+std::string AssetEventService::GetDefaultLocalSocketPath()
+{
+    char name[64];
+    snprintf(name, sizeof name, "AssetPipeline-%u.sock", (unsigned)getuid());
+    return GetTempDirectory() + name;
+}
+
+// Falls back to a path for this process if another pipeline is already
+// listening at the default path. Returns false if it can't listen at all.
+static bool ListenLocal(StreamSocket* serverSocket)
+{
+    const char* path = getenv(LOCAL_SOCKET_PATH_VARIABLE);
+    if (path && *path != '\0') {
+        if (serverSocket->BindLocal(path) && serverSocket->Listen(LISTEN_BACKLOG))
+            return true;
+        serverSocket->Disconnect();
+        DebugPrint("Failed to listen for asset clients at %s", path);
+        return false;
+    }
+
+    std::string defaultPath = AssetEventService::GetDefaultLocalSocketPath();
+    if (serverSocket->BindLocal(defaultPath.c_str()) && serverSocket->Listen(LISTEN_BACKLOG))
+        return true;
+    serverSocket->Disconnect();
+
+    char name[64];
+    snprintf(name, sizeof name, "AssetPipeline-%u-%d.sock", (unsigned)getuid(),
+             (int)getpid());
+    std::string instancePath = GetTempDirectory() + name;
+    if (serverSocket->BindLocal(instancePath.c_str()) && serverSocket->Listen(LISTEN_BACKLOG)) {
+        DebugPrint("%s is in use; listening for asset clients at %s instead (set %s to "
+                   "connect to it)", defaultPath.c_str(), instancePath.c_str(),
+                   LOCAL_SOCKET_PATH_VARIABLE);
+        return true;
     }
+    serverSocket->Disconnect();
+    DebugPrint("Failed to listen for asset clients at %s", instancePath.c_str());
+    return false;
 }
 
 void AssetEventService::ThreadProc()
 {
-    TcpSocket serverSocket;
-    if (!serverSocket.Bind(LOCALHOST, PORT))
-        FATAL("Failed to bind socket");
-    if (!serverSocket.Listen(0))
-        FATAL("Failed to setup socket listening");
+    // N.B. Either server socket can fail to listen (e.g. because another
+    // pipeline is running). poll() ignores one that failed, as its handle is
+    // -1. If both fail, the service carries on without any clients, since
+    // the rest of the pipeline doesn't need them.
+    StreamSocket localServerSocket;
+    ListenLocal(&localServerSocket);
+    StreamSocket tcpServerSocket;
+    if (!tcpServerSocket.Bind(LOCALHOST, PORT) || !tcpServerSocket.Listen(LISTEN_BACKLOG))
+        tcpServerSocket.Disconnect();
+    if (localServerSocket.GetOsHandle() == -1 && tcpServerSocket.GetOsHandle() == -1)
+        DebugPrint("Failed to set up socket listening; asset clients won't be notified");
+    localServerSocket.SetBlockingMode(StreamSocket::NONBLOCKING);
+    tcpServerSocket.SetBlockingMode(StreamSocket::NONBLOCKING);
+
+    // The first three entries are for the signal and the server sockets,
+    // and the rest are for the clients, in order.
+    const size_t FIRST_CLIENT_FD = 3;
+    std::vector<pollfd> fds;
 
     for (;;) {
-        fd_set readSet;
-        FD_ZERO(&readSet);
-        FD_SET(serverSocket.GetOsHandle(), &readSet);
-
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = SOCKET_ACCEPT_TIMEOUT_MS * 1000;
-
-        int result = select(serverSocket.GetOsHandle() + 1, &readSet,
-                            NULL, NULL, &tv);
-        if (result == -1)
-            FATAL("select");
-        if (result == 0) {
+        fds.clear();
+        pollfd signalFd = { m_signal.GetOsHandle(), POLLIN, 0 };
+        pollfd localServerFd = { localServerSocket.GetOsHandle(), POLLIN, 0 };
+        pollfd tcpServerFd = { tcpServerSocket.GetOsHandle(), POLLIN, 0 };
+        fds.push_back(signalFd);
+        fds.push_back(localServerFd);
+        fds.push_back(tcpServerFd);
+        for (size_t i = 0; i < m_clients.size(); ++i) {
+            const Client& client = *m_clients[i];
+            short events = POLLIN;
+            // N.B. A client with a full ring tells us when it has made room.
+            if (client.sendOffset < client.sendBuffer.size() ||
+                (!client.queue.IsEmpty() && !client.ringAttached))
+                events |= POLLOUT;
+            pollfd clientFd = { client.socket.GetOsHandle(), events, 0 };
+            fds.push_back(clientFd);
+        }
+
+        if (poll(&fds[0], (nfds_t)fds.size(), -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            FATAL("poll: %s", strerror(errno));
+        }
+
+        if (fds[0].revents) {
+            // N.B. The signal must be cleared before the queue is looked at,
+            // so that messages queued afterwards raise it again.
+            m_signal.Clear();
             if (m_shouldExit)
                 break;
+            TakeBuildStatus();
+        }
+
+        // Disconnected clients are removed as we go.
+        size_t nClients = m_clients.size();
+        size_t clientIndex = 0;
+        for (size_t i = 0; i < nClients; ++i) {
+            short revents = fds[FIRST_CLIENT_FD + i].revents;
+            Client* client = m_clients[clientIndex].get();
+            bool connected = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+                connected = ReadFromClient(client);
+            if (connected && (revents & POLLOUT))
+                connected = FlushClient(client);
+            if (connected)
+                ++clientIndex;
             else
-                continue;
+                RemoveClient(clientIndex);
         }
 
-        TcpSocket socket;
-        if (!serverSocket.Accept(&socket))
-            FATAL("Failed to accept socket");
+        if (fds[1].revents & POLLIN)
+            AcceptClients(localServerSocket);
+        if (fds[2].revents & POLLIN)
+            AcceptClients(tcpServerSocket);
+
+        if (!m_clients.empty())
+            QueueMessagesForClients();
+
+        UpdateClientStats();
+    }
+}
+
+void AssetEventService::AcceptClients(StreamSocket& serverSocket)
+{
+    size_t capacity;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        capacity = m_queueCapacity;
+    }
+
+    for (;;) {
+        std::unique_ptr<Client> client(new Client(capacity));
+        if (!serverSocket.Accept(&client->socket))
+            break;
+        client->socket.SetBlockingMode(StreamSocket::NONBLOCKING);
+        m_clients.push_back(std::move(client));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_nClients = (int)m_clients.size();
+}
+
+void AssetEventService::RemoveClient(size_t index)
+{
+    ASSERT(index < m_clients.size());
+    m_clients.erase(m_clients.begin() + index);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nClients = (int)m_clients.size();
+    }
+    // A producer that was waiting for the client doesn't need to any more.
+    m_intakeNotFull.notify_all();
+}
 
-        for (;;) {
-            {
-                std::unique_lock<std::mutex> lock(m_messageQueueMutex);
-                m_condVar.wait(lock, [=] {
-                    return m_shouldExit || !m_messageQueue.empty();
-                });
+void AssetEventService::TakeBuildStatus()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_buildStatusVersion == m_latestBuildStatusVersion)
+        return;
+    m_buildStatusMessage = m_latestBuildStatus;
+    m_buildStatusVersion = m_latestBuildStatusVersion;
+}
+
+// Hands the queued messages to every client, and sends what can be sent
+// without blocking (which saves a trip round the event loop).
+void AssetEventService::QueueMessagesForClients()
+{
+    bool moved = false;
+    bool blocked = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_clients.size(); ++i) {
+            NotificationQueue& queue = m_clients[i]->queue;
+            if (queue.Capacity() != m_queueCapacity) {
+                size_t nQueued = queue.Size();
+                queue.SetCapacity(m_queueCapacity);
+                m_stats.nDropped += nQueued - queue.Size();
             }
-            if (m_shouldExit)
-                break;
-            if (!SendQueuedMessages(socket))
-                break;
         }
-        if (m_shouldExit)
+
+        while (!m_intake.IsEmpty()) {
+            // The slowest client holds everyone up (and eventually the
+            // producer too).
+            if (m_policy == OVERFLOW_BLOCK) {
+                bool anyFull = false;
+                for (size_t i = 0; i < m_clients.size() && !anyFull; ++i)
+                    anyFull = m_clients[i]->queue.IsFull();
+                if (anyFull) {
+                    blocked = true;
+                    break;
+                }
+            }
+
+            Notification notification = m_intake.Pop();
+            for (size_t i = 0; i < m_clients.size(); ++i) {
+                Client& client = *m_clients[i];
+                if (client.subscribed && !client.filter.Matches(notification.asset.c_str()))
+                    ++m_stats.nFiltered;
+                else
+                    RecordPushResult(client.queue.Push(notification, m_policy));
+            }
+            moved = true;
+        }
+    }
+    if (moved)
+        m_intakeNotFull.notify_all();
+
+    size_t clientIndex = 0;
+    while (clientIndex < m_clients.size()) {
+        if (FlushClient(m_clients[clientIndex].get()))
+            ++clientIndex;
+        else
+            RemoveClient(clientIndex);
+    }
+
+    // If sending made room in the queues, go round again for the rest of the
+    // notifications, since nothing else may wake us (the producer could be
+    // waiting for us, and the clients for the notifications).
+    if (blocked) {
+        bool anyFull = false;
+        for (size_t i = 0; i < m_clients.size() && !anyFull; ++i)
+            anyFull = m_clients[i]->queue.IsFull();
+        if (!anyFull)
+            m_signal.Set();
+    }
+}
+
+bool AssetEventService::ReadFromClient(Client* client)
+{
+    ASSERT(client);
+
+    // Reading stops once there's a whole message (or an error) to deal
+    // with, so a client can't make the buffer grow without limit.
+    u8 buffer[RECV_BUFFER_SIZE];
+    while (client->recvBuffer.size() < sizeof(u32) + MAX_CLIENT_MESSAGE_SIZE) {
+        size_t received;
+        StreamSocket::SocketResult result = client->socket.Recv(buffer, sizeof buffer, &received);
+        if (result == StreamSocket::FAILURE)
+            return false;
+        if (result == StreamSocket::WOULDBLOCK)
             break;
+        if (received == 0)
+            return false;
+        client->recvBuffer.insert(client->recvBuffer.end(), buffer, buffer + received);
     }
+
+    std::vector<u8>& recvBuffer = client->recvBuffer;
+    size_t offset = 0;
+    while (recvBuffer.size() - offset >= sizeof(u32)) {
+        u32 size = Read(&recvBuffer[offset]);
+        if (size < sizeof(u32) || size > MAX_CLIENT_MESSAGE_SIZE)
+            return false;
+        if (recvBuffer.size() - offset - sizeof(u32) < size)
+            break;
+        if (!HandleClientMessage(client, &recvBuffer[offset + sizeof(u32)], size))
+            return false;
+        offset += sizeof(u32) + size;
+    }
+    recvBuffer.erase(recvBuffer.begin(), recvBuffer.begin() + offset);
+    return true;
 }
 
-bool AssetEventService::SendQueuedMessages(TcpSocket& socket)
+// Returns false if the client should be disconnected.
+bool AssetEventService::HandleClientMessage(Client* client, const u8* message, u32 size)
 {
-    for (;;) {
-        Message message;
-        {
-            std::lock_guard<std::mutex> lock(m_messageQueueMutex);
-            if (m_messageQueue.empty())
-                break;
-            message = m_messageQueue.front();
-            m_messageQueue.pop();
-        }
+    ASSERT(client);
+    ASSERT(message);
+    ASSERT(size >= sizeof(u32));
 
-        u32 swappedSize = EndianSwapLE32(message.size);
-        if (!socket.Send(&swappedSize, sizeof swappedSize, NULL))
+    u32 type = Read(message);
+    if (type == MSG_HELLO) {
+        if (size < 2 * sizeof(u32))
+            return false;
+        // The reply goes after whatever is already in the send buffer, so
+        // the client gets batches only after it has seen it.
+        u32 requested = Read(message + sizeof(u32));
+        if ((requested & CAP_SHARED_RING) && !client->ring)
+            CreateRing(client);
+        u32 capabilities = GetCapabilities(*client);
+        client->capabilities = requested & capabilities;
+        AppendHelloMessage(&client->sendBuffer, capabilities);
+        if (client->ring && !client->ringAttached)
+            AppendSharedRingMessage(&client->sendBuffer, *client->ring);
+    } else if (type == MSG_SHARED_RING_ATTACHED) {
+        if (!client->ring)
             return false;
-        if (!socket.Send(message.bytes, message.size, NULL))
+        // Nobody else needs to open it, and now it can't be left behind if
+        // we crash.
+        client->ring->Unlink();
+        client->ringAttached = true;
+    } else if (type == MSG_SET_PAYLOAD_LIMIT) {
+        if (size < 2 * sizeof(u32))
             return false;
+        client->payloadLimit = std::min(Read(message + sizeof(u32)), MAX_PAYLOAD_BYTES);
+    } else if (type == MSG_RING_CONSUMED) {
+        // Nothing to do, as the ring is written to again whenever the event
+        // loop wakes up.
+    } else if (type == MSG_SUBSCRIBE || type == MSG_UNSUBSCRIBE) {
+        return HandleSubscribeMessage(client, type, message + sizeof(u32), size - sizeof(u32));
     }
+    // Other messages are ignored, so that newer clients can still talk to
+    // us.
+    return true;
+}
+
+bool AssetEventService::HandleSubscribeMessage(Client* client, u32 type, const u8* message,
+                                               u32 size)
+{
+    ASSERT(client);
+    ASSERT(message);
+
+    if (size < 2 * sizeof(u32))
+        return false;
+    u32 kind = Read(message);
+    u32 strLen = Read(message + sizeof(u32));
+    if (kind > FILTER_GLOB || strLen != size - 2 * sizeof(u32) - 1)
+        return false;
+    const char* pattern = (const char*)(message + 2 * sizeof(u32));
+    if (pattern[strLen] != '\0' || strlen(pattern) != strLen)
+        return false;
 
+    if (type == MSG_SUBSCRIBE) {
+        if (client->filter.NumPatterns() >= MAX_CLIENT_FILTER_PATTERNS)
+            return false;
+        client->filter.Add((AssetFilterKind)kind, pattern);
+        client->subscribed = true;
+    } else {
+        // N.B. A client that unsubscribes from everything is sent nothing,
+        // not everything.
+        client->filter.Remove((AssetFilterKind)kind, pattern);
+    }
     return true;
 }
+
+// What we can offer the client.
+u32 AssetEventService::GetCapabilities(const Client& client) const
+{
+    u32 capabilities = SERVICE_CAPABILITIES;
+    if (!client.ring)
+        capabilities &= ~CAP_SHARED_RING;
+    if (client.socket.GetFamily() != StreamSocket::LOCAL)
+        capabilities &= ~CAP_FILE_HANDLES;
+    return capabilities;
+}
+
+void AssetEventService::CreateRing(Client* client)
+{
+    ASSERT(client);
+    ASSERT(!client->ring);
+
+    char name[32];
+    snprintf(name, sizeof name, "/AssetEvents.%d.%u", (int)getpid(), m_nextRingId++);
+    std::unique_ptr<SharedNotificationRing> ring(new SharedNotificationRing);
+    // If shared memory isn't available, the client carries on with the
+    // socket.
+    if (ring->Create(name, SHARED_RING_BYTES))
+        client->ring = std::move(ring);
+}
+
+void AssetEventService::WriteToRing(Client* client)
+{
+    ASSERT(client);
+    ASSERT(client->ringAttached);
+
+    NotificationQueue& queue = client->queue;
+    bool wrote = false;
+    while (!queue.IsEmpty()) {
+        const Notification& notification = queue.Front();
+        u32 payloadBytes;
+        bool written;
+        if (ReadPayload(notification, client->payloadLimit, &m_payload, &payloadBytes))
+            written = client->ring->TryWrite(MSG_ASSET_DATA, notification.asset, &m_payload[0],
+                                             payloadBytes);
+        else
+            written = client->ring->TryWrite(MSG_ASSET_COMPILED, notification.asset);
+        if (!written)
+            break;
+        queue.Pop();
+        wrote = true;
+    }
+    if (wrote && client->ring->Publish())
+        AppendDoorbellMessage(&client->sendBuffer);
+}
+
+// Moves notifications from the client's queue into its send buffer, up to
+// about SEND_CHUNK_BYTES at a time.
+void AssetEventService::EncodeQueuedMessages(Client* client)
+{
+    ASSERT(client);
+
+    std::vector<u8>& buffer = client->sendBuffer;
+    NotificationQueue& queue = client->queue;
+    bool batches = (client->capabilities & CAP_BATCHES) != 0;
+
+    size_t batchStart = batches ? BeginBatch(&buffer) : 0;
+    std::unordered_set<std::string> batchAssets;
+    u32 count = 0;
+    u64 nCoalesced = 0;
+    bool fileHandles = (client->capabilities & CAP_FILE_HANDLES) != 0;
+    while (!queue.IsEmpty() && buffer.size() < SEND_CHUNK_BYTES &&
+           client->handles.size() < MAX_PENDING_HANDLES_PER_CLIENT) {
+        Notification notification = queue.Pop();
+        if (batches && !batchAssets.insert(notification.asset).second) {
+            ++nCoalesced;
+            continue;
+        }
+
+        u32 payloadBytes = 0;
+        int handle = -1;
+        u32 fileBytes = 0;
+        if (ReadPayload(notification, client->payloadLimit, &m_payload, &payloadBytes) ||
+            (fileHandles && (handle = OpenFileHandle(notification, &fileBytes)) != -1)) {
+            // The data or handle goes in a message of its own, between two
+            // batches.
+            if (batches)
+                EndBatch(&buffer, batchStart, count);
+            if (handle == -1) {
+                AppendAssetDataMessage(&buffer, notification.asset, &m_payload[0],
+                                       payloadBytes);
+            } else {
+                Client::PendingHandle pending = { buffer.size(), handle };
+                client->handles.push_back(pending);
+                AppendAssetFileMessage(&buffer, notification.asset, fileBytes);
+            }
+            if (batches) {
+                batchStart = BeginBatch(&buffer);
+                count = 0;
+            }
+        } else if (batches) {
+            u32 strLen = (u32)notification.asset.length();
+            Append(&buffer, strLen);
+            Append(&buffer, notification.asset.c_str(), strLen);
+            ++count;
+        } else {
+            AppendAssetCompiledMessage(&buffer, notification.asset);
+        }
+    }
+    if (batches)
+        EndBatch(&buffer, batchStart, count);
+
+    if (nCoalesced > 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.nCoalesced += nCoalesced;
+    }
+}
+
+bool AssetEventService::FlushClient(Client* client)
+{
+    ASSERT(client);
+
+    if (client->ringAttached)
+        WriteToRing(client);
+
+    std::vector<u8>& buffer = client->sendBuffer;
+    for (;;) {
+        if (client->sendOffset == buffer.size()) {
+            ASSERT(client->handles.empty());
+            buffer.clear();
+            client->sendOffset = 0;
+            // Statuses aren't queued, so a client that's behind skips
+            // straight to the latest one.
+            if ((client->capabilities & CAP_BUILD_STATUS) &&
+                client->buildStatusVersion != m_buildStatusVersion) {
+                AppendBytes(&buffer, &m_buildStatusMessage[0], (u32)m_buildStatusMessage.size());
+                client->buildStatusVersion = m_buildStatusVersion;
+            }
+            if (!client->queue.IsEmpty() && !client->ringAttached)
+                EncodeQueuedMessages(client);
+            // Everything may have been coalesced away.
+            if (buffer.empty()) {
+                if (buffer.capacity() > MAX_IDLE_SEND_BUFFER_BYTES)
+                    std::vector<u8>().swap(buffer);
+                return true;
+            }
+        }
+
+        // A handle has to go with the right byte, so sending stops just
+        // before each one, and the next send starts with it.
+        size_t end = buffer.size();
+        int handle = -1;
+        std::vector<Client::PendingHandle>& handles = client->handles;
+        if (!handles.empty()) {
+            if (handles[0].offset == client->sendOffset) {
+                handle = handles[0].handle;
+                if (handles.size() > 1)
+                    end = handles[1].offset;
+            } else {
+                end = handles[0].offset;
+            }
+        }
+
+        size_t sent;
+        bool connected;
+        if (handle == -1) {
+            connected = client->socket.Send(&buffer[client->sendOffset],
+                                            end - client->sendOffset, &sent);
+        } else {
+            connected = client->socket.SendWithHandle(&buffer[client->sendOffset],
+                                                      end - client->sendOffset, handle, &sent);
+            if (connected && sent > 0) {
+                close(handle);
+                handles.erase(handles.begin());
+            }
+        }
+        if (!connected)
+            return false;
+        client->sendOffset += sent;
+        // The socket can't take any more for now.
+        if (client->sendOffset < end)
+            return true;
+    }
+}
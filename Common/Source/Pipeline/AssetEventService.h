@@ -2,36 +2,182 @@
 #define PIPELINE_ASSETEVENTSERVICE_H
 
 #include <thread>
-#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <Core/Types.h>
+#include <Os/EventSignal.h>
+#include <Os/StreamSocket.h>
+#include "AssetFilter.h"
+#include "NotificationQueue.h"
+#include "SharedNotificationRing.h"
 
-class TcpSocket;
+struct AssetBuildStatusInfo;
 
+struct AssetEventServiceStats {
+    AssetEventServiceStats();
+
+    int nClients;
+    // Notifications waiting to be sent (once for each client they're for).
+    size_t nQueued;
+    // Memory held by the queues and the clients' send buffers.
+    size_t memoryBytes;
+    size_t peakMemoryBytes;
+    u64 nDropped;
+    u64 nCoalesced;
+    // Notifications that weren't sent to a client because of its filter.
+    u64 nFiltered;
+    // How many times NotifyAssetCompiled() has had to wait for the clients.
+    u64 nProducerWaits;
+};
+
+// Tells connected clients (e.g. running instances of the game, or the
+// editor) about assets as they're compiled. Any number of clients can be
+// connected at once, and each of them is sent every notification.
+//
+// Clients connect to a local (AF_UNIX) socket, at the path in the
+// ASSET_PIPELINE_SOCKET environment variable or GetDefaultLocalSocketPath(),
+// which is per-user. If another pipeline run by the same user already has
+// that path, the service listens at a path of its own instead, and logs it
+// (clients can be pointed at it with ASSET_PIPELINE_SOCKET). For older
+// clients, the service also listens on a TCP port on localhost, if another
+// process isn't already using it. If it can't listen at all, notifications
+// are queued (and dropped) as if no clients were connected.
+//
+// Each client has a bounded queue, as does the service itself (for
+// notifications that haven't been handed to the clients yet, or that are
+// waiting for a client to connect). The overflow policy says what happens
+// when a client falls behind; OVERFLOW_BLOCK only blocks while a client is
+// connected.
+//
+// A client that subscribes to prefixes, paths or globs is only sent the
+// notifications that match one of them; others are sent everything.
+//
+// Clients on the same machine can ask for notifications to be written to a
+// ring in shared memory instead of the socket, which is then only used to
+// wake them up.
+//
+// Clients can also ask for the contents of compiled assets up to a given
+// size to be sent along with the notifications, so they don't have to read
+// the files themselves.
+//
+// While a build is going, clients that ask for them are also sent its
+// status, which replaces any status they haven't been sent yet.
 class AssetEventService {
 public:
+    static const NotificationOverflowPolicy DEFAULT_OVERFLOW_POLICY = OVERFLOW_COALESCE;
+    static const size_t DEFAULT_QUEUE_CAPACITY = 4096;
+
     AssetEventService();
     ~AssetEventService();
 
-    void NotifyAssetCompiled(const char* asset);
+    // May be called from any thread. filePath is where the compiled asset
+    // can be read from, for clients that want its contents.
+    void NotifyAssetCompiled(const char* asset, const char* filePath = NULL);
+    // May be called from any thread.
+    void NotifyBuildStatus(const AssetBuildStatusInfo& info);
+
+    void SetQueueLimits(NotificationOverflowPolicy policy, size_t capacity);
+    AssetEventServiceStats GetStats() const;
+
+    // The path that clients connect to unless ASSET_PIPELINE_SOCKET is set:
+    // AssetPipeline-<uid>.sock, in $TMPDIR (or /tmp).
+    static std::string GetDefaultLocalSocketPath();
 
 private:
     AssetEventService(const AssetEventService&);
     AssetEventService& operator=(const AssetEventService&);
 
-    struct Message {
-        u32 size;
-        void* bytes;
+    // N.B. Clients are only used by the service's thread.
+    struct Client {
+        explicit Client(size_t queueCapacity);
+        ~Client();
+
+        // A handle that's passed along with the byte of sendBuffer at
+        // offset (and closed once it has been).
+        struct PendingHandle {
+            size_t offset;
+            int handle;
+        };
+
+        StreamSocket socket;
+        NotificationQueue queue;
+        // Messages that haven't been sent yet, starting at sendOffset.
+        std::vector<u8> sendBuffer;
+        size_t sendOffset;
+        // Bytes received that don't make up a whole message yet.
+        std::vector<u8> recvBuffer;
+        // What the client said it supports when it said hello.
+        u32 capabilities;
+        // Only used once the client has subscribed to something.
+        AssetFilter filter;
+        bool subscribed;
+        // Once the client has mapped the ring, notifications go there.
+        std::unique_ptr<SharedNotificationRing> ring;
+        bool ringAttached;
+        // Files up to this size are sent with their notifications.
+        u32 payloadLimit;
+        // In order of offset.
+        std::vector<PendingHandle> handles;
+        // The version of the last status the client was sent, or 0.
+        u32 buildStatusVersion;
     };
 
     void ThreadProc();
-    bool SendQueuedMessages(TcpSocket& socket);
+    void AcceptClients(StreamSocket& serverSocket);
+    u32 GetCapabilities(const Client& client) const;
+    void RemoveClient(size_t index);
+    void TakeBuildStatus();
+    void QueueMessagesForClients();
+    // These return false if the client has disconnected.
+    bool ReadFromClient(Client* client);
+    bool HandleClientMessage(Client* client, const u8* message, u32 size);
+    bool HandleSubscribeMessage(Client* client, u32 type, const u8* message, u32 size);
+    bool FlushClient(Client* client);
+    void EncodeQueuedMessages(Client* client);
+    void CreateRing(Client* client);
+    void WriteToRing(Client* client);
+
+    void UpdateClientStats();
+
+    // N.B. These must be called with m_mutex locked.
+    NotificationOverflowPolicy GetIntakePolicy() const;
+    void RecordPushResult(NotificationQueue::PushResult result);
+    void UpdateStats();
 
     std::thread m_thread;
-    std::mutex m_messageQueueMutex;
-    std::queue<Message> m_messageQueue;
     std::atomic<bool> m_shouldExit;
-    std::condition_variable m_condVar;
+    // Raised when there are new messages, or the thread should exit.
+    EventSignal m_signal;
+
+    // The following are protected by m_mutex.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_intakeNotFull;
+    NotificationQueue m_intake;
+    NotificationOverflowPolicy m_policy;
+    size_t m_queueCapacity;
+    int m_nClients;
+    // The totals for the clients' queues, as of the last time the thread
+    // looked at them.
+    size_t m_nQueuedForClients;
+    size_t m_clientMemoryBytes;
+    AssetEventServiceStats m_stats;
+    // The encoded message for the latest status, and how many there have
+    // been.
+    std::vector<u8> m_latestBuildStatus;
+    u32 m_latestBuildStatusVersion;
+
+    std::vector<std::unique_ptr<Client>> m_clients;
+    u32 m_nextRingId;
+    // The thread's copy of the latest status.
+    std::vector<u8> m_buildStatusMessage;
+    u32 m_buildStatusVersion;
+    // The contents of the file that's being sent with a notification.
+    std::vector<u8> m_payload;
 };
 
 #endif // PIPELINE_ASSETEVENTSERVICE_H
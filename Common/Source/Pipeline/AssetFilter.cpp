@@ -0,0 +1,209 @@
+#include "AssetFilter.h"
+
+#include <string.h>
+#include <Core/Macros.h>
+#include "Glob.h"
+
+const u32 AssetFilter::INVALID_NODE;
+
+static size_t GlobLiteralPrefixLength(const char* pattern)
+{
+    // N.B. A '[' that doesn't start a well-formed set is matched literally,
+    // but stopping at it anyway only means the glob is tried more often.
+    return strcspn(pattern, "*?[");
+}
+
+AssetFilter::Node::Node()
+    : children()
+    , prefixEnd(false)
+    , exactEnd(false)
+    , globs()
+{}
+
+bool AssetFilter::Node::IsUnused() const
+{
+    return children.empty() && !prefixEnd && !exactEnd && globs.empty();
+}
+
+AssetFilter::AssetFilter()
+    : m_nodes(1)
+    , m_freeNodes()
+    , m_globs()
+    , m_freeGlobs()
+    , m_numPatterns(0)
+{}
+
+u32 AssetFilter::FindNode(const char* str, size_t length, bool create)
+{
+    u32 node = 0;
+    for (size_t i = 0; i < length; ++i) {
+        u32 child = INVALID_NODE;
+        const std::vector<Edge>& children = m_nodes[node].children;
+        for (size_t j = 0; j < children.size(); ++j) {
+            if (children[j].c == str[i]) {
+                child = children[j].node;
+                break;
+            }
+        }
+
+        if (child == INVALID_NODE) {
+            if (!create)
+                return INVALID_NODE;
+            if (m_freeNodes.empty()) {
+                child = (u32)m_nodes.size();
+                // N.B. This may move the nodes, so children can't be used
+                // afterwards.
+                m_nodes.push_back(Node());
+            } else {
+                child = m_freeNodes.back();
+                m_freeNodes.pop_back();
+            }
+            Edge edge = { str[i], child };
+            m_nodes[node].children.push_back(edge);
+        }
+        node = child;
+    }
+    return node;
+}
+
+void AssetFilter::PruneNodes(const char* str, size_t length)
+{
+    std::vector<u32> path;
+    path.reserve(length + 1);
+    path.push_back(0);
+    for (size_t i = 0; i < length; ++i) {
+        const std::vector<Edge>& children = m_nodes[path.back()].children;
+        for (size_t j = 0; j < children.size(); ++j) {
+            if (children[j].c == str[i]) {
+                path.push_back(children[j].node);
+                break;
+            }
+        }
+        ASSERT(path.size() == i + 2);
+    }
+
+    // N.B. The root is never freed.
+    for (size_t i = length; i > 0 && m_nodes[path[i]].IsUnused(); --i) {
+        std::vector<Edge>& siblings = m_nodes[path[i - 1]].children;
+        for (size_t j = 0; j < siblings.size(); ++j) {
+            if (siblings[j].node == path[i]) {
+                siblings.erase(siblings.begin() + j);
+                break;
+            }
+        }
+        // Release the node's memory, as it may not be reused for a while.
+        m_nodes[path[i]] = Node();
+        m_freeNodes.push_back(path[i]);
+    }
+}
+
+bool AssetFilter::Add(AssetFilterKind kind, const char* pattern)
+{
+    ASSERT(pattern);
+
+    if (kind == FILTER_GLOB) {
+        Node& node = m_nodes[FindNode(pattern, GlobLiteralPrefixLength(pattern), true)];
+        for (size_t i = 0; i < node.globs.size(); ++i) {
+            if (m_globs[node.globs[i]] == pattern)
+                return false;
+        }
+
+        u32 glob;
+        if (m_freeGlobs.empty()) {
+            glob = (u32)m_globs.size();
+            m_globs.push_back(pattern);
+        } else {
+            glob = m_freeGlobs.back();
+            m_freeGlobs.pop_back();
+            m_globs[glob] = pattern;
+        }
+        node.globs.push_back(glob);
+    } else {
+        Node& node = m_nodes[FindNode(pattern, strlen(pattern), true)];
+        bool& end = kind == FILTER_PREFIX ? node.prefixEnd : node.exactEnd;
+        if (end)
+            return false;
+        end = true;
+    }
+
+    ++m_numPatterns;
+    return true;
+}
+
+bool AssetFilter::Remove(AssetFilterKind kind, const char* pattern)
+{
+    ASSERT(pattern);
+
+    size_t length = kind == FILTER_GLOB ? GlobLiteralPrefixLength(pattern) : strlen(pattern);
+    u32 nodeIndex = FindNode(pattern, length, false);
+    if (nodeIndex == INVALID_NODE)
+        return false;
+    Node& node = m_nodes[nodeIndex];
+
+    if (kind == FILTER_GLOB) {
+        std::vector<u32>::iterator it = node.globs.begin();
+        while (it != node.globs.end() && m_globs[*it] != pattern)
+            ++it;
+        if (it == node.globs.end())
+            return false;
+        std::string().swap(m_globs[*it]);
+        m_freeGlobs.push_back(*it);
+        node.globs.erase(it);
+    } else {
+        bool& end = kind == FILTER_PREFIX ? node.prefixEnd : node.exactEnd;
+        if (!end)
+            return false;
+        end = false;
+    }
+
+    if (node.IsUnused())
+        PruneNodes(pattern, length);
+
+    --m_numPatterns;
+    return true;
+}
+
+void AssetFilter::Clear()
+{
+    m_nodes.clear();
+    m_nodes.push_back(Node());
+    m_freeNodes.clear();
+    m_globs.clear();
+    m_freeGlobs.clear();
+    m_numPatterns = 0;
+}
+
+size_t AssetFilter::NumPatterns() const
+{
+    return m_numPatterns;
+}
+
+bool AssetFilter::Matches(const char* path) const
+{
+    ASSERT(path);
+
+    u32 nodeIndex = 0;
+    const char* p = path;
+    for (;;) {
+        const Node& node = m_nodes[nodeIndex];
+        if (node.prefixEnd)
+            return true;
+        for (size_t i = 0; i < node.globs.size(); ++i) {
+            if (GlobMatch(m_globs[node.globs[i]].c_str(), path))
+                return true;
+        }
+        if (*p == '\0')
+            return node.exactEnd;
+
+        nodeIndex = INVALID_NODE;
+        for (size_t i = 0; i < node.children.size(); ++i) {
+            if (node.children[i].c == *p) {
+                nodeIndex = node.children[i].node;
+                break;
+            }
+        }
+        if (nodeIndex == INVALID_NODE)
+            return false;
+        ++p;
+    }
+}
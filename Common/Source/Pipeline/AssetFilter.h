@@ -0,0 +1,79 @@
+#ifndef PIPELINE_ASSETFILTER_H
+#define PIPELINE_ASSETFILTER_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <Core/Types.h>
+
+enum AssetFilterKind {
+    // Matches paths that start with the pattern (e.g. a directory, with a
+    // trailing '/').
+    FILTER_PREFIX,
+    // Matches just the one path.
+    FILTER_EXACT,
+    // Matches paths that GlobMatch() the pattern.
+    FILTER_GLOB,
+};
+
+// A set of patterns that asset paths are tested against. A path matches if
+// any of the patterns match it, so an empty filter matches nothing.
+//
+// The patterns are kept in a trie, so testing a path only walks it once,
+// however many prefixes and paths have been added. Globs are hung off the
+// trie by their literal prefix (the part before the first wildcard), so only
+// the globs that could match are tried.
+class AssetFilter {
+public:
+    AssetFilter();
+
+    // These return false if the pattern was already in (or wasn't in) the
+    // filter.
+    bool Add(AssetFilterKind kind, const char* pattern);
+    bool Remove(AssetFilterKind kind, const char* pattern);
+    void Clear();
+
+    size_t NumPatterns() const;
+    bool Matches(const char* path) const;
+
+private:
+    AssetFilter(const AssetFilter&);
+    AssetFilter& operator=(const AssetFilter&);
+
+    struct Edge {
+        char c;
+        u32 node;
+    };
+
+    struct Node {
+        Node();
+
+        std::vector<Edge> children;
+        bool prefixEnd;
+        bool exactEnd;
+        // Indices into m_globs.
+        std::vector<u32> globs;
+
+        bool IsUnused() const;
+    };
+
+    // Returns the node for the string (adding nodes if create is true), or
+    // INVALID_NODE.
+    u32 FindNode(const char* str, size_t length, bool create);
+    // Frees the nodes at the end of the string's path that no longer lead to
+    // any patterns.
+    void PruneNodes(const char* str, size_t length);
+
+    static const u32 INVALID_NODE = 0xFFFFFFFF;
+
+    // m_nodes[0] is the root, for the empty string.
+    std::vector<Node> m_nodes;
+    // Slots in m_nodes left by pruned nodes, which are reused.
+    std::vector<u32> m_freeNodes;
+    std::vector<std::string> m_globs;
+    // Slots in m_globs left by removed globs, which are reused.
+    std::vector<u32> m_freeGlobs;
+    size_t m_numPatterns;
+};
+
+#endif // PIPELINE_ASSETFILTER_H
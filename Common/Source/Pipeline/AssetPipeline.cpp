@@ -2,8 +2,16 @@
 
 #include <string>
 #include <memory>
+#include <new>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <limits.h>
+#include <string.h>
 #include <lua.hpp>
+extern "C" {
+#include <lstate.h>
+}
 
 #include <Core/Macros.h>
 #include <Os/FileSystemWatcher.h>
@@ -12,37 +20,75 @@
 #include "Process.h"
 #include "StrUtils.h"
 #include "ProjectDBConn.h"
+#include "DependencySnapshot.h"
+#include "BinaryManifest.h"
+#include "Glob.h"
+#include "StaleOutputCollector.h"
+#include "JobScheduler.h"
+#include "BuildStatusTracker.h"
+#include "AssetCostHistory.h"
 
 const char* const BUILD_SCRIPT_RELATIVE_PATH = "assetpipeline.lua";
 
+// Stale outputs are removed in small batches while the pipeline is idle, so
+// that removing lots of them doesn't hold up compiles (or swamp the disk).
+static const size_t STALE_OUTPUTS_BATCH_SIZE = 32;
+static const int STALE_OUTPUTS_INTERVAL_MS = 50;
+// After files have been recompiled, the dependency snapshot is brought up to
+// date once the pipeline has been idle for this long, so that a burst of
+// changes only updates it once.
+static const int DEPENDENCY_SNAPSHOT_DELAY_MS = 500;
+// Changes to the dependencies are applied to the loaded snapshot in memory,
+// until the outputs they've changed reach this number (or an eighth of the
+// paths in the snapshot, if that's more), when a new snapshot is written.
+static const size_t MIN_DEPENDENCY_SNAPSHOT_CHANGES = 256;
+
 static const char* const BUILD_SYSTEM_SCRIPTS[] = {
     "list.lua",
     "buildsystem.lua",
 };
 
 AssetPipeline::AssetPipeline()
-    : m_thread(&AssetPipeline::CompileProc, this)
+    : m_thread()
     , m_compileQueue()
     , m_mutex()
-    , m_compileInProgress(false)
     , m_condVar()
+    , m_shouldExit(false)
+
+    , m_compiling(false)
+    , m_currentItem()
+    , m_cancelRequested(false)
+    , m_currentSuperseded(false)
+    , m_watchedProjectID(-1)
+
+    , m_processTracker()
 
     , m_delegate(NULL)
 
-    , m_messageQueue()
-    , m_messageQueueMutex()
+    , m_eventQueue()
+    , m_progress()
+    , m_status()
 
     , m_assetEventService()
-{}
+
+    , m_globCache()
+{
+    m_status.projectID = -1;
+
+    // N.B. The thread must be started only once all the other members have
+    // been initialized.
+    m_thread = std::thread(&AssetPipeline::CompileProc, this);
+}
 
 AssetPipeline::~AssetPipeline()
 {
-    // Set up special conditions that let the thread know it's time to exit.
+    // Let the thread know it's time to exit, and stop whatever it's doing.
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        while (!m_compileQueue.empty())
-            m_compileQueue.pop();
-        m_compileInProgress = true;
+        m_compileQueue.clear();
+        m_shouldExit = true;
+        if (m_compiling)
+            CancelCurrentItem(false);
     }
     m_condVar.notify_all();
 
@@ -58,35 +104,199 @@ void AssetPipeline::CompileProject(int projectID)
     PushCompileQueueItem(item);
 }
 
+void AssetPipeline::CancelBuild()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_compileQueue.clear();
+    if (m_compiling)
+        CancelCurrentItem(false);
+}
+
+void AssetPipeline::CancelProject(int projectID)
+{
+    ASSERT(projectID >= 0);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::deque<CompileQueueItem>::iterator it = m_compileQueue.begin();
+    while (it != m_compileQueue.end()) {
+        if (it->projectID == projectID)
+            it = m_compileQueue.erase(it);
+        else
+            ++it;
+    }
+    if (m_compiling && m_currentItem.projectID == projectID)
+        CancelCurrentItem(false);
+}
+
+// N.B. m_mutex must be locked by the caller.
+void AssetPipeline::CancelCurrentItem(bool superseded)
+{
+    ASSERT(m_compiling);
+    if (!m_cancelRequested)
+        m_currentSuperseded = superseded;
+    m_cancelRequested = true;
+    m_processTracker.CancelAll();
+}
+
+static void AddErrorChange(AssetBuildProgressInfo* progress, int errorID, bool added)
+{
+    // N.B. An error that's recorded and then removed in the same batch is
+    // only reported as removed.
+    std::vector<AssetErrorChange>& changes = progress->errorChanges;
+    for (size_t i = 0; i < changes.size(); ++i) {
+        if (changes[i].errorID == errorID) {
+            changes[i].added = added;
+            return;
+        }
+    }
+    AssetErrorChange change = { errorID, added };
+    changes.push_back(change);
+}
+
 void AssetPipeline::CallDelegateFunctions()
 {
+    // The signal is cleared even without a delegate, or it would keep
+    // firing.
+    m_eventQueue.GetSignal().Clear();
     if (!m_delegate)
         return;
-    MsgFunc func;
-    for (;;) {
-        {
-            std::lock_guard<std::mutex> lock(m_messageQueueMutex);
-            if (m_messageQueue.empty())
+
+    // N.B. m_progress is only a member so that its vector's storage is reused.
+    AssetBuildProgressInfo& progress = m_progress;
+    progress.projectID = -1;
+    progress.nSucceeded = 0;
+    progress.nFailed = 0;
+    progress.errorChanges.clear();
+
+    while (AssetPipelineEvent* event = m_eventQueue.Pop()) {
+        switch (event->type) {
+            case AssetPipelineEvent::BUILD_FINISHED:
+                FlushProgress(&progress);
+                FlushStatus();
+                m_delegate->OnAssetBuildFinished(event->buildInfo);
+                break;
+            case AssetPipelineEvent::RECOMPILE_FINISHED:
+                FlushProgress(&progress);
+                FlushStatus();
+                m_delegate->OnAssetRecompileFinished(event->recompileInfo);
+                break;
+            case AssetPipelineEvent::BUILD_STATUS:
+                // Only the latest status matters. (Swapping gives the event
+                // the old status's storage to reuse.)
+                std::swap(m_status, event->statusInfo);
+                break;
+            case AssetPipelineEvent::COMPILE_SUCCEEDED:
+            case AssetPipelineEvent::FAILED_TO_COMPILE:
+            case AssetPipelineEvent::ERROR_CLEARED:
+                if (event->projectID != progress.projectID)
+                    FlushProgress(&progress);
+                progress.projectID = event->projectID;
+                if (event->type == AssetPipelineEvent::COMPILE_SUCCEEDED) {
+                    ++progress.nSucceeded;
+                } else {
+                    AddErrorChange(&progress, event->errorID,
+                                   event->type == AssetPipelineEvent::FAILED_TO_COMPILE);
+                }
+                if (event->type == AssetPipelineEvent::FAILED_TO_COMPILE) {
+                    ++progress.nFailed;
+                    m_delegate->OnAssetFailedToCompile(event->failureInfo);
+                }
                 break;
-            func = m_messageQueue.front();
-            m_messageQueue.pop();
         }
-        func(m_delegate);
+        m_eventQueue.Free(event);
     }
+    FlushProgress(&progress);
+    FlushStatus();
+}
+
+void AssetPipeline::FlushProgress(AssetBuildProgressInfo* progress)
+{
+    ASSERT(progress);
+    if (progress->projectID < 0)
+        return;
+    m_delegate->OnAssetBuildProgress(*progress);
+    progress->projectID = -1;
+    progress->nSucceeded = 0;
+    progress->nFailed = 0;
+    progress->errorChanges.clear();
+}
+
+void AssetPipeline::FlushStatus()
+{
+    if (m_status.projectID < 0)
+        return;
+    m_delegate->OnAssetBuildStatus(m_status);
+    m_status.projectID = -1;
+}
+
+EventSignal::OsHandle AssetPipeline::GetDelegateEventHandle() const
+{
+    return m_eventQueue.GetSignal().GetOsHandle();
+}
+
+bool AssetPipeline::WaitForDelegateEvents(int timeoutMs)
+{
+    return m_eventQueue.GetSignal().Wait(timeoutMs);
 }
 
-void AssetPipeline::PushMessage(const MsgFunc& message)
+AssetEventServiceStats AssetPipeline::GetAssetEventServiceStats() const
 {
-    std::lock_guard<std::mutex> lock(m_messageQueueMutex);
-    m_messageQueue.push(message);
+    return m_assetEventService.GetStats();
+}
+
+AssetPipelineEvent* AssetPipeline::AllocEvent(AssetPipelineEvent::Type type)
+{
+    return m_eventQueue.Alloc(type);
+}
+
+void AssetPipeline::PushEvent(AssetPipelineEvent* event)
+{
+    m_eventQueue.Push(event);
 }
 
 void AssetPipeline::PushCompileQueueItem(const CompileQueueItem& item)
 {
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_compileQueue.push(item);
-        m_compileInProgress = true;
+
+        // Drop queued work that the new item makes redundant. A queued
+        // recompile of the same file will pick up the latest changes anyway,
+        // and a project build rechecks every file in the project.
+        std::deque<CompileQueueItem>::iterator it = m_compileQueue.begin();
+        for (; it != m_compileQueue.end(); ++it) {
+            if (it->projectID != item.projectID)
+                continue;
+            if (!item.IsSingleFile() && !it->IsSingleFile())
+                return;
+            // The latest event for a file says what needs doing, but a
+            // rename also has to be applied to the dependencies, so it
+            // can't be merged away.
+            if (item.IsSingleFile() &&
+                it->modifiedFilePath == item.modifiedFilePath &&
+                it->event != FileSystemWatcher::FILE_RENAMED &&
+                item.event != FileSystemWatcher::FILE_RENAMED) {
+                it->event = item.event;
+                return;
+            }
+        }
+        if (!item.IsSingleFile()) {
+            it = m_compileQueue.begin();
+            while (it != m_compileQueue.end()) {
+                if (it->projectID == item.projectID && it->IsSingleFile())
+                    it = m_compileQueue.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        // If the same file is being recompiled right now, that work is stale:
+        // restart it.
+        if (m_compiling && item.IsSingleFile() &&
+            m_currentItem.projectID == item.projectID &&
+            m_currentItem.modifiedFilePath == item.modifiedFilePath)
+            CancelCurrentItem(true);
+
+        m_compileQueue.push_back(item);
     }
     m_condVar.notify_all();
 }
@@ -97,11 +307,21 @@ void AssetPipeline::PushCompileQueueItem(const CompileQueueItem& item)
 static const char KEY_RULES = 0;
 static const char KEY_CONTENTDIR = 0;
 static const char KEY_DATADIR = 0;
+static const char KEY_PROJECTDIR = 0;
 static const char KEY_MANIFEST = 0;
+static const char KEY_MANIFESTGLOBS = 0;
+static const char KEY_STALEOUTPUTS = 0;
 static const char KEY_THIS = 0;
 static const char KEY_ASSETEVENTSERVICE = 0;
 static const char KEY_PROJECTDBCONN = 0;
 static const char KEY_PROJECTID = 0;
+static const char KEY_PROCESSTRACKER = 0;
+static const char KEY_GLOBCACHE = 0;
+static const char KEY_OUTPUTCOLLECTOR = 0;
+static const char KEY_JOBSCHEDULER = 0;
+static const char KEY_MAXJOBS = 0;
+static const char KEY_STATUSTRACKER = 0;
+static const char KEY_COSTHISTORY = 0;
 
 namespace {
     template<class T>
@@ -158,6 +378,63 @@ namespace {
     }
 }
 
+static std::string JoinPaths(const std::string& a, const std::string& b)
+{
+    std::string ret;
+    ret.reserve(a.length() + b.length() + 1);
+    ret.append(a);
+    if (a.back() != '/' && a.back() != '\\')
+        ret.push_back('/');
+    ret.append(b);
+    return ret;
+}
+
+// Reads a rule's Resources table, e.g.
+//     { CPU = 4, MemoryMB = 16384, Pool = "lightmaps" }
+// (where every field is optional), raising an error if it isn't valid.
+// N.B. index must be positive.
+static void GetJobResources(lua_State* L, int index, JobResources* resources)
+{
+    ASSERT(index > 0);
+    ASSERT(resources);
+
+    *resources = JobResources();
+    if (lua_isnoneornil(L, index))
+        return;
+    if (!lua_istable(L, index))
+        luaL_error(L, "Resources must be a table, e.g. "
+                      "{ CPU = 4, MemoryMB = 16384, Pool = \"name\" }");
+
+    lua_getfield(L, index, "CPU");
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isnumber(L, -1) || lua_tointeger(L, -1) < 1)
+            luaL_error(L, "Resources.CPU must be a positive number");
+        resources->cpuSlots = (int)lua_tointeger(L, -1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, index, "MemoryMB");
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 0)
+            luaL_error(L, "Resources.MemoryMB must be a non-negative number");
+        resources->memoryMB = (u64)lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, index, "Pool");
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isstring(L, -1))
+            luaL_error(L, "Resources.Pool must be a string");
+        resources->pool = lua_tostring(L, -1);
+        JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+        if (!scheduler->HasPool(resources->pool))
+            luaL_error(L, "Unknown pool '%s' (pools must be declared with "
+                          "Pool(name, depth) before they are used)",
+                       resources->pool.c_str());
+    }
+    lua_pop(L, 1);
+}
+
 static int lua_Rule(lua_State* L)
 {
     if (lua_gettop(L) != 2 ||
@@ -166,6 +443,30 @@ static int lua_Rule(lua_State* L)
         return luaL_error(L, "Usage: Rule(name or { names }, "
                              "{ Parse = func, Execute = func })");
 
+    // The resources are checked now, so that mistakes show up when the
+    // script is loaded rather than part-way through a build.
+    JobResources resources;
+    lua_getfield(L, 2, "Resources");
+    GetJobResources(L, lua_gettop(L), &resources);
+    lua_pop(L, 1);
+
+    // Rules are told apart by name in the build status (and in the durations
+    // that are kept for it), so a rule without one is named after its
+    // (first) pattern.
+    lua_getfield(L, 2, "Name");
+    if (lua_isnil(L, -1)) {
+        if (lua_istable(L, 1))
+            lua_rawgeti(L, 1, 1);
+        else
+            lua_pushvalue(L, 1);
+        if (!lua_isstring(L, -1))
+            return luaL_error(L, "Rule patterns must be strings");
+        lua_setfield(L, 2, "Name");
+    } else if (!lua_isstring(L, -1)) {
+        return luaL_error(L, "Rule name must be a string");
+    }
+    lua_pop(L, 1);
+
     lua_pushlightuserdata(L, (void*)&KEY_RULES);
     lua_gettable(L, LUA_REGISTRYINDEX);
 
@@ -200,18 +501,107 @@ static int lua_DataDir(lua_State* L)
     return 0;
 }
 
+// Either sets the path of the text manifest, or adds a rule that lists the
+// files matching a glob pattern. If the rule has an Output function, that's
+// called with each matching path, and returns the path to build (or nil).
 static int lua_Manifest(lua_State* L)
 {
+    if (lua_gettop(L) != 1 || (!lua_isstring(L, 1) && !lua_istable(L, 1)))
+        return luaL_error(L, "Usage: Manifest(path) or "
+                             "Manifest({ Glob = pattern, Output = func })");
+
+    if (lua_isstring(L, 1)) {
+        lua_pushlightuserdata(L, (void*)&KEY_MANIFEST);
+        lua_pushvalue(L, 1);
+        lua_settable(L, LUA_REGISTRYINDEX);
+        return 0;
+    }
+
+    lua_getfield(L, 1, "Glob");
+    lua_getfield(L, 1, "Output");
+    if (!lua_isstring(L, -2) || (!lua_isnil(L, -1) && !lua_isfunction(L, -1)))
+        return luaL_error(L, "Usage: Manifest({ Glob = pattern, Output = func })");
+    lua_pop(L, 2);
+
+    lua_pushlightuserdata(L, (void*)&KEY_MANIFESTGLOBS);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, (int)lua_objlen(L, -2) + 1);
+
+    return 0;
+}
+
+static int lua_Pool(lua_State* L)
+{
+    if (lua_gettop(L) != 2 || !lua_isstring(L, 1) || !lua_isnumber(L, 2) ||
+        lua_tointeger(L, 2) < 1)
+        return luaL_error(L, "Usage: Pool(\"name\", maxConcurrentJobs)");
+
+    JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+    scheduler->SetPoolDepth(lua_tostring(L, 1), (int)lua_tointeger(L, 2));
+    return 0;
+}
+
+static int lua_MaxJobs(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isnumber(L, 1) || lua_tointeger(L, 1) < 1)
+        return luaL_error(L, "Usage: MaxJobs(n)");
+
+    SetInRegistry(L, &KEY_MAXJOBS, (int)lua_tointeger(L, 1));
+    return 0;
+}
+
+// Sets what happens to outputs that the project no longer produces: "keep"
+// (the default), "report", or "remove".
+static int lua_StaleOutputs(lua_State* L)
+{
+    static const char* const MODES[] = { "keep", "report", "remove", NULL };
+
     if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
-        return luaL_error(L, "Usage: Manifest(path)");
+        return luaL_error(L, "Usage: StaleOutputs(\"keep\" or \"report\" or \"remove\")");
+    luaL_checkoption(L, 1, NULL, MODES);
 
-    lua_pushlightuserdata(L, (void*)&KEY_MANIFEST);
+    lua_pushlightuserdata(L, (void*)&KEY_STALEOUTPUTS);
     lua_pushvalue(L, 1);
     lua_settable(L, LUA_REGISTRYINDEX);
 
     return 0;
 }
 
+static int lua_NotificationOverflow(lua_State* L)
+{
+    static const char* const POLICY_NAMES[] = { "drop", "coalesce", "block", NULL };
+    static const NotificationOverflowPolicy POLICIES[] = {
+        OVERFLOW_DROP_OLDEST, OVERFLOW_COALESCE, OVERFLOW_BLOCK
+    };
+
+    int nArgs = lua_gettop(L);
+    if (nArgs < 1 || nArgs > 2 || !lua_isstring(L, 1) ||
+        (nArgs == 2 && (!lua_isnumber(L, 2) || lua_tointeger(L, 2) < 1)))
+        return luaL_error(L, "Usage: NotificationOverflow(\"drop\" or \"coalesce\" "
+                             "or \"block\", [queueCapacity])");
+
+    int policy = luaL_checkoption(L, 1, NULL, POLICY_NAMES);
+    size_t capacity = AssetEventService::DEFAULT_QUEUE_CAPACITY;
+    if (nArgs == 2)
+        capacity = (size_t)lua_tointeger(L, 2);
+
+    AssetEventService* service = GetFromRegistry<AssetEventService*>(L, &KEY_ASSETEVENTSERVICE);
+    service->SetQueueLimits(POLICIES[policy], capacity);
+    return 0;
+}
+
+static int lua_GetManifestGlobs(lua_State* L)
+{
+    if (lua_gettop(L) != 0)
+        return luaL_error(L, "Usage: GetManifestGlobs()");
+
+    lua_pushlightuserdata(L, (void*)&KEY_MANIFESTGLOBS);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+
+    return 1;
+}
+
 static int lua_GetManifestPath(lua_State* L)
 {
     if (lua_gettop(L) != 0)
@@ -223,6 +613,129 @@ static int lua_GetManifestPath(lua_State* L)
     return 1;
 }
 
+static const char* const BINARY_MANIFEST_METATABLE = "AssetPipeline.BinaryManifest";
+
+static int BinaryManifest_gc(lua_State* L)
+{
+    BinaryManifest* manifest = (BinaryManifest*)lua_touserdata(L, 1);
+    manifest->~BinaryManifest();
+    return 0;
+}
+
+// Upvalues: the BinaryManifest userdata, and the index of the next entry.
+static int ManifestIteratorNext(lua_State* L)
+{
+    BinaryManifest* manifest = (BinaryManifest*)lua_touserdata(L, lua_upvalueindex(1));
+    u32 index = (u32)lua_tointeger(L, lua_upvalueindex(2));
+    if (index >= manifest->NumEntries())
+        return 0;
+
+    lua_pushinteger(L, (lua_Integer)index + 1);
+    lua_replace(L, lua_upvalueindex(2));
+
+    lua_pushlstring(L, manifest->GetEntry(index), manifest->GetEntryLength(index));
+    return 1;
+}
+
+// Returns an iterator over the entries in the manifest, which are read from
+// a binary manifest (compiling it first if necessary), followed by the number
+// of entries. Returns nil if the binary manifest can't be loaded.
+static int lua_ManifestIterator(lua_State* L)
+{
+    if (lua_gettop(L) != 0)
+        return luaL_error(L, "Usage: ManifestIterator()");
+
+    lua_pushlightuserdata(L, (void*)&KEY_MANIFEST);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    if (!lua_isstring(L, -1))
+        return luaL_error(L, "No manifest has been specified");
+    const char* textPath = lua_tostring(L, -1);
+
+    int projID = GetFromRegistry<int>(L, &KEY_PROJECTID);
+    std::string binaryPath = AssetPipelineOsFuncs::GetPathToBinaryManifest(projID);
+
+    // The manifest is owned by a userdata, so that it's unmapped once the
+    // iterator has been garbage collected.
+    void* memory = lua_newuserdata(L, sizeof(BinaryManifest));
+    BinaryManifest* manifest = new (memory) BinaryManifest;
+    if (luaL_newmetatable(L, BINARY_MANIFEST_METATABLE)) {
+        lua_pushcfunction(L, BinaryManifest_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    if (!manifest->LoadOrCompile(textPath, binaryPath.c_str())) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, ManifestIteratorNext, 2);
+    lua_pushinteger(L, (lua_Integer)manifest->NumEntries());
+    return 2;
+}
+
+typedef std::vector<std::string> PathList;
+
+static const char* const PATH_LIST_METATABLE = "AssetPipeline.PathList";
+
+static int PathList_gc(lua_State* L)
+{
+    PathList* paths = (PathList*)lua_touserdata(L, 1);
+    paths->~PathList();
+    return 0;
+}
+
+// Upvalues: the PathList userdata, and the index of the next path.
+static int PathListIteratorNext(lua_State* L)
+{
+    PathList* paths = (PathList*)lua_touserdata(L, lua_upvalueindex(1));
+    size_t index = (size_t)lua_tointeger(L, lua_upvalueindex(2));
+    if (index >= paths->size())
+        return 0;
+
+    lua_pushinteger(L, (lua_Integer)index + 1);
+    lua_replace(L, lua_upvalueindex(2));
+
+    const std::string& path = (*paths)[index];
+    lua_pushlstring(L, path.c_str(), path.length());
+    return 1;
+}
+
+static int lua_MatchGlob(lua_State* L)
+{
+    if (lua_gettop(L) != 2 || !lua_isstring(L, 1) || !lua_isstring(L, 2))
+        return luaL_error(L, "Usage: MatchGlob(pattern, path)");
+
+    lua_pushboolean(L, GlobMatch(lua_tostring(L, 1), lua_tostring(L, 2)));
+    return 1;
+}
+
+// Returns an iterator over the files matching a glob pattern, in sorted order,
+// followed by the number of files.
+static int lua_ExpandGlob(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+        return luaL_error(L, "Usage: ExpandGlob(pattern)");
+
+    GlobCache* globCache = GetFromRegistry<GlobCache*>(L, &KEY_GLOBCACHE);
+
+    void* memory = lua_newuserdata(L, sizeof(PathList));
+    PathList* paths = new (memory) PathList;
+    if (luaL_newmetatable(L, PATH_LIST_METATABLE)) {
+        lua_pushcfunction(L, PathList_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    globCache->Expand(lua_tostring(L, 1), paths);
+
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, PathListIteratorNext, 2);
+    lua_pushinteger(L, (lua_Integer)paths->size());
+    return 2;
+}
+
 static void StringTableToVector(lua_State* L, int tableIndex,
                                 std::vector<std::string>* vec)
 {
@@ -240,6 +753,34 @@ static void StringTableToVector(lua_State* L, int tableIndex,
     }
 }
 
+// Unlike StringTableToVector(), this doesn't copy the strings. They're left
+// on the Lua stack, which keeps them alive until the calling C function
+// returns.
+static void StringTableToPointers(lua_State* L, int tableIndex,
+                                  std::vector<const char*>* vec)
+{
+    ASSERT(vec);
+    // this method doesn't support negative stack indices
+    ASSERT(tableIndex >= 0);
+    int size = luaL_getn(L, tableIndex);
+    for (int i = 1; i <= size; ++i) {
+        luaL_checkstack(L, 1, "Too many strings in table");
+        lua_pushinteger(L, i);
+        lua_gettable(L, tableIndex);
+        if (!lua_isstring(L, -1))
+            luaL_error(L, "Expected string, got %s", luaL_typename(L, -1));
+        vec->push_back(lua_tostring(L, -1));
+    }
+}
+
+static void PushErrorClearedEvent(AssetPipeline* pipeline, int projID, int errorID)
+{
+    AssetPipelineEvent* event = pipeline->AllocEvent(AssetPipelineEvent::ERROR_CLEARED);
+    event->projectID = projID;
+    event->errorID = errorID;
+    pipeline->PushEvent(event);
+}
+
 static int lua_RecordCompileError(lua_State* L)
 {
     if (lua_gettop(L) != 4 || !lua_istable(L, 1) ||
@@ -250,31 +791,63 @@ static int lua_RecordCompileError(lua_State* L)
                "outputsTable, errorMsg)"
         );
 
-    AssetCompileFailureInfo info;
-    StringTableToVector(L, 1, &info.inputPaths);
-    if (!lua_isnil(L, 2))
-        StringTableToVector(L, 2, &info.additionalInputPaths);
-    StringTableToVector(L, 3, &info.outputPaths);
-    info.errorMessage = lua_tostring(L, 4);
+    // Tools fail when they are killed by a cancelled build, but that isn't
+    // an error in the asset itself. A killed tool may have left its outputs
+    // half-written though, and they'd look up to date to the next build, so
+    // they're removed to make sure that the job is run again.
+    ProcessTracker* tracker = GetFromRegistry<ProcessTracker*>(L, &KEY_PROCESSTRACKER);
+    if (tracker->IsCancelled()) {
+        ProjectDBConn* conn = GetFromRegistry<ProjectDBConn*>(L, &KEY_PROJECTDBCONN);
+        int projID = GetFromRegistry<int>(L, &KEY_PROJECTID);
+        std::vector<const char*> outputPaths;
+        StringTableToPointers(L, 3, &outputPaths);
+        for (size_t i = 0; i < outputPaths.size(); ++i) {
+            if (!AssetPipelineOsFuncs::RemoveFile(outputPaths[i]))
+                DebugPrint("Failed to remove output of cancelled job: %s", outputPaths[i]);
+            conn->SetCleanStamp(projID, outputPaths[i], 0);
+        }
+        return 0;
+    }
 
     AssetPipeline* this_ = GetFromRegistry<AssetPipeline*>(L, &KEY_THIS);
 
-    this_->PushMessage(std::bind(
-        &AssetPipelineDelegate::OnAssetFailedToCompile,
-        std::placeholders::_1,
-        info
-    ));
+    // The tables are read before the event is allocated, since a bad table
+    // raises a Lua error (which would leak the event).
+    std::vector<const char*> inputPaths;
+    std::vector<const char*> additionalInputPaths;
+    std::vector<const char*> outputPaths;
+    StringTableToPointers(L, 1, &inputPaths);
+    if (!lua_isnil(L, 2))
+        StringTableToPointers(L, 2, &additionalInputPaths);
+    StringTableToPointers(L, 3, &outputPaths);
+
+    // The event's vectors are filled in directly, so that their storage can
+    // be reused from one event to the next.
+    AssetPipelineEvent* event = this_->AllocEvent(AssetPipelineEvent::FAILED_TO_COMPILE);
+    AssetCompileFailureInfo& info = event->failureInfo;
+    info.inputPaths.assign(inputPaths.begin(), inputPaths.end());
+    info.additionalInputPaths.assign(additionalInputPaths.begin(), additionalInputPaths.end());
+    info.outputPaths.assign(outputPaths.begin(), outputPaths.end());
+    info.errorMessage = lua_tostring(L, 4);
 
     ProjectDBConn* conn = GetFromRegistry<ProjectDBConn*>(L, &KEY_PROJECTDBCONN);
     int projID = GetFromRegistry<int>(L, &KEY_PROJECTID);
 
-    conn->RecordError(
+    int clearedErrorID;
+    event->projectID = projID;
+    info.errorID = conn->RecordError(
         projID,
         info.inputPaths,
         info.additionalInputPaths,
         info.outputPaths,
-        info.errorMessage
+        info.errorMessage,
+        &clearedErrorID
     );
+    event->errorID = info.errorID;
+
+    if (clearedErrorID != -1)
+        PushErrorClearedEvent(this_, projID, clearedErrorID);
+    this_->PushEvent(event);
 
     return 0;
 }
@@ -300,7 +873,11 @@ static int lua_ClearCompileError(lua_State* L)
     ProjectDBConn* conn = GetFromRegistry<ProjectDBConn*>(L, &KEY_PROJECTDBCONN);
     int projID = GetFromRegistry<int>(L, &KEY_PROJECTID);
 
-    conn->ClearError(projID, inputPaths, additionalInputPaths, outputPaths);
+    int errorID = conn->ClearError(projID, inputPaths, additionalInputPaths, outputPaths);
+    if (errorID != -1) {
+        AssetPipeline* this_ = GetFromRegistry<AssetPipeline*>(L, &KEY_THIS);
+        PushErrorClearedEvent(this_, projID, errorID);
+    }
 
     return 0;
 }
@@ -329,8 +906,18 @@ static int lua_NotifyAssetCompile(lua_State* L)
                 relativePath[i] = '\\';
         }
 
-        if (!relativePath.empty())
-            service->NotifyAssetCompiled(relativePath.c_str());
+        if (!relativePath.empty()) {
+            // The service reads the file on its own thread, after the
+            // working directory may have moved on to another project.
+            std::string filePath = path;
+            if (path[0] != '/') {
+                lua_pushlightuserdata(L, (void*)&KEY_PROJECTDIR);
+                lua_gettable(L, LUA_REGISTRYINDEX);
+                filePath = JoinPaths(lua_tostring(L, -1), path);
+                lua_pop(L, 1);
+            }
+            service->NotifyAssetCompiled(relativePath.c_str(), filePath.c_str());
+        }
     }
 
     return 0;
@@ -369,6 +956,54 @@ static int lua_RecordDependency(lua_State* L)
     return 0;
 }
 
+static int lua_SetDependencies(lua_State* L)
+{
+    if (lua_gettop(L) != 3 || !lua_isstring(L, 1) || !lua_istable(L, 2) ||
+        (!lua_istable(L, 3) && !lua_isnil(L, 3)))
+        return luaL_error(
+            L, "Usage: SetDependencies(\"outputPath\", inputsTable, "
+               "additionalInputsTable or nil)"
+        );
+
+    const char* outputPath = lua_tostring(L, 1);
+
+    std::vector<const char*> inputPaths;
+    StringTableToPointers(L, 2, &inputPaths);
+    if (!lua_isnil(L, 3))
+        StringTableToPointers(L, 3, &inputPaths);
+
+    ProjectDBConn* conn = GetFromRegistry<ProjectDBConn*>(L, &KEY_PROJECTDBCONN);
+
+    int projIdx = GetFromRegistry<int>(L, &KEY_PROJECTID);
+
+    conn->SetDependencies(projIdx, outputPath, inputPaths);
+
+    return 0;
+}
+
+static int PushProcessResults(lua_State* L, const Process& process)
+{
+    if (process.result == PROCESS_SUCCESS) {
+        lua_pushinteger(L, process.status);
+        lua_pushstring(L, process.stdoutStr.c_str());
+        lua_pushstring(L, process.stderrStr.c_str());
+    } else {
+        lua_pushnil(L);
+        lua_pushnil(L);
+        lua_pushnil(L);
+    }
+    return 3;
+}
+
+// Lua 5.1 can't yield across a call made from C, such as a call to a function
+// passed to pcall(), or to a metamethod, and it has no way to ask whether a
+// yield is possible. So this makes the same check that lua_yield() does,
+// rather than letting it fail.
+static bool CanYield(lua_State* L)
+{
+    return L->nCcalls <= L->baseCcalls;
+}
+
 static int lua_RunProcess(lua_State* L)
 {
     int nArgs = lua_gettop(L);
@@ -389,18 +1024,140 @@ static int lua_RunProcess(lua_State* L)
     }
     args.push_back(NULL);
 
-    Process process(command, args);
-    if (process.result == PROCESS_SUCCESS) {
-        lua_pushinteger(L, process.status);
-        lua_pushstring(L, process.stdoutStr.c_str());
-        lua_pushstring(L, process.stderrStr.c_str());
-    } else {
-        lua_pushnil(L);
-        lua_pushnil(L);
-        lua_pushnil(L);
+    ProcessTracker* tracker = GetFromRegistry<ProcessTracker*>(L, &KEY_PROCESSTRACKER);
+
+    // The build system runs each job as a coroutine. Its processes are run in
+    // the background, and the job yields the process's ID, to be resumed with
+    // the results once the process has finished.
+    bool isMainThread = (lua_pushthread(L) != 0);
+    lua_pop(L, 1);
+    if (!isMainThread) {
+        if (CanYield(L)) {
+            JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+            std::vector<std::string> argStrs(args.begin(), args.end() - 1);
+            lua_pushinteger(L, scheduler->StartProcess(argStrs, tracker));
+            return lua_yield(L, 1);
+        }
+        DebugPrint("RunProcess: called where the job can't yield (e.g. within "
+                   "pcall()), so waiting for '%s' to finish", command);
     }
 
-    return 3;
+    Process process(command, args, tracker);
+    return PushProcessResults(L, process);
+}
+
+// Sends the build's status to the delegate and to the asset event service's
+// clients.
+static void ReportBuildStatus(AssetPipeline* pipeline, AssetEventService* service,
+                              BuildStatusTracker* tracker, bool finished, bool cancelled)
+{
+    AssetPipelineEvent* event = pipeline->AllocEvent(AssetPipelineEvent::BUILD_STATUS);
+    AssetBuildStatusInfo& info = event->statusInfo;
+    tracker->TakeStatus(&info);
+    info.finished = finished;
+    info.cancelled = cancelled;
+    if (finished)
+        info.msRemaining = 0;
+    event->projectID = info.projectID;
+    service->NotifyBuildStatus(info);
+    pipeline->PushEvent(event);
+}
+
+static void ReportBuildStatusIfDue(lua_State* L)
+{
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    if (!tracker->IsStatusDue())
+        return;
+    ReportBuildStatus(GetFromRegistry<AssetPipeline*>(L, &KEY_THIS),
+                      GetFromRegistry<AssetEventService*>(L, &KEY_ASSETEVENTSERVICE),
+                      tracker, false, false);
+}
+
+// Waits for one of the processes started by a job to finish. Returns the
+// process's ID followed by the same results as RunProcess(), and then the
+// CPU time (in milliseconds) and peak memory (in KB) that the process used,
+// or nothing if there are no processes running.
+static int lua_WaitForProcess(lua_State* L)
+{
+    JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+
+    if (!scheduler->HasProcesses())
+        return 0;
+
+    // The wait is broken up so that the build's status (and the estimate of
+    // the time left) keeps being reported while a long job runs.
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    int processID;
+    std::unique_ptr<Process> process;
+    while (!(process = scheduler->WaitForProcess(&processID,
+                                                 tracker->GetMsUntilStatusDue())))
+        ReportBuildStatusIfDue(L);
+
+    lua_pushinteger(L, processID);
+    int nResults = PushProcessResults(L, *process);
+    lua_pushnumber(L, (lua_Number)process->cpuMs);
+    lua_pushnumber(L, (lua_Number)process->maxRssKB);
+    return 1 + nResults + 2;
+}
+
+static int lua_CanStartJob(lua_State* L)
+{
+    JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+    lua_pushboolean(L, scheduler->HasFreeSlot());
+    return 1;
+}
+
+// Returns true if the resources were reserved for a job. Otherwise returns
+// false, followed by "pool" or "capacity" depending on what the job is
+// waiting for.
+static int lua_AcquireJobResources(lua_State* L)
+{
+    if (lua_gettop(L) > 1)
+        return luaL_error(L, "Usage: AcquireJobResources(resourcesTable or nil)");
+
+    JobResources resources;
+    GetJobResources(L, 1, &resources);
+
+    JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+    JobScheduler::AcquireResult result = scheduler->TryAcquire(resources);
+    lua_pushboolean(L, result == JobScheduler::ACQUIRED);
+    if (result == JobScheduler::ACQUIRED)
+        return 1;
+    lua_pushstring(L, result == JobScheduler::POOL_FULL ? "pool" : "capacity");
+    return 2;
+}
+
+static int lua_ReleaseJobResources(lua_State* L)
+{
+    if (lua_gettop(L) > 1)
+        return luaL_error(L, "Usage: ReleaseJobResources(resourcesTable or nil)");
+
+    JobResources resources;
+    GetJobResources(L, 1, &resources);
+
+    JobScheduler* scheduler = GetFromRegistry<JobScheduler*>(L, &KEY_JOBSCHEDULER);
+    scheduler->Release(resources);
+    return 0;
+}
+
+static int lua_MarkOutputsLive(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_istable(L, 1))
+        return luaL_error(L, "Usage: MarkOutputsLive(outputsTable)");
+
+    StaleOutputCollector* collector =
+        GetFromRegistry<StaleOutputCollector*>(L, &KEY_OUTPUTCOLLECTOR);
+
+    int size = luaL_getn(L, 1);
+    for (int i = 1; i <= size; ++i) {
+        lua_rawgeti(L, 1, i);
+        if (!lua_isstring(L, -1))
+            return luaL_error(L, "Expected string, got %s", luaL_typename(L, -1));
+        collector->MarkLive(lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+
+    return 0;
 }
 
 static int lua_GetFileTimestamp(lua_State* L)
@@ -412,15 +1169,181 @@ static int lua_GetFileTimestamp(lua_State* L)
     return 1;
 }
 
+// Like GetFileTimestamp(), but an output that has been found to be up to
+// date more recently than it was written gets the later timestamp.
+static int lua_GetOutputTimestamp(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+        return luaL_error(L, "Usage: GetOutputTimestamp(\"path/to/file\"");
+    const char* path = lua_tostring(L, 1);
+
+    u64 timestamp = AssetPipelineOsFuncs::GetTimeStamp(path);
+    if (timestamp != 0) {
+        ProjectDBConn* conn = GetFromRegistry<ProjectDBConn*>(L, &KEY_PROJECTDBCONN);
+        int projID = GetFromRegistry<int>(L, &KEY_PROJECTID);
+        timestamp = std::max(timestamp, conn->GetCleanStamp(projID, path));
+    }
+
+    lua_pushnumber(L, (lua_Number)timestamp);
+    return 1;
+}
+
+// Records that the outputs are up to date with inputs as new as the given
+// timestamp. A timestamp of 0 removes the outputs' clean stamps.
+static int lua_SetCleanStamps(lua_State* L)
+{
+    if (lua_gettop(L) != 2 || !lua_istable(L, 1) || !lua_isnumber(L, 2))
+        return luaL_error(L, "Usage: SetCleanStamps(outputsTable, timestamp)");
+
+    ProjectDBConn* conn = GetFromRegistry<ProjectDBConn*>(L, &KEY_PROJECTDBCONN);
+    int projID = GetFromRegistry<int>(L, &KEY_PROJECTID);
+    u64 stamp = (u64)lua_tonumber(L, 2);
+
+    int size = luaL_getn(L, 1);
+    for (int i = 1; i <= size; ++i) {
+        lua_rawgeti(L, 1, i);
+        if (!lua_isstring(L, -1))
+            return luaL_error(L, "Expected string, got %s", luaL_typename(L, -1));
+        conn->SetCleanStamp(projID, lua_tostring(L, -1), stamp);
+        lua_pop(L, 1);
+    }
+
+    return 0;
+}
+
+static int lua_ExpectPaths(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isnumber(L, 1) || lua_tointeger(L, 1) < 0)
+        return luaL_error(L, "Usage: ExpectPaths(count)");
+
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    tracker->AddExpectedPaths((u32)lua_tointeger(L, 1));
+    return 0;
+}
+
+static int lua_AllPathsPlanned(lua_State* L)
+{
+    if (lua_gettop(L) != 0)
+        return luaL_error(L, "Usage: AllPathsPlanned()");
+
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    tracker->AllPathsPlanned();
+    return 0;
+}
+
+static int lua_PlanPaths(lua_State* L)
+{
+    if (lua_gettop(L) != 2 || !lua_isstring(L, 1) || !lua_isnumber(L, 2) ||
+        lua_tointeger(L, 2) < 0)
+        return luaL_error(L, "Usage: PlanPaths(ruleName, count)");
+
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    tracker->AddPlannedPaths(lua_tostring(L, 1), (u32)lua_tointeger(L, 2));
+    return 0;
+}
+
+static int lua_PathDone(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+        return luaL_error(L, "Usage: PathDone(ruleName)");
+
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    tracker->PathDone(lua_tostring(L, 1));
+    ReportBuildStatusIfDue(L);
+    return 0;
+}
+
+static int lua_JobStarted(lua_State* L)
+{
+    if (lua_gettop(L) != 2 || !lua_isstring(L, 1) || !lua_isstring(L, 2))
+        return luaL_error(L, "Usage: JobStarted(ruleName, path)");
+
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    int jobID = tracker->JobStarted(lua_tostring(L, 1), lua_tostring(L, 2));
+    ReportBuildStatusIfDue(L);
+    lua_pushinteger(L, (lua_Integer)jobID);
+    return 1;
+}
+
+// Returns how long the job took, in milliseconds.
+static int lua_JobFinished(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isnumber(L, 1))
+        return luaL_error(L, "Usage: JobFinished(jobID)");
+
+    // Jobs whose tools were killed didn't take as long as they normally
+    // would.
+    ProcessTracker* processTracker = GetFromRegistry<ProcessTracker*>(L, &KEY_PROCESSTRACKER);
+    BuildStatusTracker* tracker = GetFromRegistry<BuildStatusTracker*>(L, &KEY_STATUSTRACKER);
+    i64 ms = tracker->JobFinished((int)lua_tointeger(L, 1), !processTracker->IsCancelled());
+    ReportBuildStatusIfDue(L);
+    lua_pushnumber(L, (lua_Number)ms);
+    return 1;
+}
+
+static int lua_RecordAssetCost(lua_State* L)
+{
+    if (lua_gettop(L) != 6 || !lua_isstring(L, 1) || !lua_istable(L, 2) ||
+        (!lua_istable(L, 3) && !lua_isnil(L, 3)) ||
+        !lua_isnumber(L, 4) || !lua_isnumber(L, 5) || !lua_isnumber(L, 6))
+        return luaL_error(L, "Usage: RecordAssetCost(path, inputsTable, "
+                             "additionalInputsTable or nil, wallMs, cpuMs, maxRssKB)");
+
+    std::vector<std::string> inputs;
+    StringTableToVector(L, 2, &inputs);
+    if (!lua_isnil(L, 3)) {
+        std::vector<std::string> additionalInputs;
+        StringTableToVector(L, 3, &additionalInputs);
+        inputs.insert(inputs.end(), additionalInputs.begin(), additionalInputs.end());
+    }
+
+    AssetCostHistory* history = GetFromRegistry<AssetCostHistory*>(L, &KEY_COSTHISTORY);
+    history->RecordAsset(lua_tostring(L, 1), inputs, (i64)lua_tonumber(L, 4),
+                         (i64)lua_tonumber(L, 5), (u64)lua_tonumber(L, 6));
+    return 0;
+}
+
+// Returns how soon the path should be started: the larger the number, the
+// sooner.
+static int lua_GetBuildPriority(lua_State* L)
+{
+    if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+        return luaL_error(L, "Usage: GetBuildPriority(path)");
+
+    size_t length;
+    const char* path = lua_tolstring(L, 1, &length);
+    AssetCostHistory* history = GetFromRegistry<AssetCostHistory*>(L, &KEY_COSTHISTORY);
+    lua_pushnumber(L, (lua_Number)history->GetPriorityMs(path, length));
+    return 1;
+}
+
 static lua_State* SetupLuaState(int projectID,
                                 const char* projectPath,
                                 AssetPipeline* pipeline,
                                 AssetEventService* assetEventService,
-                                ProjectDBConn* projectDBConn)
+                                ProjectDBConn* projectDBConn,
+                                ProcessTracker* processTracker,
+                                GlobCache* globCache,
+                                StaleOutputCollector* outputCollector,
+                                JobScheduler* jobScheduler,
+                                BuildStatusTracker* statusTracker,
+                                AssetCostHistory* costHistory)
 {
     ASSERT(projectPath);
     ASSERT(pipeline);
     ASSERT(assetEventService);
+    ASSERT(processTracker);
+    ASSERT(globCache);
+    ASSERT(outputCollector);
+    ASSERT(jobScheduler);
+    ASSERT(statusTracker);
+    ASSERT(costHistory);
+
+    // Pools are declared by the build script, which can also change how
+    // notifications are queued.
+    jobScheduler->ClearPools();
+    assetEventService->SetQueueLimits(AssetEventService::DEFAULT_OVERFLOW_POLICY,
+                                      AssetEventService::DEFAULT_QUEUE_CAPACITY);
 
     lua_State* L = luaL_newstate();
 
@@ -430,23 +1353,62 @@ static lua_State* SetupLuaState(int projectID,
     lua_newtable(L);
     lua_settable(L, LUA_REGISTRYINDEX);
 
+    lua_pushlightuserdata(L, (void*)&KEY_MANIFESTGLOBS);
+    lua_newtable(L);
+    lua_settable(L, LUA_REGISTRYINDEX);
+
     SetInRegistry(L, &KEY_THIS, pipeline);
     SetInRegistry(L, &KEY_ASSETEVENTSERVICE, assetEventService);
     SetInRegistry(L, &KEY_PROJECTDBCONN, projectDBConn);
     SetInRegistry(L, &KEY_PROJECTID, projectID);
 
+    lua_pushlightuserdata(L, (void*)&KEY_PROJECTDIR);
+    lua_pushstring(L, projectPath);
+    lua_settable(L, LUA_REGISTRYINDEX);
+
+    SetInRegistry(L, &KEY_PROCESSTRACKER, processTracker);
+    SetInRegistry(L, &KEY_GLOBCACHE, globCache);
+    SetInRegistry(L, &KEY_OUTPUTCOLLECTOR, outputCollector);
+    SetInRegistry(L, &KEY_JOBSCHEDULER, jobScheduler);
+    SetInRegistry(L, &KEY_STATUSTRACKER, statusTracker);
+    SetInRegistry(L, &KEY_COSTHISTORY, costHistory);
+
     lua_register(L, "Rule", lua_Rule);
     lua_register(L, "ContentDir", lua_ContentDir);
     lua_register(L, "DataDir", lua_DataDir);
     lua_register(L, "Manifest", lua_Manifest);
     lua_register(L, "GetManifestPath", lua_GetManifestPath);
+    lua_register(L, "ManifestIterator", lua_ManifestIterator);
+    lua_register(L, "GetManifestGlobs", lua_GetManifestGlobs);
+    lua_register(L, "ExpandGlob", lua_ExpandGlob);
+    lua_register(L, "MatchGlob", lua_MatchGlob);
+    lua_register(L, "StaleOutputs", lua_StaleOutputs);
+    lua_register(L, "NotificationOverflow", lua_NotificationOverflow);
+    lua_register(L, "Pool", lua_Pool);
+    lua_register(L, "MaxJobs", lua_MaxJobs);
+    lua_register(L, "MarkOutputsLive", lua_MarkOutputsLive);
     lua_register(L, "RecordCompileError", lua_RecordCompileError);
     lua_register(L, "ClearCompileError", lua_ClearCompileError);
     lua_register(L, "RunProcess", lua_RunProcess);
+    lua_register(L, "WaitForProcess", lua_WaitForProcess);
+    lua_register(L, "CanStartJob", lua_CanStartJob);
+    lua_register(L, "AcquireJobResources", lua_AcquireJobResources);
+    lua_register(L, "ReleaseJobResources", lua_ReleaseJobResources);
     lua_register(L, "GetFileTimestamp", lua_GetFileTimestamp);
+    lua_register(L, "GetOutputTimestamp", lua_GetOutputTimestamp);
+    lua_register(L, "SetCleanStamps", lua_SetCleanStamps);
     lua_register(L, "NotifyAssetCompile", lua_NotifyAssetCompile);
     lua_register(L, "ClearDependencies", lua_ClearDependencies);
     lua_register(L, "RecordDependency", lua_RecordDependency);
+    lua_register(L, "SetDependencies", lua_SetDependencies);
+    lua_register(L, "ExpectPaths", lua_ExpectPaths);
+    lua_register(L, "AllPathsPlanned", lua_AllPathsPlanned);
+    lua_register(L, "PlanPaths", lua_PlanPaths);
+    lua_register(L, "PathDone", lua_PathDone);
+    lua_register(L, "JobStarted", lua_JobStarted);
+    lua_register(L, "JobFinished", lua_JobFinished);
+    lua_register(L, "RecordAssetCost", lua_RecordAssetCost);
+    lua_register(L, "GetBuildPriority", lua_GetBuildPriority);
 
     int ret = luaL_dofile(L, BUILD_SCRIPT_RELATIVE_PATH);
     if (ret != 0) {
@@ -491,12 +1453,78 @@ static void SetupBuildSystem(lua_State* L, std::vector<std::string>* paths)
         lua_pushnil(L);
     }
 
-    if (lua_pcall(L, 2, 0, 0) != 0) {
+    // The paths are counted by rule, for the build status.
+    lua_pushlightuserdata(L, (void*)&KEY_RULES);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+
+    if (lua_pcall(L, 3, 0, 0) != 0) {
+        DebugPrint("Error in Lua script.");
+        DebugPrint("Error: %s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        exit(1);
+    }
+}
+
+// Adds the outputs of the manifest's glob rules that match the (newly
+// created) file, if they aren't already in the list.
+static void AddManifestGlobOutputs(lua_State* L, const char* path,
+                                   std::vector<std::string>* outputs)
+{
+    int top = lua_gettop(L);
+
+    lua_getglobal(L, "BuildSystem");
+    lua_pushstring(L, "GetManifestGlobOutputs");
+    lua_gettable(L, -2);
+    lua_getglobal(L, "BuildSystem");
+    lua_pushstring(L, path);
+
+    if (lua_pcall(L, 2, 1, 0) != 0) {
+        DebugPrint("Error in Lua script.");
+        DebugPrint("Error: %s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        exit(1);
+    }
+
+    std::vector<std::string> globOutputs;
+    StringTableToVector(L, top + 2, &globOutputs);
+    lua_settop(L, top);
+
+    for (size_t i = 0; i < globOutputs.size(); ++i) {
+        if (std::find(outputs->begin(), outputs->end(), globOutputs[i]) == outputs->end())
+            outputs->push_back(globOutputs[i]);
+    }
+}
+
+// Records errors for the outputs, without running any tools.
+static void InvalidateOutputs(lua_State* L, const char* removedPath,
+                              const std::vector<std::string>& outputs)
+{
+    if (outputs.empty())
+        return;
+
+    int top = lua_gettop(L);
+
+    lua_getglobal(L, "BuildSystem");
+    lua_pushstring(L, "InvalidateOutputs");
+    lua_gettable(L, -2);
+    lua_getglobal(L, "BuildSystem");
+
+    lua_newtable(L);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        lua_pushstring(L, outputs[i].c_str());
+        lua_rawseti(L, -2, (int)i + 1);
+    }
+    lua_pushstring(L, removedPath);
+    lua_pushlightuserdata(L, (void*)&KEY_RULES);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+
+    if (lua_pcall(L, 4, 0, 0) != 0) {
         DebugPrint("Error in Lua script.");
         DebugPrint("Error: %s", lua_tostring(L, -1));
         lua_pop(L, 1);
         exit(1);
     }
+    lua_settop(L, top);
 }
 
 static void CompileOneFile(lua_State* L,
@@ -524,6 +1552,34 @@ static void CompileOneFile(lua_State* L,
     *succeeded = (bool)lua_toboolean(L, -1);
 }
 
+// Waits for the jobs that are still running when a build stops early.
+static void FinishRunningJobs(lua_State* L)
+{
+    int top = lua_gettop(L);
+
+    lua_getglobal(L, "BuildSystem");
+    lua_pushstring(L, "FinishRunningJobs");
+    lua_gettable(L, -2);
+    lua_getglobal(L, "BuildSystem");
+
+    if (lua_pcall(L, 1, 0, 0) != 0) {
+        DebugPrint("Error in Lua script.");
+        DebugPrint("Error: %s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        exit(1);
+    }
+    lua_settop(L, top);
+}
+
+// Returns the number of CPU slots that jobs are packed into. Jobs are run one
+// at a time unless the project asks for more with MaxJobs(), since its tools
+// may not be safe to run in parallel.
+static int GetMaxJobs(lua_State* L)
+{
+    int maxJobs = GetFromRegistry<int>(L, &KEY_MAXJOBS);
+    return maxJobs > 0 ? maxJobs : 1;
+}
+
 // Returns an empty string if not found
 static std::string GetContentDir(lua_State* L)
 {
@@ -536,23 +1592,144 @@ static std::string GetContentDir(lua_State* L)
     return str;
 }
 
-static std::string JoinPaths(const std::string& a, const std::string& b)
+// Returns an empty string if not found
+static std::string GetDataDir(lua_State* L)
 {
-    std::string ret;
-    ret.reserve(a.length() + b.length() + 1);
-    ret.append(a);
-    if (a.back() != '/' && a.back() != '\\')
-        ret.push_back('/');
-    ret.append(b);
-    return ret;
+    lua_pushlightuserdata(L, (void*)&KEY_DATADIR);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    std::string str;
+    if (lua_isstring(L, -1))
+        str = lua_tostring(L, -1);
+    lua_pop(L, 1);
+    return str;
+}
+
+static StaleOutputCollector::Mode GetStaleOutputsMode(lua_State* L)
+{
+    lua_pushlightuserdata(L, (void*)&KEY_STALEOUTPUTS);
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    StaleOutputCollector::Mode mode = StaleOutputCollector::MODE_KEEP;
+    if (lua_isstring(L, -1)) {
+        const char* str = lua_tostring(L, -1);
+        if (strcmp(str, "report") == 0)
+            mode = StaleOutputCollector::MODE_REPORT;
+        else if (strcmp(str, "remove") == 0)
+            mode = StaleOutputCollector::MODE_REMOVE;
+    }
+    lua_pop(L, 1);
+    return mode;
+}
+
+// Logged after each build, so that clients that can't keep up with the
+// notifications (or a queue that's too small) show up.
+static void LogAssetEventServiceStats(const AssetEventServiceStats& stats)
+{
+    DebugPrint("Asset notifications: %d client(s), %u queued, %u KB (peak %u KB), "
+               "%llu dropped, %llu coalesced, %llu filtered, %llu producer wait(s)",
+               stats.nClients, (unsigned)stats.nQueued,
+               (unsigned)(stats.memoryBytes / 1024),
+               (unsigned)(stats.peakMemoryBytes / 1024),
+               (unsigned long long)stats.nDropped,
+               (unsigned long long)stats.nCoalesced,
+               (unsigned long long)stats.nFiltered,
+               (unsigned long long)stats.nProducerWaits);
+}
+
+// Applies the changes to the dependencies since the snapshot's generation to
+// the snapshot in memory, which only reads the changed outputs' dependencies.
+// Returns false if that isn't possible, or if enough has changed that a new
+// snapshot should be written.
+static bool ApplyDependencyChanges(ProjectDBConn& dbConn, int projID,
+                                   DependencySnapshot* snapshot)
+{
+    if (!snapshot->IsLoaded() || snapshot->GetProjectID() != projID)
+        return false;
+
+    std::vector<std::string> outputs;
+    i64 generation;
+    if (!dbConn.TakeDependencyChanges(projID, snapshot->GetGeneration(),
+                                      &outputs, &generation))
+        return false;
+
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        dbConn.GetDependencies(projID, outputs[i].c_str(), &inputs);
+        snapshot->SetDependencies(outputs[i], inputs);
+    }
+    snapshot->SetGeneration(generation);
+
+    size_t maxChanges = std::max(MIN_DEPENDENCY_SNAPSHOT_CHANGES,
+                                 (size_t)snapshot->GetNumPaths() / 8);
+    return snapshot->GetNumChangedOutputs() <= maxChanges;
+}
+
+// Brings the project's dependency snapshot up to date with the database:
+// either in memory, or by writing (and loading) a new one.
+static void UpdateDependencySnapshot(ProjectDBConn& dbConn, int projID,
+                                     DependencySnapshot* snapshot)
+{
+    ASSERT(snapshot);
+
+    if (ApplyDependencyChanges(dbConn, projID, snapshot))
+        return;
+
+    PathTable paths;
+    std::vector<DependencyEdge> edges;
+    i64 generation;
+    dbConn.QueryAllDependencies(projID, &paths, &edges, &generation);
+    dbConn.TrackDependencyChanges(projID, generation);
+
+    std::string path = AssetPipelineOsFuncs::GetPathToDependencySnapshot(projID);
+    if (!DependencySnapshot::Write(path.c_str(), projID, generation, paths, edges)) {
+        DebugPrint("Failed to write dependency snapshot: %s", path.c_str());
+        snapshot->Unload();
+        return;
+    }
+    snapshot->Load(path.c_str(), projID);
+}
+
+// Uses the snapshot if it's still up to date, and the database otherwise.
+static void GetDependents(ProjectDBConn& dbConn, const DependencySnapshot& snapshot,
+                          int projID, const char* inputFile,
+                          std::vector<std::string>* outputFiles)
+{
+    if (snapshot.IsLoaded() && snapshot.GetProjectID() == projID &&
+        snapshot.GetGeneration() == dbConn.GetDependencyGeneration(projID)) {
+        snapshot.GetDependents(inputFile, outputFiles);
+    } else {
+        dbConn.GetDependents(projID, inputFile, outputFiles);
+    }
 }
 
 void AssetPipeline::FileSystemWatcherCallback(FileSystemWatcher::EventType event,
-                                              const char* path)
+                                              const char* path,
+                                              const char* oldPath)
 {
+    if (event == FileSystemWatcher::RESCAN_REQUIRED) {
+        m_globCache.OnRescanRequired();
+    } else {
+        m_globCache.OnPathChanged(path);
+        if (oldPath)
+            m_globCache.OnPathChanged(oldPath);
+    }
+
     CompileQueueItem item;
-    item.projectID = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        item.projectID = m_watchedProjectID;
+    }
+    if (item.projectID < 0)
+        return;
+    // Any file may have changed without an event, so the whole project is
+    // checked by a full build.
+    if (event == FileSystemWatcher::RESCAN_REQUIRED) {
+        PushCompileQueueItem(item);
+        return;
+    }
     item.modifiedFilePath = path;
+    item.event = event;
+    if (oldPath)
+        item.oldFilePath = oldPath;
     PushCompileQueueItem(item);
 }
 
@@ -561,40 +1738,93 @@ void AssetPipeline::CompileProc(AssetPipeline* this_)
     lua_State* L = NULL;
 
     ProjectDBConn dbConn;
+    DependencySnapshot depSnapshot;
+    StaleOutputCollector outputCollector;
+    JobScheduler jobScheduler;
+    BuildStatusTracker statusTracker;
+    AssetCostHistory costHistory;
 
     typedef std::unique_ptr<FileSystemWatcher, void (*)(FileSystemWatcher*)> FSWatcherPtr;
     FSWatcherPtr fsWatcher(FileSystemWatcher::Create(), &FileSystemWatcher::Destroy);
     fsWatcher->SetOnFileChanged([=] (FileSystemWatcher::EventType event,
-                                     const char* path) {
+                                     const char* path, const char* oldPath) {
         // WARNING: This is called on the main thread!!
-        this_->FileSystemWatcherCallback(event, path);
+        this_->FileSystemWatcherCallback(event, path, oldPath);
     });
 
     std::string currDir;
     int currProjID = -1;
+    // True if the dependencies have changed since the snapshot was made.
+    bool snapshotOutOfDate = false;
 
     for (;;) {
         CompileQueueItem nextItem;
         {
             std::unique_lock<std::mutex> lock(this_->m_mutex);
-            this_->m_condVar.wait(lock, [=] { return this_->m_compileInProgress; });
-            if (this_->m_compileQueue.empty()) {
-                // Signals quit
-                break;
+            auto hasWork = [=] {
+                return this_->m_shouldExit || !this_->m_compileQueue.empty();
+            };
+            if (outputCollector.HasPendingWork()) {
+                bool hadWork = this_->m_condVar.wait_for(
+                    lock, std::chrono::milliseconds(STALE_OUTPUTS_INTERVAL_MS), hasWork
+                );
+                if (!hadWork) {
+                    lock.unlock();
+                    std::vector<int> clearedErrorIDs;
+                    outputCollector.Step(dbConn, STALE_OUTPUTS_BATCH_SIZE,
+                                         &clearedErrorIDs);
+                    // The costs of the removed outputs are gone too.
+                    costHistory.Invalidate();
+                    for (size_t i = 0; i < clearedErrorIDs.size(); ++i) {
+                        PushErrorClearedEvent(this_, outputCollector.GetProjectID(),
+                                              clearedErrorIDs[i]);
+                    }
+                    // The dependencies have changed, so the snapshot needs
+                    // to be brought up to date.
+                    if (!outputCollector.HasPendingWork())
+                        snapshotOutOfDate = true;
+                    continue;
+                }
+            } else if (snapshotOutOfDate) {
+                bool hadWork = this_->m_condVar.wait_for(
+                    lock, std::chrono::milliseconds(DEPENDENCY_SNAPSHOT_DELAY_MS), hasWork
+                );
+                if (!hadWork) {
+                    lock.unlock();
+                    UpdateDependencySnapshot(dbConn, currProjID, &depSnapshot);
+                    snapshotOutOfDate = false;
+                    continue;
+                }
             } else {
-                nextItem = this_->m_compileQueue.front();
-                this_->m_compileQueue.pop();
+                this_->m_condVar.wait(lock, hasWork);
             }
+            if (this_->m_shouldExit)
+                break;
+            nextItem = this_->m_compileQueue.front();
+            this_->m_compileQueue.pop_front();
+
+            this_->m_compiling = true;
+            this_->m_currentItem = nextItem;
+            this_->m_cancelRequested = false;
+            this_->m_currentSuperseded = false;
+            this_->m_processTracker.Reset();
         }
 
         std::string singleFilePath;
         bool recompilingSingleFile = false;
+        // The number of assets marked as failed because an input was removed.
+        int nInvalidated = 0;
 
-        if (nextItem.projectID < 0) {
-            // We are recompiling a modified file.
+        if (nextItem.IsSingleFile()) {
+            // We are recompiling a modified file. If the active project has
+            // changed since the file was queued, the item is out of date.
+            if (nextItem.projectID != currProjID) {
+                std::lock_guard<std::mutex> lock(this_->m_mutex);
+                this_->m_compiling = false;
+                continue;
+            }
             recompilingSingleFile = true;
 
-            ASSERT(currProjID >= 0);
             ASSERT(!currDir.empty());
 
             std::string input = StrUtilsMakeRelativePath(
@@ -602,9 +1832,33 @@ void AssetPipeline::CompileProc(AssetPipeline* this_)
             );
             singleFilePath = input;
 
+            // The things that depend on a renamed file now depend on it at
+            // its new path (if that's wrong, rebuilding them below will say
+            // so).
+            if (nextItem.event == FileSystemWatcher::FILE_RENAMED) {
+                std::string oldInput = StrUtilsMakeRelativePath(
+                    currDir.c_str(), nextItem.oldFilePath.c_str()
+                );
+                if (!oldInput.empty())
+                    dbConn.RenameDependencyPath(currProjID, oldInput.c_str(),
+                                                input.c_str());
+            }
+
             std::vector<std::string> outputs;
-            dbConn.GetDependents(currProjID, input.c_str(), &outputs);
+            GetDependents(dbConn, depSnapshot, currProjID, input.c_str(), &outputs);
+
+            if (nextItem.event == FileSystemWatcher::FILE_REMOVED) {
+                // Nothing can be built without the file, so there's no
+                // point running any tools.
+                InvalidateOutputs(L, input.c_str(), outputs);
+                nInvalidated = (int)outputs.size();
+                outputs.clear();
+            } else if (nextItem.event != FileSystemWatcher::FILE_MODIFIED) {
+                AddManifestGlobOutputs(L, input.c_str(), &outputs);
+            }
 
+            statusTracker.BeginBuild(dbConn, currProjID, GetMaxJobs(L));
+            costHistory.BeginBuild(dbConn, currProjID);
             SetupBuildSystem(L, &outputs);
         } else {
             // We are compiling a whole project.
@@ -627,76 +1881,140 @@ void AssetPipeline::CompileProc(AssetPipeline* this_)
                     projectDir.c_str(),
                     this_,
                     &this_->m_assetEventService,
-                    &dbConn
+                    &dbConn,
+                    &this_->m_processTracker,
+                    &this_->m_globCache,
+                    &outputCollector,
+                    &jobScheduler,
+                    &statusTracker,
+                    &costHistory
                 );
 
                 std::string contentDir = GetContentDir(L);
                 if (!contentDir.empty()) {
                     std::string fullPath = JoinPaths(projectDir, contentDir);
                     fsWatcher->WatchDirectory(fullPath.c_str());
+                    this_->m_globCache.Reset(projectDir.c_str(), contentDir.c_str());
+                } else {
+                    this_->m_globCache.Reset(projectDir.c_str(), NULL);
                 }
+
+                // N.B. If the snapshot is out of date, it will just be
+                // ignored until the build below replaces it.
+                std::string snapshotPath =
+                    AssetPipelineOsFuncs::GetPathToDependencySnapshot(currProjID);
+                depSnapshot.Load(snapshotPath.c_str(), currProjID);
+
+                std::lock_guard<std::mutex> lock(this_->m_mutex);
+                this_->m_watchedProjectID = currProjID;
             }
 
+            outputCollector.BeginBuild(currProjID);
+            statusTracker.BeginBuild(dbConn, currProjID, GetMaxJobs(L));
+            costHistory.BeginBuild(dbConn, currProjID);
             SetupBuildSystem(L, NULL);
         }
 
+        // Clients hear how much there is to do straight away.
+        ReportBuildStatus(this_, &this_->m_assetEventService, &statusTracker, false, false);
+
+        // Memory that's in use elsewhere can't be given to jobs, so the
+        // capacity is worked out afresh for each build.
+        jobScheduler.Reset(GetMaxJobs(L), AssetPipelineOsFuncs::GetAvailableMemoryMB());
+
         int nSucceeded = 0;
         int nFailed = 0;
+        bool cancelled = false;
+        bool superseded = false;
 
         for (;;) {
-            bool compiling;
-            {
-                std::lock_guard<std::mutex> lock(this_->m_mutex);
-                compiling = this_->m_compileInProgress;
-            }
-            if (!compiling)
-                break;
-
             // Compile one file
             bool hadRemainingAsset;
             bool succeeded;
             CompileOneFile(L, &hadRemainingAsset, &succeeded);
 
-            if (!hadRemainingAsset) {
-                // Compilation process is done
-                {
-                    std::lock_guard<std::mutex> lock(this_->m_mutex);
-                    this_->m_compileInProgress = false;
-                }
-                ASSERT(currProjID != -1);
-                if (recompilingSingleFile) {
-                    AssetRecompileInfo info;
-                    info.projectID = currProjID;
-                    info.path = singleFilePath;
-                    info.succeeded = (nSucceeded > 0);
-                    this_->PushMessage(std::bind(
-                        &AssetPipelineDelegate::OnAssetRecompileFinished,
-                        std::placeholders::_1,
-                        info
-                    ));
-                } else {
-                    AssetBuildCompletionInfo info;
-                    info.projectID = currProjID;
-                    info.nSucceeded = nSucceeded;
-                    info.nFailed = nFailed;
-                    this_->PushMessage(std::bind(
-                        &AssetPipelineDelegate::OnAssetBuildFinished,
-                        std::placeholders::_1,
-                        info
-                    ));
-                }
-                break;
+            {
+                std::lock_guard<std::mutex> lock(this_->m_mutex);
+                cancelled = this_->m_cancelRequested;
+                superseded = this_->m_currentSuperseded;
             }
+            if (cancelled || !hadRemainingAsset)
+                break;
+
+            if (statusTracker.IsStatusDue())
+                ReportBuildStatus(this_, &this_->m_assetEventService, &statusTracker,
+                                  false, false);
 
             if (succeeded) {
                 ++nSucceeded;
-                this_->PushMessage(
-                    &AssetPipelineDelegate::OnAssetCompileSucceeded
+                AssetPipelineEvent* event = this_->AllocEvent(
+                    AssetPipelineEvent::COMPILE_SUCCEEDED
                 );
+                event->projectID = currProjID;
+                this_->PushEvent(event);
             } else {
                 ++nFailed;
             }
         }
+
+        // The processes of any jobs that are still running have been killed,
+        // so this doesn't take long.
+        if (cancelled)
+            FinishRunningJobs(L);
+
+        ReportBuildStatus(this_, &this_->m_assetEventService, &statusTracker, true, cancelled);
+        statusTracker.EndBuild(dbConn);
+        costHistory.EndBuild(dbConn);
+
+        // Compilation process is done
+        ASSERT(currProjID != -1);
+        if (recompilingSingleFile) {
+            bool removed = (nextItem.event == FileSystemWatcher::FILE_REMOVED);
+            if (!cancelled && (!removed || nInvalidated > 0)) {
+                AssetPipelineEvent* event = this_->AllocEvent(
+                    AssetPipelineEvent::RECOMPILE_FINISHED
+                );
+                AssetRecompileInfo& info = event->recompileInfo;
+                info.projectID = currProjID;
+                info.path = singleFilePath;
+                info.succeeded = (nSucceeded > 0);
+                this_->PushEvent(event);
+            }
+        } else {
+            std::vector<std::string> staleOutputs;
+            outputCollector.EndBuild(dbConn, !cancelled && !superseded,
+                                     GetStaleOutputsMode(L), GetDataDir(L),
+                                     &staleOutputs);
+
+            if (!superseded) {
+                if (!cancelled)
+                    UpdateDependencySnapshot(dbConn, currProjID, &depSnapshot);
+
+                AssetPipelineEvent* event = this_->AllocEvent(
+                    AssetPipelineEvent::BUILD_FINISHED
+                );
+                AssetBuildCompletionInfo& info = event->buildInfo;
+                info.projectID = currProjID;
+                info.nSucceeded = nSucceeded;
+                info.nFailed = nFailed;
+                info.cancelled = cancelled;
+                info.staleOutputs.swap(staleOutputs);
+                this_->PushEvent(event);
+
+                LogAssetEventServiceStats(this_->GetAssetEventServiceStats());
+            }
+        }
+
+        // Recompiles (and builds that didn't finish) change the dependencies
+        // too, so the snapshot is brought up to date once things are quiet.
+        // N.B. Checking the generation doesn't touch the database.
+        snapshotOutOfDate = !depSnapshot.IsLoaded() ||
+            depSnapshot.GetGeneration() != dbConn.GetDependencyGeneration(currProjID);
+
+        {
+            std::lock_guard<std::mutex> lock(this_->m_mutex);
+            this_->m_compiling = false;
+        }
     }
 
     if (L != NULL)
@@ -1,35 +1,20 @@
 #ifndef PIPELINE_ASSETPIPELINE_H
 #define PIPELINE_ASSETPIPELINE_H
 
-#include <functional>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <string>
-#include <vector>
-#include <queue>
+#include <deque>
+#include <Os/EventSignal.h>
 #include <Os/FileSystemWatcher.h>
+#include "AssetPipelineEvents.h"
 #include "AssetEventService.h"
+#include "Process.h"
+#include "GlobCache.h"
 
 class ProjectDBConn;
 
-struct AssetBuildCompletionInfo {
-    int projectID;
-    int nSucceeded;
-    int nFailed;
-};
-
-struct AssetRecompileInfo {
-    int projectID;
-    std::string path;
-    bool succeeded;
-};
-
-struct AssetCompileFailureInfo {
-    std::vector<std::string> inputPaths;
-    std::vector<std::string> additionalInputPaths;
-    std::vector<std::string> outputPaths;
-    std::string errorMessage;
-};
-
 class AssetPipelineDelegate {
 public:
     enum BuildType {
@@ -41,8 +26,15 @@ public:
 
     virtual void OnAssetBuildFinished(const AssetBuildCompletionInfo& info) = 0;
     virtual void OnAssetRecompileFinished(const AssetRecompileInfo& info) = 0;
-    virtual void OnAssetCompileSucceeded() = 0;
+    // Called at most once per call to CallDelegateFunctions(), rather than
+    // once per asset. Progress is always reported before the corresponding
+    // build/recompile finishes.
+    virtual void OnAssetBuildProgress(const AssetBuildProgressInfo& info) = 0;
     virtual void OnAssetFailedToCompile(const AssetCompileFailureInfo& info) = 0;
+    // Only the latest status is reported by each call to
+    // CallDelegateFunctions(). The final status of a build comes before it
+    // finishes.
+    virtual void OnAssetBuildStatus(const AssetBuildStatusInfo& info) = 0;
 };
 
 class AssetPipeline {
@@ -52,45 +44,96 @@ public:
 
     void CompileProject(int projectID);
 
+    // Cancels the build currently in progress (if any) along with all queued
+    // work. Any tools that the build is running are killed.
+    void CancelBuild();
+    // As above, but only cancels work belonging to the given project.
+    void CancelProject(int projectID);
+
     AssetPipelineDelegate* GetDelegate() const;
     void SetDelegate(AssetPipelineDelegate* delegate);
 
+    // Calls the delegate for the events that have arrived since the last call.
+    // This should be called from a single thread only (normally the main
+    // thread), either periodically, or whenever the delegate event handle
+    // becomes readable. Per-asset events are batched together, so calling
+    // this less often means less work for the delegate.
     void CallDelegateFunctions();
 
-private:
-    typedef std::function<void(AssetPipelineDelegate*)> MsgFunc;
+    // The handle is readable whenever there are delegate events waiting to be
+    // processed, so it can be plugged into an event loop.
+    EventSignal::OsHandle GetDelegateEventHandle() const;
+    // Blocks until there are delegate events waiting to be processed. Returns
+    // false if the timeout expired first (a negative timeout never expires).
+    bool WaitForDelegateEvents(int timeoutMs);
+
+    // How the clients that are listening for compiled assets are keeping up.
+    AssetEventServiceStats GetAssetEventServiceStats() const;
+
 public: // NOT for use by user code
-    void PushMessage(const MsgFunc& message);
+    AssetPipelineEvent* AllocEvent(AssetPipelineEvent::Type type);
+    void PushEvent(AssetPipelineEvent* event);
 private:
 
     struct CompileQueueItem {
-        // If projectID is negative, this item represents a single modified
-        // file, specified by modifiedFilePath.
-        // Otherwise, this represents compilation of a project, and
-        // modifiedFilePath is ignored.
+        CompileQueueItem()
+            : projectID(-1)
+            , modifiedFilePath()
+            , event(FileSystemWatcher::FILE_MODIFIED)
+            , oldFilePath()
+        {}
+
+        // If modifiedFilePath is empty, this item represents compilation of
+        // the whole project. Otherwise, it represents recompilation of a
+        // single modified file (within the project's directory).
         int projectID;
         std::string modifiedFilePath;
+        // What happened to the file, and its previous path if it was renamed.
+        FileSystemWatcher::EventType event;
+        std::string oldFilePath;
+
+        bool IsSingleFile() const { return !modifiedFilePath.empty(); }
     };
 
     AssetPipeline(const AssetPipeline&);
     AssetPipeline& operator=(const AssetPipeline&);
 
+    void FlushProgress(AssetBuildProgressInfo* progress);
+    void FlushStatus();
     void PushCompileQueueItem(const CompileQueueItem& item);
-    void FileSystemWatcherCallback(FileSystemWatcher::EventType event, const char* path);
+    void CancelCurrentItem(bool superseded);
+    void FileSystemWatcherCallback(FileSystemWatcher::EventType event, const char* path,
+                                   const char* oldPath);
     static void CompileProc(AssetPipeline* this_);
 
     std::thread m_thread;
-    std::queue<CompileQueueItem> m_compileQueue;
+    std::deque<CompileQueueItem> m_compileQueue;
     std::mutex m_mutex;
-    bool m_compileInProgress;
     std::condition_variable m_condVar;
+    bool m_shouldExit;
+
+    // The following are protected by m_mutex.
+    bool m_compiling;
+    CompileQueueItem m_currentItem;
+    bool m_cancelRequested;
+    // True if the current item was cancelled because a newer item replaces
+    // it, in which case no completion message is sent for it.
+    bool m_currentSuperseded;
+    // ID of the project whose content directory is being watched, or -1.
+    int m_watchedProjectID;
+
+    ProcessTracker m_processTracker;
 
     AssetPipelineDelegate* m_delegate;
 
-    std::queue<MsgFunc> m_messageQueue;
-    std::mutex m_messageQueueMutex;
+    AssetPipelineEventQueue m_eventQueue;
+    AssetBuildProgressInfo m_progress;
+    // The status that hasn't been reported yet, if its projectID isn't -1.
+    AssetBuildStatusInfo m_status;
 
     AssetEventService m_assetEventService;
+
+    GlobCache m_globCache;
 };
 
 #endif // PIPELINE_ASSETPIPELINE_H
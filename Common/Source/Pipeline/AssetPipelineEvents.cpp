@@ -0,0 +1,69 @@
+#include "AssetPipelineEvents.h"
+
+#include <Core/Macros.h>
+
+const i64 AssetBuildStatusInfo::UNKNOWN_TIME;
+
+// Events beyond this number are freed rather than being returned to the pool.
+const size_t EVENT_POOL_CAPACITY = 256;
+
+AssetPipelineEventQueue::AssetPipelineEventQueue()
+    : m_queue()
+    , m_pool(EVENT_POOL_CAPACITY)
+    , m_signal()
+{}
+
+AssetPipelineEventQueue::~AssetPipelineEventQueue()
+{
+    while (AssetPipelineEvent* event = Pop())
+        delete event;
+    AssetPipelineEvent* event;
+    while (m_pool.TryPop(&event))
+        delete event;
+}
+
+AssetPipelineEvent* AssetPipelineEventQueue::Alloc(AssetPipelineEvent::Type type)
+{
+    AssetPipelineEvent* event;
+    if (!m_pool.TryPop(&event))
+        event = new AssetPipelineEvent;
+    event->type = type;
+    return event;
+}
+
+void AssetPipelineEventQueue::Push(AssetPipelineEvent* event)
+{
+    ASSERT(event);
+    m_queue.Push(event);
+    m_signal.Set();
+}
+
+AssetPipelineEvent* AssetPipelineEventQueue::Pop()
+{
+    return static_cast<AssetPipelineEvent*>(m_queue.Pop());
+}
+
+void AssetPipelineEventQueue::Free(AssetPipelineEvent* event)
+{
+    ASSERT(event);
+    // Clear out the payload, but keep the allocated capacity.
+    event->buildInfo.staleOutputs.clear();
+    event->recompileInfo.path.clear();
+    event->failureInfo.inputPaths.clear();
+    event->failureInfo.additionalInputPaths.clear();
+    event->failureInfo.outputPaths.clear();
+    event->failureInfo.errorMessage.clear();
+    event->statusInfo.runningPaths.clear();
+    if (!m_pool.TryPush(event))
+        delete event;
+}
+
+EventSignal& AssetPipelineEventQueue::GetSignal()
+{
+    return m_signal;
+}
+
+const EventSignal& AssetPipelineEventQueue::GetSignal() const
+{
+    return m_signal;
+}
@@ -0,0 +1,128 @@
+#ifndef PIPELINE_ASSETPIPELINEEVENTS_H
+#define PIPELINE_ASSETPIPELINEEVENTS_H
+
+#include <string>
+#include <vector>
+#include <Core/Types.h>
+#include <Core/LockFreeQueue.h>
+#include <Os/EventSignal.h>
+
+struct AssetBuildCompletionInfo {
+    int projectID;
+    int nSucceeded;
+    int nFailed;
+    bool cancelled;
+    // Outputs that the project no longer produces. Only filled in when the
+    // project's stale outputs are set to "report".
+    std::vector<std::string> staleOutputs;
+};
+
+struct AssetRecompileInfo {
+    int projectID;
+    std::string path;
+    bool succeeded;
+};
+
+struct AssetErrorChange {
+    int errorID;
+    // False if the error was removed.
+    bool added;
+};
+
+// Aggregates the progress made since the previous progress report.
+struct AssetBuildProgressInfo {
+    int projectID;
+    int nSucceeded;
+    int nFailed;
+    // The errors that were recorded or removed, without duplicates: an error
+    // that changed more than once only appears with its last change.
+    std::vector<AssetErrorChange> errorChanges;
+};
+
+// A snapshot of how far through a build (or recompile) the pipeline is.
+struct AssetBuildStatusInfo {
+    static const i64 UNKNOWN_TIME = -1;
+
+    int projectID;
+    // The paths that the build started from (those in the manifest, or those
+    // affected by a modified file), and how many of them have been dealt
+    // with so far (i.e. checked, and their jobs started if they need any).
+    u32 nPathsDone;
+    u32 nPathsTotal;
+    u32 nJobsRunning;
+    // The paths of the running jobs, though not necessarily all of them.
+    std::vector<std::string> runningPaths;
+    // Estimated from how long the rules' jobs have taken before. May be
+    // UNKNOWN_TIME until there's something to go on.
+    i64 msRemaining;
+    bool finished;
+    bool cancelled;
+};
+
+struct AssetCompileFailureInfo {
+    // The error that was recorded for the failure.
+    int errorID;
+    std::vector<std::string> inputPaths;
+    std::vector<std::string> additionalInputPaths;
+    std::vector<std::string> outputPaths;
+    std::string errorMessage;
+};
+
+struct AssetPipelineEvent : MpscQueueNode {
+    enum Type {
+        BUILD_FINISHED,
+        RECOMPILE_FINISHED,
+        COMPILE_SUCCEEDED,
+        FAILED_TO_COMPILE,
+        ERROR_CLEARED,
+        BUILD_STATUS,
+    };
+
+    Type type;
+
+    // Valid for COMPILE_SUCCEEDED, FAILED_TO_COMPILE and ERROR_CLEARED.
+    int projectID;
+    // Valid for FAILED_TO_COMPILE and ERROR_CLEARED: the error that was
+    // recorded or removed.
+    int errorID;
+
+    // Only the member corresponding to the type is valid.
+    AssetBuildCompletionInfo buildInfo;
+    AssetRecompileInfo recompileInfo;
+    AssetCompileFailureInfo failureInfo;
+    AssetBuildStatusInfo statusInfo;
+};
+
+// Carries events from the compile thread to the thread that calls the
+// delegate. Event records are pooled (and their strings and vectors keep their
+// capacity), so pushing an event doesn't normally allocate.
+//
+// The signal is raised whenever an event is pushed, so the consumer can block
+// on it rather than polling.
+class AssetPipelineEventQueue {
+public:
+    AssetPipelineEventQueue();
+    ~AssetPipelineEventQueue();
+
+    // These may be called from any thread.
+    AssetPipelineEvent* Alloc(AssetPipelineEvent::Type type);
+    void Push(AssetPipelineEvent* event);
+
+    // These must only be called by the consumer. The signal should be cleared
+    // before popping events.
+    AssetPipelineEvent* Pop();
+    void Free(AssetPipelineEvent* event);
+
+    EventSignal& GetSignal();
+    const EventSignal& GetSignal() const;
+
+private:
+    AssetPipelineEventQueue(const AssetPipelineEventQueue&);
+    AssetPipelineEventQueue& operator=(const AssetPipelineEventQueue&);
+
+    MpscQueue m_queue;
+    BoundedMpmcQueue<AssetPipelineEvent*> m_pool;
+    EventSignal m_signal;
+};
+
+#endif // PIPELINE_ASSETPIPELINEEVENTS_H
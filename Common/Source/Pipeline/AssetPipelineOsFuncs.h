@@ -6,9 +6,17 @@
 
 namespace AssetPipelineOsFuncs {
     std::string GetPathToProjectDB();
+    std::string GetPathToDependencySnapshot(int projID);
+    std::string GetPathToBinaryManifest(int projID);
     std::string GetScriptsDirectory();
 
     u64 GetTimeStamp(const char* path);
+    // Returns true if the file was removed, or didn't exist anyway.
+    bool RemoveFile(const char* path);
+
+    // Returns the physical memory that could be given to new processes
+    // without paging, or 0 if it isn't known.
+    u64 GetAvailableMemoryMB();
 
     void SetWorkingDirectory(const char* path);
 }
@@ -2,9 +2,10 @@
 #import <Cocoa/Cocoa.h>
 #include <sys/stat.h>
 #include <utime.h>
+#include <mach/mach.h>
 #include <Core/Macros.h>
 
-std::string AssetPipelineOsFuncs::GetPathToProjectDB()
+static NSString* GetDataDirectory()
 {
     NSArray* array = NSSearchPathForDirectoriesInDomains(
         NSApplicationSupportDirectory,
@@ -16,7 +17,26 @@ std::string AssetPipelineOsFuncs::GetPathToProjectDB()
                               withIntermediateDirectories:YES
                                                attributes:nil
                                                     error:nil];
-    NSString* path = [dir stringByAppendingPathComponent:@"ProjectDB.sqlite3"];
+    return dir;
+}
+
+std::string AssetPipelineOsFuncs::GetPathToProjectDB()
+{
+    NSString* path = [GetDataDirectory() stringByAppendingPathComponent:@"ProjectDB.sqlite3"];
+    return [path UTF8String];
+}
+
+std::string AssetPipelineOsFuncs::GetPathToDependencySnapshot(int projID)
+{
+    NSString* name = [NSString stringWithFormat:@"Dependencies-%d.bin", projID];
+    NSString* path = [GetDataDirectory() stringByAppendingPathComponent:name];
+    return [path UTF8String];
+}
+
+std::string AssetPipelineOsFuncs::GetPathToBinaryManifest(int projID)
+{
+    NSString* name = [NSString stringWithFormat:@"Manifest-%d.bin", projID];
+    NSString* path = [GetDataDirectory() stringByAppendingPathComponent:name];
     return [path UTF8String];
 }
 
@@ -42,6 +62,24 @@ u64 AssetPipelineOsFuncs::GetTimeStamp(const char* path)
     return result;
 }
 
+bool AssetPipelineOsFuncs::RemoveFile(const char* path)
+{
+    return unlink(path) == 0 || errno == ENOENT;
+}
+
+u64 AssetPipelineOsFuncs::GetAvailableMemoryMB()
+{
+    vm_statistics64_data_t stats;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+    if (host_statistics64(mach_host_self(), HOST_VM_INFO64,
+                          (host_info64_t)&stats, &count) != KERN_SUCCESS)
+        return 0;
+
+    // Inactive and purgeable pages are given up as soon as they're needed.
+    u64 nPages = (u64)stats.free_count + stats.inactive_count + stats.purgeable_count;
+    return nPages * vm_kernel_page_size / (1024 * 1024);
+}
+
 void AssetPipelineOsFuncs::SetWorkingDirectory(const char* path)
 {
     chdir(path);
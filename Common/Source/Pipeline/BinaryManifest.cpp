@@ -0,0 +1,195 @@
+#include "BinaryManifest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <Core/Macros.h>
+
+#include "AssetPipelineOsFuncs.h"
+
+// N.B. Like dependency snapshots, binary manifests are only read on the
+// machine that wrote them, so they're stored in native byte order.
+const u32 MANIFEST_MAGIC = 0x464D5041; // "APMF"
+const u32 MANIFEST_VERSION = 1;
+
+// The header is followed by:
+//   u32 offsets[nEntries + 1]  offsets into data (the last is dataSize)
+//   char data[dataSize]        null-terminated entries
+struct ManifestHeader {
+    u32 magic;
+    u32 version;
+    u64 textTimestamp;
+    u32 nEntries;
+    u32 dataSize;
+};
+
+static bool ReadWholeFile(const char* path, std::vector<char>* contents)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    contents->clear();
+    char buffer[4096];
+    size_t nRead;
+    while ((nRead = fread(buffer, 1, sizeof buffer, file)) > 0)
+        contents->insert(contents->end(), buffer, buffer + nRead);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+bool BinaryManifest::Compile(const char* textPath, const char* binaryPath)
+{
+    ASSERT(textPath);
+    ASSERT(binaryPath);
+
+    // N.B. The timestamp is taken before the file is read, so if the file is
+    // modified in between, it will just be compiled again next time.
+    u64 textTimestamp = AssetPipelineOsFuncs::GetTimeStamp(textPath);
+
+    std::vector<char> text;
+    if (!ReadWholeFile(textPath, &text))
+        return false;
+
+    // Split the text into lines in the same way as Lua's io.lines(): each
+    // '\n' ends a line, and there's no empty line after a final '\n'.
+    std::vector<u32> offsets;
+    std::vector<char> data;
+    size_t lineStart = 0;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        bool atEnd = (i == text.size());
+        if (!atEnd && text[i] != '\n')
+            continue;
+        if (atEnd && i == lineStart)
+            break;
+        offsets.push_back((u32)data.size());
+        data.insert(data.end(), text.begin() + lineStart, text.begin() + i);
+        data.push_back('\0');
+        lineStart = i + 1;
+    }
+    offsets.push_back((u32)data.size());
+
+    ManifestHeader header;
+    memset(&header, 0, sizeof header);
+    header.magic = MANIFEST_MAGIC;
+    header.version = MANIFEST_VERSION;
+    header.textTimestamp = textTimestamp;
+    header.nEntries = (u32)offsets.size() - 1;
+    header.dataSize = (u32)data.size();
+
+    // Write to a temporary file, then move it into place.
+    std::string tempPath(binaryPath);
+    tempPath.append(".tmp");
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof header, 1, file) == 1;
+    ok = ok && fwrite(&offsets[0], sizeof(u32), offsets.size(), file)
+               == offsets.size();
+    ok = ok && (data.empty() ||
+                fwrite(&data[0], 1, data.size(), file) == data.size());
+
+    if (fclose(file) != 0)
+        ok = false;
+    if (ok)
+        ok = rename(tempPath.c_str(), binaryPath) == 0;
+    if (!ok)
+        remove(tempPath.c_str());
+    return ok;
+}
+
+BinaryManifest::BinaryManifest()
+    : m_file()
+    , m_nEntries(0)
+    , m_offsets(NULL)
+    , m_data(NULL)
+{}
+
+bool BinaryManifest::LoadOrCompile(const char* textPath, const char* binaryPath)
+{
+    ASSERT(textPath);
+    ASSERT(binaryPath);
+
+    u64 textTimestamp = AssetPipelineOsFuncs::GetTimeStamp(textPath);
+    if (textTimestamp == 0)
+        return false; // The text manifest doesn't exist.
+
+    if (Load(binaryPath, textTimestamp))
+        return true;
+
+    return Compile(textPath, binaryPath) && Load(binaryPath, textTimestamp);
+}
+
+// Returns false if the binary manifest doesn't exist or wasn't compiled from
+// the current version of the text manifest.
+bool BinaryManifest::Load(const char* binaryPath, u64 textTimestamp)
+{
+    Unload();
+
+    if (!m_file.Open(binaryPath))
+        return false;
+
+    const char* data = (const char*)m_file.GetData();
+    size_t size = m_file.GetSize();
+
+    ManifestHeader header;
+    if (size < sizeof header) {
+        Unload();
+        return false;
+    }
+    memcpy(&header, data, sizeof header);
+
+    u64 expectedSize = sizeof header + ((u64)header.nEntries + 1) * sizeof(u32) +
+                       header.dataSize;
+    if (header.magic != MANIFEST_MAGIC || header.version != MANIFEST_VERSION ||
+        header.textTimestamp != textTimestamp || expectedSize != size) {
+        Unload();
+        return false;
+    }
+
+    m_nEntries = header.nEntries;
+    m_offsets = (const u32*)(data + sizeof header);
+    m_data = (const char*)(m_offsets + header.nEntries + 1);
+
+    if (m_offsets[m_nEntries] != header.dataSize) {
+        Unload();
+        return false;
+    }
+
+    return true;
+}
+
+void BinaryManifest::Unload()
+{
+    m_file.Close();
+    m_nEntries = 0;
+    m_offsets = NULL;
+    m_data = NULL;
+}
+
+bool BinaryManifest::IsLoaded() const
+{
+    return m_file.IsOpen();
+}
+
+u32 BinaryManifest::NumEntries() const
+{
+    return m_nEntries;
+}
+
+const char* BinaryManifest::GetEntry(u32 index) const
+{
+    ASSERT(index < m_nEntries);
+    return m_data + m_offsets[index];
+}
+
+size_t BinaryManifest::GetEntryLength(u32 index) const
+{
+    ASSERT(index < m_nEntries);
+    // Don't count the null terminator.
+    return m_offsets[index + 1] - m_offsets[index] - 1;
+}
@@ -0,0 +1,48 @@
+#ifndef PIPELINE_BINARYMANIFEST_H
+#define PIPELINE_BINARYMANIFEST_H
+
+#include <stddef.h>
+#include <Core/Types.h>
+#include <Os/MappedFile.h>
+
+// A precompiled form of a project's manifest (the text file listing the
+// assets to build, one path per line), which is memory mapped rather than
+// being read and split into lines on every build.
+//
+// The file holds an array of offsets followed by the null-terminated paths,
+// so entries can be read in place. It also records the timestamp of the text
+// manifest it was compiled from, so that it can be regenerated when that
+// changes.
+class BinaryManifest {
+public:
+    BinaryManifest();
+
+    // Returns false if the text manifest couldn't be read, or the binary
+    // manifest couldn't be written.
+    static bool Compile(const char* textPath, const char* binaryPath);
+
+    // Loads the binary manifest, first compiling it from the text manifest
+    // if it doesn't exist or is out of date. Returns false if the manifest
+    // can't be loaded.
+    bool LoadOrCompile(const char* textPath, const char* binaryPath);
+    void Unload();
+
+    bool IsLoaded() const;
+    u32 NumEntries() const;
+    // N.B. The returned string is null-terminated.
+    const char* GetEntry(u32 index) const;
+    size_t GetEntryLength(u32 index) const;
+
+private:
+    BinaryManifest(const BinaryManifest&);
+    BinaryManifest& operator=(const BinaryManifest&);
+
+    bool Load(const char* binaryPath, u64 textTimestamp);
+
+    MappedFile m_file;
+    u32 m_nEntries;
+    const u32* m_offsets;
+    const char* m_data;
+};
+
+#endif // PIPELINE_BINARYMANIFEST_H
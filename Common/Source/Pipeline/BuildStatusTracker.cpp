@@ -0,0 +1,260 @@
+#include "BuildStatusTracker.h"
+
+#include <algorithm>
+#include <Core/Macros.h>
+
+#include "ProjectDBConn.h"
+
+// Statuses are taken at most this often, however fast the build goes.
+const int STATUS_INTERVAL_MS = 250;
+// A rule's recorded duration counts for at most this many jobs, so that it
+// follows changes to the rule (or its inputs) reasonably quickly.
+const int MAX_HISTORY_SAMPLES = 50;
+const size_t MAX_REPORTED_RUNNING_PATHS = 16;
+
+static i64 ToMs(std::chrono::steady_clock::duration duration)
+{
+    return (i64)std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+BuildStatusTracker::Rule::Rule()
+    : nPlanned(0)
+    , nDone(0)
+    , historyAverageMs(0)
+    , historySamples(0)
+    , totalMs(0)
+    , nJobs(0)
+{}
+
+i64 BuildStatusTracker::Rule::GetAverageMs() const
+{
+    i64 historyWeight = std::min(historySamples, MAX_HISTORY_SAMPLES);
+    i64 nSamples = historyWeight + nJobs;
+    if (nSamples == 0)
+        return -1;
+    return (historyAverageMs * historyWeight + totalMs) / nSamples;
+}
+
+BuildStatusTracker::BuildStatusTracker()
+    : m_projID(-1)
+    , m_cpuSlots(1)
+    , m_startTime()
+    , m_lastStatusTime()
+    , m_rules()
+    , m_key()
+    , m_runningJobs()
+    , m_nextJobID(0)
+    , m_nExpected(0)
+    , m_nPlanned(0)
+    , m_nDone(0)
+    , m_nJobsFinished(0)
+    , m_busyMs(0)
+{}
+
+void BuildStatusTracker::BeginBuild(ProjectDBConn& dbConn, int projID, int cpuSlots)
+{
+    ASSERT(projID >= 0);
+    ASSERT(cpuSlots > 0);
+
+    m_projID = projID;
+    m_cpuSlots = cpuSlots;
+    m_startTime = Clock::now();
+    m_lastStatusTime = m_startTime;
+    m_runningJobs.clear();
+    m_nExpected = 0;
+    m_nPlanned = 0;
+    m_nDone = 0;
+    m_nJobsFinished = 0;
+    m_busyMs = 0;
+
+    m_rules.clear();
+    std::vector<RuleDuration> durations;
+    dbConn.QueryRuleDurations(projID, &durations);
+    for (size_t i = 0; i < durations.size(); ++i) {
+        Rule& rule = m_rules[durations[i].rule];
+        rule.historyAverageMs = durations[i].averageMs;
+        rule.historySamples = durations[i].nSamples;
+    }
+}
+
+void BuildStatusTracker::EndBuild(ProjectDBConn& dbConn)
+{
+    ASSERT(m_projID >= 0);
+
+    std::vector<RuleDuration> durations;
+    std::unordered_map<std::string, Rule>::const_iterator it;
+    for (it = m_rules.begin(); it != m_rules.end(); ++it) {
+        const Rule& rule = it->second;
+        if (rule.nJobs == 0 || it->first.empty())
+            continue;
+        RuleDuration duration;
+        duration.rule = it->first;
+        duration.averageMs = rule.GetAverageMs();
+        duration.nSamples = std::min(rule.historySamples + rule.nJobs, MAX_HISTORY_SAMPLES);
+        durations.push_back(duration);
+    }
+    dbConn.SetRuleDurations(m_projID, durations);
+
+    m_runningJobs.clear();
+}
+
+BuildStatusTracker::Rule* BuildStatusTracker::GetRule(const char* name)
+{
+    ASSERT(name);
+    m_key.assign(name);
+    return &m_rules[m_key];
+}
+
+void BuildStatusTracker::AddExpectedPaths(u32 count)
+{
+    m_nExpected += count;
+}
+
+void BuildStatusTracker::AllPathsPlanned()
+{
+    m_nExpected = m_nPlanned;
+}
+
+void BuildStatusTracker::AddPlannedPaths(const char* rule, u32 count)
+{
+    GetRule(rule)->nPlanned += count;
+    m_nPlanned += count;
+}
+
+void BuildStatusTracker::PathDone(const char* rule)
+{
+    ++GetRule(rule)->nDone;
+    ++m_nDone;
+}
+
+int BuildStatusTracker::JobStarted(const char* rule, const char* path)
+{
+    ASSERT(path);
+
+    RunningJob job;
+    job.id = m_nextJobID++;
+    job.rule = GetRule(rule);
+    job.path = path;
+    job.startTime = Clock::now();
+    m_runningJobs.push_back(job);
+    return job.id;
+}
+
+i64 BuildStatusTracker::JobFinished(int jobID, bool countDuration)
+{
+    std::vector<RunningJob>::iterator it = m_runningJobs.begin();
+    while (it != m_runningJobs.end() && it->id != jobID)
+        ++it;
+    ASSERT(it != m_runningJobs.end());
+
+    i64 ms = ToMs(Clock::now() - it->startTime);
+    if (countDuration) {
+        it->rule->totalMs += ms;
+        ++it->rule->nJobs;
+    }
+    m_busyMs += ms;
+    ++m_nJobsFinished;
+    m_runningJobs.erase(it);
+    return ms;
+}
+
+bool BuildStatusTracker::IsStatusDue() const
+{
+    return GetMsUntilStatusDue() == 0;
+}
+
+int BuildStatusTracker::GetMsUntilStatusDue() const
+{
+    i64 elapsedMs = ToMs(Clock::now() - m_lastStatusTime);
+    return (int)std::max((i64)STATUS_INTERVAL_MS - elapsedMs, (i64)0);
+}
+
+void BuildStatusTracker::TakeStatus(AssetBuildStatusInfo* status)
+{
+    ASSERT(status);
+
+    Clock::time_point now = Clock::now();
+    m_lastStatusTime = now;
+
+    status->projectID = m_projID;
+    status->nPathsDone = m_nDone;
+    status->nPathsTotal = std::max(m_nPlanned, m_nExpected);
+    status->nJobsRunning = (u32)m_runningJobs.size();
+    status->runningPaths.clear();
+    size_t nPaths = std::min(m_runningJobs.size(), MAX_REPORTED_RUNNING_PATHS);
+    for (size_t i = 0; i < nPaths; ++i)
+        status->runningPaths.push_back(m_runningJobs[i].path);
+    status->msRemaining = EstimateMsRemaining(now);
+    status->finished = false;
+    status->cancelled = false;
+}
+
+i64 BuildStatusTracker::EstimateMsRemaining(Clock::time_point now) const
+{
+    // Until a path has been dealt with, there's no telling how many of them
+    // need any work.
+    if (m_nDone == 0)
+        return AssetBuildStatusInfo::UNKNOWN_TIME;
+    double jobsPerPath = (double)m_nJobsFinished / m_nDone;
+
+    // Rules that haven't run any jobs yet are assumed to take as long as the
+    // average job.
+    i64 fallbackMs = -1;
+    if (m_nJobsFinished > 0) {
+        fallbackMs = m_busyMs / m_nJobsFinished;
+    } else {
+        i64 totalMs = 0;
+        int nRules = 0;
+        std::unordered_map<std::string, Rule>::const_iterator it;
+        for (it = m_rules.begin(); it != m_rules.end(); ++it) {
+            if (it->second.historySamples > 0) {
+                totalMs += it->second.historyAverageMs;
+                ++nRules;
+            }
+        }
+        if (nRules > 0)
+            fallbackMs = totalMs / nRules;
+    }
+
+    double workMs = 0.0;
+    std::unordered_map<std::string, Rule>::const_iterator it;
+    for (it = m_rules.begin(); it != m_rules.end(); ++it) {
+        const Rule& rule = it->second;
+        // Paths without a rule don't run anything.
+        if (it->first.empty() || rule.nDone >= rule.nPlanned)
+            continue;
+        i64 averageMs = rule.GetAverageMs();
+        if (averageMs < 0)
+            averageMs = fallbackMs;
+        if (averageMs < 0)
+            return AssetBuildStatusInfo::UNKNOWN_TIME;
+        workMs += (rule.nPlanned - rule.nDone) * jobsPerPath * (double)averageMs;
+    }
+    if (m_nExpected > m_nPlanned) {
+        if (fallbackMs < 0)
+            return AssetBuildStatusInfo::UNKNOWN_TIME;
+        workMs += (m_nExpected - m_nPlanned) * jobsPerPath * (double)fallbackMs;
+    }
+
+    i64 runningMs = 0;
+    for (size_t i = 0; i < m_runningJobs.size(); ++i) {
+        const RunningJob& job = m_runningJobs[i];
+        i64 elapsedMs = ToMs(now - job.startTime);
+        runningMs += elapsedMs;
+        i64 averageMs = job.rule->GetAverageMs();
+        if (averageMs < 0)
+            averageMs = fallbackMs;
+        if (averageMs > elapsedMs)
+            workMs += (double)(averageMs - elapsedMs);
+    }
+
+    // The jobs are spread over as many slots as they've managed to use so
+    // far.
+    i64 buildMs = ToMs(now - m_startTime);
+    double parallelism = (double)m_cpuSlots;
+    if (buildMs > 0)
+        parallelism = (double)(m_busyMs + runningMs) / (double)buildMs;
+    parallelism = std::max(1.0, std::min(parallelism, (double)m_cpuSlots));
+
+    return (i64)(workMs / parallelism);
+}
@@ -0,0 +1,106 @@
+#ifndef PIPELINE_BUILDSTATUSTRACKER_H
+#define PIPELINE_BUILDSTATUSTRACKER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <Core/Types.h>
+#include "AssetPipelineEvents.h"
+
+class ProjectDBConn;
+
+// Keeps track of how far through a build the pipeline is, and estimates how
+// long the rest of it will take.
+//
+// The build system says how many paths it expects to start from as soon as
+// it knows (e.g. the size of the manifest, or of a glob once it has been
+// expanded), and plans each path, by the rule that builds it, as it gets to
+// it. The total can grow as the build goes on. The time left is then worked
+// out from the paths that haven't been dealt with yet, how many jobs each
+// path has needed so far, and how long each rule's jobs have taken (both in
+// previous builds, which are kept in the database, and in this one). Paths
+// that haven't been planned yet are assumed to take as long as the average
+// job.
+//
+// Taking a status isn't free, so callers should only do it when one is due.
+class BuildStatusTracker {
+public:
+    BuildStatusTracker();
+
+    void BeginBuild(ProjectDBConn& dbConn, int projID, int cpuSlots);
+    // Records the durations of the jobs that finished during the build.
+    void EndBuild(ProjectDBConn& dbConn);
+
+    void AddExpectedPaths(u32 count);
+    // Called once every path has been planned, in case fewer were planned
+    // than were expected.
+    void AllPathsPlanned();
+    // rule is the name of the rule that builds the paths, or an empty string
+    // if there isn't one.
+    void AddPlannedPaths(const char* rule, u32 count);
+    void PathDone(const char* rule);
+    // Returns an ID to pass to JobFinished().
+    int JobStarted(const char* rule, const char* path);
+    // A job whose tools were killed (e.g. because the build was cancelled)
+    // shouldn't count towards the rule's duration. Returns how long the job
+    // took, in milliseconds.
+    i64 JobFinished(int jobID, bool countDuration);
+
+    // True if it has been long enough since the last status was taken.
+    bool IsStatusDue() const;
+    int GetMsUntilStatusDue() const;
+    void TakeStatus(AssetBuildStatusInfo* status);
+
+private:
+    BuildStatusTracker(const BuildStatusTracker&);
+    BuildStatusTracker& operator=(const BuildStatusTracker&);
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Rule {
+        Rule();
+
+        // Returns -1 if the rule has no jobs to go on.
+        i64 GetAverageMs() const;
+
+        u32 nPlanned;
+        u32 nDone;
+        // From previous builds.
+        i64 historyAverageMs;
+        int historySamples;
+        // From this build.
+        i64 totalMs;
+        int nJobs;
+    };
+
+    struct RunningJob {
+        int id;
+        Rule* rule;
+        std::string path;
+        Clock::time_point startTime;
+    };
+
+    Rule* GetRule(const char* name);
+    i64 EstimateMsRemaining(Clock::time_point now) const;
+
+    int m_projID;
+    int m_cpuSlots;
+    Clock::time_point m_startTime;
+    Clock::time_point m_lastStatusTime;
+    // N.B. Pointers to the rules are kept by the running jobs, which is fine
+    // as the elements of an unordered_map don't move.
+    std::unordered_map<std::string, Rule> m_rules;
+    // Reused to look rules up without allocating.
+    std::string m_key;
+    std::vector<RunningJob> m_runningJobs;
+    int m_nextJobID;
+    u32 m_nExpected;
+    u32 m_nPlanned;
+    u32 m_nDone;
+    u32 m_nJobsFinished;
+    // The time taken by all the jobs that have finished, added up.
+    i64 m_busyMs;
+};
+
+#endif // PIPELINE_BUILDSTATUSTRACKER_H
@@ -0,0 +1,323 @@
+#include "DependencySnapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <Core/Macros.h>
+
+// N.B. Snapshots are only ever read on the machine that wrote them, so
+// everything is stored in native byte order. (A snapshot from a machine with
+// the opposite byte order would fail the magic number check.)
+const u32 SNAPSHOT_MAGIC = 0x47445041; // "APDG"
+const u32 SNAPSHOT_VERSION = 1;
+
+// The header is followed by the arrays:
+//   u32 pathOffsets[nPaths + 1]  offsets into pathData, of the sorted paths
+//   u32 rowStarts[nPaths + 1]    indices into dependents, per input path
+//   u32 dependents[nEdges]       indices of output paths
+//   char pathData[pathDataSize]  null-terminated paths
+struct SnapshotHeader {
+    u32 magic;
+    u32 version;
+    i32 projID;
+    u32 nPaths;
+    i64 generation;
+    u32 nEdges;
+    u32 pathDataSize;
+};
+
+namespace {
+    struct PathLess {
+        const PathTable* paths;
+
+        bool operator()(PathID a, PathID b) const
+        {
+            return strcmp(paths->GetPath(a), paths->GetPath(b)) < 0;
+        }
+    };
+}
+
+bool DependencySnapshot::Write(const char* path, int projID, i64 generation,
+                               const PathTable& paths,
+                               const std::vector<DependencyEdge>& edges)
+{
+    ASSERT(path);
+    ASSERT(projID >= 0);
+
+    u32 nPaths = (u32)paths.NumPaths();
+
+    // Sort the paths, and work out where each one ends up.
+    std::vector<PathID> sorted(nPaths);
+    for (u32 i = 0; i < nPaths; ++i)
+        sorted[i] = i;
+    PathLess less = { &paths };
+    std::sort(sorted.begin(), sorted.end(), less);
+
+    std::vector<u32> indices(nPaths);
+    std::vector<u32> pathOffsets(nPaths + 1);
+    u32 pathDataSize = 0;
+    for (u32 i = 0; i < nPaths; ++i) {
+        indices[sorted[i]] = i;
+        pathOffsets[i] = pathDataSize;
+        pathDataSize += (u32)paths.GetPathLength(sorted[i]) + 1;
+    }
+    pathOffsets[nPaths] = pathDataSize;
+
+    // Sort the edges by input, then output, dropping any duplicates.
+    std::vector<u64> sortedEdges(edges.size());
+    for (size_t i = 0; i < edges.size(); ++i) {
+        sortedEdges[i] = ((u64)indices[edges[i].inputPath] << 32) |
+                         indices[edges[i].outputPath];
+    }
+    std::sort(sortedEdges.begin(), sortedEdges.end());
+    sortedEdges.erase(std::unique(sortedEdges.begin(), sortedEdges.end()),
+                      sortedEdges.end());
+
+    std::vector<u32> rowStarts(nPaths + 1, 0);
+    std::vector<u32> dependents(sortedEdges.size());
+    for (size_t i = 0; i < sortedEdges.size(); ++i) {
+        ++rowStarts[(u32)(sortedEdges[i] >> 32) + 1];
+        dependents[i] = (u32)sortedEdges[i];
+    }
+    for (u32 i = 0; i < nPaths; ++i)
+        rowStarts[i + 1] += rowStarts[i];
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof header);
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.projID = projID;
+    header.nPaths = nPaths;
+    header.generation = generation;
+    header.nEdges = (u32)dependents.size();
+    header.pathDataSize = pathDataSize;
+
+    // Write to a temporary file, then move it into place.
+    std::string tempPath(path);
+    tempPath.append(".tmp");
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof header, 1, file) == 1;
+    ok = ok && fwrite(&pathOffsets[0], sizeof(u32), pathOffsets.size(), file)
+               == pathOffsets.size();
+    ok = ok && fwrite(&rowStarts[0], sizeof(u32), rowStarts.size(), file)
+               == rowStarts.size();
+    ok = ok && (dependents.empty() ||
+                fwrite(&dependents[0], sizeof(u32), dependents.size(), file)
+                == dependents.size());
+    for (u32 i = 0; ok && i < nPaths; ++i) {
+        size_t size = paths.GetPathLength(sorted[i]) + 1;
+        ok = fwrite(paths.GetPath(sorted[i]), 1, size, file) == size;
+    }
+
+    if (fclose(file) != 0)
+        ok = false;
+    if (ok)
+        ok = rename(tempPath.c_str(), path) == 0;
+    if (!ok)
+        remove(tempPath.c_str());
+    return ok;
+}
+
+DependencySnapshot::DependencySnapshot()
+    : m_file()
+    , m_projID(-1)
+    , m_generation(0)
+    , m_nPaths(0)
+    , m_pathOffsets(NULL)
+    , m_rowStarts(NULL)
+    , m_dependents(NULL)
+    , m_pathData(NULL)
+    , m_changedInputs()
+    , m_changedDependents()
+{}
+
+bool DependencySnapshot::Load(const char* path, int projID)
+{
+    ASSERT(path);
+
+    Unload();
+
+    if (!m_file.Open(path))
+        return false;
+
+    const char* data = (const char*)m_file.GetData();
+    size_t size = m_file.GetSize();
+
+    SnapshotHeader header;
+    if (size < sizeof header) {
+        Unload();
+        return false;
+    }
+    memcpy(&header, data, sizeof header);
+
+    // Check that the arrays actually fit in the file, in case it's been
+    // truncated or corrupted.
+    u64 expectedSize = sizeof header +
+                       ((u64)header.nPaths + 1) * 2 * sizeof(u32) +
+                       (u64)header.nEdges * sizeof(u32) +
+                       header.pathDataSize;
+    if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+        header.projID != projID || expectedSize != size) {
+        Unload();
+        return false;
+    }
+
+    m_projID = projID;
+    m_generation = header.generation;
+    m_nPaths = header.nPaths;
+    m_pathOffsets = (const u32*)(data + sizeof header);
+    m_rowStarts = m_pathOffsets + header.nPaths + 1;
+    m_dependents = m_rowStarts + header.nPaths + 1;
+    m_pathData = (const char*)(m_dependents + header.nEdges);
+
+    if (!AreArraysValid(header.nEdges, header.pathDataSize)) {
+        Unload();
+        return false;
+    }
+
+    return true;
+}
+
+// Checks everything that lookups rely on, so that a corrupted file can't
+// make them read outside of it: the offsets and row starts must be in order
+// and in range, every path must be null-terminated, and every dependent must
+// be a valid path index.
+bool DependencySnapshot::AreArraysValid(u32 nEdges, u32 pathDataSize) const
+{
+    if (m_pathOffsets[0] != 0 || m_pathOffsets[m_nPaths] != pathDataSize ||
+        m_rowStarts[0] != 0 || m_rowStarts[m_nPaths] != nEdges)
+        return false;
+
+    for (u32 i = 0; i < m_nPaths; ++i) {
+        // Each path takes up at least its null terminator.
+        if (m_pathOffsets[i + 1] <= m_pathOffsets[i] ||
+            m_pathOffsets[i + 1] > pathDataSize ||
+            m_pathData[m_pathOffsets[i + 1] - 1] != '\0')
+            return false;
+        if (m_rowStarts[i + 1] < m_rowStarts[i] || m_rowStarts[i + 1] > nEdges)
+            return false;
+    }
+
+    for (u32 i = 0; i < nEdges; ++i) {
+        if (m_dependents[i] >= m_nPaths)
+            return false;
+    }
+
+    return true;
+}
+
+void DependencySnapshot::Unload()
+{
+    m_file.Close();
+    m_projID = -1;
+    m_generation = 0;
+    m_nPaths = 0;
+    m_pathOffsets = NULL;
+    m_rowStarts = NULL;
+    m_dependents = NULL;
+    m_pathData = NULL;
+    m_changedInputs.clear();
+    m_changedDependents.clear();
+}
+
+bool DependencySnapshot::IsLoaded() const
+{
+    return m_file.IsOpen();
+}
+
+int DependencySnapshot::GetProjectID() const
+{
+    return m_projID;
+}
+
+i64 DependencySnapshot::GetGeneration() const
+{
+    return m_generation;
+}
+
+u32 DependencySnapshot::GetNumPaths() const
+{
+    return m_nPaths;
+}
+
+void DependencySnapshot::GetDependents(const char* inputFile,
+                                       std::vector<std::string>* outputFiles) const
+{
+    ASSERT(inputFile);
+    ASSERT(outputFiles);
+    ASSERT(IsLoaded());
+
+    outputFiles->clear();
+
+    // Outputs whose dependencies have been set in memory are skipped in the
+    // file, and looked up in memory instead.
+    i64 index = FindPath(inputFile);
+    if (index != -1) {
+        for (u32 i = m_rowStarts[index]; i < m_rowStarts[index + 1]; ++i) {
+            const char* outputFile = m_pathData + m_pathOffsets[m_dependents[i]];
+            if (m_changedInputs.empty() ||
+                m_changedInputs.find(outputFile) == m_changedInputs.end())
+                outputFiles->push_back(outputFile);
+        }
+    }
+
+    std::unordered_map<std::string, std::vector<std::string>>::const_iterator it =
+        m_changedDependents.find(inputFile);
+    if (it != m_changedDependents.end())
+        outputFiles->insert(outputFiles->end(), it->second.begin(), it->second.end());
+}
+
+void DependencySnapshot::SetDependencies(const std::string& outputFile,
+                                         const std::vector<std::string>& inputFiles)
+{
+    ASSERT(IsLoaded());
+
+    std::vector<std::string>& inputs = m_changedInputs[outputFile];
+
+    // Forget the output's previous inputs.
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::vector<std::string>& dependents = m_changedDependents[inputs[i]];
+        dependents.erase(std::find(dependents.begin(), dependents.end(), outputFile));
+        if (dependents.empty())
+            m_changedDependents.erase(inputs[i]);
+    }
+
+    // N.B. An output with no inputs is still recorded, so that its
+    // dependencies in the file are ignored.
+    inputs = inputFiles;
+    std::sort(inputs.begin(), inputs.end());
+    inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+    for (size_t i = 0; i < inputs.size(); ++i)
+        m_changedDependents[inputs[i]].push_back(outputFile);
+}
+
+void DependencySnapshot::SetGeneration(i64 generation)
+{
+    ASSERT(IsLoaded());
+    m_generation = generation;
+}
+
+size_t DependencySnapshot::GetNumChangedOutputs() const
+{
+    return m_changedInputs.size();
+}
+
+i64 DependencySnapshot::FindPath(const char* path) const
+{
+    u32 lo = 0;
+    u32 hi = m_nPaths;
+    while (lo < hi) {
+        u32 mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(m_pathData + m_pathOffsets[mid], path);
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
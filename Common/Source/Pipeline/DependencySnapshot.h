@@ -0,0 +1,80 @@
+#ifndef PIPELINE_DEPENDENCYSNAPSHOT_H
+#define PIPELINE_DEPENDENCYSNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <Core/Types.h>
+#include <Os/MappedFile.h>
+#include "PathTable.h"
+#include "ProjectDBConn.h"
+
+// A read-only copy of a project's dependency graph, stored in a file that's
+// memory mapped, so that it can be loaded without reading (or parsing) the
+// whole thing.
+//
+// The file holds the graph in compressed sparse row form: the paths are
+// sorted and given indices in that order, and the dependents of each input
+// path are stored contiguously. Looking up a path is a binary search.
+//
+// Each snapshot records the generation of the dependencies it was made from,
+// so that it can be checked against the project database before being used.
+//
+// Rather than writing a new file whenever a few outputs' dependencies change,
+// the changes can be applied on top of the loaded file, in memory.
+class DependencySnapshot {
+public:
+    DependencySnapshot();
+
+    // Writes a snapshot of the given dependencies. The file is replaced
+    // atomically, so it's safe to write a snapshot while an older one is
+    // loaded. Returns false if the file couldn't be written.
+    static bool Write(const char* path, int projID, i64 generation,
+                      const PathTable& paths,
+                      const std::vector<DependencyEdge>& edges);
+
+    // Returns false (and leaves the snapshot unloaded) if the file doesn't
+    // exist or isn't a valid snapshot for the project.
+    bool Load(const char* path, int projID);
+    void Unload();
+
+    bool IsLoaded() const;
+    int GetProjectID() const;
+    i64 GetGeneration() const;
+    u32 GetNumPaths() const;
+
+    void GetDependents(const char* inputFile,
+                       std::vector<std::string>* outputFiles) const;
+
+    // Replaces the dependencies of the output file, in memory only.
+    void SetDependencies(const std::string& outputFile,
+                         const std::vector<std::string>& inputFiles);
+    // Sets the generation once the changes since the previous one have all
+    // been applied.
+    void SetGeneration(i64 generation);
+    // The number of outputs whose dependencies have been set in memory.
+    size_t GetNumChangedOutputs() const;
+
+private:
+    DependencySnapshot(const DependencySnapshot&);
+    DependencySnapshot& operator=(const DependencySnapshot&);
+
+    bool AreArraysValid(u32 nEdges, u32 pathDataSize) const;
+    // Returns -1 if the path isn't in the snapshot.
+    i64 FindPath(const char* path) const;
+
+    MappedFile m_file;
+    int m_projID;
+    i64 m_generation;
+    u32 m_nPaths;
+    const u32* m_pathOffsets;
+    const u32* m_rowStarts;
+    const u32* m_dependents;
+    const char* m_pathData;
+    // Outputs whose dependencies have been set in memory, with their inputs
+    // (which replace any in the file), and the reverse mapping.
+    std::unordered_map<std::string, std::vector<std::string>> m_changedInputs;
+    std::unordered_map<std::string, std::vector<std::string>> m_changedDependents;
+};
+
+#endif // PIPELINE_DEPENDENCYSNAPSHOT_H
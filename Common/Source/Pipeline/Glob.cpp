@@ -0,0 +1,169 @@
+#include "Glob.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <Core/Macros.h>
+
+static bool IsWildcard(char c)
+{
+    return c == '*' || c == '?' || c == '[';
+}
+
+// pattern points at the '['. If the set is well formed, sets *end to point
+// just past the closing ']' and returns whether c is in the set. Otherwise,
+// sets *end to NULL (and the '[' is treated as an ordinary character).
+static bool MatchCharSet(const char* pattern, char c, const char** end)
+{
+    const char* p = pattern + 1;
+    bool negate = false;
+    if (*p == '!' || *p == '^') {
+        negate = true;
+        ++p;
+    }
+
+    bool matched = false;
+    // N.B. A ']' straight after the '[' is part of the set.
+    bool first = true;
+    while (*p != '\0' && (*p != ']' || first)) {
+        first = false;
+        char lo = *p;
+        char hi = lo;
+        if (p[1] == '-' && p[2] != '\0' && p[2] != ']') {
+            hi = p[2];
+            p += 3;
+        } else {
+            ++p;
+        }
+        if (lo <= c && c <= hi)
+            matched = true;
+    }
+    if (*p != ']') {
+        *end = NULL;
+        return false;
+    }
+
+    *end = p + 1;
+    return matched != negate;
+}
+
+// Adds the states that can be reached from the active ones without matching
+// a character, i.e. by a '*' or '**' not matching any more. These only lead
+// further into the pattern, so one pass through it is enough.
+//
+// N.B. The state at the first '*' of a '**' is before it has matched
+// anything, and the state at the second is after it's matched something.
+// The difference is that only the first can skip a following '/', since
+// "**/" matches either no directories at all, or something ending in '/'.
+static void AddEmptyMatches(const char* pattern, size_t length, char* active)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (pattern[i] != '*')
+            continue;
+        if (pattern[i + 1] == '*') {
+            if (active[i] && pattern[i + 2] == '/')
+                active[i + 3] = 1;
+            if (active[i] || active[i + 1])
+                active[i + 2] = 1;
+            ++i;
+        } else if (active[i]) {
+            active[i + 1] = 1;
+        }
+    }
+}
+
+// The pattern is matched by keeping track of every position in it that the
+// path so far could have reached, rather than by trying each way that the
+// wildcards could match in turn. So the time taken is at worst proportional
+// to the product of the lengths, however many wildcards there are.
+bool GlobMatch(const char* pattern, const char* path)
+{
+    ASSERT(pattern);
+    ASSERT(path);
+
+    size_t length = strlen(pattern);
+
+    // Most patterns are short enough not to need to allocate the states.
+    const size_t MAX_STACK_STATES = 128;
+    char stackStates[2 * MAX_STACK_STATES];
+    std::vector<char> heapStates;
+    char* active = stackStates;
+    if (length + 1 > MAX_STACK_STATES) {
+        heapStates.resize(2 * (length + 1));
+        active = &heapStates[0];
+    }
+    char* next = active + length + 1;
+
+    memset(active, 0, length + 1);
+    active[0] = 1;
+    AddEmptyMatches(pattern, length, active);
+
+    for (const char* s = path; *s != '\0'; ++s) {
+        char c = *s;
+        memset(next, 0, length + 1);
+        bool anyActive = false;
+
+        for (size_t i = 0; i < length; ++i) {
+            if (pattern[i] == '*' && pattern[i + 1] == '*') {
+                if (active[i] || active[i + 1])
+                    next[i + 1] = 1;
+                ++i;
+                continue;
+            }
+            if (!active[i])
+                continue;
+            switch (pattern[i]) {
+            case '*':
+                if (c != '/')
+                    next[i] = 1;
+                break;
+
+            case '?':
+                if (c != '/')
+                    next[i + 1] = 1;
+                break;
+
+            case '[': {
+                if (c == '/')
+                    break;
+                const char* end;
+                bool inSet = MatchCharSet(pattern + i, c, &end);
+                if (end) {
+                    if (inSet)
+                        next[end - pattern] = 1;
+                } else if (c == '[') {
+                    // Not a well-formed set, so match the '[' literally.
+                    next[i + 1] = 1;
+                }
+                break;
+            }
+
+            default:
+                if (pattern[i] == c)
+                    next[i + 1] = 1;
+                break;
+            }
+        }
+
+        AddEmptyMatches(pattern, length, next);
+        for (size_t i = 0; i <= length; ++i)
+            anyActive = anyActive || next[i];
+        if (!anyActive)
+            return false;
+        std::swap(active, next);
+    }
+
+    return active[length] != 0;
+}
+
+std::string GlobBaseDirectory(const char* pattern)
+{
+    ASSERT(pattern);
+
+    size_t baseLength = 0;
+    for (const char* p = pattern; *p != '\0' && !IsWildcard(*p); ++p) {
+        if (*p == '/')
+            baseLength = (size_t)(p - pattern);
+    }
+    return std::string(pattern, baseLength);
+}
@@ -0,0 +1,19 @@
+#ifndef PIPELINE_GLOB_H
+#define PIPELINE_GLOB_H
+
+#include <string>
+
+// Returns true if the path matches the glob pattern. '*' matches any run of
+// characters other than '/', '**' matches any run of characters at all (so
+// "a/**/b" matches "a/b" and "a/x/y/b"), '?' matches one character other than
+// '/', and "[...]" matches one of a set of characters (with ranges like
+// "[a-z]", and '!' or '^' at the start to negate the set).
+bool GlobMatch(const char* pattern, const char* path);
+
+// Returns the directory that every path matching the pattern must be in,
+// i.e. the components of the pattern before the first one with a wildcard.
+// For example, this is "content/textures" for "content/textures/**.png", and
+// an empty string for "*.png".
+std::string GlobBaseDirectory(const char* pattern);
+
+#endif // PIPELINE_GLOB_H
@@ -0,0 +1,222 @@
+#include "GlobCache.h"
+
+#include <string.h>
+#include <Core/Macros.h>
+
+#include "AssetPipelineOsFuncs.h"
+#include "Glob.h"
+
+static std::string JoinPath(const std::string& a, const std::string& b)
+{
+    if (a.empty())
+        return b;
+    if (b.empty())
+        return a;
+    return a + "/" + b;
+}
+
+// Beyond this many changed paths, the cached expansions are dropped instead.
+const size_t MAX_CHANGED_PATHS = 4096;
+
+static void StripTrailingSlashes(std::string* path)
+{
+    while (!path->empty() && path->back() == '/')
+        path->pop_back();
+}
+
+GlobCache::GlobCache()
+    : m_walker()
+    , m_mutex()
+    , m_rootDir()
+    , m_watchedDir()
+    , m_watching(false)
+    , m_generation(0)
+    , m_expansions()
+    , m_nExpanding(0)
+    , m_changedPaths()
+{}
+
+void GlobCache::Reset(const char* rootDir, const char* watchedDir)
+{
+    ASSERT(rootDir);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rootDir = rootDir;
+    StripTrailingSlashes(&m_rootDir);
+    m_watching = (watchedDir != NULL);
+    m_watchedDir = watchedDir ? watchedDir : "";
+    StripTrailingSlashes(&m_watchedDir);
+    ++m_generation;
+    m_expansions.clear();
+}
+
+bool GlobCache::IsWatched(const std::string& dir) const
+{
+    if (!m_watching)
+        return false;
+    if (m_watchedDir.empty())
+        return true;
+    return dir.compare(0, m_watchedDir.length(), m_watchedDir) == 0 &&
+           (dir.length() == m_watchedDir.length() ||
+            dir[m_watchedDir.length()] == '/');
+}
+
+void GlobCache::Expand(const char* pattern, std::vector<std::string>* paths)
+{
+    ASSERT(pattern);
+    ASSERT(paths);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    paths->clear();
+
+    ApplyChanges(lock);
+    std::map<std::string, PathSet>::const_iterator it = m_expansions.find(pattern);
+    if (it != m_expansions.end()) {
+        paths->assign(it->second.begin(), it->second.end());
+        return;
+    }
+
+    std::string baseDir = GlobBaseDirectory(pattern);
+    std::string fullDir = JoinPath(m_rootDir, baseDir);
+    u32 generation = m_generation;
+    ++m_nExpanding;
+
+    lock.unlock();
+
+    std::vector<std::string> files;
+    m_walker.ListFiles(fullDir.c_str(), &files);
+    PathSet matches;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string path = JoinPath(baseDir, files[i]);
+        if (GlobMatch(pattern, path.c_str()))
+            matches.insert(path);
+    }
+
+    lock.lock();
+
+    --m_nExpanding;
+    if (generation == m_generation && IsWatched(baseDir)) {
+        // Anything that changed during the walk is applied along with the
+        // rest of the changes. (Rescanning a path that the walk already saw
+        // does no harm.)
+        m_expansions[pattern].swap(matches);
+        ApplyChanges(lock);
+        it = m_expansions.find(pattern);
+        if (it != m_expansions.end())
+            paths->assign(it->second.begin(), it->second.end());
+    } else {
+        paths->assign(matches.begin(), matches.end());
+    }
+    if (m_expansions.empty() && m_nExpanding == 0)
+        m_changedPaths.clear();
+}
+
+void GlobCache::ApplyChanges(std::unique_lock<std::mutex>& lock)
+{
+    if (m_changedPaths.empty() || m_expansions.empty())
+        return;
+
+    std::vector<ScannedPath> scanned(m_changedPaths.size());
+    PathSet::const_iterator changed = m_changedPaths.begin();
+    for (size_t i = 0; i < scanned.size(); ++i, ++changed)
+        scanned[i].relPath = *changed;
+    m_changedPaths.clear();
+    std::string rootDir = m_rootDir;
+    u32 generation = m_generation;
+
+    lock.unlock();
+    for (size_t i = 0; i < scanned.size(); ++i)
+        ScanPath(rootDir, &scanned[i]);
+    lock.lock();
+
+    // The expansions that the paths were scanned for are gone.
+    if (generation != m_generation)
+        return;
+
+    std::map<std::string, PathSet>::iterator it = m_expansions.begin();
+    for (; it != m_expansions.end(); ++it) {
+        for (size_t i = 0; i < scanned.size(); ++i)
+            UpdateExpansion(it->first.c_str(), scanned[i], &it->second);
+    }
+}
+
+void GlobCache::ScanPath(const std::string& rootDir, ScannedPath* scanned)
+{
+    ASSERT(scanned);
+
+    std::string fullPath = JoinPath(rootDir, scanned->relPath);
+    std::vector<std::string>& files = scanned->files;
+    files.clear();
+    if (m_walker.ListFiles(fullPath.c_str(), &files)) {
+        std::string dirPrefix = scanned->relPath + "/";
+        for (size_t i = 0; i < files.size(); ++i)
+            files[i] = dirPrefix + files[i];
+    } else if (AssetPipelineOsFuncs::GetTimeStamp(fullPath.c_str()) != 0) {
+        files.push_back(scanned->relPath);
+    }
+}
+
+void GlobCache::UpdateExpansion(const char* pattern, const ScannedPath& scanned,
+                                PathSet* paths)
+{
+    ASSERT(pattern);
+    ASSERT(paths);
+
+    // Whatever happened to the path, forget what was known about it (and
+    // anything below it, in case it's a directory), and then add back
+    // whatever is there now.
+    std::string dirPrefix = scanned.relPath + "/";
+    paths->erase(scanned.relPath);
+    PathSet::iterator first = paths->lower_bound(dirPrefix);
+    PathSet::iterator last = first;
+    while (last != paths->end() &&
+           last->compare(0, dirPrefix.length(), dirPrefix) == 0)
+        ++last;
+    paths->erase(first, last);
+
+    for (size_t i = 0; i < scanned.files.size(); ++i) {
+        if (GlobMatch(pattern, scanned.files[i].c_str()))
+            paths->insert(scanned.files[i]);
+    }
+}
+
+void GlobCache::OnPathChanged(const char* path)
+{
+    ASSERT(path);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_expansions.empty() && m_nExpanding == 0)
+        return;
+    size_t rootLength = m_rootDir.length();
+    if (strncmp(path, m_rootDir.c_str(), rootLength) != 0 || path[rootLength] != '/')
+        return;
+    std::string relPath(path + rootLength + 1);
+    StripTrailingSlashes(&relPath);
+    if (relPath.empty())
+        return;
+
+    // If lots of paths have changed (e.g. a big checkout), walking the
+    // directories afresh is cheaper than rescanning them all one by one.
+    if (m_changedPaths.size() >= MAX_CHANGED_PATHS) {
+        ForgetExpansions();
+        return;
+    }
+    m_changedPaths.insert(relPath);
+}
+
+void GlobCache::OnRescanRequired()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ForgetExpansions();
+}
+
+// Expansions that are in progress aren't cached when they finish, since the
+// generation has changed.
+void GlobCache::ForgetExpansions()
+{
+    ++m_generation;
+    m_expansions.clear();
+    m_changedPaths.clear();
+}
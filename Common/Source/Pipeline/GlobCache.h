@@ -0,0 +1,86 @@
+#ifndef PIPELINE_GLOBCACHE_H
+#define PIPELINE_GLOBCACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <Core/Types.h>
+#include <Os/DirectoryWalker.h>
+
+// Expands the glob patterns in a project's manifest into the files that match
+// them, caching the results so that a big content tree doesn't have to be
+// walked on every build. The cache is kept up to date from file system watcher
+// events, so only patterns within the watched directory are cached; others
+// are expanded afresh every time.
+//
+// Changed paths are only recorded when the events arrive. They're rescanned
+// the next time a pattern is expanded, without holding the lock, so neither
+// the watcher's thread nor anything else waits for a directory walk.
+//
+// All functions may be called from any thread.
+class GlobCache {
+public:
+    GlobCache();
+
+    // Forgets all cached expansions. Patterns and paths are relative to
+    // rootDir, and watchedDir (which may be NULL) is the directory, relative
+    // to rootDir, whose changes are passed to OnPathChanged().
+    void Reset(const char* rootDir, const char* watchedDir);
+
+    // Replaces the contents of paths with the files matching the pattern, in
+    // sorted order.
+    void Expand(const char* pattern, std::vector<std::string>* paths);
+
+    // Called when a file or directory has been created, removed, renamed or
+    // modified. N.B. The path is absolute.
+    void OnPathChanged(const char* path);
+    // Called when changes may have been missed, so that nothing that's
+    // cached can be trusted.
+    void OnRescanRequired();
+
+private:
+    GlobCache(const GlobCache&);
+    GlobCache& operator=(const GlobCache&);
+
+    typedef std::set<std::string> PathSet;
+
+    // What a changed path (and anything below it) holds now.
+    struct ScannedPath {
+        std::string relPath;
+        std::vector<std::string> files;
+    };
+
+    bool IsWatched(const std::string& dir) const;
+    // Needs the lock.
+    void ForgetExpansions();
+    // Brings the cached expansions up to date with the paths that have
+    // changed. N.B. The lock is released while the paths are scanned.
+    void ApplyChanges(std::unique_lock<std::mutex>& lock);
+    // Doesn't need the lock.
+    void ScanPath(const std::string& rootDir, ScannedPath* scanned);
+    static void UpdateExpansion(const char* pattern, const ScannedPath& scanned,
+                                PathSet* paths);
+
+    DirectoryWalker m_walker;
+
+    std::mutex m_mutex;
+    // The following are protected by m_mutex.
+    std::string m_rootDir;
+    std::string m_watchedDir;
+    bool m_watching;
+    // Incremented by Reset(), so that an expansion that was started before a
+    // reset isn't cached afterwards.
+    u32 m_generation;
+    // Keyed by pattern.
+    std::map<std::string, PathSet> m_expansions;
+    // Changes are recorded while a pattern is being expanded too, since the
+    // walk may have missed them.
+    int m_nExpanding;
+    // The paths (relative to the root directory) that have changed since the
+    // expansions were last brought up to date.
+    PathSet m_changedPaths;
+};
+
+#endif // PIPELINE_GLOBCACHE_H
@@ -0,0 +1,165 @@
+#include "JobScheduler.h"
+
+#include <iterator>
+
+#include <Core/Macros.h>
+
+JobResources::JobResources()
+    : cpuSlots(1)
+    , memoryMB(0)
+    , pool()
+{}
+
+JobScheduler::JobScheduler()
+    : m_cpuSlots(1)
+    , m_memoryMB(0)
+    , m_nRunningJobs(0)
+    , m_usedCpuSlots(0)
+    , m_usedMemoryMB(0)
+    , m_pools()
+
+    , m_nextProcessID(0)
+    , m_running()
+    , m_finished()
+    , m_waitProcesses()
+{}
+
+JobScheduler::~JobScheduler()
+{
+    int processID;
+    while (WaitForProcess(&processID)) {}
+}
+
+void JobScheduler::Reset(int cpuSlots, u64 memoryMB)
+{
+    ASSERT(cpuSlots > 0);
+    ASSERT(m_nRunningJobs == 0);
+
+    m_cpuSlots = cpuSlots;
+    m_memoryMB = memoryMB;
+}
+
+void JobScheduler::SetPoolDepth(const std::string& name, int depth)
+{
+    ASSERT(!name.empty());
+    ASSERT(depth > 0);
+    ASSERT(m_nRunningJobs == 0);
+
+    Pool& pool = m_pools[name];
+    pool.depth = depth;
+    pool.nRunning = 0;
+}
+
+bool JobScheduler::HasPool(const std::string& name) const
+{
+    return m_pools.find(name) != m_pools.end();
+}
+
+void JobScheduler::ClearPools()
+{
+    ASSERT(m_nRunningJobs == 0);
+    m_pools.clear();
+}
+
+bool JobScheduler::HasFreeSlot() const
+{
+    return m_nRunningJobs == 0 || m_usedCpuSlots < m_cpuSlots;
+}
+
+JobScheduler::AcquireResult JobScheduler::TryAcquire(const JobResources& resources)
+{
+    Pool* pool = NULL;
+    if (!resources.pool.empty()) {
+        std::map<std::string, Pool>::iterator it = m_pools.find(resources.pool);
+        ASSERT(it != m_pools.end());
+        pool = &it->second;
+        if (pool->nRunning >= pool->depth)
+            return POOL_FULL;
+    }
+
+    // Jobs that would never fit are let through when nothing else is running,
+    // since waiting won't make any more room for them.
+    if (m_nRunningJobs > 0) {
+        if (m_usedCpuSlots + resources.cpuSlots > m_cpuSlots)
+            return NO_CAPACITY;
+        if (m_memoryMB != 0 && m_usedMemoryMB + resources.memoryMB > m_memoryMB)
+            return NO_CAPACITY;
+    }
+
+    ++m_nRunningJobs;
+    m_usedCpuSlots += resources.cpuSlots;
+    m_usedMemoryMB += resources.memoryMB;
+    if (pool)
+        ++pool->nRunning;
+    return ACQUIRED;
+}
+
+void JobScheduler::Release(const JobResources& resources)
+{
+    ASSERT(m_nRunningJobs > 0);
+
+    --m_nRunningJobs;
+    m_usedCpuSlots -= resources.cpuSlots;
+    m_usedMemoryMB -= resources.memoryMB;
+    if (!resources.pool.empty()) {
+        std::map<std::string, Pool>::iterator it = m_pools.find(resources.pool);
+        ASSERT(it != m_pools.end());
+        --it->second.nRunning;
+    }
+}
+
+int JobScheduler::StartProcess(const std::vector<std::string>& args,
+                               ProcessTracker* tracker)
+{
+    ASSERT(!args.empty());
+
+    std::vector<const char*> argPtrs;
+    for (size_t i = 0; i < args.size(); ++i)
+        argPtrs.push_back(args[i].c_str());
+    argPtrs.push_back(NULL);
+
+    int processID = m_nextProcessID++;
+    std::unique_ptr<Process> process(new Process());
+    process->Start(argPtrs[0], argPtrs, tracker);
+    if (process->IsRunning())
+        m_running[processID] = std::move(process);
+    else
+        m_finished.push_back(std::make_pair(processID, process.release()));
+    return processID;
+}
+
+bool JobScheduler::HasProcesses() const
+{
+    return !m_finished.empty() || !m_running.empty();
+}
+
+std::unique_ptr<Process> JobScheduler::WaitForProcess(int* processID, int timeoutMs)
+{
+    ASSERT(processID);
+
+    if (!m_finished.empty()) {
+        std::pair<int, Process*> finished = m_finished.front();
+        m_finished.pop_front();
+        *processID = finished.first;
+        return std::unique_ptr<Process>(finished.second);
+    }
+
+    if (m_running.empty())
+        return std::unique_ptr<Process>();
+
+    m_waitProcesses.clear();
+    std::map<int, std::unique_ptr<Process>>::iterator it;
+    for (it = m_running.begin(); it != m_running.end(); ++it)
+        m_waitProcesses.push_back(it->second.get());
+
+    size_t index;
+    if (!WaitForAnyProcess(&m_waitProcesses[0], m_waitProcesses.size(), timeoutMs, &index))
+        return std::unique_ptr<Process>();
+    it = m_running.begin();
+    std::advance(it, index);
+
+    *processID = it->first;
+    std::unique_ptr<Process> process = std::move(it->second);
+    m_running.erase(it);
+    return process;
+}
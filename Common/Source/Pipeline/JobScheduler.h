@@ -0,0 +1,91 @@
+#ifndef PIPELINE_JOBSCHEDULER_H
+#define PIPELINE_JOBSCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <memory>
+#include <Core/Types.h>
+#include "Process.h"
+
+// What one job (i.e. one run of a rule's Execute function) needs while it
+// runs.
+struct JobResources {
+    JobResources();
+
+    int cpuSlots;
+    u64 memoryMB;
+    // Empty if the job doesn't belong to a pool.
+    std::string pool;
+};
+
+// Decides which jobs can run at the same time, by packing them against the
+// machine's CPU slots and memory, and runs their processes in the background.
+// A job that needs more than the machine has is still run, but on its own.
+//
+// N.B. The scheduler must only be used from one thread, which reads the
+// processes' output and reaps them while it waits.
+class JobScheduler {
+public:
+    enum AcquireResult {
+        ACQUIRED,
+        // The job's pool already has as many jobs running as it allows.
+        POOL_FULL,
+        // There's not enough CPU or memory free.
+        NO_CAPACITY,
+    };
+
+    JobScheduler();
+    // Waits for any processes that are still running.
+    ~JobScheduler();
+
+    // Sets the capacity that jobs are packed against. A memoryMB of 0 means
+    // that memory is unlimited. Must not be called while jobs are running.
+    void Reset(int cpuSlots, u64 memoryMB);
+
+    // No more than depth jobs in a pool run at once, however much else is
+    // free (so a depth of 1 makes a rule's jobs exclusive).
+    void SetPoolDepth(const std::string& name, int depth);
+    bool HasPool(const std::string& name) const;
+    void ClearPools();
+
+    // Returns true if a job that needs a single CPU slot could be started.
+    bool HasFreeSlot() const;
+    AcquireResult TryAcquire(const JobResources& resources);
+    void Release(const JobResources& resources);
+
+    // Starts the process without waiting for it, and returns an ID for it.
+    // N.B. args[0] is the path to the executable.
+    int StartProcess(const std::vector<std::string>& args, ProcessTracker* tracker);
+    bool HasProcesses() const;
+    // Blocks until one of the processes has finished. Returns NULL if there
+    // are none left, or if none finished within timeoutMs (a negative timeout
+    // never expires).
+    std::unique_ptr<Process> WaitForProcess(int* processID, int timeoutMs = -1);
+
+private:
+    JobScheduler(const JobScheduler&);
+    JobScheduler& operator=(const JobScheduler&);
+
+    struct Pool {
+        int depth;
+        int nRunning;
+    };
+
+    int m_cpuSlots;
+    u64 m_memoryMB;
+    int m_nRunningJobs;
+    int m_usedCpuSlots;
+    u64 m_usedMemoryMB;
+    std::map<std::string, Pool> m_pools;
+
+    int m_nextProcessID;
+    std::map<int, std::unique_ptr<Process>> m_running;
+    // Processes that couldn't be started (e.g. because the build has been
+    // cancelled), which haven't been returned by WaitForProcess() yet.
+    std::deque<std::pair<int, Process*>> m_finished;
+    std::vector<Process*> m_waitProcesses;
+};
+
+#endif // PIPELINE_JOBSCHEDULER_H
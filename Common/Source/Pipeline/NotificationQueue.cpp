@@ -0,0 +1,88 @@
+#include "NotificationQueue.h"
+
+#include <Core/Macros.h>
+
+NotificationQueue::NotificationQueue(size_t capacity)
+    : m_notifications(capacity)
+    , m_counts()
+    , m_stringBytes(0)
+{}
+
+NotificationQueue::PushResult NotificationQueue::Push(const Notification& notification,
+                                                      NotificationOverflowPolicy policy)
+{
+    PushResult result = PUSHED;
+    if (m_notifications.IsFull()) {
+        if (policy == OVERFLOW_BLOCK)
+            return FULL;
+        if (policy == OVERFLOW_COALESCE &&
+            m_counts.find(notification.asset) != m_counts.end())
+            return COALESCED;
+        Pop();
+        result = DROPPED_OLDEST;
+    }
+
+    m_notifications.PushBack(notification);
+    ++m_counts[notification.asset];
+    m_stringBytes += notification.asset.length() * 2 + notification.filePath.length();
+    return result;
+}
+
+Notification NotificationQueue::Pop()
+{
+    Notification notification;
+    std::swap(notification, m_notifications.Front());
+    m_notifications.PopFront();
+    Forget(notification);
+    return notification;
+}
+
+const Notification& NotificationQueue::Front() const
+{
+    return m_notifications.Front();
+}
+
+void NotificationQueue::Forget(const Notification& notification)
+{
+    std::unordered_map<std::string, unsigned>::iterator it = m_counts.find(notification.asset);
+    ASSERT(it != m_counts.end());
+    if (--it->second == 0)
+        m_counts.erase(it);
+    m_stringBytes -= notification.asset.length() * 2 + notification.filePath.length();
+}
+
+size_t NotificationQueue::Size() const
+{
+    return m_notifications.Size();
+}
+
+bool NotificationQueue::IsEmpty() const
+{
+    return m_notifications.IsEmpty();
+}
+
+bool NotificationQueue::IsFull() const
+{
+    return m_notifications.IsFull();
+}
+
+size_t NotificationQueue::Capacity() const
+{
+    return m_notifications.Capacity();
+}
+
+size_t NotificationQueue::GetMemoryUsage() const
+{
+    // N.B. m_stringBytes counts each asset twice: once in the ring, and once
+    // as a key of m_counts.
+    return m_notifications.Capacity() * sizeof(Notification) +
+           m_counts.size() * (sizeof(std::string) + sizeof(unsigned) + sizeof(void*)) +
+           m_stringBytes;
+}
+
+void NotificationQueue::SetCapacity(size_t capacity)
+{
+    while (m_notifications.Size() > capacity)
+        Pop();
+    m_notifications.SetCapacity(capacity);
+}
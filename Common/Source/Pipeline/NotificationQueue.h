@@ -0,0 +1,68 @@
+#ifndef PIPELINE_NOTIFICATIONQUEUE_H
+#define PIPELINE_NOTIFICATIONQUEUE_H
+
+#include <stddef.h>
+#include <string>
+#include <unordered_map>
+#include <Core/RingBuffer.h>
+
+// What happens to a notification that arrives when its queue is full.
+enum NotificationOverflowPolicy {
+    // The oldest queued notification is thrown away.
+    OVERFLOW_DROP_OLDEST,
+    // As above, but if the asset is already queued, the new notification is
+    // dropped instead (the asset will be reloaded anyway). Duplicates are
+    // only dropped when the queue is full.
+    OVERFLOW_COALESCE,
+    // The notification isn't queued, and the caller has to wait.
+    OVERFLOW_BLOCK,
+};
+
+struct Notification {
+    std::string asset;
+    // Where the compiled asset can be read from, if it's known.
+    std::string filePath;
+};
+
+// A bounded queue of the assets that a client hasn't been told about yet.
+class NotificationQueue {
+public:
+    enum PushResult {
+        PUSHED,
+        COALESCED,
+        // The asset was queued, but the oldest one was lost.
+        DROPPED_OLDEST,
+        // Only with OVERFLOW_BLOCK.
+        FULL,
+    };
+
+    explicit NotificationQueue(size_t capacity);
+
+    PushResult Push(const Notification& notification, NotificationOverflowPolicy policy);
+    // Moves the oldest notification out of the queue.
+    Notification Pop();
+    const Notification& Front() const;
+
+    size_t Size() const;
+    bool IsEmpty() const;
+    bool IsFull() const;
+    size_t Capacity() const;
+    // Roughly the number of bytes held by the queue.
+    size_t GetMemoryUsage() const;
+
+    // Drops the oldest assets if they don't fit.
+    void SetCapacity(size_t capacity);
+
+private:
+    NotificationQueue(const NotificationQueue&);
+    NotificationQueue& operator=(const NotificationQueue&);
+
+    void Forget(const Notification& notification);
+
+    RingBuffer<Notification> m_notifications;
+    // How many times each asset is in the queue.
+    std::unordered_map<std::string, unsigned> m_counts;
+    size_t m_stringBytes;
+};
+
+#endif // PIPELINE_NOTIFICATIONQUEUE_H
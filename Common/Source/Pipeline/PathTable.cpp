@@ -0,0 +1,140 @@
+#include "PathTable.h"
+
+#include <string.h>
+#include <Core/Macros.h>
+#include <Core/Hash.h>
+
+const size_t INITIAL_BUCKETS = 1024;
+const size_t BLOCK_SIZE_BYTES = 64 * 1024;
+
+PathTable::PathTable()
+    : m_entries()
+    , m_buckets(INITIAL_BUCKETS, INVALID_PATH_ID)
+    , m_blocks()
+    , m_blockPos(NULL)
+    , m_blockBytesLeft(0)
+{}
+
+PathTable::~PathTable()
+{
+    Clear();
+}
+
+PathID PathTable::Intern(const char* path)
+{
+    ASSERT(path);
+    return Intern(path, strlen(path));
+}
+
+PathID PathTable::Intern(const char* path, size_t length)
+{
+    ASSERT(path);
+
+    u64 hash = HashFNV1a64(path, length);
+    size_t bucket = FindBucket(path, length, hash);
+    if (m_buckets[bucket] != INVALID_PATH_ID)
+        return m_buckets[bucket];
+
+    if (m_entries.size() >= INVALID_PATH_ID)
+        FATAL("Too many paths");
+
+    char* str = AllocString(length);
+    memcpy(str, path, length);
+    str[length] = '\0';
+
+    PathID id = (PathID)m_entries.size();
+    Entry entry = { str, length, hash };
+    m_entries.push_back(entry);
+    m_buckets[bucket] = id;
+
+    // Keep the load factor at or below a half.
+    if (m_entries.size() * 2 > m_buckets.size())
+        Grow();
+
+    return id;
+}
+
+PathID PathTable::Find(const char* path, size_t length) const
+{
+    ASSERT(path);
+    return m_buckets[FindBucket(path, length, HashFNV1a64(path, length))];
+}
+
+const char* PathTable::GetPath(PathID id) const
+{
+    ASSERT(id < m_entries.size());
+    return m_entries[id].str;
+}
+
+size_t PathTable::GetPathLength(PathID id) const
+{
+    ASSERT(id < m_entries.size());
+    return m_entries[id].length;
+}
+
+size_t PathTable::NumPaths() const
+{
+    return m_entries.size();
+}
+
+void PathTable::Clear()
+{
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+        delete[] m_blocks[i];
+    m_blocks.clear();
+    m_blockPos = NULL;
+    m_blockBytesLeft = 0;
+
+    m_entries.clear();
+    m_buckets.assign(INITIAL_BUCKETS, INVALID_PATH_ID);
+}
+
+// Returns the bucket holding the path, or else the empty bucket where it
+// should be inserted.
+size_t PathTable::FindBucket(const char* path, size_t length, u64 hash) const
+{
+    size_t mask = m_buckets.size() - 1;
+    for (size_t i = (size_t)hash & mask; ; i = (i + 1) & mask) {
+        PathID id = m_buckets[i];
+        if (id == INVALID_PATH_ID)
+            return i;
+        const Entry& entry = m_entries[id];
+        if (entry.hash == hash && entry.length == length &&
+            memcmp(entry.str, path, length) == 0)
+            return i;
+    }
+}
+
+void PathTable::Grow()
+{
+    m_buckets.assign(m_buckets.size() * 2, INVALID_PATH_ID);
+    size_t mask = m_buckets.size() - 1;
+    for (size_t id = 0; id < m_entries.size(); ++id) {
+        size_t i = (size_t)m_entries[id].hash & mask;
+        while (m_buckets[i] != INVALID_PATH_ID)
+            i = (i + 1) & mask;
+        m_buckets[i] = (PathID)id;
+    }
+}
+
+// Allocates space for a string of the given length plus a null terminator.
+char* PathTable::AllocString(size_t length)
+{
+    size_t nBytes = length + 1;
+    if (nBytes > m_blockBytesLeft) {
+        // Unusually long paths get a block to themselves, so that the rest of
+        // the current block isn't wasted.
+        if (nBytes > BLOCK_SIZE_BYTES / 4) {
+            char* block = new char[nBytes];
+            m_blocks.push_back(block);
+            return block;
+        }
+        m_blockPos = new char[BLOCK_SIZE_BYTES];
+        m_blockBytesLeft = BLOCK_SIZE_BYTES;
+        m_blocks.push_back(m_blockPos);
+    }
+    char* str = m_blockPos;
+    m_blockPos += nBytes;
+    m_blockBytesLeft -= nBytes;
+    return str;
+}
@@ -0,0 +1,60 @@
+#ifndef PIPELINE_PATHTABLE_H
+#define PIPELINE_PATHTABLE_H
+
+#include <stddef.h>
+#include <vector>
+#include <Core/Types.h>
+
+typedef u32 PathID;
+
+const PathID INVALID_PATH_ID = 0xFFFFFFFF;
+
+// Interns path strings, giving each distinct path a small integer ID. The IDs
+// are allocated consecutively from zero, so they can be used to index arrays,
+// and two paths are equal if and only if their IDs are.
+//
+// The strings themselves are stored in large blocks that are only freed when
+// the table is destroyed or cleared, so pointers returned by GetPath() stay
+// valid until then.
+class PathTable {
+public:
+    PathTable();
+    ~PathTable();
+
+    PathID Intern(const char* path);
+    PathID Intern(const char* path, size_t length);
+    // Returns INVALID_PATH_ID if the path hasn't been interned.
+    PathID Find(const char* path, size_t length) const;
+
+    // N.B. The returned string is null-terminated.
+    const char* GetPath(PathID id) const;
+    size_t GetPathLength(PathID id) const;
+
+    size_t NumPaths() const;
+    void Clear();
+
+private:
+    PathTable(const PathTable&);
+    PathTable& operator=(const PathTable&);
+
+    struct Entry {
+        const char* str;
+        size_t length;
+        u64 hash;
+    };
+
+    size_t FindBucket(const char* path, size_t length, u64 hash) const;
+    void Grow();
+    char* AllocString(size_t length);
+
+    std::vector<Entry> m_entries;
+    // Open-addressed hash table of IDs. The number of buckets is always a
+    // power of two, and empty buckets hold INVALID_PATH_ID.
+    std::vector<PathID> m_buckets;
+
+    std::vector<char*> m_blocks;
+    char* m_blockPos;
+    size_t m_blockBytesLeft;
+};
+
+#endif // PIPELINE_PATHTABLE_H
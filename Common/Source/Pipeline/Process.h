@@ -3,19 +3,89 @@
 
 #include <vector>
 #include <string>
+#include <mutex>
+#include <Core/Types.h>
 
 enum ProcessCreationResult {
     PROCESS_SUCCESS,
-    PROCESS_NOT_FOUND
+    PROCESS_NOT_FOUND,
+    PROCESS_CANCELLED,
+};
+
+// Keeps track of the child processes that are running on behalf of a build,
+// so that they can be killed from another thread if the build is cancelled.
+class ProcessTracker {
+public:
+    ProcessTracker();
+
+    // Kills all processes currently registered with the tracker. Any process
+    // subsequently started with this tracker is killed immediately, until
+    // Reset() is called.
+    void CancelAll();
+    void Reset();
+    bool IsCancelled() const;
+
+private:
+    friend struct Process;
+
+    ProcessTracker(const ProcessTracker&);
+    ProcessTracker& operator=(const ProcessTracker&);
+
+    // Returns false if the tracker has been cancelled, in which case the
+    // process is not registered.
+    bool Register(int pid);
+    void Unregister(int pid);
+
+    mutable std::mutex m_mutex;
+    std::vector<int> m_pids;
+    bool m_cancelled;
 };
 
 struct Process {
-    Process(const char* path, const std::vector<const char*>& args);
+    Process();
+    // Runs the process to completion.
+    // N.B. tracker may be NULL
+    Process(const char* path, const std::vector<const char*>& args,
+            ProcessTracker* tracker = NULL);
+    ~Process();
+
+    // Starts the process without waiting for it. Until it has been finished
+    // by WaitForAnyProcess(), only result is valid.
+    void Start(const char* path, const std::vector<const char*>& args,
+               ProcessTracker* tracker = NULL);
+    bool IsRunning() const;
 
     ProcessCreationResult result;
     int status;
     std::string stdoutStr;
     std::string stderrStr;
+    // The CPU time (user and system) and peak memory used by the process,
+    // and by any processes of its own that it waited for. Zero if it didn't
+    // run.
+    i64 cpuMs;
+    u64 maxRssKB;
+
+private:
+    friend bool WaitForAnyProcess(Process* const* processes, size_t nProcesses,
+                                  int timeoutMs, size_t* index);
+
+    Process(const Process&);
+    Process& operator=(const Process&);
+
+    void Finish();
+
+    int m_pid;
+    // -1 once the pipe has reached EOF.
+    int m_stdoutPipe;
+    int m_stderrPipe;
+    ProcessTracker* m_tracker;
 };
 
+// Reads the output of the running processes until one of them has closed its
+// output, then waits for it to exit and writes its index to index. Returns
+// false if none had finished within timeoutMs (a negative timeout never
+// expires).
+bool WaitForAnyProcess(Process* const* processes, size_t nProcesses,
+                       int timeoutMs, size_t* index);
+
 #endif // PIPELINE_PROCESS_H
@@ -1,71 +1,145 @@
 #include "Process.h"
 
+#include <algorithm>
+#include <chrono>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 #include <spawn.h>
 #include <poll.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 #include <Core/Macros.h>
 
-static void ReadPipes(int stdoutReadPipe, int stderrReadPipe,
-                      std::string& stdoutStr, std::string& stderrStr)
+// Each child is started in its own process group, so that killing the group
+// also takes down any processes that the tool itself has spawned (these would
+// otherwise keep the output pipes open).
+static void KillProcessGroup(int pid)
 {
-    const unsigned OUTPUT_BUFFER_SIZE_BYTES = 1024;
+    if (kill(-(pid_t)pid, SIGKILL) == -1 && errno != ESRCH)
+        FATAL("kill");
+}
 
-    std::vector<char> buffer;
-    buffer.resize(OUTPUT_BUFFER_SIZE_BYTES);
+ProcessTracker::ProcessTracker()
+    : m_mutex()
+    , m_pids()
+    , m_cancelled(false)
+{}
 
-    pollfd fds[] = { {stdoutReadPipe, POLLIN}, {stderrReadPipe, POLLIN} };
-    const int NFDS = sizeof fds / sizeof fds[0];
+void ProcessTracker::CancelAll()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cancelled = true;
+    for (size_t i = 0; i < m_pids.size(); ++i)
+        KillProcessGroup(m_pids[i]);
+}
 
-    for (int rval; (rval = poll(fds, NFDS, (int)buffer.size())) > 0; ) {
-        bool eof = false;
-        if (fds[0].revents & POLLIN) {
-            ssize_t bytesRead = read(stdoutReadPipe, &buffer[0],
-                                     buffer.size() - 1);
-            if (bytesRead < 0)
-                FATAL("read");
-            if (bytesRead > 0) {
-                buffer[bytesRead] = 0;
-                stdoutStr.reserve((size_t)bytesRead);
-                stdoutStr.append(&buffer[0]);
-            } else {
-                eof = true;
-            }
-        }
-        if (fds[1].revents & POLLIN) {
-            ssize_t bytesRead = read(stderrReadPipe, &buffer[0],
-                                     buffer.size() - 1);
-            if (bytesRead < 0)
-                FATAL("read");
-            if (bytesRead > 0) {
-                buffer[bytesRead] = 0;
-                stderrStr.reserve((size_t)bytesRead);
-                stderrStr.append(&buffer[0]);
-                eof = false;
-            }
-        }
-        if (eof)
-            break;
-    }
+void ProcessTracker::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cancelled = false;
 }
 
-Process::Process(const char* path, const std::vector<const char*>& args)
+bool ProcessTracker::IsCancelled() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cancelled;
+}
+
+bool ProcessTracker::Register(int pid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_cancelled)
+        return false;
+    m_pids.push_back(pid);
+    return true;
+}
+
+void ProcessTracker::Unregister(int pid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<int>::iterator it = std::find(m_pids.begin(), m_pids.end(), pid);
+    if (it != m_pids.end())
+        m_pids.erase(it);
+}
+
+Process::Process()
     : result(PROCESS_SUCCESS)
     , status(-1)
     , stdoutStr()
     , stderrStr()
+    , cpuMs(0)
+    , maxRssKB(0)
+
+    , m_pid(-1)
+    , m_stdoutPipe(-1)
+    , m_stderrPipe(-1)
+    , m_tracker(NULL)
+{}
+
+Process::Process(const char* path, const std::vector<const char*>& args,
+                 ProcessTracker* tracker)
+    : result(PROCESS_SUCCESS)
+    , status(-1)
+    , stdoutStr()
+    , stderrStr()
+    , cpuMs(0)
+    , maxRssKB(0)
+
+    , m_pid(-1)
+    , m_stdoutPipe(-1)
+    , m_stderrPipe(-1)
+    , m_tracker(NULL)
 {
+    Start(path, args, tracker);
+    Process* process = this;
+    size_t index;
+    if (IsRunning())
+        WaitForAnyProcess(&process, 1, -1, &index);
+}
+
+Process::~Process()
+{
+    ASSERT(!IsRunning());
+}
+
+void Process::Start(const char* path, const std::vector<const char*>& args,
+                    ProcessTracker* tracker)
+{
+    ASSERT(!IsRunning());
+
     if (args.back() != NULL)
         FATAL("Last member of args vector should be a null pointer");
 
+    result = PROCESS_SUCCESS;
+    status = -1;
+    stdoutStr.clear();
+    stderrStr.clear();
+    cpuMs = 0;
+    maxRssKB = 0;
+
+    if (tracker && tracker->IsCancelled()) {
+        result = PROCESS_CANCELLED;
+        return;
+    }
+
     int stdoutPipe[2];
     int stderrPipe[2];
     posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
 
     if (pipe(stdoutPipe) || pipe(stderrPipe))
         FATAL("pipe");
 
+    // Several processes can be running at once, so the read ends mustn't
+    // leak into the processes that are started later.
+    if (fcntl(stdoutPipe[0], F_SETFD, FD_CLOEXEC) == -1 ||
+        fcntl(stderrPipe[0], F_SETFD, FD_CLOEXEC) == -1)
+        FATAL("fcntl");
+
     posix_spawn_file_actions_init(&actions);
     posix_spawn_file_actions_addclose(&actions, stdoutPipe[0]);
     posix_spawn_file_actions_addclose(&actions, stderrPipe[0]);
@@ -75,29 +149,164 @@ Process::Process(const char* path, const std::vector<const char*>& args)
     posix_spawn_file_actions_addclose(&actions, stdoutPipe[1]);
     posix_spawn_file_actions_addclose(&actions, stderrPipe[1]);
 
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
     pid_t pid;
-    int spawnResult = posix_spawn(&pid, path, &actions, NULL,
+    int spawnResult = posix_spawn(&pid, path, &actions, &attr,
                                   (char* const*)&args[0], NULL);
     if (spawnResult != 0) {
         if (spawnResult == ENOENT || spawnResult == ESRCH) {
             result = PROCESS_NOT_FOUND;
         } else {
-            FATAL("Couldn't posix_spawn: %s", strerror(errno));
+            FATAL("Couldn't posix_spawn: %s", strerror(spawnResult));
         }
     }
 
     close(stdoutPipe[1]);
     close(stderrPipe[1]);
 
-    stdoutStr.clear();
-    stderrStr.clear();
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (spawnResult != 0) {
+        close(stdoutPipe[0]);
+        close(stderrPipe[0]);
+        return;
+    }
+
+    // If the build was cancelled between the check above and the process
+    // being spawned, the tracker won't kill the process for us.
+    if (tracker && !tracker->Register((int)pid))
+        KillProcessGroup((int)pid);
+
+    m_pid = (int)pid;
+    m_stdoutPipe = stdoutPipe[0];
+    m_stderrPipe = stderrPipe[0];
+    m_tracker = tracker;
+}
 
-    if (spawnResult == 0) {
-        ReadPipes(stdoutPipe[0], stderrPipe[0], stdoutStr, stderrStr);
+bool Process::IsRunning() const
+{
+    return m_pid != -1;
+}
+
+// Called once both pipes have reached EOF.
+void Process::Finish()
+{
+    ASSERT(IsRunning());
+    ASSERT(m_stdoutPipe == -1 && m_stderrPipe == -1);
+
+    pid_t pid = (pid_t)m_pid;
 
-        if (wait(&status) == -1)
-            FATAL("wait");
+    // The process is unregistered while it's still a zombie, as once it
+    // has been reaped its pid (and so its group) may be reused, and
+    // CancelAll() would kill whatever now has it.
+    if (m_tracker) {
+        siginfo_t info;
+        while (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) == -1) {
+            if (errno != EINTR)
+                FATAL("waitid");
+        }
+        m_tracker->Unregister((int)pid);
     }
 
-    posix_spawn_file_actions_destroy(&actions);
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) == -1) {
+        if (errno != EINTR)
+            FATAL("wait4");
+    }
+    cpuMs = (i64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+#ifdef __APPLE__
+    // N.B. macOS reports bytes rather than kilobytes.
+    maxRssKB = (u64)usage.ru_maxrss / 1024;
+#else
+    maxRssKB = (u64)usage.ru_maxrss;
+#endif
+
+    if (m_tracker && m_tracker->IsCancelled())
+        result = PROCESS_CANCELLED;
+
+    m_pid = -1;
+    m_tracker = NULL;
+}
+
+bool WaitForAnyProcess(Process* const* processes, size_t nProcesses,
+                       int timeoutMs, size_t* index)
+{
+    typedef std::chrono::steady_clock Clock;
+    const unsigned OUTPUT_BUFFER_SIZE_BYTES = 1024;
+
+    ASSERT(processes);
+    ASSERT(nProcesses > 0);
+    ASSERT(index);
+
+    // A process that writes a lot would otherwise keep putting the timeout
+    // off.
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    char buffer[OUTPUT_BUFFER_SIZE_BYTES];
+
+    // Each process has two entries: its stdout pipe followed by its stderr
+    // pipe. A negative fd is ignored by poll(); this is used to mark pipes
+    // that have reached EOF.
+    std::vector<pollfd> fds(nProcesses * 2);
+    for (size_t i = 0; i < nProcesses; ++i) {
+        ASSERT(processes[i]->IsRunning());
+        fds[i * 2].fd = processes[i]->m_stdoutPipe;
+        fds[i * 2 + 1].fd = processes[i]->m_stderrPipe;
+    }
+    for (size_t i = 0; i < fds.size(); ++i)
+        fds[i].events = POLLIN;
+
+    for (;;) {
+        for (size_t i = 0; i < nProcesses; ++i) {
+            Process* process = processes[i];
+            if (process->m_stdoutPipe == -1 && process->m_stderrPipe == -1) {
+                process->Finish();
+                *index = i;
+                return true;
+            }
+        }
+
+        int pollTimeoutMs = -1;
+        if (timeoutMs >= 0) {
+            pollTimeoutMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - Clock::now()).count();
+            if (pollTimeoutMs <= 0)
+                return false;
+        }
+        int rval = poll(&fds[0], (nfds_t)fds.size(), pollTimeoutMs);
+        if (rval == -1) {
+            if (errno == EINTR)
+                continue;
+            FATAL("poll");
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            // N.B. Some platforms report a closed pipe with POLLHUP only.
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            Process* process = processes[i / 2];
+            bool isStdout = (i % 2 == 0);
+            ssize_t bytesRead = read(fds[i].fd, buffer, sizeof buffer);
+            if (bytesRead < 0) {
+                if (errno == EINTR)
+                    continue;
+                FATAL("read");
+            }
+            if (bytesRead > 0) {
+                std::string& str = isStdout ? process->stdoutStr : process->stderrStr;
+                str.append(buffer, (size_t)bytesRead);
+            } else {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                if (isStdout)
+                    process->m_stdoutPipe = -1;
+                else
+                    process->m_stderrPipe = -1;
+            }
+        }
+    }
 }
@@ -1,12 +1,13 @@
 #include "ProjectDBConn.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #include <sqlite3/sqlite3.h>
-#include <md5/md5.h>
 
 #include <Core/Macros.h>
 #include <Core/Types.h>
+#include <Core/Hash.h>
 
 #include "AssetPipelineOsFuncs.h"
 
@@ -105,12 +106,21 @@ void ProjectDBConn::SQLiteStatement::BindInt64(int pos, i64 value)
         FATAL("sqlite3_bind_int64");
 }
 
-void ProjectDBConn::SQLiteStatement::BindText(int pos, const char* str)
+// N.B. The string isn't copied (see the header).
+void ProjectDBConn::SQLiteStatement::BindText(int pos, const char* str,
+                                              int nBytes)
 {
-    if (sqlite3_bind_text(stmt, pos, strdup(str), -1, free) != SQLITE_OK)
+    if (sqlite3_bind_text(stmt, pos, str, nBytes, SQLITE_STATIC) != SQLITE_OK)
         FATAL("sqlite3_bind_text");
 }
 
+void ProjectDBConn::SQLiteStatement::BindBlob(int pos, const void* data,
+                                              int nBytes)
+{
+    if (sqlite3_bind_blob(stmt, pos, data, nBytes, SQLITE_STATIC) != SQLITE_OK)
+        FATAL("sqlite3_bind_blob");
+}
+
 int ProjectDBConn::SQLiteStatement::ColumnInt(int index)
 {
     if (sqlite3_column_type(stmt, index) != SQLITE_INTEGER)
@@ -118,6 +128,13 @@ int ProjectDBConn::SQLiteStatement::ColumnInt(int index)
     return sqlite3_column_int(stmt, index);
 }
 
+i64 ProjectDBConn::SQLiteStatement::ColumnInt64(int index)
+{
+    if (sqlite3_column_type(stmt, index) != SQLITE_INTEGER)
+        FATAL("Wrong column type");
+    return (i64)sqlite3_column_int64(stmt, index);
+}
+
 const char* ProjectDBConn::SQLiteStatement::ColumnText(int index)
 {
     if (sqlite3_column_type(stmt, index) != SQLITE_TEXT)
@@ -125,21 +142,155 @@ const char* ProjectDBConn::SQLiteStatement::ColumnText(int index)
     return (const char*)sqlite3_column_text(stmt, index);
 }
 
+const void* ProjectDBConn::SQLiteStatement::ColumnBlob(int index, int* nBytes)
+{
+    ASSERT(nBytes);
+    if (sqlite3_column_type(stmt, index) != SQLITE_BLOB)
+        FATAL("Wrong column type");
+    const void* data = sqlite3_column_blob(stmt, index);
+    *nBytes = sqlite3_column_bytes(stmt, index);
+    return data;
+}
+
 bool ProjectDBConn::SQLiteStatement::IsColumnNull(int index)
 {
     return sqlite3_column_type(stmt, index) == SQLITE_NULL;
 }
 
+// Rows are inserted using statements with these numbers of rows in their
+// VALUES clauses, largest first. (SQLite limits a statement to 999 parameters
+// by default.)
+static const int BULK_INSERT_BATCH_SIZES[] = { 64, 8, 1 };
+static const int BULK_INSERT_MAX_COLUMNS = 999 / 64;
+
+static std::string MakeBulkInsertText(const char* insertText, int nColumns,
+                                      int nRows)
+{
+    std::string text(insertText);
+    text.append(" VALUES ");
+    for (int row = 0; row < nRows; ++row) {
+        text.append(row == 0 ? "(" : ", (");
+        for (int col = 0; col < nColumns; ++col)
+            text.append(col == 0 ? "?" : ", ?");
+        text.append(")");
+    }
+    return text;
+}
+
+ProjectDBConn::BulkInsertStatement::BulkInsertStatement(DBHandle& db,
+                                                        const char* insertText,
+                                                        int nColumns)
+    : m_nColumns(nColumns)
+    , m_values()
+{
+    static_assert(sizeof BULK_INSERT_BATCH_SIZES / sizeof BULK_INSERT_BATCH_SIZES[0]
+                  == N_BATCH_SIZES, "Wrong number of batch sizes");
+    ASSERT(nColumns > 0 && nColumns <= BULK_INSERT_MAX_COLUMNS);
+    for (int i = 0; i < N_BATCH_SIZES; ++i) {
+        std::string text = MakeBulkInsertText(insertText, nColumns,
+                                              BULK_INSERT_BATCH_SIZES[i]);
+        m_stmts[i] = new SQLiteStatement(db, text.c_str(), (int)text.size() + 1);
+    }
+}
+
+ProjectDBConn::BulkInsertStatement::~BulkInsertStatement()
+{
+    for (int i = 0; i < N_BATCH_SIZES; ++i)
+        delete m_stmts[i];
+}
+
+void ProjectDBConn::BulkInsertStatement::AddRow(const i64* values)
+{
+    ASSERT(values);
+    m_values.insert(m_values.end(), values, values + m_nColumns);
+}
+
+void ProjectDBConn::BulkInsertStatement::Exec(const DBHandle& db)
+{
+    size_t nRowsLeft = m_values.size() / (size_t)m_nColumns;
+    const i64* values = m_values.data();
+
+    for (int i = 0; i < N_BATCH_SIZES; ++i) {
+        size_t batchSize = (size_t)BULK_INSERT_BATCH_SIZES[i];
+        SQLiteStatement& stmt = *m_stmts[i];
+        for (; nRowsLeft >= batchSize; nRowsLeft -= batchSize) {
+            int nValues = (int)batchSize * m_nColumns;
+            for (int j = 0; j < nValues; ++j)
+                stmt.BindInt64(j + 1, values[j]);
+            stmt.Exec(db);
+            values += nValues;
+        }
+    }
+
+    m_values.clear();
+}
+
 static const char STMT_SETUPWAL[] = "PRAGMA journal_mode=WAL";
 
 static const char STMT_BEGINTRANSAC[] = "BEGIN";
+static const char STMT_BEGINIMMEDIATETRANSAC[] = "BEGIN IMMEDIATE";
 static const char STMT_ENDTRANSAC[] = "COMMIT";
 
+// The version of the database schema is stored in SQLite's user_version
+// field. Databases with an older version are upgraded when they're opened.
+static const int SCHEMA_VERSION = 3;
+
+static const char STMT_GETSCHEMAVERSION[] = "PRAGMA user_version";
+
+static const char STMT_TABLEEXISTS[] =
+    "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = ?";
+
+// Version 1: errors are identified by a key made from their paths (rather
+// than by a hash of them).
+static const char STMT_DROPERRORINPUTS[] = "DROP TABLE IF EXISTS ErrorInputs";
+static const char STMT_DROPERROROUTPUTS[] = "DROP TABLE IF EXISTS ErrorOutputs";
+static const char STMT_DROPERRORS[] = "DROP TABLE IF EXISTS Errors";
+static const char STMT_DROPERRORLOG[] = "DROP TABLE IF EXISTS ErrorLog";
+
+// Version 2: paths are stored once in the Paths table, and referred to by ID.
+static const char STMT_V2_RENAMEDEPS[] =
+    "ALTER TABLE Dependencies RENAME TO OldDependencies";
+static const char STMT_V2_DEPPATHS[] =
+    "INSERT OR IGNORE INTO Paths (Path)"
+    " SELECT InputPath FROM OldDependencies"
+    " UNION SELECT OutputPath FROM OldDependencies";
+static const char STMT_V2_COPYDEPS[] =
+    "INSERT INTO Dependencies (ProjectID, InputPathID, OutputPathID)"
+    " SELECT d.ProjectID, i.PathID, o.PathID FROM OldDependencies d"
+    " JOIN Paths i ON i.Path = d.InputPath"
+    " JOIN Paths o ON o.Path = d.OutputPath";
+static const char STMT_V2_DROPDEPS[] = "DROP TABLE OldDependencies";
+
+static const char STMT_V2_RENAMEERRORINPUTS[] =
+    "ALTER TABLE ErrorInputs RENAME TO OldErrorInputs";
+static const char STMT_V2_ERRORINPUTPATHS[] =
+    "INSERT OR IGNORE INTO Paths (Path) SELECT InputPath FROM OldErrorInputs";
+static const char STMT_V2_COPYERRORINPUTS[] =
+    "INSERT INTO ErrorInputs (ErrorID, PathIndex, IsAdditionalPath, PathID)"
+    " SELECT e.ErrorID, e.PathIndex, e.IsAdditionalPath, p.PathID"
+    " FROM OldErrorInputs e JOIN Paths p ON p.Path = e.InputPath";
+static const char STMT_V2_DROPERRORINPUTS[] = "DROP TABLE OldErrorInputs";
+
+static const char STMT_V2_RENAMEERROROUTPUTS[] =
+    "ALTER TABLE ErrorOutputs RENAME TO OldErrorOutputs";
+static const char STMT_V2_ERROROUTPUTPATHS[] =
+    "INSERT OR IGNORE INTO Paths (Path) SELECT OutputPath FROM OldErrorOutputs";
+static const char STMT_V2_COPYERROROUTPUTS[] =
+    "INSERT INTO ErrorOutputs (ErrorID, PathIndex, PathID)"
+    " SELECT e.ErrorID, e.PathIndex, p.PathID"
+    " FROM OldErrorOutputs e JOIN Paths p ON p.Path = e.OutputPath";
+static const char STMT_V2_DROPERROROUTPUTS[] = "DROP TABLE OldErrorOutputs";
+
+// Version 3: each project has a counter that changes with its dependencies.
+static const char STMT_V3_ADDDEPSGENERATION[] =
+    "ALTER TABLE Projects ADD COLUMN DepsGeneration INTEGER NOT NULL DEFAULT 0";
+
 static const char STMT_PROJECTSTABLE[] =
     "CREATE TABLE IF NOT EXISTS Projects ("
     "    ProjectID INTEGER PRIMARY KEY AUTOINCREMENT,"
     "    Name TEXT NOT NULL,"
-    "    Directory TEXT NOT NULL"
+    "    Directory TEXT NOT NULL,"
+    "    DepsGeneration INTEGER NOT NULL DEFAULT 0"
     ")";
 
 static const char STMT_CONFIGTABLE[] =
@@ -148,19 +299,45 @@ static const char STMT_CONFIGTABLE[] =
     "    FOREIGN KEY(ActiveProject) REFERENCES Projects(ProjectID)"
     ")";
 
+static const char STMT_PATHSTABLE[] =
+    "CREATE TABLE IF NOT EXISTS Paths ("
+    "    PathID INTEGER PRIMARY KEY,"
+    "    Path TEXT NOT NULL UNIQUE"
+    ")";
+
 static const char STMT_DEPSTABLE[] =
     "CREATE TABLE IF NOT EXISTS Dependencies ("
     "    ProjectID INTEGER NOT NULL,"
-    "    InputPath TEXT NOT NULL,"
-    "    OutputPath TEXT NOT NULL,"
-    "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID)"
+    "    InputPathID INTEGER NOT NULL,"
+    "    OutputPathID INTEGER NOT NULL,"
+    "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID),"
+    "    FOREIGN KEY(InputPathID) REFERENCES Paths(PathID),"
+    "    FOREIGN KEY(OutputPathID) REFERENCES Paths(PathID)"
+    ")";
+
+static const char STMT_DEPSINPUTINDEX[] =
+    "CREATE INDEX IF NOT EXISTS DependenciesByInput"
+    " ON Dependencies (ProjectID, InputPathID)";
+
+static const char STMT_DEPSOUTPUTINDEX[] =
+    "CREATE INDEX IF NOT EXISTS DependenciesByOutput"
+    " ON Dependencies (ProjectID, OutputPathID)";
+
+static const char STMT_CLEANSTAMPSTABLE[] =
+    "CREATE TABLE IF NOT EXISTS CleanStamps ("
+    "    ProjectID INTEGER NOT NULL,"
+    "    OutputPathID INTEGER NOT NULL,"
+    "    Stamp INTEGER NOT NULL,"
+    "    PRIMARY KEY(ProjectID, OutputPathID),"
+    "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID),"
+    "    FOREIGN KEY(OutputPathID) REFERENCES Paths(PathID)"
     ")";
 
 static const char STMT_ERRORSTABLE[] =
     "CREATE TABLE IF NOT EXISTS Errors ("
     "    ErrorID INTEGER PRIMARY KEY AUTOINCREMENT,"
     "    ProjectID INTEGER NOT NULL,"
-    "    Hash INTEGER NOT NULL,"
+    "    Key BLOB NOT NULL,"
     "    Message TEXT NOT NULL,"
     "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID)"
     ")";
@@ -170,16 +347,74 @@ static const char STMT_ERRORINPUTSTABLE[] =
     "    ErrorID INTEGER NOT NULL,"
     "    PathIndex INTEGER NOT NULL,"
     "    IsAdditionalPath INTEGER NOT NULL,"
-    "    InputPath TEXT NOT NULL,"
-    "    FOREIGN KEY(ErrorID) REFERENCES Errors(ErrorID)"
+    "    PathID INTEGER NOT NULL,"
+    "    FOREIGN KEY(ErrorID) REFERENCES Errors(ErrorID),"
+    "    FOREIGN KEY(PathID) REFERENCES Paths(PathID)"
     ")";
 
 static const char STMT_ERROROUTPUTSTABLE[] =
     "CREATE TABLE IF NOT EXISTS ErrorOutputs ("
     "    ErrorID INTEGER NOT NULL,"
     "    PathIndex INTEGER NOT NULL,"
-    "    OutputPath TEXT NOT NULL,"
-    "    FOREIGN KEY(ErrorID) REFERENCES Errors(ErrorID)"
+    "    PathID INTEGER NOT NULL,"
+    "    FOREIGN KEY(ErrorID) REFERENCES Errors(ErrorID),"
+    "    FOREIGN KEY(PathID) REFERENCES Paths(PathID)"
+    ")";
+
+static const char STMT_ERRORSKEYINDEX[] =
+    "CREATE UNIQUE INDEX IF NOT EXISTS ErrorsByKey ON Errors (ProjectID, Key)";
+
+static const char STMT_ERRORINPUTSINDEX[] =
+    "CREATE INDEX IF NOT EXISTS ErrorInputsByErrorID ON ErrorInputs (ErrorID)";
+
+static const char STMT_ERROROUTPUTSINDEX[] =
+    "CREATE INDEX IF NOT EXISTS ErrorOutputsByErrorID ON ErrorOutputs (ErrorID)";
+
+// N.B. Added is 1 if the error was recorded, 0 if it was removed.
+static const char STMT_ERRORLOGTABLE[] =
+    "CREATE TABLE IF NOT EXISTS ErrorLog ("
+    "    Seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "    ProjectID INTEGER NOT NULL,"
+    "    ErrorID INTEGER NOT NULL,"
+    "    Added INTEGER NOT NULL,"
+    "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID)"
+    ")";
+
+// Only the most recent changes are kept in the log. Clients that have fallen
+// further behind than this just reload the whole error list.
+static const char STMT_TRIMERRORLOG[] =
+    "DELETE FROM ErrorLog"
+    " WHERE Seq <= (SELECT MAX(Seq) FROM ErrorLog) - 10000";
+// The log is trimmed when the connection is opened, and again after this
+// many changes have been logged, so that it doesn't grow without bound in a
+// long-running pipeline.
+static const int ERROR_LOG_TRIM_INTERVAL = 1000;
+
+// Rules are identified by name (see lua_Rule()).
+static const char STMT_RULEDURATIONSTABLE[] =
+    "CREATE TABLE IF NOT EXISTS RuleDurations ("
+    "    ProjectID INTEGER NOT NULL,"
+    "    Rule TEXT NOT NULL,"
+    "    AverageMs INTEGER NOT NULL,"
+    "    Samples INTEGER NOT NULL,"
+    "    PRIMARY KEY(ProjectID, Rule),"
+    "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID)"
+    ")";
+
+// The costs of the assets that have been built, keyed by the path the rule
+// was matched against. CriticalPathMs is the longest WallMs chain through the
+// asset's inputs that are themselves built, ending with the asset.
+static const char STMT_ASSETCOSTSTABLE[] =
+    "CREATE TABLE IF NOT EXISTS AssetCosts ("
+    "    ProjectID INTEGER NOT NULL,"
+    "    OutputPathID INTEGER NOT NULL,"
+    "    WallMs INTEGER NOT NULL,"
+    "    CpuMs INTEGER NOT NULL,"
+    "    MaxRssKB INTEGER NOT NULL,"
+    "    CriticalPathMs INTEGER NOT NULL,"
+    "    PRIMARY KEY(ProjectID, OutputPathID),"
+    "    FOREIGN KEY(ProjectID) REFERENCES Projects(ProjectID),"
+    "    FOREIGN KEY(OutputPathID) REFERENCES Paths(PathID)"
     ")";
 
 static const char STMT_SETUPCONFIG[] =
@@ -204,33 +439,73 @@ static const char STMT_GETACTIVEPROJ[] = "SELECT ActiveProject FROM Config";
 
 static const char STMT_SETACTIVEPROJ[] = "UPDATE Config SET ActiveProject = ?";
 
+static const char STMT_FINDPATH[] = "SELECT PathID FROM Paths WHERE Path = ?";
+
+static const char STMT_ADDPATH[] = "INSERT OR IGNORE INTO Paths (Path) VALUES (?)";
+
 static const char STMT_CLEARDEPS[] = "DELETE FROM Dependencies"
-                                     " WHERE ProjectID = ? AND OutputPath = ?";
+                                     " WHERE ProjectID = ? AND OutputPathID = ?";
+
+static const char STMT_RECORDDEPS[] = "INSERT INTO Dependencies (ProjectID, InputPathID, OutputPathID)";
 
-static const char STMT_RECORDDEP[] = "INSERT INTO Dependencies (ProjectID, InputPath, OutputPath)"
-                                     " VALUES (?, ?, ?)";
+static const char STMT_GETALLDEPS[] =
+    "SELECT i.Path, o.Path FROM Dependencies d"
+    " JOIN Paths i ON i.PathID = d.InputPathID"
+    " JOIN Paths o ON o.PathID = d.OutputPathID"
+    " WHERE d.ProjectID = ?";
 
-static const char STMT_GETDEPS[] = "SELECT OutputPath FROM Dependencies"
-                                   " WHERE ProjectID = ? AND InputPath = ?";
+static const char STMT_GETALLOUTPUTS[] =
+    "SELECT DISTINCT Path FROM Dependencies"
+    " JOIN Paths ON Paths.PathID = Dependencies.OutputPathID"
+    " WHERE ProjectID = ?";
 
-static const char STMT_FETCHERRORS[] = "SELECT ErrorID FROM Errors"
-                                       " WHERE ProjectID = ? AND Hash = ?";
+static const char STMT_GETDEPSGENERATION[] = "SELECT DepsGeneration FROM Projects"
+                                             " WHERE ProjectID = ?";
+
+static const char STMT_BUMPDEPSGENERATION[] = "UPDATE Projects SET DepsGeneration = DepsGeneration + 1"
+                                              " WHERE ProjectID = ?";
+
+static const char STMT_GETDEPS[] = "SELECT Path FROM Dependencies"
+                                   " JOIN Paths ON Paths.PathID = Dependencies.OutputPathID"
+                                   " WHERE ProjectID = ? AND InputPathID = ?";
+
+static const char STMT_GETINPUTDEPS[] = "SELECT Path FROM Dependencies"
+                                        " JOIN Paths ON Paths.PathID = Dependencies.InputPathID"
+                                        " WHERE ProjectID = ? AND OutputPathID = ?";
+
+static const char STMT_RENAMEDEPINPUTS[] = "UPDATE Dependencies SET InputPathID = ?"
+                                          " WHERE ProjectID = ? AND InputPathID = ?";
+
+static const char STMT_RENAMEDEPOUTPUTS[] = "UPDATE Dependencies SET OutputPathID = ?"
+                                           " WHERE ProjectID = ? AND OutputPathID = ?";
+
+static const char STMT_GETCLEANSTAMPS[] =
+    "SELECT Path, Stamp FROM CleanStamps"
+    " JOIN Paths ON Paths.PathID = CleanStamps.OutputPathID"
+    " WHERE ProjectID = ?";
+
+static const char STMT_SETCLEANSTAMP[] =
+    "INSERT OR REPLACE INTO CleanStamps (ProjectID, OutputPathID, Stamp)"
+    " VALUES (?, ?, ?)";
+
+static const char STMT_CLEARCLEANSTAMP[] = "DELETE FROM CleanStamps"
+                                          " WHERE ProjectID = ? AND OutputPathID = ?";
+
+static const char STMT_FINDERROR[] = "SELECT ErrorID FROM Errors"
+                                    " WHERE ProjectID = ? AND Key = ?";
+
+static const char STMT_ALLERRORKEYS[] = "SELECT ProjectID, Key FROM Errors";
 
 static const char STMT_ERROREXISTS[] = "SELECT COUNT(*) FROM Errors"
                                        " WHERE ErrorID = ?";
 
 static const char STMT_ERRORGETINPUTS[] =
-    "SELECT InputPath FROM ErrorInputs"
+    "SELECT Path FROM ErrorInputs JOIN Paths USING (PathID)"
     " WHERE ErrorID = ?"
     " ORDER BY PathIndex ASC";
 
-static const char STMT_ERRORGETCOREINPUTS[] =
-    "SELECT InputPath FROM ErrorInputs"
-    " WHERE ErrorID = ? AND IsAdditionalPath = 0"
-    " ORDER BY PathIndex ASC";
-
 static const char STMT_ERRORGETOUTPUTS[] =
-    "SELECT OutputPath FROM ErrorOutputs"
+    "SELECT Path FROM ErrorOutputs JOIN Paths USING (PathID)"
     " WHERE ErrorID = ?"
     " ORDER BY PathIndex ASC";
 
@@ -238,17 +513,19 @@ static const char STMT_ERROR_DELETE1[] = "DELETE FROM ErrorInputs WHERE ErrorID
 static const char STMT_ERROR_DELETE2[] = "DELETE FROM ErrorOutputs WHERE ErrorID = ?";
 static const char STMT_ERROR_DELETE3[] = "DELETE FROM Errors WHERE ErrorID = ?";
 
+static const char STMT_FINDERRORSBYOUTPUT[] =
+    "SELECT DISTINCT ErrorID, Key FROM ErrorOutputs JOIN Errors USING (ErrorID)"
+    " WHERE ProjectID = ? AND PathID = ?";
+
 static const char STMT_ERROR_NEW[] =
-    "INSERT INTO Errors (ProjectID, Hash, Message)"
+    "INSERT INTO Errors (ProjectID, Key, Message)"
     " VALUES (?, ?, ?)";
 
-static const char STMT_ERROR_ADD_INPUT[] =
-    "INSERT INTO ErrorInputs (ErrorID, PathIndex, IsAdditionalPath, InputPath)"
-    " VALUES (?, ?, ?, ?)";
+static const char STMT_ERROR_ADD_INPUTS[] =
+    "INSERT INTO ErrorInputs (ErrorID, PathIndex, IsAdditionalPath, PathID)";
 
-static const char STMT_ERROR_ADD_OUTPUT[] =
-    "INSERT INTO ErrorOutputs (ErrorID, PathIndex, OutputPath)"
-    " VALUES (?, ?, ?)";
+static const char STMT_ERROR_ADD_OUTPUTS[] =
+    "INSERT INTO ErrorOutputs (ErrorID, PathIndex, PathID)";
 
 static const char STMT_ERROR_QUERY_ALL[] =
     "SELECT ErrorID FROM Errors WHERE ProjectID = ?";
@@ -256,8 +533,67 @@ static const char STMT_ERROR_QUERY_ALL[] =
 static const char STMT_ERROR_GET_MESSAGE[] =
     "SELECT Message FROM Errors WHERE ErrorID = ?";
 
+static const char STMT_ERRORLOG_ADD[] =
+    "INSERT INTO ErrorLog (ProjectID, ErrorID, Added) VALUES (?, ?, ?)";
+
+static const char STMT_ERRORLIST_VERSION[] =
+    "SELECT IFNULL(MAX(Seq), 0) FROM ErrorLog";
+
+static const char STMT_ERRORLOG_RANGE[] =
+    "SELECT MIN(Seq), MAX(Seq) FROM ErrorLog";
+
+#define FIRST_INPUT_PATH_OF_ERROR(errorIDColumn) \
+    "(SELECT Path FROM ErrorInputs JOIN Paths USING (PathID)" \
+    "  WHERE ErrorInputs.ErrorID = " errorIDColumn \
+    "  ORDER BY PathIndex ASC LIMIT 1)"
+
+static const char STMT_QUERY_ERRORLIST[] =
+    "SELECT ErrorID, " FIRST_INPUT_PATH_OF_ERROR("Errors.ErrorID")
+    " FROM Errors WHERE ProjectID = ?"
+    " ORDER BY ErrorID ASC";
+
+static const char STMT_QUERY_ERRORCHANGES[] =
+    "SELECT Seq, ErrorID, Added, " FIRST_INPUT_PATH_OF_ERROR("ErrorLog.ErrorID")
+    " FROM ErrorLog WHERE ProjectID = ? AND Seq > ?"
+    " ORDER BY Seq ASC";
+
+static const char STMT_GETRULEDURATIONS[] =
+    "SELECT Rule, AverageMs, Samples FROM RuleDurations WHERE ProjectID = ?";
+
+static const char STMT_SETRULEDURATION[] =
+    "INSERT OR REPLACE INTO RuleDurations (ProjectID, Rule, AverageMs, Samples)"
+    " VALUES (?, ?, ?, ?)";
+
+static const char STMT_GETASSETCOSTS[] =
+    "SELECT Path, WallMs, CpuMs, MaxRssKB, CriticalPathMs FROM AssetCosts"
+    " JOIN Paths ON Paths.PathID = AssetCosts.OutputPathID"
+    " WHERE ProjectID = ?";
+
+static const char STMT_SETASSETCOST[] =
+    "INSERT OR REPLACE INTO AssetCosts"
+    " (ProjectID, OutputPathID, WallMs, CpuMs, MaxRssKB, CriticalPathMs)"
+    " VALUES (?, ?, ?, ?, ?, ?)";
+
+static const char STMT_CLEARASSETCOST[] =
+    "DELETE FROM AssetCosts WHERE ProjectID = ? AND OutputPathID = ?";
+
 ProjectDBConn::ProjectDBConn()
     : m_dbHandle(AssetPipelineOsFuncs::GetPathToProjectDB())
+    , m_schemaVersion(UpgradeSchema(m_dbHandle))
+    , m_errorKey()
+    , m_errorKeyHashes()
+    , m_errorKeyHashesLoaded(false)
+    , m_nErrorLogChanges(0)
+    , m_pathTable()
+    , m_pathDBIDs()
+    , m_depsGenerationsBumped()
+    , m_depsGenerations()
+    , m_depChangesProjID(-1)
+    , m_depChangesGeneration(0)
+    , m_depChangesKnown(false)
+    , m_depChanges()
+    , m_cleanStampsProjID(-1)
+    , m_cleanStamps()
 
     , m_stmtSetupWAL(m_dbHandle, STMT_SETUPWAL, sizeof STMT_SETUPWAL,
                      true)
@@ -270,12 +606,33 @@ ProjectDBConn::ProjectDBConn()
                         true)
     , m_stmtSetupConfig(m_dbHandle, STMT_SETUPCONFIG, sizeof STMT_SETUPCONFIG,
                         true)
+    , m_stmtPathsTable(m_dbHandle, STMT_PATHSTABLE, sizeof STMT_PATHSTABLE, true)
     , m_stmtDepsTable(m_dbHandle, STMT_DEPSTABLE, sizeof STMT_DEPSTABLE, true)
+    , m_stmtDepsInputIndex(m_dbHandle, STMT_DEPSINPUTINDEX, sizeof STMT_DEPSINPUTINDEX,
+                           true)
+    , m_stmtDepsOutputIndex(m_dbHandle, STMT_DEPSOUTPUTINDEX, sizeof STMT_DEPSOUTPUTINDEX,
+                            true)
+    , m_stmtCleanStampsTable(m_dbHandle, STMT_CLEANSTAMPSTABLE, sizeof STMT_CLEANSTAMPSTABLE,
+                             true)
     , m_stmtErrorsTable(m_dbHandle, STMT_ERRORSTABLE, sizeof STMT_ERRORSTABLE, true)
+    , m_stmtErrorsKeyIndex(m_dbHandle, STMT_ERRORSKEYINDEX, sizeof STMT_ERRORSKEYINDEX,
+                           true)
     , m_stmtErrorInputsTable(m_dbHandle, STMT_ERRORINPUTSTABLE,
                              sizeof STMT_ERRORINPUTSTABLE, true)
     , m_stmtErrorOutputsTable(m_dbHandle, STMT_ERROROUTPUTSTABLE,
                               sizeof STMT_ERROROUTPUTSTABLE, true)
+    , m_stmtErrorInputsIndex(m_dbHandle, STMT_ERRORINPUTSINDEX,
+                             sizeof STMT_ERRORINPUTSINDEX, true)
+    , m_stmtErrorOutputsIndex(m_dbHandle, STMT_ERROROUTPUTSINDEX,
+                              sizeof STMT_ERROROUTPUTSINDEX, true)
+    , m_stmtErrorLogTable(m_dbHandle, STMT_ERRORLOGTABLE, sizeof STMT_ERRORLOGTABLE,
+                          true)
+    , m_stmtTrimErrorLog(m_dbHandle, STMT_TRIMERRORLOG, sizeof STMT_TRIMERRORLOG,
+                         true)
+    , m_stmtRuleDurationsTable(m_dbHandle, STMT_RULEDURATIONSTABLE,
+                               sizeof STMT_RULEDURATIONSTABLE, true)
+    , m_stmtAssetCostsTable(m_dbHandle, STMT_ASSETCOSTSTABLE, sizeof STMT_ASSETCOSTSTABLE,
+                            true)
 
     , m_stmtNumProjects(m_dbHandle, STMT_NUMPROJECTS, sizeof STMT_NUMPROJECTS)
     , m_stmtQueryAllProjects(m_dbHandle, STMT_QUERYALLPROJECTS, sizeof STMT_QUERYALLPROJECTS)
@@ -286,26 +643,146 @@ ProjectDBConn::ProjectDBConn()
     , m_stmtGetActiveProj(m_dbHandle, STMT_GETACTIVEPROJ, sizeof STMT_GETACTIVEPROJ)
     , m_stmtSetActiveProj(m_dbHandle, STMT_SETACTIVEPROJ, sizeof STMT_SETACTIVEPROJ)
 
+    , m_stmtFindPath(m_dbHandle, STMT_FINDPATH, sizeof STMT_FINDPATH)
+    , m_stmtAddPath(m_dbHandle, STMT_ADDPATH, sizeof STMT_ADDPATH)
+
     , m_stmtClearDeps(m_dbHandle, STMT_CLEARDEPS, sizeof STMT_CLEARDEPS)
-    , m_stmtRecordDep(m_dbHandle, STMT_RECORDDEP, sizeof STMT_RECORDDEP)
+    , m_bulkRecordDeps(m_dbHandle, STMT_RECORDDEPS, 3)
     , m_stmtGetDeps(m_dbHandle, STMT_GETDEPS, sizeof STMT_GETDEPS)
-
-    , m_stmtFetchErrors(m_dbHandle, STMT_FETCHERRORS, sizeof STMT_FETCHERRORS)
+    , m_stmtGetInputDeps(m_dbHandle, STMT_GETINPUTDEPS, sizeof STMT_GETINPUTDEPS)
+    , m_stmtRenameDepInputs(m_dbHandle, STMT_RENAMEDEPINPUTS, sizeof STMT_RENAMEDEPINPUTS)
+    , m_stmtRenameDepOutputs(m_dbHandle, STMT_RENAMEDEPOUTPUTS, sizeof STMT_RENAMEDEPOUTPUTS)
+    , m_stmtGetAllDeps(m_dbHandle, STMT_GETALLDEPS, sizeof STMT_GETALLDEPS)
+    , m_stmtGetAllOutputs(m_dbHandle, STMT_GETALLOUTPUTS, sizeof STMT_GETALLOUTPUTS)
+    , m_stmtGetDepsGeneration(m_dbHandle, STMT_GETDEPSGENERATION, sizeof STMT_GETDEPSGENERATION)
+    , m_stmtBumpDepsGeneration(m_dbHandle, STMT_BUMPDEPSGENERATION, sizeof STMT_BUMPDEPSGENERATION)
+
+    , m_stmtGetCleanStamps(m_dbHandle, STMT_GETCLEANSTAMPS, sizeof STMT_GETCLEANSTAMPS)
+    , m_stmtSetCleanStamp(m_dbHandle, STMT_SETCLEANSTAMP, sizeof STMT_SETCLEANSTAMP)
+    , m_stmtClearCleanStamp(m_dbHandle, STMT_CLEARCLEANSTAMP, sizeof STMT_CLEARCLEANSTAMP)
+
+    , m_stmtFindError(m_dbHandle, STMT_FINDERROR, sizeof STMT_FINDERROR)
+    , m_stmtAllErrorKeys(m_dbHandle, STMT_ALLERRORKEYS, sizeof STMT_ALLERRORKEYS)
     , m_stmtErrorExists(m_dbHandle, STMT_ERROREXISTS, sizeof STMT_ERROREXISTS)
     , m_stmtErrorGetInputs(m_dbHandle, STMT_ERRORGETINPUTS, sizeof STMT_ERRORGETINPUTS)
-    , m_stmtErrorGetCoreInputs(m_dbHandle, STMT_ERRORGETCOREINPUTS, sizeof STMT_ERRORGETCOREINPUTS)
     , m_stmtErrorGetOutputs(m_dbHandle, STMT_ERRORGETOUTPUTS, sizeof STMT_ERRORGETOUTPUTS)
     , m_stmtErrorDelete1(m_dbHandle, STMT_ERROR_DELETE1, sizeof STMT_ERROR_DELETE1)
     , m_stmtErrorDelete2(m_dbHandle, STMT_ERROR_DELETE2, sizeof STMT_ERROR_DELETE2)
     , m_stmtErrorDelete3(m_dbHandle, STMT_ERROR_DELETE3, sizeof STMT_ERROR_DELETE3)
+    , m_stmtFindErrorsByOutput(m_dbHandle, STMT_FINDERRORSBYOUTPUT,
+                               sizeof STMT_FINDERRORSBYOUTPUT)
 
     , m_stmtNewError(m_dbHandle, STMT_ERROR_NEW, sizeof STMT_ERROR_NEW)
-    , m_stmtErrorAddInput(m_dbHandle, STMT_ERROR_ADD_INPUT, sizeof STMT_ERROR_ADD_INPUT)
-    , m_stmtErrorAddOutput(m_dbHandle, STMT_ERROR_ADD_OUTPUT, sizeof STMT_ERROR_ADD_OUTPUT)
+    , m_bulkErrorAddInputs(m_dbHandle, STMT_ERROR_ADD_INPUTS, 4)
+    , m_bulkErrorAddOutputs(m_dbHandle, STMT_ERROR_ADD_OUTPUTS, 3)
     , m_stmtQueryAllErrors(m_dbHandle, STMT_ERROR_QUERY_ALL, sizeof STMT_ERROR_QUERY_ALL)
     , m_stmtErrorGetMessage(m_dbHandle, STMT_ERROR_GET_MESSAGE, sizeof STMT_ERROR_GET_MESSAGE)
+    , m_stmtErrorLogAdd(m_dbHandle, STMT_ERRORLOG_ADD, sizeof STMT_ERRORLOG_ADD)
+    , m_stmtErrorListVersion(m_dbHandle, STMT_ERRORLIST_VERSION, sizeof STMT_ERRORLIST_VERSION)
+    , m_stmtErrorLogRange(m_dbHandle, STMT_ERRORLOG_RANGE, sizeof STMT_ERRORLOG_RANGE)
+    , m_stmtQueryErrorList(m_dbHandle, STMT_QUERY_ERRORLIST, sizeof STMT_QUERY_ERRORLIST)
+    , m_stmtQueryErrorChanges(m_dbHandle, STMT_QUERY_ERRORCHANGES, sizeof STMT_QUERY_ERRORCHANGES)
+
+    , m_stmtGetRuleDurations(m_dbHandle, STMT_GETRULEDURATIONS, sizeof STMT_GETRULEDURATIONS)
+    , m_stmtSetRuleDuration(m_dbHandle, STMT_SETRULEDURATION, sizeof STMT_SETRULEDURATION)
+
+    , m_stmtGetAssetCosts(m_dbHandle, STMT_GETASSETCOSTS, sizeof STMT_GETASSETCOSTS)
+    , m_stmtSetAssetCost(m_dbHandle, STMT_SETASSETCOST, sizeof STMT_SETASSETCOST)
+    , m_stmtClearAssetCost(m_dbHandle, STMT_CLEARASSETCOST, sizeof STMT_CLEARASSETCOST)
 {}
 
+bool ProjectDBConn::TableExists(DBHandle& db, const char* name)
+{
+    SQLiteStatement stmt(db, STMT_TABLEEXISTS, sizeof STMT_TABLEEXISTS);
+    stmt.BindText(1, name);
+    if (!stmt.GetNextRow(db))
+        FATAL("No data found");
+    bool exists = stmt.ColumnInt(0) != 0;
+    stmt.Reset(db);
+    return exists;
+}
+
+int ProjectDBConn::UpgradeSchema(DBHandle& db)
+{
+    SQLiteStatement beginTransaction(db, STMT_BEGINIMMEDIATETRANSAC,
+                                     sizeof STMT_BEGINIMMEDIATETRANSAC);
+    SQLiteStatement endTransaction(db, STMT_ENDTRANSAC, sizeof STMT_ENDTRANSAC);
+    SQLiteStatement getVersion(db, STMT_GETSCHEMAVERSION,
+                               sizeof STMT_GETSCHEMAVERSION);
+
+    // N.B. The version is checked inside the transaction, in case another
+    // process is upgrading the database at the same time.
+    beginTransaction.Exec(db);
+
+    if (!getVersion.GetNextRow(db))
+        FATAL("No data found");
+    int version = getVersion.ColumnInt(0);
+    getVersion.Reset(db);
+
+    if (version > SCHEMA_VERSION)
+        FATAL("Project DB has newer schema version %d", version);
+
+    if (version < 1) {
+        // Errors are regenerated by the next build, so there's no need to
+        // convert the old tables. (They're recreated by the constructor.)
+        SQLiteStatement(db, STMT_DROPERRORINPUTS, sizeof STMT_DROPERRORINPUTS, true);
+        SQLiteStatement(db, STMT_DROPERROROUTPUTS, sizeof STMT_DROPERROROUTPUTS, true);
+        SQLiteStatement(db, STMT_DROPERRORS, sizeof STMT_DROPERRORS, true);
+        SQLiteStatement(db, STMT_DROPERRORLOG, sizeof STMT_DROPERRORLOG, true);
+    }
+
+    if (version < 2) {
+        // Each table is renamed, recreated with path IDs in place of paths,
+        // and then copied into the new table.
+        SQLiteStatement(db, STMT_PATHSTABLE, sizeof STMT_PATHSTABLE, true);
+        if (TableExists(db, "Dependencies")) {
+            SQLiteStatement(db, STMT_V2_RENAMEDEPS, sizeof STMT_V2_RENAMEDEPS, true);
+            SQLiteStatement(db, STMT_DEPSTABLE, sizeof STMT_DEPSTABLE, true);
+            SQLiteStatement(db, STMT_V2_DEPPATHS, sizeof STMT_V2_DEPPATHS, true);
+            SQLiteStatement(db, STMT_V2_COPYDEPS, sizeof STMT_V2_COPYDEPS, true);
+            SQLiteStatement(db, STMT_V2_DROPDEPS, sizeof STMT_V2_DROPDEPS, true);
+        }
+        if (TableExists(db, "ErrorInputs")) {
+            SQLiteStatement(db, STMT_V2_RENAMEERRORINPUTS,
+                            sizeof STMT_V2_RENAMEERRORINPUTS, true);
+            SQLiteStatement(db, STMT_ERRORINPUTSTABLE, sizeof STMT_ERRORINPUTSTABLE, true);
+            SQLiteStatement(db, STMT_V2_ERRORINPUTPATHS,
+                            sizeof STMT_V2_ERRORINPUTPATHS, true);
+            SQLiteStatement(db, STMT_V2_COPYERRORINPUTS,
+                            sizeof STMT_V2_COPYERRORINPUTS, true);
+            SQLiteStatement(db, STMT_V2_DROPERRORINPUTS,
+                            sizeof STMT_V2_DROPERRORINPUTS, true);
+        }
+        if (TableExists(db, "ErrorOutputs")) {
+            SQLiteStatement(db, STMT_V2_RENAMEERROROUTPUTS,
+                            sizeof STMT_V2_RENAMEERROROUTPUTS, true);
+            SQLiteStatement(db, STMT_ERROROUTPUTSTABLE, sizeof STMT_ERROROUTPUTSTABLE, true);
+            SQLiteStatement(db, STMT_V2_ERROROUTPUTPATHS,
+                            sizeof STMT_V2_ERROROUTPUTPATHS, true);
+            SQLiteStatement(db, STMT_V2_COPYERROROUTPUTS,
+                            sizeof STMT_V2_COPYERROROUTPUTS, true);
+            SQLiteStatement(db, STMT_V2_DROPERROROUTPUTS,
+                            sizeof STMT_V2_DROPERROROUTPUTS, true);
+        }
+    }
+
+    if (version < 3 && TableExists(db, "Projects")) {
+        SQLiteStatement(db, STMT_V3_ADDDEPSGENERATION,
+                        sizeof STMT_V3_ADDDEPSGENERATION, true);
+    }
+
+    if (version != SCHEMA_VERSION) {
+        char text[64];
+        int nBytes = snprintf(text, sizeof text, "PRAGMA user_version = %d",
+                              SCHEMA_VERSION);
+        SQLiteStatement(db, text, nBytes + 1, true);
+    }
+
+    endTransaction.Exec(db);
+
+    return SCHEMA_VERSION;
+}
+
 unsigned ProjectDBConn::NumProjects() const
 {
     if (!m_stmtNumProjects.GetNextRow(m_dbHandle))
@@ -403,8 +880,15 @@ void ProjectDBConn::ClearDependencies(int projID, const char* outputFile)
     ASSERT(projID >= 0);
     ASSERT(outputFile);
 
+    i64 outputPathID = FindPathDBID(outputFile);
+    if (outputPathID == -1)
+        return; // No dependencies can have been recorded.
+
+    BumpDependencyGeneration(projID);
+    LogDependencyChange(projID, outputFile);
+
     m_stmtClearDeps.BindInt(1, projID);
-    m_stmtClearDeps.BindText(2, outputFile);
+    m_stmtClearDeps.BindInt64(2, outputPathID);
 
     m_stmtClearDeps.Exec(m_dbHandle);
 }
@@ -416,11 +900,38 @@ void ProjectDBConn::RecordDependency(int projID, const char* outputFile,
     ASSERT(outputFile);
     ASSERT(inputFile);
 
-    m_stmtRecordDep.BindInt(1, projID);
-    m_stmtRecordDep.BindText(2, inputFile);
-    m_stmtRecordDep.BindText(3, outputFile);
+    BumpDependencyGeneration(projID);
+    LogDependencyChange(projID, outputFile);
 
-    m_stmtRecordDep.Exec(m_dbHandle);
+    i64 row[] = { projID, GetPathDBID(inputFile), GetPathDBID(outputFile) };
+    m_bulkRecordDeps.AddRow(row);
+    m_bulkRecordDeps.Exec(m_dbHandle);
+}
+
+void ProjectDBConn::SetDependencies(int projID, const char* outputFile,
+                                    const std::vector<const char*>& inputFiles)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFile);
+
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+
+    BumpDependencyGeneration(projID);
+    LogDependencyChange(projID, outputFile);
+
+    i64 outputPathID = GetPathDBID(outputFile);
+
+    m_stmtClearDeps.BindInt(1, projID);
+    m_stmtClearDeps.BindInt64(2, outputPathID);
+    m_stmtClearDeps.Exec(m_dbHandle);
+
+    for (size_t i = 0; i < inputFiles.size(); ++i) {
+        i64 row[] = { projID, GetPathDBID(inputFiles[i]), outputPathID };
+        m_bulkRecordDeps.AddRow(row);
+    }
+    m_bulkRecordDeps.Exec(m_dbHandle);
+
+    m_stmtEndTransaction.Exec(m_dbHandle);
 }
 
 void ProjectDBConn::GetDependents(int projID, const char* inputFile,
@@ -432,76 +943,501 @@ void ProjectDBConn::GetDependents(int projID, const char* inputFile,
 
     outputFiles->clear();
 
+    i64 inputPathID = FindPathDBID(inputFile);
+    if (inputPathID == -1)
+        return;
+
     m_stmtGetDeps.BindInt(1, projID);
-    m_stmtGetDeps.BindText(2, inputFile);
+    m_stmtGetDeps.BindInt64(2, inputPathID);
 
     while (m_stmtGetDeps.GetNextRow(m_dbHandle))
         outputFiles->push_back(m_stmtGetDeps.ColumnText(0));
 }
 
-void ProjectDBConn::ClearError(
+void ProjectDBConn::GetDependencies(int projID, const char* outputFile,
+                                    std::vector<std::string>* inputFiles)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFile);
+    ASSERT(inputFiles);
+
+    inputFiles->clear();
+
+    i64 outputPathID = FindPathDBID(outputFile);
+    if (outputPathID == -1)
+        return;
+
+    m_stmtGetInputDeps.BindInt(1, projID);
+    m_stmtGetInputDeps.BindInt64(2, outputPathID);
+
+    while (m_stmtGetInputDeps.GetNextRow(m_dbHandle))
+        inputFiles->push_back(m_stmtGetInputDeps.ColumnText(0));
+}
+
+void ProjectDBConn::QueryAllOutputs(int projID, std::vector<std::string>* outputFiles)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFiles);
+
+    outputFiles->clear();
+
+    m_stmtGetAllOutputs.BindInt(1, projID);
+    while (m_stmtGetAllOutputs.GetNextRow(m_dbHandle))
+        outputFiles->push_back(m_stmtGetAllOutputs.ColumnText(0));
+}
+
+// N.B. The Paths table is shared between projects, so rather than renaming
+// the path itself, the project's dependencies are pointed at a new one.
+void ProjectDBConn::RenameDependencyPath(int projID, const char* oldPath,
+                                         const char* newPath)
+{
+    ASSERT(projID >= 0);
+    ASSERT(oldPath);
+    ASSERT(newPath);
+
+    i64 oldPathID = FindPathDBID(oldPath);
+    if (oldPathID == -1)
+        return; // No dependencies can have been recorded.
+
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+
+    BumpDependencyGeneration(projID);
+    // Any number of outputs' dependencies can change.
+    if (projID == m_depChangesProjID)
+        m_depChangesKnown = false;
+
+    i64 newPathID = GetPathDBID(newPath);
+
+    m_stmtRenameDepInputs.BindInt64(1, newPathID);
+    m_stmtRenameDepInputs.BindInt(2, projID);
+    m_stmtRenameDepInputs.BindInt64(3, oldPathID);
+    m_stmtRenameDepInputs.Exec(m_dbHandle);
+
+    m_stmtRenameDepOutputs.BindInt64(1, newPathID);
+    m_stmtRenameDepOutputs.BindInt(2, projID);
+    m_stmtRenameDepOutputs.BindInt64(3, oldPathID);
+    m_stmtRenameDepOutputs.Exec(m_dbHandle);
+
+    m_stmtEndTransaction.Exec(m_dbHandle);
+}
+
+void ProjectDBConn::QueryAllDependencies(int projID, PathTable* paths,
+                                         std::vector<DependencyEdge>* edges,
+                                         i64* generation)
+{
+    ASSERT(projID >= 0);
+    ASSERT(paths);
+    ASSERT(edges);
+    ASSERT(generation);
+
+    edges->clear();
+
+    // The generation must match the dependencies that are returned.
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+
+    *generation = ReadDependencyGeneration(projID);
+
+    m_stmtGetAllDeps.BindInt(1, projID);
+    while (m_stmtGetAllDeps.GetNextRow(m_dbHandle)) {
+        DependencyEdge edge;
+        edge.inputPath = paths->Intern(m_stmtGetAllDeps.ColumnText(0));
+        edge.outputPath = paths->Intern(m_stmtGetAllDeps.ColumnText(1));
+        edges->push_back(edge);
+    }
+
+    m_stmtEndTransaction.Exec(m_dbHandle);
+}
+
+i64 ProjectDBConn::GetDependencyGeneration(int projID)
+{
+    ASSERT(projID >= 0);
+
+    std::unordered_map<int, i64>::const_iterator it = m_depsGenerations.find(projID);
+    if (it == m_depsGenerations.end())
+        return ReadDependencyGeneration(projID);
+
+    // The next change to the dependencies must be seen to change the
+    // generation (see BumpDependencyGeneration()).
+    m_depsGenerationsBumped.erase(projID);
+    return it->second;
+}
+
+void ProjectDBConn::TrackDependencyChanges(int projID, i64 generation)
+{
+    ASSERT(projID >= 0);
+
+    m_depChangesProjID = projID;
+    m_depChangesGeneration = generation;
+    m_depChangesKnown = true;
+    m_depChanges.clear();
+}
+
+bool ProjectDBConn::TakeDependencyChanges(int projID, i64 sinceGeneration,
+                                          std::vector<std::string>* outputFiles,
+                                          i64* generation)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFiles);
+    ASSERT(generation);
+
+    outputFiles->clear();
+
+    if (projID != m_depChangesProjID || !m_depChangesKnown ||
+        sinceGeneration != m_depChangesGeneration)
+        return false;
+
+    outputFiles->assign(m_depChanges.begin(), m_depChanges.end());
+    m_depChanges.clear();
+
+    // N.B. Reading the generation means the next change will increment it.
+    *generation = GetDependencyGeneration(projID);
+    m_depChangesGeneration = *generation;
+    return true;
+}
+
+i64 ProjectDBConn::ReadDependencyGeneration(int projID)
+{
+    ASSERT(projID >= 0);
+
+    m_depsGenerationsBumped.erase(projID);
+
+    m_stmtGetDepsGeneration.BindInt(1, projID);
+    if (!m_stmtGetDepsGeneration.GetNextRow(m_dbHandle))
+        FATAL("No data found");
+    i64 generation = m_stmtGetDepsGeneration.ColumnInt64(0);
+    m_stmtGetDepsGeneration.Reset(m_dbHandle);
+
+    m_depsGenerations[projID] = generation;
+    return generation;
+}
+
+// A build changes the dependencies of many files, so rather than being
+// incremented for every change, the generation is only incremented for the
+// first change since it was last read. That's enough to tell a reader that
+// the dependencies they saw are out of date.
+void ProjectDBConn::BumpDependencyGeneration(int projID)
+{
+    if (m_depsGenerationsBumped.find(projID) != m_depsGenerationsBumped.end())
+        return;
+
+    m_stmtBumpDepsGeneration.BindInt(1, projID);
+    m_stmtBumpDepsGeneration.Exec(m_dbHandle);
+
+    // N.B. If the generation hasn't been read yet, there's nothing to keep
+    // up to date.
+    std::unordered_map<int, i64>::iterator it = m_depsGenerations.find(projID);
+    if (it != m_depsGenerations.end())
+        ++it->second;
+    m_depsGenerationsBumped.insert(projID);
+}
+
+void ProjectDBConn::LogDependencyChange(int projID, const char* outputFile)
+{
+    if (projID == m_depChangesProjID && m_depChangesKnown)
+        m_depChanges.insert(outputFile);
+}
+
+u64 ProjectDBConn::GetCleanStamp(int projID, const char* outputFile)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFile);
+
+    if (projID != m_cleanStampsProjID)
+        LoadCleanStamps(projID);
+
+    PathID id = m_pathTable.Find(outputFile, strlen(outputFile));
+    if (id == INVALID_PATH_ID)
+        return 0;
+    std::unordered_map<PathID, u64>::const_iterator it = m_cleanStamps.find(id);
+    return it != m_cleanStamps.end() ? it->second : 0;
+}
+
+void ProjectDBConn::SetCleanStamp(int projID, const char* outputFile, u64 stamp)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFile);
+
+    if (projID != m_cleanStampsProjID)
+        LoadCleanStamps(projID);
+
+    if (stamp == 0) {
+        // Any path with a stamp was interned when the stamp was loaded or set.
+        PathID id = m_pathTable.Find(outputFile, strlen(outputFile));
+        if (id == INVALID_PATH_ID || m_cleanStamps.erase(id) == 0)
+            return; // There was no stamp to remove.
+        m_stmtClearCleanStamp.BindInt(1, projID);
+        m_stmtClearCleanStamp.BindInt64(2, GetPathDBID(outputFile));
+        m_stmtClearCleanStamp.Exec(m_dbHandle);
+        return;
+    }
+
+    PathID id = m_pathTable.Intern(outputFile);
+    std::unordered_map<PathID, u64>::iterator it = m_cleanStamps.find(id);
+    if (it != m_cleanStamps.end() && it->second == stamp)
+        return;
+    m_cleanStamps[id] = stamp;
+
+    m_stmtSetCleanStamp.BindInt(1, projID);
+    m_stmtSetCleanStamp.BindInt64(2, GetPathDBID(outputFile));
+    m_stmtSetCleanStamp.BindInt64(3, (i64)stamp);
+    m_stmtSetCleanStamp.Exec(m_dbHandle);
+}
+
+void ProjectDBConn::LoadCleanStamps(int projID)
+{
+    m_cleanStamps.clear();
+    m_cleanStampsProjID = projID;
+
+    m_stmtGetCleanStamps.BindInt(1, projID);
+    while (m_stmtGetCleanStamps.GetNextRow(m_dbHandle)) {
+        PathID id = m_pathTable.Intern(m_stmtGetCleanStamps.ColumnText(0));
+        m_cleanStamps[id] = (u64)m_stmtGetCleanStamps.ColumnInt64(1);
+    }
+}
+
+// Paths are interned in m_pathTable, which maps them to the index in
+// m_pathDBIDs of their ID in the Paths table (or -1 if it isn't known yet).
+// So each distinct path is only looked up in the database once.
+//
+// N.B. This relies on paths never being removed from the Paths table.
+i64* ProjectDBConn::GetCachedPathDBID(PathID id)
+{
+    if (id >= m_pathDBIDs.size())
+        m_pathDBIDs.resize(id + 1, -1);
+    return &m_pathDBIDs[id];
+}
+
+// Returns -1 if the path isn't in the database. The path isn't interned, so
+// looking up paths that were never recorded (e.g. every file the watcher sees)
+// doesn't grow m_pathTable; only GetPathDBID adds paths.
+i64 ProjectDBConn::FindPathDBID(const char* path)
+{
+    size_t length = strlen(path);
+    PathID id = m_pathTable.Find(path, length);
+    if (id != INVALID_PATH_ID) {
+        i64 cachedID = *GetCachedPathDBID(id);
+        if (cachedID != -1)
+            return cachedID;
+    }
+
+    i64 pathID = -1;
+    m_stmtFindPath.BindText(1, path, (int)length);
+    if (m_stmtFindPath.GetNextRow(m_dbHandle)) {
+        pathID = m_stmtFindPath.ColumnInt64(0);
+        m_stmtFindPath.Reset(m_dbHandle);
+        if (id != INVALID_PATH_ID)
+            *GetCachedPathDBID(id) = pathID;
+    }
+
+    return pathID;
+}
+
+// Adds the path to the database if it isn't there already.
+i64 ProjectDBConn::GetPathDBID(const char* path)
+{
+    i64 pathID = FindPathDBID(path);
+    if (pathID != -1)
+        return pathID;
+
+    PathID id = m_pathTable.Intern(path);
+    m_stmtAddPath.BindText(1, m_pathTable.GetPath(id),
+                           (int)m_pathTable.GetPathLength(id));
+    m_stmtAddPath.Exec(m_dbHandle);
+
+    pathID = FindPathDBID(path);
+    if (pathID == -1)
+        FATAL("Failed to add path");
+    return pathID;
+}
+
+int ProjectDBConn::ClearError(
     int projID,
     const std::vector<std::string>& inputFiles,
     const std::vector<std::string>& additionalInputFiles,
     const std::vector<std::string>& outputFiles
 )
 {
-    int errorID = FindErrorID(projID, inputFiles, outputFiles);
+    MakeErrorKey(inputFiles, outputFiles, &m_errorKey);
+    u64 keyHash = HashErrorKey(projID, m_errorKey.data(), m_errorKey.size());
+
+    // Almost every successfully compiled asset gets here, but very few of them
+    // will have had an error, so avoid touching the database if possible.
+    if (!MayHaveError(keyHash))
+        return -1;
+
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+    int errorID = ClearErrorInternal(projID, m_errorKey, keyHash);
+    m_stmtEndTransaction.Exec(m_dbHandle);
+
+    return errorID;
+}
+
+// N.B. Must be called inside a transaction.
+int ProjectDBConn::ClearErrorInternal(int projID, const std::string& key,
+                                      u64 keyHash)
+{
+    if (!MayHaveError(keyHash))
+        return -1;
+
+    int errorID = FindErrorID(projID, key);
 
     if (errorID == -1)
-        return; // Error not in database; don't need to do anything.
+        return -1; // Error not in database; don't need to do anything.
+
+    DeleteError(projID, errorID, keyHash);
+    return errorID;
+}
 
+void ProjectDBConn::DeleteError(int projID, int errorID, u64 keyHash)
+{
     m_stmtErrorDelete1.BindInt(1, errorID);
     m_stmtErrorDelete2.BindInt(1, errorID);
     m_stmtErrorDelete3.BindInt(1, errorID);
 
-    m_stmtBeginTransaction.Exec(m_dbHandle);
     m_stmtErrorDelete1.Exec(m_dbHandle);
     m_stmtErrorDelete2.Exec(m_dbHandle);
     m_stmtErrorDelete3.Exec(m_dbHandle);
+
+    // N.B. Only one instance is removed, as other errors may share the hash.
+    if (m_errorKeyHashesLoaded) {
+        std::unordered_multiset<u64>::iterator it = m_errorKeyHashes.find(keyHash);
+        if (it != m_errorKeyHashes.end())
+            m_errorKeyHashes.erase(it);
+    }
+
+    LogErrorChange(projID, errorID, false);
+}
+
+void ProjectDBConn::ClearErrorsForOutput(int projID, const char* outputFile,
+                                         std::vector<int>* clearedErrorIDs)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFile);
+    ASSERT(clearedErrorIDs);
+
+    i64 pathID = FindPathDBID(outputFile);
+    if (pathID == -1)
+        return; // No errors can have been recorded.
+
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+
+    // The errors are found before any are deleted, so that the query isn't
+    // still running while its table changes.
+    std::vector<std::pair<int, u64>> errors;
+    m_stmtFindErrorsByOutput.BindInt(1, projID);
+    m_stmtFindErrorsByOutput.BindInt64(2, pathID);
+    while (m_stmtFindErrorsByOutput.GetNextRow(m_dbHandle)) {
+        int keyBytes;
+        const void* key = m_stmtFindErrorsByOutput.ColumnBlob(1, &keyBytes);
+        errors.push_back(std::make_pair(m_stmtFindErrorsByOutput.ColumnInt(0),
+                                        HashErrorKey(projID, key, (size_t)keyBytes)));
+    }
+
+    for (size_t i = 0; i < errors.size(); ++i) {
+        DeleteError(projID, errors[i].first, errors[i].second);
+        clearedErrorIDs->push_back(errors[i].first);
+    }
+
     m_stmtEndTransaction.Exec(m_dbHandle);
 }
 
-// TODO: This is case sensitive. Is that what we want?
-static u64 Hash(const std::vector<std::string>& inputFiles,
-                const std::vector<std::string>& outputFiles)
+u64 ProjectDBConn::HashErrorKey(int projID, const void* key, size_t keyBytes)
 {
-    MD5_CTX ctx;
-    MD5_Init(&ctx);
+    u64 hash = HashFNV1a64(&projID, sizeof projID);
+    return HashFNV1a64(key, keyBytes, hash);
+}
 
-    for (size_t i = 0; i < inputFiles.size(); ++i) {
-        MD5_Update(&ctx, (void*)inputFiles[i].c_str(), inputFiles[i].size());
+// Returns false only if there's definitely no error with the given key hash.
+bool ProjectDBConn::MayHaveError(u64 keyHash)
+{
+    if (!m_errorKeyHashesLoaded)
+        LoadErrorKeyHashes();
+    return m_errorKeyHashes.find(keyHash) != m_errorKeyHashes.end();
+}
+
+// N.B. The hashes are only kept up to date with the errors that this
+// connection records or clears. This is fine because only the asset pipeline
+// itself modifies errors, using a single connection.
+void ProjectDBConn::LoadErrorKeyHashes()
+{
+    m_errorKeyHashes.clear();
+
+    while (m_stmtAllErrorKeys.GetNextRow(m_dbHandle)) {
+        int projID = m_stmtAllErrorKeys.ColumnInt(0);
+        int keyBytes;
+        const void* key = m_stmtAllErrorKeys.ColumnBlob(1, &keyBytes);
+        m_errorKeyHashes.insert(HashErrorKey(projID, key, (size_t)keyBytes));
     }
-    for (size_t i = 0; i < outputFiles.size(); ++i) {
-        MD5_Update(&ctx, (void*)outputFiles[i].c_str(), outputFiles[i].size());
+
+    m_errorKeyHashesLoaded = true;
+}
+
+void ProjectDBConn::LogErrorChange(int projID, int errorID, bool added)
+{
+    m_stmtErrorLogAdd.BindInt(1, projID);
+    m_stmtErrorLogAdd.BindInt(2, errorID);
+    m_stmtErrorLogAdd.BindInt(3, added ? 1 : 0);
+
+    m_stmtErrorLogAdd.Exec(m_dbHandle);
+
+    if (++m_nErrorLogChanges >= ERROR_LOG_TRIM_INTERVAL) {
+        m_stmtTrimErrorLog.Exec(m_dbHandle);
+        m_nErrorLogChanges = 0;
     }
+}
 
-    u8 result[16];
-    MD5_Final(result, &ctx);
-    u64 ret = (u64(result[0]) << 56) | (u64(result[1]) << 48) |
-              (u64(result[2]) << 40) | (u64(result[3]) << 32) |
-              (u64(result[4]) << 24) | (u64(result[5]) << 16) |
-              (u64(result[6]) << 8) | u64(result[7]);
+static void AppendU32(std::string* str, u32 value)
+{
+    str->push_back((char)(value & 0xFF));
+    str->push_back((char)((value >> 8) & 0xFF));
+    str->push_back((char)((value >> 16) & 0xFF));
+    str->push_back((char)((value >> 24) & 0xFF));
+}
 
-    return ret;
+static void AppendPaths(std::string* str, const std::vector<std::string>& paths)
+{
+    AppendU32(str, (u32)paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        AppendU32(str, (u32)paths[i].size());
+        str->append(paths[i]);
+    }
+}
+
+// Errors are identified by their (core) input and output paths. These are
+// serialized into a key, with each list and path prefixed by its length, so
+// that no two different sets of paths give the same key.
+// TODO: This is case sensitive. Is that what we want?
+void ProjectDBConn::MakeErrorKey(const std::vector<std::string>& inputFiles,
+                                 const std::vector<std::string>& outputFiles,
+                                 std::string* key)
+{
+    key->clear();
+    AppendPaths(key, inputFiles);
+    AppendPaths(key, outputFiles);
 }
 
-void ProjectDBConn::RecordError(
+int ProjectDBConn::RecordError(
     int projID,
     const std::vector<std::string>& inputFiles,
     const std::vector<std::string>& additionalInputFiles,
     const std::vector<std::string>& outputFiles,
-    const std::string& errorMessage
+    const std::string& errorMessage,
+    int* clearedErrorID
 )
 {
-    // TODO: Don't necessarily need to clear the error every time.
-    ClearError(projID, inputFiles, additionalInputFiles, outputFiles);
+    MakeErrorKey(inputFiles, outputFiles, &m_errorKey);
+    u64 keyHash = HashErrorKey(projID, m_errorKey.data(), m_errorKey.size());
+
+    m_stmtBeginTransaction.Exec(m_dbHandle);
 
-    u64 hash = Hash(inputFiles, outputFiles);
+    // TODO: Don't necessarily need to clear the error every time.
+    int oldErrorID = ClearErrorInternal(projID, m_errorKey, keyHash);
+    if (clearedErrorID)
+        *clearedErrorID = oldErrorID;
 
     m_stmtNewError.BindInt(1, projID);
-    m_stmtNewError.BindInt64(2, hash);
-    m_stmtNewError.BindText(3, errorMessage.c_str());
+    m_stmtNewError.BindBlob(2, m_errorKey.data(), (int)m_errorKey.size());
+    m_stmtNewError.BindText(3, errorMessage.data(), (int)errorMessage.size());
 
     m_stmtNewError.Exec(m_dbHandle);
 
@@ -510,100 +1446,219 @@ void ProjectDBConn::RecordError(
         FATAL("Error ID too large");
 
     for (size_t i = 0; i < inputFiles.size(); ++i) {
-        m_stmtErrorAddInput.BindInt(1, (int)errorID);
-        m_stmtErrorAddInput.BindInt(2, (int)i);
-        m_stmtErrorAddInput.BindInt(3, 0); // IsAdditionalPath = false
-        m_stmtErrorAddInput.BindText(4, inputFiles[i].c_str());
-
-        m_stmtErrorAddInput.Exec(m_dbHandle);
+        // IsAdditionalPath = false
+        i64 row[] = { errorID, (i64)i, 0, GetPathDBID(inputFiles[i].c_str()) };
+        m_bulkErrorAddInputs.AddRow(row);
     }
     for (size_t i = 0; i < additionalInputFiles.size(); ++i) {
-        m_stmtErrorAddInput.BindInt(1, (int)errorID);
         // Additional inputs are in no order; order them after the core inputs.
-        m_stmtErrorAddInput.BindInt(2, INT_MAX);
-        m_stmtErrorAddInput.BindInt(3, 1); // IsAdditionalPath = true
-        m_stmtErrorAddInput.BindText(4, additionalInputFiles[i].c_str());
-
-        m_stmtErrorAddInput.Exec(m_dbHandle);
+        // IsAdditionalPath = true
+        i64 row[] = { errorID, INT_MAX, 1,
+                      GetPathDBID(additionalInputFiles[i].c_str()) };
+        m_bulkErrorAddInputs.AddRow(row);
     }
-    for (size_t i = 0; i < outputFiles.size(); ++i) {
-        m_stmtErrorAddOutput.BindInt(1, (int)errorID);
-        m_stmtErrorAddOutput.BindInt(2, (int)i);
-        m_stmtErrorAddOutput.BindText(3, outputFiles[i].c_str());
+    m_bulkErrorAddInputs.Exec(m_dbHandle);
 
-        m_stmtErrorAddOutput.Exec(m_dbHandle);
+    for (size_t i = 0; i < outputFiles.size(); ++i) {
+        i64 row[] = { errorID, (i64)i, GetPathDBID(outputFiles[i].c_str()) };
+        m_bulkErrorAddOutputs.AddRow(row);
     }
+    m_bulkErrorAddOutputs.Exec(m_dbHandle);
+
+    m_errorKeyHashes.insert(keyHash);
+
+    LogErrorChange(projID, (int)errorID, true);
+
+    m_stmtEndTransaction.Exec(m_dbHandle);
+
+    return (int)errorID;
 }
 
 // Returns -1 if not found.
-int ProjectDBConn::FindErrorID(
-    int projID,
-    const std::vector<std::string>& inputFiles,
-    const std::vector<std::string>& outputFiles
-)
+int ProjectDBConn::FindErrorID(int projID, const std::string& key)
 {
-    u64 hash = Hash(inputFiles, outputFiles);
+    m_stmtFindError.BindInt(1, projID);
+    m_stmtFindError.BindBlob(2, key.data(), (int)key.size());
 
-    m_stmtFetchErrors.BindInt(1, projID);
-    m_stmtFetchErrors.BindInt64(2, hash);
+    int errorID = -1;
+    if (m_stmtFindError.GetNextRow(m_dbHandle)) {
+        errorID = m_stmtFindError.ColumnInt(0);
+        m_stmtFindError.Reset(m_dbHandle);
+    }
 
-    int trueErrorID = -1;
+    return errorID;
+}
 
-    while (m_stmtFetchErrors.GetNextRow(m_dbHandle)) {
-        int errorID = m_stmtFetchErrors.ColumnInt(0);
+void ProjectDBConn::QueryAllErrorIDs(int projID, std::vector<int>* vec) const
+{
+    ASSERT(vec);
+    ASSERT(projID >= 0);
 
-        if (MatchError(errorID, inputFiles, outputFiles)) {
-            m_stmtFetchErrors.Reset(m_dbHandle);
-            trueErrorID = errorID;
-            break;
-        }
+    vec->clear();
+
+    m_stmtQueryAllErrors.BindInt(1, projID);
+    while (m_stmtQueryAllErrors.GetNextRow(m_dbHandle))
+        vec->push_back(m_stmtQueryAllErrors.ColumnInt(0));
+}
+
+void ProjectDBConn::QueryRuleDurations(int projID, std::vector<RuleDuration>* durations) const
+{
+    ASSERT(durations);
+    ASSERT(projID >= 0);
+
+    durations->clear();
+
+    m_stmtGetRuleDurations.BindInt(1, projID);
+    while (m_stmtGetRuleDurations.GetNextRow(m_dbHandle)) {
+        RuleDuration duration;
+        duration.rule = m_stmtGetRuleDurations.ColumnText(0);
+        duration.averageMs = m_stmtGetRuleDurations.ColumnInt64(1);
+        duration.nSamples = m_stmtGetRuleDurations.ColumnInt(2);
+        durations->push_back(duration);
     }
+}
+
+void ProjectDBConn::SetRuleDurations(int projID, const std::vector<RuleDuration>& durations)
+{
+    ASSERT(projID >= 0);
+
+    if (durations.empty())
+        return;
 
-    return trueErrorID;
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+    for (size_t i = 0; i < durations.size(); ++i) {
+        const RuleDuration& duration = durations[i];
+        m_stmtSetRuleDuration.BindInt(1, projID);
+        m_stmtSetRuleDuration.BindText(2, duration.rule.data(), (int)duration.rule.size());
+        m_stmtSetRuleDuration.BindInt64(3, duration.averageMs);
+        m_stmtSetRuleDuration.BindInt(4, duration.nSamples);
+        m_stmtSetRuleDuration.Exec(m_dbHandle);
+    }
+    m_stmtEndTransaction.Exec(m_dbHandle);
 }
 
-bool ProjectDBConn::MatchError(
-    int errorID,
-    const std::vector<std::string>& inputFiles,
-    const std::vector<std::string>& outputFiles)
+void ProjectDBConn::QueryAssetCosts(int projID, std::vector<AssetCost>* costs) const
 {
-    return MatchInputsOrOutputs(errorID, inputFiles, m_stmtErrorGetCoreInputs) &&
-           MatchInputsOrOutputs(errorID, outputFiles, m_stmtErrorGetOutputs);
+    ASSERT(costs);
+    ASSERT(projID >= 0);
+
+    costs->clear();
+
+    m_stmtGetAssetCosts.BindInt(1, projID);
+    while (m_stmtGetAssetCosts.GetNextRow(m_dbHandle)) {
+        AssetCost cost;
+        cost.path = m_stmtGetAssetCosts.ColumnText(0);
+        cost.wallMs = m_stmtGetAssetCosts.ColumnInt64(1);
+        cost.cpuMs = m_stmtGetAssetCosts.ColumnInt64(2);
+        cost.maxRssKB = (u64)m_stmtGetAssetCosts.ColumnInt64(3);
+        cost.criticalPathMs = m_stmtGetAssetCosts.ColumnInt64(4);
+        costs->push_back(cost);
+    }
 }
 
-bool ProjectDBConn::MatchInputsOrOutputs(
-    int errorID,
-    const std::vector<std::string>& paths,
-    SQLiteStatement& stmt
-)
+void ProjectDBConn::SetAssetCosts(int projID, const std::vector<AssetCost>& costs)
 {
-    stmt.BindInt(1, errorID);
+    ASSERT(projID >= 0);
 
-    bool matched = true;
+    if (costs.empty())
+        return;
 
-    int i = 0;
-    for (; stmt.GetNextRow(m_dbHandle); ++i) {
-        const char* path = stmt.ColumnText(0);
-        if (strcmp(path, paths[i].c_str()) != 0) {
-            stmt.Reset(m_dbHandle);
-            matched = false;
-            break;
-        }
+    m_stmtBeginTransaction.Exec(m_dbHandle);
+    for (size_t i = 0; i < costs.size(); ++i) {
+        const AssetCost& cost = costs[i];
+        m_stmtSetAssetCost.BindInt(1, projID);
+        m_stmtSetAssetCost.BindInt64(2, GetPathDBID(cost.path.c_str()));
+        m_stmtSetAssetCost.BindInt64(3, cost.wallMs);
+        m_stmtSetAssetCost.BindInt64(4, cost.cpuMs);
+        m_stmtSetAssetCost.BindInt64(5, (i64)cost.maxRssKB);
+        m_stmtSetAssetCost.BindInt64(6, cost.criticalPathMs);
+        m_stmtSetAssetCost.Exec(m_dbHandle);
     }
+    m_stmtEndTransaction.Exec(m_dbHandle);
+}
 
-    return matched;
+void ProjectDBConn::ClearAssetCost(int projID, const char* outputFile)
+{
+    ASSERT(projID >= 0);
+    ASSERT(outputFile);
+
+    i64 outputPathID = FindPathDBID(outputFile);
+    if (outputPathID == -1)
+        return; // No cost can have been recorded.
+
+    m_stmtClearAssetCost.BindInt(1, projID);
+    m_stmtClearAssetCost.BindInt64(2, outputPathID);
+    m_stmtClearAssetCost.Exec(m_dbHandle);
 }
 
-void ProjectDBConn::QueryAllErrorIDs(int projID, std::vector<int>* vec) const
+void ProjectDBConn::QueryErrorList(int projID, std::vector<ErrorListEntry>* errors,
+                                   i64* version) const
 {
-    ASSERT(vec);
     ASSERT(projID >= 0);
+    ASSERT(errors);
+    ASSERT(version);
 
-    vec->clear();
+    errors->clear();
 
-    m_stmtQueryAllErrors.BindInt(1, projID);
-    while (m_stmtQueryAllErrors.GetNextRow(m_dbHandle))
-        vec->push_back(m_stmtQueryAllErrors.ColumnInt(0));
+    // N.B. The version is read first, so that any changes made while the
+    // errors are being read are picked up by the next QueryErrorListChanges().
+    if (!m_stmtErrorListVersion.GetNextRow(m_dbHandle))
+        FATAL("No data found");
+    *version = m_stmtErrorListVersion.ColumnInt64(0);
+    m_stmtErrorListVersion.Reset(m_dbHandle);
+
+    m_stmtQueryErrorList.BindInt(1, projID);
+    while (m_stmtQueryErrorList.GetNextRow(m_dbHandle)) {
+        // Errors without any input paths aren't listed.
+        if (m_stmtQueryErrorList.IsColumnNull(1))
+            continue;
+        ErrorListEntry entry;
+        entry.errorID = m_stmtQueryErrorList.ColumnInt(0);
+        entry.firstInputPath = m_stmtQueryErrorList.ColumnText(1);
+        errors->push_back(entry);
+    }
+}
+
+bool ProjectDBConn::QueryErrorListChanges(int projID, i64 sinceVersion,
+                                          std::vector<ErrorListChange>* changes,
+                                          i64* version) const
+{
+    ASSERT(projID >= 0);
+    ASSERT(changes);
+    ASSERT(version);
+
+    changes->clear();
+    *version = sinceVersion;
+
+    if (!m_stmtErrorLogRange.GetNextRow(m_dbHandle))
+        FATAL("No data found");
+    bool empty = m_stmtErrorLogRange.IsColumnNull(0);
+    i64 oldest = empty ? 0 : m_stmtErrorLogRange.ColumnInt64(0);
+    i64 latest = empty ? 0 : m_stmtErrorLogRange.ColumnInt64(1);
+    m_stmtErrorLogRange.Reset(m_dbHandle);
+
+    // If the version is newer than anything in the log, the log must have
+    // been recreated (e.g. when the schema was upgraded).
+    if (sinceVersion > latest)
+        return false;
+    if (empty)
+        return true; // Nothing has ever changed.
+    if (sinceVersion + 1 < oldest)
+        return false; // Changes have been trimmed from the log.
+
+    m_stmtQueryErrorChanges.BindInt(1, projID);
+    m_stmtQueryErrorChanges.BindInt64(2, sinceVersion);
+    while (m_stmtQueryErrorChanges.GetNextRow(m_dbHandle)) {
+        ErrorListChange change;
+        *version = m_stmtQueryErrorChanges.ColumnInt64(0);
+        change.errorID = m_stmtQueryErrorChanges.ColumnInt(1);
+        change.added = m_stmtQueryErrorChanges.ColumnInt(2) != 0;
+        if (!m_stmtQueryErrorChanges.IsColumnNull(3))
+            change.firstInputPath = m_stmtQueryErrorChanges.ColumnText(3);
+        changes->push_back(change);
+    }
+
+    return true;
 }
 
 bool ProjectDBConn::ErrorExists(int errorID) const
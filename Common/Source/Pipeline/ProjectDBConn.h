@@ -3,11 +3,53 @@
 
 #include <string>
 #include <vector>
+#include <unordered_set>
+#include <unordered_map>
 #include <Core/Types.h>
+#include "PathTable.h"
 
 struct sqlite3;
 struct sqlite3_stmt;
 
+struct ErrorListEntry {
+    int errorID;
+    std::string firstInputPath;
+};
+
+struct ErrorListChange {
+    int errorID;
+    bool added;
+    // Empty if the error has since been removed again.
+    std::string firstInputPath;
+};
+
+struct RuleDuration {
+    std::string rule;
+    // The average time taken by the rule's jobs, and how many jobs that
+    // average is made from.
+    i64 averageMs;
+    int nSamples;
+};
+
+// What building an asset took, the last time it was built.
+struct AssetCost {
+    std::string path;
+    i64 wallMs;
+    // Used by the tools that were run, as reported by wait4(). The peak
+    // memory is that of the biggest tool.
+    i64 cpuMs;
+    u64 maxRssKB;
+    // The longest chain of built assets leading up to this one (including
+    // it), i.e. how long the asset takes to build if none of its inputs are
+    // up to date.
+    i64 criticalPathMs;
+};
+
+struct DependencyEdge {
+    PathID inputPath;
+    PathID outputPath;
+};
+
 class ProjectDBConn {
 public:
     ProjectDBConn();
@@ -27,23 +69,111 @@ public:
     void ClearDependencies(int projID, const char* outputFile);
     void RecordDependency(int projID, const char* outputFile,
                           const char* inputFile);
+    // Replaces all of the output file's dependencies, in a single transaction.
+    void SetDependencies(int projID, const char* outputFile,
+                         const std::vector<const char*>& inputFiles);
     void GetDependents(int projID, const char* inputFile,
                        std::vector<std::string>* outputFiles);
+    // Fetches the input files that the output file depends on.
+    void GetDependencies(int projID, const char* outputFile,
+                         std::vector<std::string>* inputFiles);
+    // Fetches every output file that has dependencies recorded.
+    void QueryAllOutputs(int projID, std::vector<std::string>* outputFiles);
+    // Moves all of the project's dependencies on or of oldPath to newPath.
+    void RenameDependencyPath(int projID, const char* oldPath, const char* newPath);
+
+    // Fetches every dependency in the project, interning the paths in the
+    // given table. The generation is a counter that changes whenever the
+    // project's dependencies do, so it can be used to check whether a copy
+    // of the dependencies is still up to date (see GetDependencyGeneration()).
+    void QueryAllDependencies(int projID, PathTable* paths,
+                              std::vector<DependencyEdge>* edges,
+                              i64* generation);
+    // N.B. The generation is read from the database once, and then kept up
+    // to date in memory, so this is cheap enough to call for every lookup.
+    // Changes made by other connections are only seen by
+    // QueryAllDependencies() (which always reads the database), and the
+    // counter is only guaranteed to change if the dependencies are modified
+    // through this connection.
+    i64 GetDependencyGeneration(int projID);
+    // Starts tracking which outputs' dependencies are changed through this
+    // connection after the given generation (which should be the one that
+    // QueryAllDependencies() returned), so that a copy of the dependencies
+    // can be brought up to date without reading all of them again. Only one
+    // project is tracked at a time.
+    void TrackDependencyChanges(int projID, i64 generation);
+    // Fetches the output files whose dependencies have changed since the
+    // given generation. Returns false if the changes aren't known, in which
+    // case the dependencies have to be read again; otherwise sets the new
+    // generation, from which the next changes are tracked.
+    bool TakeDependencyChanges(int projID, i64 sinceGeneration,
+                               std::vector<std::string>* outputFiles,
+                               i64* generation);
 
-    void ClearError(
+    // A clean stamp records that an output was found to be up to date with
+    // its inputs as of the given timestamp, even though the file itself may
+    // be older (because the tool that produces it left it untouched when its
+    // contents didn't change). Returns 0 if the output has no clean stamp.
+    u64 GetCleanStamp(int projID, const char* outputFile);
+    // A stamp of 0 removes the output's clean stamp.
+    void SetCleanStamp(int projID, const char* outputFile, u64 stamp);
+
+    // Returns the ID of the error that was removed, or -1 if there was no
+    // such error.
+    int ClearError(
         int projID,
         const std::vector<std::string>& inputFiles,
         const std::vector<std::string>& additionalInputFiles,
         const std::vector<std::string>& outputFiles
     );
-    void RecordError(
+    // Returns the ID of the new error. If an existing error for the same files
+    // was replaced, its ID is written to clearedErrorID (otherwise, -1 is).
+    // N.B. clearedErrorID may be NULL
+    int RecordError(
         int projID,
         const std::vector<std::string>& inputFiles,
         const std::vector<std::string>& additionalInputFiles,
         const std::vector<std::string>& outputFiles,
-        const std::string& errorMessage
+        const std::string& errorMessage,
+        int* clearedErrorID = NULL
     );
+    // Removes every error that lists the file as one of its outputs (e.g.
+    // because the output has been removed), appending their IDs to
+    // clearedErrorIDs.
+    void ClearErrorsForOutput(int projID, const char* outputFile,
+                              std::vector<int>* clearedErrorIDs);
     void QueryAllErrorIDs(int projID, std::vector<int>* vec) const;
+
+    // Every change to the error list is logged with a sequence number; the
+    // list's version is the sequence number of its latest change.
+    //
+    // QueryErrorList() fetches every error along with its first input path,
+    // and the version of the list at the time. QueryErrorListChanges() then
+    // fetches the changes made since a given version, in order. It returns
+    // false if the log no longer goes back that far, in which case the whole
+    // list must be fetched again.
+    //
+    // N.B. Changes made during QueryErrorList() may be included both in its
+    // results and in the next set of changes, so applying changes should be
+    // idempotent.
+    void QueryErrorList(int projID, std::vector<ErrorListEntry>* errors,
+                        i64* version) const;
+    bool QueryErrorListChanges(int projID, i64 sinceVersion,
+                               std::vector<ErrorListChange>* changes,
+                               i64* version) const;
+
+    // How long each rule's jobs usually take, as recorded by previous builds.
+    void QueryRuleDurations(int projID, std::vector<RuleDuration>* durations) const;
+    // Replaces the recorded durations of the given rules, in a single
+    // transaction.
+    void SetRuleDurations(int projID, const std::vector<RuleDuration>& durations);
+
+    void QueryAssetCosts(int projID, std::vector<AssetCost>* costs) const;
+    // Replaces the recorded costs of the given assets, in a single
+    // transaction.
+    void SetAssetCosts(int projID, const std::vector<AssetCost>& costs);
+    void ClearAssetCost(int projID, const char* outputFile);
+
     bool ErrorExists(int errorID) const;
     std::string GetErrorMessage(int errorID) const;
     void GetErrorInputPaths(int errorID, std::vector<std::string>* inputFiles) const;
@@ -79,9 +209,15 @@ private:
         void BindNull(int pos);
         void BindInt(int pos, int value);
         void BindInt64(int pos, i64 value);
-        void BindText(int pos, const char* str);
+        // N.B. The string isn't copied, so it must stay valid until the
+        // statement has been executed (or the binding is replaced). If nBytes
+        // is negative, the string must be null-terminated.
+        void BindText(int pos, const char* str, int nBytes = -1);
+        void BindBlob(int pos, const void* data, int nBytes);
         int ColumnInt(int index);
+        i64 ColumnInt64(int index);
         const char* ColumnText(int index);
+        const void* ColumnBlob(int index, int* nBytes);
         bool IsColumnNull(int index);
 
     private:
@@ -91,26 +227,85 @@ private:
         sqlite3_stmt* stmt;
     };
 
+    // Inserts any number of rows of integers, using as few statements as
+    // possible. insertText is an INSERT statement without the VALUES clause.
+    class BulkInsertStatement {
+    public:
+        BulkInsertStatement(DBHandle& db, const char* insertText, int nColumns);
+        ~BulkInsertStatement();
+
+        // values must point to one value for each column.
+        void AddRow(const i64* values);
+        // Inserts all of the rows that have been added since the last call.
+        void Exec(const DBHandle& db);
+
+    private:
+        BulkInsertStatement(const BulkInsertStatement&);
+        BulkInsertStatement& operator=(const BulkInsertStatement&);
+
+        static const int N_BATCH_SIZES = 3;
+
+        int m_nColumns;
+        std::vector<i64> m_values;
+        SQLiteStatement* m_stmts[N_BATCH_SIZES];
+    };
+
     ProjectDBConn(const ProjectDBConn&);
     ProjectDBConn& operator=(const ProjectDBConn&);
 
-    int FindErrorID(
-        int projID,
-        const std::vector<std::string>& inputFiles,
-        const std::vector<std::string>& outputFiles
-    );
-    bool MatchError(
-        int errorID,
-        const std::vector<std::string>& inputFiles,
-        const std::vector<std::string>& outputFiles
-    );
-    bool MatchInputsOrOutputs(
-        int errorID,
-        const std::vector<std::string>& paths,
-        SQLiteStatement& stmt
-    );
+    static bool TableExists(DBHandle& db, const char* name);
+    static int UpgradeSchema(DBHandle& db);
+
+    i64 ReadDependencyGeneration(int projID);
+    void BumpDependencyGeneration(int projID);
+    void LogDependencyChange(int projID, const char* outputFile);
+    void LoadCleanStamps(int projID);
+
+    i64* GetCachedPathDBID(PathID id);
+    i64 FindPathDBID(const char* path);
+    i64 GetPathDBID(const char* path);
+
+    static void MakeErrorKey(const std::vector<std::string>& inputFiles,
+                             const std::vector<std::string>& outputFiles,
+                             std::string* key);
+    static u64 HashErrorKey(int projID, const void* key, size_t keyBytes);
+    bool MayHaveError(u64 keyHash);
+    void LoadErrorKeyHashes();
+    int ClearErrorInternal(int projID, const std::string& key, u64 keyHash);
+    void DeleteError(int projID, int errorID, u64 keyHash);
+    void LogErrorChange(int projID, int errorID, bool added);
+    int FindErrorID(int projID, const std::string& key);
 
     DBHandle m_dbHandle;
+    int m_schemaVersion;
+
+    // Reused between calls to avoid reallocating.
+    std::string m_errorKey;
+    // Hashes of the keys of all errors in the database (see MayHaveError()).
+    // Loaded on first use, since most connections never modify errors.
+    std::unordered_multiset<u64> m_errorKeyHashes;
+    bool m_errorKeyHashesLoaded;
+    // The number of changes logged since the error log was last trimmed.
+    int m_nErrorLogChanges;
+    // See GetCachedPathDBID().
+    PathTable m_pathTable;
+    std::vector<i64> m_pathDBIDs;
+    // Projects whose dependency generation has been incremented since it
+    // was last read.
+    std::unordered_set<int> m_depsGenerationsBumped;
+    // The dependency generations that have been read, by project.
+    std::unordered_map<int, i64> m_depsGenerations;
+    // The outputs whose dependencies have changed since m_depChangesGeneration
+    // (see TakeDependencyChanges()). m_depChangesKnown is cleared by changes
+    // that aren't to a single output's dependencies, such as renames.
+    int m_depChangesProjID;
+    i64 m_depChangesGeneration;
+    bool m_depChangesKnown;
+    std::unordered_set<std::string> m_depChanges;
+    // The clean stamps of one project at a time, keyed by the interned output
+    // path. Loaded on first use, and then kept up to date.
+    int m_cleanStampsProjID;
+    std::unordered_map<PathID, u64> m_cleanStamps;
 
     SQLiteStatement m_stmtSetupWAL;
     SQLiteStatement m_stmtBeginTransaction;
@@ -119,10 +314,21 @@ private:
     SQLiteStatement m_stmtProjectsTable;
     SQLiteStatement m_stmtConfigTable;
     SQLiteStatement m_stmtSetupConfig;
+    SQLiteStatement m_stmtPathsTable;
     SQLiteStatement m_stmtDepsTable;
+    SQLiteStatement m_stmtDepsInputIndex;
+    SQLiteStatement m_stmtDepsOutputIndex;
+    SQLiteStatement m_stmtCleanStampsTable;
     SQLiteStatement m_stmtErrorsTable;
+    SQLiteStatement m_stmtErrorsKeyIndex;
     SQLiteStatement m_stmtErrorInputsTable;
     SQLiteStatement m_stmtErrorOutputsTable;
+    SQLiteStatement m_stmtErrorInputsIndex;
+    SQLiteStatement m_stmtErrorOutputsIndex;
+    SQLiteStatement m_stmtErrorLogTable;
+    SQLiteStatement m_stmtTrimErrorLog;
+    SQLiteStatement m_stmtRuleDurationsTable;
+    SQLiteStatement m_stmtAssetCostsTable;
 
     mutable SQLiteStatement m_stmtNumProjects;
     mutable SQLiteStatement m_stmtQueryAllProjects;
@@ -133,23 +339,50 @@ private:
     mutable SQLiteStatement m_stmtGetActiveProj;
     SQLiteStatement m_stmtSetActiveProj;
 
+    SQLiteStatement m_stmtFindPath;
+    SQLiteStatement m_stmtAddPath;
+
     SQLiteStatement m_stmtClearDeps;
-    SQLiteStatement m_stmtRecordDep;
+    BulkInsertStatement m_bulkRecordDeps;
     SQLiteStatement m_stmtGetDeps;
+    SQLiteStatement m_stmtGetInputDeps;
+    SQLiteStatement m_stmtRenameDepInputs;
+    SQLiteStatement m_stmtRenameDepOutputs;
+    SQLiteStatement m_stmtGetAllDeps;
+    SQLiteStatement m_stmtGetAllOutputs;
+    SQLiteStatement m_stmtGetDepsGeneration;
+    SQLiteStatement m_stmtBumpDepsGeneration;
+
+    SQLiteStatement m_stmtGetCleanStamps;
+    SQLiteStatement m_stmtSetCleanStamp;
+    SQLiteStatement m_stmtClearCleanStamp;
 
-    SQLiteStatement m_stmtFetchErrors;
+    SQLiteStatement m_stmtFindError;
+    SQLiteStatement m_stmtAllErrorKeys;
     mutable SQLiteStatement m_stmtErrorExists;
     mutable SQLiteStatement m_stmtErrorGetInputs;
-    mutable SQLiteStatement m_stmtErrorGetCoreInputs;
     mutable SQLiteStatement m_stmtErrorGetOutputs;
     SQLiteStatement m_stmtErrorDelete1;
     SQLiteStatement m_stmtErrorDelete2;
     SQLiteStatement m_stmtErrorDelete3;
+    SQLiteStatement m_stmtFindErrorsByOutput;
     SQLiteStatement m_stmtNewError;
-    SQLiteStatement m_stmtErrorAddInput;
-    SQLiteStatement m_stmtErrorAddOutput;
+    BulkInsertStatement m_bulkErrorAddInputs;
+    BulkInsertStatement m_bulkErrorAddOutputs;
     mutable SQLiteStatement m_stmtQueryAllErrors;
     mutable SQLiteStatement m_stmtErrorGetMessage;
+    SQLiteStatement m_stmtErrorLogAdd;
+    mutable SQLiteStatement m_stmtErrorListVersion;
+    mutable SQLiteStatement m_stmtErrorLogRange;
+    mutable SQLiteStatement m_stmtQueryErrorList;
+    mutable SQLiteStatement m_stmtQueryErrorChanges;
+
+    mutable SQLiteStatement m_stmtGetRuleDurations;
+    SQLiteStatement m_stmtSetRuleDuration;
+
+    mutable SQLiteStatement m_stmtGetAssetCosts;
+    SQLiteStatement m_stmtSetAssetCost;
+    SQLiteStatement m_stmtClearAssetCost;
 };
 
 #endif // PIPELINE_PROJECTDBCONN_H
@@ -0,0 +1,129 @@
+#include "SharedNotificationRing.h"
+
+#include <string.h>
+#include <new>
+#include <Core/Macros.h>
+
+static_assert(offsetof(SharedRingHeader, writePos) == 64, "SharedRingHeader layout");
+static_assert(offsetof(SharedRingHeader, readerSleeping) == 72, "SharedRingHeader layout");
+static_assert(offsetof(SharedRingHeader, readPos) == 128, "SharedRingHeader layout");
+static_assert(offsetof(SharedRingHeader, writerSleeping) == 136, "SharedRingHeader layout");
+
+const size_t DATA_OFFSET = 256;
+static_assert(sizeof(SharedRingHeader) <= DATA_OFFSET, "SharedRingHeader is too big");
+
+const u32 SharedNotificationRing::MAGIC;
+const u32 SharedNotificationRing::VERSION;
+
+SharedNotificationRing::SharedNotificationRing()
+    : m_memory()
+    , m_header(NULL)
+    , m_data(NULL)
+    , m_dataBytes(0)
+    , m_writePos(0)
+{}
+
+bool SharedNotificationRing::Create(const char* name, size_t dataBytes)
+{
+    ASSERT(name);
+    ASSERT(dataBytes > 0 && dataBytes % 4 == 0);
+    ASSERT(!m_header);
+
+    if (!m_memory.Create(name, DATA_OFFSET + dataBytes))
+        return false;
+
+    u8* memory = (u8*)m_memory.GetData();
+    m_header = new (memory) SharedRingHeader();
+    m_header->magic = MAGIC;
+    m_header->version = VERSION;
+    m_header->dataOffset = (u32)DATA_OFFSET;
+    m_header->dataBytes = (u32)dataBytes;
+    m_data = memory + DATA_OFFSET;
+    m_dataBytes = dataBytes;
+    return true;
+}
+
+const char* SharedNotificationRing::GetName() const
+{
+    return m_memory.GetName();
+}
+
+size_t SharedNotificationRing::GetDataBytes() const
+{
+    return m_dataBytes;
+}
+
+void SharedNotificationRing::Unlink()
+{
+    m_memory.Unlink();
+}
+
+bool SharedNotificationRing::HasRoom(size_t bytes)
+{
+    u64 readPos = m_header->readPos.load(std::memory_order_acquire);
+    if (m_dataBytes - (m_writePos - readPos) >= bytes)
+        return true;
+
+    // N.B. The flag has to be set before readPos is looked at again, so that
+    // either we see the client's progress or it sees the flag.
+    m_header->writerSleeping.store(1);
+    readPos = m_header->readPos.load();
+    if (m_dataBytes - (m_writePos - readPos) < bytes)
+        return false;
+    m_header->writerSleeping.store(0);
+    return true;
+}
+
+void SharedNotificationRing::WriteU32(size_t offset, u32 value)
+{
+    memcpy(m_data + offset, &value, sizeof value);
+}
+
+bool SharedNotificationRing::TryWrite(u32 type, const std::string& str, const void* data,
+                                      u32 dataBytes)
+{
+    ASSERT(m_header);
+
+    u32 strLen = (u32)str.length();
+    u32 msgSize = strLen + 1 + 8;
+    if (data)
+        msgSize += sizeof(u32) + dataBytes;
+    size_t bytes = (sizeof(u32) + msgSize + 3) & ~(size_t)3;
+    if (bytes > m_dataBytes / 2)
+        FATAL("Notification too big for the shared ring (%u bytes)", msgSize);
+
+    size_t offset = (size_t)(m_writePos % m_dataBytes);
+    size_t bytesToEnd = m_dataBytes - offset;
+    if (bytes > bytesToEnd) {
+        if (!HasRoom(bytesToEnd + bytes))
+            return false;
+        // The rest of the ring is skipped.
+        WriteU32(offset, 0);
+        m_writePos += bytesToEnd;
+        offset = 0;
+    } else if (!HasRoom(bytes)) {
+        return false;
+    }
+
+    WriteU32(offset, msgSize);
+    WriteU32(offset + 4, type);
+    WriteU32(offset + 8, strLen);
+    memcpy(m_data + offset + 12, str.c_str(), strLen + 1);
+    if (data) {
+        size_t dataOffset = offset + 12 + strLen + 1;
+        WriteU32(dataOffset, dataBytes);
+        memcpy(m_data + dataOffset + sizeof(u32), data, dataBytes);
+    }
+    m_writePos += bytes;
+    return true;
+}
+
+bool SharedNotificationRing::Publish()
+{
+    ASSERT(m_header);
+
+    // N.B. As in HasRoom(), the order matters: the client sets
+    // readerSleeping before looking at writePos again.
+    m_header->writePos.store(m_writePos);
+    return m_header->readerSleeping.exchange(0) != 0;
+}
@@ -0,0 +1,81 @@
+#ifndef PIPELINE_SHAREDNOTIFICATIONRING_H
+#define PIPELINE_SHAREDNOTIFICATIONRING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <string>
+
+#include <Core/Types.h>
+#include <Os/SharedMemory.h>
+
+// The start of the shared memory. Everything is in the machine's byte order,
+// and the offsets are fixed: writePos is at byte 64, readerSleeping at 72,
+// readPos at 128, writerSleeping at 136, and the data starts at byte
+// dataOffset (256).
+struct SharedRingHeader {
+    u32 magic;
+    u32 version;
+    u32 dataOffset;
+    u32 dataBytes;
+
+    // Only written by the service. Bytes are written up to here.
+    alignas(64) std::atomic<u64> writePos;
+    // Set by the client before it waits on the socket.
+    std::atomic<u32> readerSleeping;
+
+    // Only written by the client. Bytes are read up to here.
+    alignas(64) std::atomic<u64> readPos;
+    // Set by the service when it has found the ring full.
+    std::atomic<u32> writerSleeping;
+};
+
+// The writing end of a single-producer single-consumer ring of notification
+// messages in shared memory, which lets a client on the same machine read
+// them in place.
+//
+// The messages are laid out as on the socket (see AssetEventService.cpp),
+// padded to 4 bytes, and never wrap around the end of the ring: a size of 0
+// means the rest of the ring is unused, and the next message is at the
+// start. writePos and readPos only ever increase, and are taken modulo
+// dataBytes to find the position in the ring.
+//
+// Waking up the other end is left to the caller. When the client is about to
+// sleep, it sets readerSleeping and checks writePos again; Publish() clears
+// readerSleeping and tells the caller to send a wake-up if it was set. The
+// client does the same with writerSleeping after moving readPos on.
+class SharedNotificationRing {
+public:
+    static const u32 MAGIC = 0x52455041; // "APER"
+    static const u32 VERSION = 1;
+
+    SharedNotificationRing();
+
+    bool Create(const char* name, size_t dataBytes);
+    const char* GetName() const;
+    size_t GetDataBytes() const;
+    // Called once the client has mapped the memory.
+    void Unlink();
+
+    // Writes a message holding the string, followed by the data's size and
+    // the data if data isn't NULL. Returns false if there's no room for it.
+    bool TryWrite(u32 type, const std::string& str, const void* data = NULL, u32 dataBytes = 0);
+    // Makes the messages written so far visible to the client. Returns true
+    // if the client is asleep and needs to be woken.
+    bool Publish();
+
+private:
+    SharedNotificationRing(const SharedNotificationRing&);
+    SharedNotificationRing& operator=(const SharedNotificationRing&);
+
+    bool HasRoom(size_t bytes);
+    void WriteU32(size_t offset, u32 value);
+
+    SharedMemory m_memory;
+    SharedRingHeader* m_header;
+    u8* m_data;
+    size_t m_dataBytes;
+    // Not published yet.
+    u64 m_writePos;
+};
+
+#endif // PIPELINE_SHAREDNOTIFICATIONRING_H
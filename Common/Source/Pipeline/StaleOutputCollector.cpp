@@ -0,0 +1,172 @@
+#include "StaleOutputCollector.h"
+
+#include <Core/Macros.h>
+
+#include "AssetPipelineOsFuncs.h"
+#include "ProjectDBConn.h"
+
+static bool IsInDirectory(const std::string& path, const std::string& dir)
+{
+    size_t dirLength = dir.length();
+    while (dirLength > 0 && dir[dirLength - 1] == '/')
+        --dirLength;
+    return dirLength > 0 && path.length() > dirLength &&
+           path.compare(0, dirLength, dir, 0, dirLength) == 0 &&
+           path[dirLength] == '/';
+}
+
+StaleOutputCollector::StaleOutputCollector()
+    : m_projID(-1)
+    , m_building(false)
+    , m_livePaths()
+    , m_staleOutputs()
+    , m_nextStaleOutput(0)
+{}
+
+void StaleOutputCollector::BeginBuild(int projID)
+{
+    ASSERT(projID >= 0);
+
+    Cancel();
+    m_projID = projID;
+    m_building = true;
+    m_livePaths.Clear();
+}
+
+void StaleOutputCollector::MarkLive(const char* outputPath)
+{
+    ASSERT(outputPath);
+
+    // Single-file recompiles don't see the whole project, so they're ignored.
+    if (m_building)
+        m_livePaths.Intern(outputPath);
+}
+
+void StaleOutputCollector::EndBuild(ProjectDBConn& dbConn, bool completed,
+                                    Mode mode, const std::string& dataDir,
+                                    std::vector<std::string>* reportedOutputs)
+{
+    ASSERT(reportedOutputs);
+
+    if (!m_building)
+        return;
+    m_building = false;
+
+    if (!completed || mode == MODE_KEEP || dataDir.empty()) {
+        m_livePaths.Clear();
+        return;
+    }
+
+    PathTable paths;
+    std::vector<DependencyEdge> edges;
+    i64 generation;
+    dbConn.QueryAllDependencies(m_projID, &paths, &edges, &generation);
+
+    // Paths that only appear as inputs aren't outputs.
+    std::vector<char> isOutput(paths.NumPaths(), 0);
+    for (size_t i = 0; i < edges.size(); ++i)
+        isOutput[edges[i].outputPath] = 1;
+
+    std::vector<char> isLive;
+    FindLiveOutputs(paths, edges, &isLive);
+
+    for (PathID id = 0; id < paths.NumPaths(); ++id) {
+        if (!isOutput[id] || isLive[id])
+            continue;
+        std::string output(paths.GetPath(id), paths.GetPathLength(id));
+        if (!IsInDirectory(output, dataDir))
+            continue;
+        if (mode == MODE_REPORT) {
+            DebugPrint("Stale output: %s", output.c_str());
+            reportedOutputs->push_back(output);
+        } else
+            m_staleOutputs.push_back(output);
+    }
+    m_livePaths.Clear();
+}
+
+// The build only marks the outputs whose rules it parses, and it doesn't
+// parse the rules for intermediate files whose dependents are up to date.
+// So everything that a live output depends on, directly or not, is live too.
+void StaleOutputCollector::FindLiveOutputs(const PathTable& paths,
+                                           const std::vector<DependencyEdge>& edges,
+                                           std::vector<char>* isLive) const
+{
+    size_t nPaths = paths.NumPaths();
+
+    // The inputs of each output, in compressed sparse row form.
+    std::vector<u32> rowStarts(nPaths + 1, 0);
+    for (size_t i = 0; i < edges.size(); ++i)
+        ++rowStarts[edges[i].outputPath + 1];
+    for (size_t i = 0; i < nPaths; ++i)
+        rowStarts[i + 1] += rowStarts[i];
+    std::vector<PathID> inputs(edges.size());
+    std::vector<u32> nextInput(rowStarts.begin(), rowStarts.end() - 1);
+    for (size_t i = 0; i < edges.size(); ++i)
+        inputs[nextInput[edges[i].outputPath]++] = edges[i].inputPath;
+
+    isLive->assign(nPaths, 0);
+    std::vector<PathID> stack;
+    for (PathID liveID = 0; liveID < m_livePaths.NumPaths(); ++liveID) {
+        PathID id = paths.Find(m_livePaths.GetPath(liveID),
+                               m_livePaths.GetPathLength(liveID));
+        if (id != INVALID_PATH_ID && !(*isLive)[id]) {
+            (*isLive)[id] = 1;
+            stack.push_back(id);
+        }
+    }
+    while (!stack.empty()) {
+        PathID id = stack.back();
+        stack.pop_back();
+        for (u32 i = rowStarts[id]; i < rowStarts[id + 1]; ++i) {
+            PathID input = inputs[i];
+            if (!(*isLive)[input]) {
+                (*isLive)[input] = 1;
+                stack.push_back(input);
+            }
+        }
+    }
+}
+
+void StaleOutputCollector::Cancel()
+{
+    m_building = false;
+    m_staleOutputs.clear();
+    m_nextStaleOutput = 0;
+}
+
+bool StaleOutputCollector::HasPendingWork() const
+{
+    return m_nextStaleOutput < m_staleOutputs.size();
+}
+
+int StaleOutputCollector::GetProjectID() const
+{
+    return m_projID;
+}
+
+size_t StaleOutputCollector::Step(ProjectDBConn& dbConn, size_t maxOutputs,
+                                  std::vector<int>* clearedErrorIDs)
+{
+    ASSERT(clearedErrorIDs);
+
+    size_t nRemoved = 0;
+    for (size_t i = 0; i < maxOutputs && HasPendingWork(); ++i) {
+        const std::string& output = m_staleOutputs[m_nextStaleOutput++];
+        // If the file can't be removed, its dependencies are kept so that
+        // it's found again by the next build.
+        if (!AssetPipelineOsFuncs::RemoveFile(output.c_str())) {
+            DebugPrint("Failed to remove stale output: %s", output.c_str());
+            continue;
+        }
+        dbConn.ClearDependencies(m_projID, output.c_str());
+        dbConn.ClearAssetCost(m_projID, output.c_str());
+        dbConn.SetCleanStamp(m_projID, output.c_str(), 0);
+        dbConn.ClearErrorsForOutput(m_projID, output.c_str(), clearedErrorIDs);
+        ++nRemoved;
+    }
+
+    if (!HasPendingWork())
+        Cancel();
+    return nRemoved;
+}
@@ -0,0 +1,70 @@
+#ifndef PIPELINE_STALEOUTPUTCOLLECTOR_H
+#define PIPELINE_STALEOUTPUTCOLLECTOR_H
+
+#include <string>
+#include <vector>
+#include "PathTable.h"
+#include "ProjectDBConn.h"
+
+// Finds outputs that are no longer produced by a project (because its rules
+// or manifest have changed), and removes them along with their dependencies,
+// their recorded build costs, and any errors that were recorded for them.
+//
+// During a full build, the build system marks every output it comes across
+// as live. Once the build has finished, any output with dependencies in the
+// database that wasn't marked, and that no marked output depends on (even
+// indirectly), is stale. Removing files can take a while, so
+// they're removed a few at a time by calling Step() whenever the pipeline is
+// otherwise idle.
+class StaleOutputCollector {
+public:
+    enum Mode {
+        // Leave stale outputs alone.
+        MODE_KEEP,
+        // Just report the stale outputs (a dry run).
+        MODE_REPORT,
+        // Remove the stale outputs.
+        MODE_REMOVE,
+    };
+
+    StaleOutputCollector();
+
+    // Called at the start of a full build. Any outputs that are still
+    // waiting to be removed are forgotten, since the build will find them
+    // again if they're still stale.
+    void BeginBuild(int projID);
+    void MarkLive(const char* outputPath);
+    // If the build ran to completion, finds the outputs that weren't marked.
+    // Only outputs within dataDir are ever removed. In MODE_REPORT, the stale
+    // outputs are appended to reportedOutputs instead.
+    void EndBuild(ProjectDBConn& dbConn, bool completed, Mode mode,
+                  const std::string& dataDir,
+                  std::vector<std::string>* reportedOutputs);
+    // Forgets any outputs that are waiting to be removed.
+    void Cancel();
+
+    bool HasPendingWork() const;
+    int GetProjectID() const;
+    // Tries to remove up to maxOutputs of the stale outputs. Returns the
+    // number that were removed (along with their dependencies and costs). The
+    // IDs of the errors that were cleared with them are appended to
+    // clearedErrorIDs.
+    size_t Step(ProjectDBConn& dbConn, size_t maxOutputs,
+                std::vector<int>* clearedErrorIDs);
+
+private:
+    StaleOutputCollector(const StaleOutputCollector&);
+    StaleOutputCollector& operator=(const StaleOutputCollector&);
+
+    void FindLiveOutputs(const PathTable& paths,
+                         const std::vector<DependencyEdge>& edges,
+                         std::vector<char>* isLive) const;
+
+    int m_projID;
+    bool m_building;
+    PathTable m_livePaths;
+    std::vector<std::string> m_staleOutputs;
+    size_t m_nextStaleOutput;
+};
+
+#endif // PIPELINE_STALEOUTPUTCOLLECTOR_H
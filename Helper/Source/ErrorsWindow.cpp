@@ -4,6 +4,7 @@
 #include <QLabel>
 #include <QTextEdit>
 #include <QGroupBox>
+#include <algorithm>
 #include <Core/Macros.h>
 #include <Pipeline/ProjectDBConn.h>
 
@@ -12,17 +13,28 @@ ErrorsWindow::ErrorsWindow(ProjectDBConn& dbConn, QWidget* parent)
 
     , m_dbConn(dbConn)
     , m_errorIDs()
+    , m_errorListProjID(-1)
+    , m_errorListVersion(0)
+    , m_errorListEntries()
+    , m_errorListChanges()
+    , m_errorDetails()
     , m_errorList(nullptr)
     , m_textEditInputFiles(nullptr)
     , m_textEditOutputFiles(nullptr)
     , m_textEditErrorMessage(nullptr)
+    , m_buildStatusLabel(nullptr)
 {
     setWindowTitle("Asset Pipeline - Error List");
     resize(800, 500);
 
-    QHBoxLayout* overallLayout = new QHBoxLayout(this);
-    overallLayout->addWidget(CreateMasterPane());
-    overallLayout->addWidget(CreateDetailPane());
+    QVBoxLayout* overallLayout = new QVBoxLayout(this);
+    QHBoxLayout* panesLayout = new QHBoxLayout;
+    panesLayout->addWidget(CreateMasterPane());
+    panesLayout->addWidget(CreateDetailPane());
+    overallLayout->addLayout(panesLayout);
+
+    m_buildStatusLabel = new QLabel;
+    overallLayout->addWidget(m_buildStatusLabel);
 
     setLayout(overallLayout);
 }
@@ -78,29 +90,159 @@ QWidget* ErrorsWindow::CreateDetailPane()
 void ErrorsWindow::ReloadErrors()
 {
     int activeProjID = m_dbConn.GetActiveProjectID();
-    if (activeProjID >= 0)
-        m_dbConn.QueryAllErrorIDs(activeProjID, &m_errorIDs);
+    if (activeProjID < 0) {
+        m_errorListProjID = -1;
+        m_errorIDs.clear();
+        m_errorList->clear();
+        ClearDetailPane();
+        return;
+    }
+
+    // Only the errors that have changed since the last reload are fetched
+    // and updated in the list, unless we've fallen too far behind (or the
+    // active project has changed).
+    i64 newVersion;
+    if (activeProjID != m_errorListProjID ||
+        !m_dbConn.QueryErrorListChanges(activeProjID, m_errorListVersion,
+                                        &m_errorListChanges, &newVersion)) {
+        ReloadAllErrors(activeProjID);
+    } else {
+        ApplyErrorListChanges(m_errorListChanges);
+        m_errorListVersion = newVersion;
+    }
+
+    SelectFirstErrorIfNone();
+}
+
+void ErrorsWindow::ApplyErrorChanges(int projID, const std::vector<IPCErrorChange>& changes)
+{
+    if (projID != m_errorListProjID)
+        return;
+
+    // N.B. These changes will be seen again when the window next catches up
+    // with the database, which is harmless (see ApplyErrorListChanges()).
+    for (size_t i = 0; i < changes.size(); ++i) {
+        const IPCErrorChange& change = changes[i];
+        if (!change.added) {
+            RemoveErrorRow(change.errorID);
+            continue;
+        }
+        // As in the database, errors without any input paths aren't listed.
+        if (change.inputPaths.empty())
+            continue;
+        if (std::find(m_errorIDs.begin(), m_errorIDs.end(), change.errorID)
+            != m_errorIDs.end())
+            continue;
+        m_errorDetails[change.errorID] = change;
+        m_errorIDs.push_back(change.errorID);
+        m_errorList->addItem(QString(change.inputPaths[0].c_str()));
+    }
+
+    SelectFirstErrorIfNone();
+}
+
+static QString FormatDuration(u32 ms)
+{
+    u32 seconds = (ms + 999) / 1000;
+    if (seconds < 60)
+        return QString("%1s").arg(seconds);
+    return QString("%1m %2s").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+void ErrorsWindow::SetBuildStatus(const IPCBuildStatus& status)
+{
+    QString state;
+    if (!status.finished) {
+        state = "Building";
+    } else if (status.cancelled) {
+        state = "Build cancelled";
+    } else {
+        state = "Build finished";
+    }
+    QString text = QString("%1: %2 asset%3 compiled, %4 failed")
+                       .arg(state)
+                       .arg(status.nSucceeded)
+                       .arg(status.nSucceeded == 1 ? "" : "s")
+                       .arg(status.nFailed);
+    if (!status.finished && status.nPathsTotal > 0) {
+        text += QString(" (%1 of %2 checked, %3 running")
+                    .arg(status.nPathsDone)
+                    .arg(status.nPathsTotal)
+                    .arg(status.nJobsRunning);
+        if (status.msRemaining != IPC_UNKNOWN_TIME)
+            text += QString(", about %1 left").arg(FormatDuration(status.msRemaining));
+        text += ")";
+    }
+    m_buildStatusLabel->setText(text);
+}
+
+void ErrorsWindow::ReloadAllErrors(int projID)
+{
+    m_dbConn.QueryErrorList(projID, &m_errorListEntries, &m_errorListVersion);
+    m_errorListProjID = projID;
 
+    m_errorIDs.clear();
+    m_errorDetails.clear();
     m_errorList->clear();
 
-    std::vector<std::string> inputFiles;
-    for (size_t i = 0; i < m_errorIDs.size(); ++i) {
-        m_dbConn.GetErrorInputPaths(m_errorIDs[i], &inputFiles);
-        if (inputFiles.size() == 0)
+    for (size_t i = 0; i < m_errorListEntries.size(); ++i) {
+        const ErrorListEntry& entry = m_errorListEntries[i];
+        m_errorIDs.push_back(entry.errorID);
+        m_errorList->addItem(QString(entry.firstInputPath.c_str()));
+    }
+}
+
+void ErrorsWindow::ApplyErrorListChanges(const std::vector<ErrorListChange>& changes)
+{
+    // N.B. The same change may be seen twice (see QueryErrorList()), so
+    // removing a missing row or adding an existing one is harmless.
+    for (size_t i = 0; i < changes.size(); ++i) {
+        const ErrorListChange& change = changes[i];
+        if (!change.added) {
+            RemoveErrorRow(change.errorID);
+            continue;
+        }
+        // An empty path means the error has been removed again since (or has
+        // no input paths, in which case it isn't listed).
+        if (change.firstInputPath.empty())
             continue;
-        QString label(inputFiles[0].c_str());
-        m_errorList->addItem(label);
+        if (std::find(m_errorIDs.begin(), m_errorIDs.end(), change.errorID)
+            != m_errorIDs.end())
+            continue;
+        m_errorIDs.push_back(change.errorID);
+        m_errorList->addItem(QString(change.firstInputPath.c_str()));
     }
+}
 
+void ErrorsWindow::RemoveErrorRow(int errorID)
+{
+    m_errorDetails.erase(errorID);
+    std::vector<int>::iterator it = std::find(m_errorIDs.begin(),
+                                              m_errorIDs.end(), errorID);
+    if (it == m_errorIDs.end())
+        return;
+    int row = (int)(it - m_errorIDs.begin());
+    // N.B. The ID must be erased first, as taking the item can cause
+    // OnErrorListRowChanged() to be called with the new row numbers.
+    m_errorIDs.erase(it);
+    delete m_errorList->takeItem(row);
+}
+
+void ErrorsWindow::SelectFirstErrorIfNone()
+{
     if (m_errorList->selectedItems().isEmpty() && m_errorList->count() > 0) {
         m_errorList->setCurrentRow(0);
         m_errorList->setItemSelected(m_errorList->item(0), true);
     }
-    if (m_errorList->count() == 0) {
-        m_textEditInputFiles->setText("");
-        m_textEditOutputFiles->setText("");
-        m_textEditErrorMessage->setText("");
-    }
+    if (m_errorList->count() == 0)
+        ClearDetailPane();
+}
+
+void ErrorsWindow::ClearDetailPane()
+{
+    m_textEditInputFiles->setText("");
+    m_textEditOutputFiles->setText("");
+    m_textEditErrorMessage->setText("");
 }
 
 void ErrorsWindow::showEvent(QShowEvent* event)
@@ -130,16 +272,17 @@ void ErrorsWindow::OnErrorListRowChanged(int currentRow)
         return;
 
     int errorID = m_errorIDs[currentRow];
-    // HACK (again): In certain cases we end up with an error ID that no longer
-    // exists in the database. In some cases, this is just because
-    // ReloadErrors() hasn't been called yet to bring everything up to date.
-    //
-    // However, this situation seems to be able to happen even immediately after
-    // reloading the errors. E.g., this method can be called from deeper in the
-    // call stack within ReloadData(), and error IDs are still produced that
-    // don't actually exist in the database. I'm not quite sure why this is.
-    //
-    // TODO: Find out what causes the issue discussed above.
+    std::unordered_map<int, IPCErrorChange>::const_iterator it = m_errorDetails.find(errorID);
+    if (it != m_errorDetails.end()) {
+        const IPCErrorChange& details = it->second;
+        m_textEditErrorMessage->setText(details.message.c_str());
+        TextEdit_SetStringList(*m_textEditInputFiles, details.inputPaths);
+        TextEdit_SetStringList(*m_textEditOutputFiles, details.outputPaths);
+        return;
+    }
+
+    // The error may have been removed from the database since the list was
+    // last brought up to date by ReloadErrors().
     if (!m_dbConn.ErrorExists(errorID))
         return;
 
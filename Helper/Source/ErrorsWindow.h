@@ -1,11 +1,14 @@
 #ifndef ERRORSWINDOW_H
 #define ERRORSWINDOW_H
 
+#include <unordered_map>
 #include <QWidget>
 #include <Pipeline/ProjectDBConn.h>
+#include <IPCTypes.h>
 
 class QListWidget;
 class QTextEdit;
+class QLabel;
 
 class ProjectDBConn;
 
@@ -17,6 +20,11 @@ public:
     ~ErrorsWindow();
 
     void ReloadErrors();
+    // Applies changes sent by the app, which carry everything the window
+    // shows, so the database isn't touched. Ignored unless the window has
+    // loaded the project's errors (it catches up when it's next shown).
+    void ApplyErrorChanges(int projID, const std::vector<IPCErrorChange>& changes);
+    void SetBuildStatus(const IPCBuildStatus& status);
 
 protected:
     virtual void showEvent(QShowEvent* event);
@@ -29,12 +37,27 @@ private:
     QWidget* CreateMasterPane();
     QWidget* CreateDetailPane();
 
+    void ReloadAllErrors(int projID);
+    void ApplyErrorListChanges(const std::vector<ErrorListChange>& changes);
+    void RemoveErrorRow(int errorID);
+    void SelectFirstErrorIfNone();
+    void ClearDetailPane();
+
     ProjectDBConn& m_dbConn;
+    // N.B. m_errorIDs[i] is the ID of the error shown in row i of the list.
     std::vector<int> m_errorIDs;
+    int m_errorListProjID;
+    i64 m_errorListVersion;
+    std::vector<ErrorListEntry> m_errorListEntries;
+    std::vector<ErrorListChange> m_errorListChanges;
+    // The details of errors that were sent by the app, by ID. Errors loaded
+    // from the database are looked up there when they're selected.
+    std::unordered_map<int, IPCErrorChange> m_errorDetails;
     QListWidget* m_errorList;
     QTextEdit* m_textEditInputFiles;
     QTextEdit* m_textEditOutputFiles;
     QTextEdit* m_textEditErrorMessage;
+    QLabel* m_buildStatusLabel;
 };
 
 #endif // ERRORSWINDOW_H
@@ -1,26 +1,29 @@
 #include "HelperApp.h"
 #include <vector>
+#include <algorithm>
 #include <QApplication>
-#include <QHostAddress>
 
 #include <Core/Macros.h>
 
-HelperApp::HelperApp(u16 port, QObject* parent)
+HelperApp::HelperApp(const QString& serverName, QObject* parent)
     : QObject(parent)
     , m_menu()
-    , m_tcpSocket()
+    , m_socket()
     , m_socketReadData()
+    , m_sendBuffer()
+    , m_errorChanges()
+    , m_buildStatus()
+    , m_buildStatusReceived(false)
     , m_dbConn()
     , m_projectsWindow(m_dbConn)
     , m_errorsWindow(m_dbConn)
     , m_aboutWindow()
     , m_callbackQueue()
 {
-    QHostAddress address(QHostAddress::LocalHost);
-    m_tcpSocket.connectToHost(address, port);
-    connect(&m_tcpSocket, &QTcpSocket::readyRead,
+    m_socket.connectToServer(serverName);
+    connect(&m_socket, &QLocalSocket::readyRead,
             this, &HelperApp::SocketReadyForRead);
-    connect(&m_tcpSocket, &QTcpSocket::bytesWritten,
+    connect(&m_socket, &QLocalSocket::bytesWritten,
             this, &HelperApp::OnBytesWritten);
 
     QAction* aboutAction = m_menu.addAction("About Asset Pipeline");
@@ -37,7 +40,7 @@ HelperApp::HelperApp(u16 port, QObject* parent)
         });
     });
 
-    m_tcpSocket.waitForConnected();
+    m_socket.waitForConnected();
 }
 
 HelperApp::~HelperApp()
@@ -50,20 +53,38 @@ void HelperApp::ShowAboutWindow()
 
 void HelperApp::SocketReadyForRead()
 {
-    qint64 bytesAvailable = m_tcpSocket.bytesAvailable();
-    m_socketReadData.resize((size_t)bytesAvailable);
-    m_tcpSocket.read((char*)&m_socketReadData[0],
-                     (qint64)m_socketReadData.size());
+    // Messages may be split across reads, so any partial message is kept
+    // until the rest of it arrives.
+    size_t oldSize = m_socketReadData.size();
+    qint64 bytesAvailable = m_socket.bytesAvailable();
+    if (bytesAvailable <= 0)
+        return;
+    m_socketReadData.resize(oldSize + (size_t)bytesAvailable);
+    qint64 bytesRead = m_socket.read((char*)&m_socketReadData[oldSize], bytesAvailable);
+    m_socketReadData.resize(oldSize + (size_t)std::max(bytesRead, (qint64)0));
 
-    for (size_t i = 0; i < m_socketReadData.size(); ++i) {
-        ReceiveByte(m_socketReadData[i]);
+    m_buildStatusReceived = false;
+    size_t offset = 0;
+    u32 type;
+    const u8* payload;
+    size_t payloadBytes;
+    while (size_t messageBytes = IPCParseMessage(m_socketReadData.data() + offset,
+                                                 m_socketReadData.size() - offset,
+                                                 &type, &payload, &payloadBytes)) {
+        ReceiveMessage(type, payload, payloadBytes);
+        offset += messageBytes;
     }
+    m_socketReadData.erase(m_socketReadData.begin(), m_socketReadData.begin() + offset);
+
+    // If the app has got ahead of us, there's no point showing each status
+    // in turn.
+    if (m_buildStatusReceived)
+        m_errorsWindow.SetBuildStatus(m_buildStatus);
 }
 
-void HelperApp::ReceiveByte(u8 byte)
+void HelperApp::ReceiveMessage(u32 type, const u8* payload, size_t payloadBytes)
 {
-    IPCAppToHelperAction action = (IPCAppToHelperAction)byte;
-    switch (action) {
+    switch ((IPCAppToHelperAction)type) {
         case IPCAPPTOHELPER_SHOW_PROJECTS_WINDOW:
             m_projectsWindow.show();
             break;
@@ -73,12 +94,15 @@ void HelperApp::ReceiveByte(u8 byte)
         case IPCAPPTOHELPER_SHOW_ABOUT_WINDOW:
             ShowAboutWindow();
             break;
-        case IPCAPPTOHELPER_REFRESH_ERRORS:
-            // Only actually reload if the window is visible (this is a
-            // performance optimization). If the window becomes visible after
-            // this, it will reload the data anyway.
-            if (m_errorsWindow.isVisible())
-                m_errorsWindow.ReloadErrors();
+        case IPCAPPTOHELPER_BUILD_STATUS: {
+            IPCReader reader(payload, payloadBytes);
+            if (!reader.ReadBuildStatus(&m_buildStatus))
+                FATAL("Bad build status message");
+            m_buildStatusReceived = true;
+            break;
+        }
+        case IPCAPPTOHELPER_ERRORS_CHANGED:
+            ReceiveErrorsChanged(payload, payloadBytes);
             break;
         case IPCAPPTOHELPER_QUIT:
             QMetaObject::invokeMethod(qApp, "quit", Qt::QueuedConnection);
@@ -86,12 +110,30 @@ void HelperApp::ReceiveByte(u8 byte)
     }
 }
 
+void HelperApp::ReceiveErrorsChanged(const u8* payload, size_t payloadBytes)
+{
+    IPCReader reader(payload, payloadBytes);
+    u32 projID, count;
+    if (!reader.ReadU32(&projID) || !reader.ReadU32(&count))
+        FATAL("Bad error list message");
+    // N.B. Each change takes at least 8 bytes.
+    if (count > payloadBytes / 8)
+        FATAL("Bad error list message");
+    m_errorChanges.resize(count);
+    for (u32 i = 0; i < count; ++i) {
+        if (!reader.ReadErrorChange(&m_errorChanges[i]))
+            FATAL("Bad error list message");
+    }
+    m_errorsWindow.ApplyErrorChanges((int)projID, m_errorChanges);
+}
+
 void HelperApp::SendIPCMessage(IPCHelperToAppAction action)
 {
-    if ((u32)action > 0xFF)
-        FATAL("Size of message exceeded one byte");
-    u8 byte = (u8)action;
-    m_tcpSocket.write((const char*)&byte, 1);
+    m_sendBuffer.clear();
+    IPCWriter writer(&m_sendBuffer);
+    writer.BeginMessage(action);
+    writer.EndMessage();
+    m_socket.write((const char*)m_sendBuffer.data(), (qint64)m_sendBuffer.size());
 }
 
 void HelperApp::RegisterOnBytesSent(const BytesSentFunc& func)
@@ -6,7 +6,8 @@
 
 #include <QObject>
 #include <QByteArray>
-#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QString>
 #include <QMenu>
 
 #include <Core/Types.h>
@@ -21,7 +22,7 @@ class HelperApp : public QObject {
     Q_OBJECT
 
 public:
-    HelperApp(u16 port, QObject* parent = nullptr);
+    HelperApp(const QString& serverName, QObject* parent = nullptr);
     ~HelperApp();
 
 private slots:
@@ -31,14 +32,20 @@ private:
     typedef std::function<void(size_t)> BytesSentFunc;
 
     void SocketReadyForRead();
-    void ReceiveByte(u8 byte);
+    void ReceiveMessage(u32 type, const u8* payload, size_t payloadBytes);
+    void ReceiveErrorsChanged(const u8* payload, size_t payloadBytes);
     void SendIPCMessage(IPCHelperToAppAction action);
     void RegisterOnBytesSent(const BytesSentFunc& func);
     void OnBytesWritten(qint64 bytes);
 
     QMenu m_menu;
-    QTcpSocket m_tcpSocket;
+    QLocalSocket m_socket;
     std::vector<u8> m_socketReadData;
+    std::vector<u8> m_sendBuffer;
+    std::vector<IPCErrorChange> m_errorChanges;
+    // Only the latest build status in each read is shown.
+    IPCBuildStatus m_buildStatus;
+    bool m_buildStatusReceived;
     ProjectDBConn m_dbConn;
     ProjectsWindow m_projectsWindow;
     ErrorsWindow m_errorsWindow;
@@ -1,35 +1,50 @@
 #include "SystemTrayApp.h"
 #include <QApplication>
 #include <QMenu>
-#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QTimer>
+#include <algorithm>
 
 #include <Core/Macros.h>
 
-// Milliseconds
-const int PIPELINE_DELEGATE_MESSAGE_POLL_INTERVAL_MS = 20;
+// Once pipeline events start arriving, we wait this long before processing
+// them, so that the events of a whole batch of assets are handled together.
+const int PIPELINE_EVENT_BATCH_INTERVAL_MS = 50;
+
+// The most an ERRORS_CHANGED message can hold, after the project ID and the
+// count of changes.
+const size_t MAX_ERROR_CHANGES_BYTES = IPC_MAX_MESSAGE_SIZE - 3 * sizeof(u32);
 
 SystemTrayApp::SystemTrayApp(QObject* parent)
     : QObject(parent)
 
     , m_menu()
     , m_systemTrayIcon()
-    , m_tcpServer()
+    , m_server()
     , m_socket(nullptr)
     , m_sendBuffer()
     , m_socketReadData()
     , m_callbackQueue()
 
-    , m_pipelineEventTimer()
+    , m_ipcBatch()
+    , m_buildStatus()
+    , m_buildStatusChanged(false)
+    , m_failureDetails()
 
     , m_dbConn()
     , m_assetPipeline()
+
+    , m_pipelineEventNotifier(m_assetPipeline.GetDelegateEventHandle(),
+                              QSocketNotifier::Read)
 {
+    m_buildStatus.projectID = -1;
+
     m_systemTrayIcon.setIcon(QIcon(":/Resources/SystemTrayIcon.png"));
     m_systemTrayIcon.setVisible(true);
 
     m_systemTrayIcon.setContextMenu(&m_menu);
 
-    connect(&m_tcpServer, &QTcpServer::newConnection,
+    connect(&m_server, &QLocalServer::newConnection,
             this, &SystemTrayApp::OnNewConnection);
 
     QAction* aboutAction = m_menu.addAction("About Asset Pipeline");
@@ -49,6 +64,10 @@ SystemTrayApp::SystemTrayApp(QObject* parent)
     QAction* compileAction = m_menu.addAction("Compile");
     connect(compileAction, &QAction::triggered, this, &SystemTrayApp::Compile);
 
+    QAction* cancelAction = m_menu.addAction("Cancel Build");
+    connect(cancelAction, &QAction::triggered,
+            this, &SystemTrayApp::CancelBuild);
+
     m_menu.addSeparator();
 
     QAction* quitAction = m_menu.addAction("Quit Asset Pipeline");
@@ -57,9 +76,10 @@ SystemTrayApp::SystemTrayApp(QObject* parent)
         Quit();
     });
 
-    connect(&m_pipelineEventTimer, &QTimer::timeout, this,
-            &SystemTrayApp::PipelineEventTimerTick);
-    m_pipelineEventTimer.start(PIPELINE_DELEGATE_MESSAGE_POLL_INTERVAL_MS);
+    // Rather than polling for pipeline events, wait for the pipeline's event
+    // handle to become readable.
+    connect(&m_pipelineEventNotifier, &QSocketNotifier::activated, this,
+            &SystemTrayApp::OnPipelineEventsAvailable);
 
     m_assetPipeline.SetDelegate(this);
 
@@ -72,12 +92,27 @@ SystemTrayApp::~SystemTrayApp()
 
 void SystemTrayApp::OnAssetBuildFinished(const AssetBuildCompletionInfo& info)
 {
+    m_buildStatus.projectID = info.projectID;
+    m_buildStatus.nSucceeded = (u32)info.nSucceeded;
+    m_buildStatus.nFailed = (u32)info.nFailed;
+    m_buildStatus.finished = true;
+    m_buildStatus.cancelled = info.cancelled;
+    m_buildStatusChanged = true;
+
     std::string projName = m_dbConn.GetProjectName(info.projectID);
 
     QString title = QString("Asset Build Completed (%1)").arg(projName.c_str());
 
     QString message;
-    if (info.nFailed == 0 && info.nSucceeded > 0) {
+    if (info.cancelled) {
+        title = QString("Asset Build Cancelled (%1)").arg(projName.c_str());
+        message = QString("%1 asset%2 compiled successfully, %3 failed "
+                          "before the build was cancelled.")
+                      .arg(info.nSucceeded)
+                      .arg(info.nSucceeded == 1 ? "" : "s")
+                      .arg(info.nFailed);
+    }
+    else if (info.nFailed == 0 && info.nSucceeded > 0) {
         message = QString("Successfully compiled %1%2 asset%3.")
                       .arg(info.nSucceeded == 1 ? "" : "all ")
                       .arg(info.nSucceeded)
@@ -93,11 +128,22 @@ void SystemTrayApp::OnAssetBuildFinished(const AssetBuildCompletionInfo& info)
                       .arg(info.nFailed);
     }
 
+    if (!info.staleOutputs.empty()) {
+        message += QString(" %1 output%2 %3 no longer produced by the project.")
+                       .arg(info.staleOutputs.size())
+                       .arg(info.staleOutputs.size() == 1 ? "" : "s")
+                       .arg(info.staleOutputs.size() == 1 ? "is" : "are");
+    }
+
     m_systemTrayIcon.showMessage(title, message);
 }
 
 void SystemTrayApp::OnAssetRecompileFinished(const AssetRecompileInfo& info)
 {
+    m_buildStatus.finished = true;
+    m_buildStatus.cancelled = false;
+    m_buildStatusChanged = true;
+
     std::string projName = m_dbConn.GetProjectName(info.projectID);
 
     QString title;
@@ -111,21 +157,164 @@ void SystemTrayApp::OnAssetRecompileFinished(const AssetRecompileInfo& info)
     m_systemTrayIcon.showMessage(title, message);
 }
 
-void SystemTrayApp::OnAssetCompileSucceeded()
+void SystemTrayApp::OnAssetBuildProgress(const AssetBuildProgressInfo& info)
 {
-    if (IsConnectedToHelper())
-        SendIPCMessage(IPCAPPTOHELPER_REFRESH_ERRORS);
+    BeginBuildStatus(info.projectID);
+    m_buildStatus.nSucceeded += (u32)info.nSucceeded;
+    m_buildStatus.nFailed += (u32)info.nFailed;
+    m_buildStatusChanged = true;
+
+    // Only bother the helper if the error list has actually changed. The
+    // changes are sent in full, so the helper doesn't have to look them up in
+    // the database.
+    if (info.errorChanges.empty() || !IsConnectedToHelper())
+        return;
+
+    std::vector<IPCErrorChange> changes(info.errorChanges.size());
+    for (size_t i = 0; i < info.errorChanges.size(); ++i) {
+        const AssetErrorChange& change = info.errorChanges[i];
+        IPCErrorChange& details = changes[i];
+        std::unordered_map<int, IPCErrorChange>::const_iterator it =
+            m_failureDetails.find(change.errorID);
+        if (change.added && it != m_failureDetails.end()) {
+            details = it->second;
+        } else if (change.added && m_dbConn.ErrorExists(change.errorID)) {
+            // The failure wasn't seen (e.g. the helper connected partway
+            // through the batch), so its details are read back instead.
+            details.errorID = change.errorID;
+            details.added = true;
+            m_dbConn.GetErrorInputPaths(change.errorID, &details.inputPaths);
+            m_dbConn.GetErrorOutputPaths(change.errorID, &details.outputPaths);
+            details.message = m_dbConn.GetErrorMessage(change.errorID);
+        } else {
+            // Either the error was removed, or it has been cleared since.
+            details.errorID = change.errorID;
+            details.added = false;
+        }
+    }
+    SendErrorChanges(info.projectID, &changes);
+}
+
+// Makes sure that the change fits in a message by itself. Long error messages
+// are cut short, and if the paths alone are too much (which they shouldn't
+// ever be), the trailing ones are dropped.
+static void FitErrorChange(IPCErrorChange* change)
+{
+    if (change->message.length() > IPC_MAX_ERROR_MESSAGE_LENGTH) {
+        change->message.resize(IPC_MAX_ERROR_MESSAGE_LENGTH);
+        change->message += "\n[...]";
+    }
+    size_t size = IPCErrorChangeSize(*change);
+    while (size > MAX_ERROR_CHANGES_BYTES && !change->outputPaths.empty()) {
+        size -= sizeof(u32) + change->outputPaths.back().length();
+        change->outputPaths.pop_back();
+    }
+    while (size > MAX_ERROR_CHANGES_BYTES && change->inputPaths.size() > 1) {
+        size -= sizeof(u32) + change->inputPaths.back().length();
+        change->inputPaths.pop_back();
+    }
+}
+
+// The changes are split across as many messages as it takes to keep each one
+// under IPC_MAX_MESSAGE_SIZE. The helper applies each message as it arrives,
+// so splitting them changes nothing as long as the order is kept.
+void SystemTrayApp::SendErrorChanges(int projectID, std::vector<IPCErrorChange>* changes)
+{
+    for (size_t i = 0; i < changes->size(); ++i)
+        FitErrorChange(&(*changes)[i]);
+
+    IPCWriter writer(&m_ipcBatch);
+    size_t begin = 0;
+    while (begin < changes->size()) {
+        size_t end = begin;
+        size_t bytes = 0;
+        while (end < changes->size()) {
+            size_t size = IPCErrorChangeSize((*changes)[end]);
+            if (end > begin && bytes + size > MAX_ERROR_CHANGES_BYTES)
+                break;
+            bytes += size;
+            ++end;
+        }
+
+        writer.BeginMessage(IPCAPPTOHELPER_ERRORS_CHANGED);
+        writer.WriteU32((u32)projectID);
+        writer.WriteU32((u32)(end - begin));
+        for (size_t i = begin; i < end; ++i)
+            writer.WriteErrorChange((*changes)[i]);
+        writer.EndMessage();
+        begin = end;
+    }
+}
+
+void SystemTrayApp::OnAssetBuildStatus(const AssetBuildStatusInfo& info)
+{
+    BeginBuildStatus(info.projectID);
+    m_buildStatus.nPathsDone = info.nPathsDone;
+    m_buildStatus.nPathsTotal = info.nPathsTotal;
+    m_buildStatus.nJobsRunning = info.nJobsRunning;
+    if (info.msRemaining == AssetBuildStatusInfo::UNKNOWN_TIME)
+        m_buildStatus.msRemaining = IPC_UNKNOWN_TIME;
+    else
+        m_buildStatus.msRemaining = (u32)std::min(info.msRemaining, (i64)IPC_UNKNOWN_TIME - 1);
+    m_buildStatus.finished = info.finished;
+    m_buildStatus.cancelled = info.cancelled;
+    m_buildStatusChanged = true;
+}
+
+// Anything reported after a build has finished belongs to the next one.
+void SystemTrayApp::BeginBuildStatus(int projectID)
+{
+    if (!m_buildStatus.finished && m_buildStatus.projectID == projectID)
+        return;
+    m_buildStatus.projectID = projectID;
+    m_buildStatus.nSucceeded = 0;
+    m_buildStatus.nFailed = 0;
+    m_buildStatus.nPathsDone = 0;
+    m_buildStatus.nPathsTotal = 0;
+    m_buildStatus.nJobsRunning = 0;
+    m_buildStatus.msRemaining = IPC_UNKNOWN_TIME;
+    m_buildStatus.finished = false;
+    m_buildStatus.cancelled = false;
 }
 
 void SystemTrayApp::OnAssetFailedToCompile(const AssetCompileFailureInfo& info)
 {
-    if (IsConnectedToHelper())
-        SendIPCMessage(IPCAPPTOHELPER_REFRESH_ERRORS);
+    if (!IsConnectedToHelper())
+        return;
+
+    // Kept until the batch's progress is reported.
+    IPCErrorChange& details = m_failureDetails[info.errorID];
+    details.errorID = info.errorID;
+    details.added = true;
+    details.inputPaths = info.inputPaths;
+    details.inputPaths.insert(details.inputPaths.end(),
+                              info.additionalInputPaths.begin(),
+                              info.additionalInputPaths.end());
+    details.outputPaths = info.outputPaths;
+    details.message = info.errorMessage;
 }
 
-void SystemTrayApp::PipelineEventTimerTick()
+void SystemTrayApp::OnPipelineEventsAvailable()
+{
+    // Stop listening until the batch has been processed; otherwise we'd be
+    // woken for every single event.
+    m_pipelineEventNotifier.setEnabled(false);
+    QTimer::singleShot(PIPELINE_EVENT_BATCH_INTERVAL_MS, this,
+                       &SystemTrayApp::ProcessPipelineEvents);
+}
+
+void SystemTrayApp::ProcessPipelineEvents()
 {
     m_assetPipeline.CallDelegateFunctions();
+    m_failureDetails.clear();
+
+    // The helper only needs the latest status, once per batch.
+    if (m_buildStatusChanged && IsConnectedToHelper())
+        AppendBuildStatusMessage();
+    m_buildStatusChanged = false;
+    FlushIPCMessages();
+
+    m_pipelineEventNotifier.setEnabled(true);
 }
 
 void SystemTrayApp::ShowAboutWindow()
@@ -153,6 +342,11 @@ void SystemTrayApp::Compile()
         m_assetPipeline.CompileProject(projID);
 }
 
+void SystemTrayApp::CancelBuild()
+{
+    m_assetPipeline.CancelBuild();
+}
+
 void SystemTrayApp::Quit()
 {
     if (m_socket) {
@@ -173,20 +367,32 @@ void SystemTrayApp::SocketDisconnected()
 
 void SystemTrayApp::SocketReadyForRead()
 {
+    // Messages may be split across reads, so any partial message is kept
+    // until the rest of it arrives.
+    size_t oldSize = m_socketReadData.size();
     qint64 bytesAvailable = m_socket->bytesAvailable();
-    m_socketReadData.resize((size_t)bytesAvailable);
-    m_socket->read((char*)&m_socketReadData[0],
-                   (qint64)m_socketReadData.size());
-
-    for (size_t i = 0; i < m_socketReadData.size(); ++i) {
-        ReceiveByte(m_socketReadData[i]);
+    if (bytesAvailable <= 0)
+        return;
+    m_socketReadData.resize(oldSize + (size_t)bytesAvailable);
+    qint64 bytesRead = m_socket->read((char*)&m_socketReadData[oldSize], bytesAvailable);
+    m_socketReadData.resize(oldSize + (size_t)std::max(bytesRead, (qint64)0));
+
+    size_t offset = 0;
+    u32 type;
+    const u8* payload;
+    size_t payloadBytes;
+    while (size_t messageBytes = IPCParseMessage(m_socketReadData.data() + offset,
+                                                 m_socketReadData.size() - offset,
+                                                 &type, &payload, &payloadBytes)) {
+        ReceiveMessage(type, payload, payloadBytes);
+        offset += messageBytes;
     }
+    m_socketReadData.erase(m_socketReadData.begin(), m_socketReadData.begin() + offset);
 }
 
-void SystemTrayApp::ReceiveByte(u8 byte)
+void SystemTrayApp::ReceiveMessage(u32 type, const u8* payload, size_t payloadBytes)
 {
-    IPCHelperToAppAction action = (IPCHelperToAppAction)byte;
-    switch (action) {
+    switch ((IPCHelperToAppAction)type) {
         case IPCHELPERTOAPP_QUIT:
             QMetaObject::invokeMethod(qApp, "quit", Qt::QueuedConnection);
             break;
@@ -197,14 +403,31 @@ void SystemTrayApp::SendIPCMessage(IPCAppToHelperAction action)
 {
     ASSERT(IsConnectedToHelper());
 
-    if ((u32)action > 0xFF)
-        FATAL("Size of message exceeded one byte");
-    u8 byte = (u8)action;
+    IPCWriter writer(&m_ipcBatch);
+    writer.BeginMessage(action);
+    writer.EndMessage();
+    FlushIPCMessages();
+}
+
+void SystemTrayApp::AppendBuildStatusMessage()
+{
+    IPCWriter writer(&m_ipcBatch);
+    writer.BeginMessage(IPCAPPTOHELPER_BUILD_STATUS);
+    writer.WriteBuildStatus(m_buildStatus);
+    writer.EndMessage();
+}
+
+void SystemTrayApp::FlushIPCMessages()
+{
+    if (m_ipcBatch.empty())
+        return;
+
     if (m_socket) {
-        m_socket->write((const char*)&byte, 1);
-    } else {
-        m_sendBuffer.push_back(byte);
+        m_socket->write((const char*)m_ipcBatch.data(), (qint64)m_ipcBatch.size());
+    } else if (IsConnectedToHelper()) {
+        m_sendBuffer.insert(m_sendBuffer.end(), m_ipcBatch.begin(), m_ipcBatch.end());
     }
+    m_ipcBatch.clear();
 }
 
 void SystemTrayApp::RegisterOnBytesSent(const BytesSentFunc& func)
@@ -222,7 +445,7 @@ void SystemTrayApp::OnBytesWritten(qint64 bytes)
 
 bool SystemTrayApp::IsConnectedToHelper() const
 {
-    return (m_socket || m_tcpServer.isListening());
+    return (m_socket || m_server.isListening());
 }
 
 void SystemTrayApp::LaunchHelperIfNeeded()
@@ -230,23 +453,38 @@ void SystemTrayApp::LaunchHelperIfNeeded()
     if (IsConnectedToHelper())
         return;
 
-    ASSERT(!m_tcpServer.isListening());
-    m_tcpServer.listen();
-
-    LaunchHelper(m_tcpServer.serverPort());
+    ASSERT(!m_server.isListening());
+    // The name only has to be unique on this machine, and the helper is
+    // given the full path of the socket.
+    QString name = QString("AssetPipelineHelper-%1").arg(QCoreApplication::applicationPid());
+    // A socket left behind by a previous process with the same ID would
+    // stop us listening.
+    QLocalServer::removeServer(name);
+    m_server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server.listen(name))
+        FATAL("Failed to listen for the helper: %s",
+              m_server.errorString().toUtf8().constData());
+
+    LaunchHelper(m_server.fullServerName());
+
+    // Bring the helper up to date with any build that's in progress.
+    if (m_buildStatus.projectID >= 0) {
+        AppendBuildStatusMessage();
+        FlushIPCMessages();
+    }
 }
 
 void SystemTrayApp::OnNewConnection()
 {
     ASSERT(!m_socket);
-    m_socket = m_tcpServer.nextPendingConnection();
-    connect(m_socket, &QTcpSocket::disconnected,
+    m_socket = m_server.nextPendingConnection();
+    connect(m_socket, &QLocalSocket::disconnected,
             this, &SystemTrayApp::SocketDisconnected);
-    connect(m_socket, &QTcpSocket::readyRead,
+    connect(m_socket, &QLocalSocket::readyRead,
             this, &SystemTrayApp::SocketReadyForRead);
-    connect(m_socket, &QTcpSocket::bytesWritten,
+    connect(m_socket, &QLocalSocket::bytesWritten,
             this, &SystemTrayApp::OnBytesWritten);
-    m_tcpServer.close();
+    m_server.close();
     if (!m_sendBuffer.empty()) {
         m_socket->write((const char*)&m_sendBuffer[0],
                         (qint64)m_sendBuffer.size());
@@ -3,12 +3,13 @@
 
 #include <vector>
 #include <functional>
+#include <unordered_map>
 
 #include <QObject>
 #include <QSystemTrayIcon>
 #include <QMenu>
-#include <QTcpServer>
-#include <QTimer>
+#include <QLocalServer>
+#include <QSocketNotifier>
 
 #include <Core/Types.h>
 #include <IPCTypes.h>
@@ -25,17 +26,20 @@ public:
 private:
     virtual void OnAssetBuildFinished(const AssetBuildCompletionInfo& info);
     virtual void OnAssetRecompileFinished(const AssetRecompileInfo& info);
-    virtual void OnAssetCompileSucceeded();
+    virtual void OnAssetBuildProgress(const AssetBuildProgressInfo& info);
     virtual void OnAssetFailedToCompile(const AssetCompileFailureInfo& info);
+    virtual void OnAssetBuildStatus(const AssetBuildStatusInfo& info);
 
 private slots:
-    void PipelineEventTimerTick();
+    void OnPipelineEventsAvailable();
+    void ProcessPipelineEvents();
 
     void ShowAboutWindow();
     void ManageProjects();
     void ViewErrorList();
 
     void Compile();
+    void CancelBuild();
     void Quit();
 
 private:
@@ -43,9 +47,13 @@ private:
 
     void SocketDisconnected();
     void SocketReadyForRead();
-    void ReceiveByte(u8 byte);
+    void ReceiveMessage(u32 type, const u8* payload, size_t payloadBytes);
 
     void SendIPCMessage(IPCAppToHelperAction action);
+    void SendErrorChanges(int projectID, std::vector<IPCErrorChange>* changes);
+    void BeginBuildStatus(int projectID);
+    void AppendBuildStatusMessage();
+    void FlushIPCMessages();
     void RegisterOnBytesSent(const BytesSentFunc& func);
     void OnBytesWritten(qint64 bytes);
 
@@ -54,20 +62,29 @@ private:
     void OnNewConnection();
 
     // Os-specific functions
-    void LaunchHelper(unsigned short port);
+    void LaunchHelper(const QString& serverName);
 
     QMenu m_menu;
     QSystemTrayIcon m_systemTrayIcon;
-    QTcpServer m_tcpServer;
-    QTcpSocket* m_socket;
+    QLocalServer m_server;
+    QLocalSocket* m_socket;
     std::vector<u8> m_sendBuffer;
     std::vector<u8> m_socketReadData;
     std::vector<BytesSentFunc> m_callbackQueue;
 
-    QTimer m_pipelineEventTimer;
+    // Messages for the helper are gathered here while pipeline events are
+    // processed, and sent together once the batch is done.
+    std::vector<u8> m_ipcBatch;
+    IPCBuildStatus m_buildStatus;
+    bool m_buildStatusChanged;
+    // The details of the errors recorded in the current batch, by ID, which
+    // are sent to the helper with the batch's progress.
+    std::unordered_map<int, IPCErrorChange> m_failureDetails;
 
     ProjectDBConn m_dbConn;
     AssetPipeline m_assetPipeline;
+
+    QSocketNotifier m_pipelineEventNotifier;
 };
 
 #endif // SystemTrayApp_H
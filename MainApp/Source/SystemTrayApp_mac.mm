@@ -1,12 +1,12 @@
 #include "SystemTrayApp.h"
 #import <Cocoa/Cocoa.h>
 
-void SystemTrayApp::LaunchHelper(unsigned short port)
+void SystemTrayApp::LaunchHelper(const QString& serverName)
 {
     NSURL* URL = [[NSBundle mainBundle] URLForResource:@"Asset Pipeline Helper"
                                          withExtension:@".app"];
 
-    NSString* str = [NSString stringWithFormat:@"%d", (int)port];
+    NSString* str = serverName.toNSString();
     NSDictionary* config = @{
         NSWorkspaceLaunchConfigurationArguments: @[ str ]
     };
@@ -21,7 +21,7 @@ local function AreInputsNewer(inputs, additionalInputs, outputs)
     local latestOutputTimestamp = 0;
     for _, output in ipairs(outputs) do
         latestOutputTimestamp = math.max(latestOutputTimestamp,
-                                         GetFileTimestamp(output))
+                                         GetOutputTimestamp(output))
     end
     for _, input in ipairs(inputs) do
         if GetFileTimestamp(input) > latestOutputTimestamp then
@@ -38,17 +38,113 @@ local function AreInputsNewer(inputs, additionalInputs, outputs)
    return false
 end
 
-local function InputNeedsCompile(inputPath, mapRules)
+local function GetLatestTimestamp(inputs, additionalInputs)
+    local latestTimestamp = 0
+    for _, input in ipairs(inputs) do
+        latestTimestamp = math.max(latestTimestamp, GetFileTimestamp(input))
+    end
+    if additionalInputs then
+        for _, input in ipairs(additionalInputs) do
+            latestTimestamp = math.max(latestTimestamp, GetFileTimestamp(input))
+        end
+    end
+    return latestTimestamp
+end
+
+local function GetTimestamps(paths)
+    local timestamps = {}
+    for i, path in ipairs(paths) do
+        timestamps[i] = GetFileTimestamp(path)
+    end
+    return timestamps
+end
+
+-- Returns true if any of the files has been written (or created, or removed)
+-- since the timestamps were taken.
+local function HaveFilesChanged(paths, timestamps)
+    for i, path in ipairs(paths) do
+        local timestamp = GetFileTimestamp(path)
+        if timestamp == 0 or timestamp ~= timestamps[i] then
+            return true
+        end
+    end
+    return false
+end
+
+-- N.B. compiled is the set of paths that have already been compiled during
+-- the current build, which are never compiled again.
+local function InputNeedsCompile(inputPath, mapRules, compiled)
+    if compiled[inputPath] then
+        return false
+    end
     local funcTable, matchResults = Map(inputPath, mapRules)
     if funcTable == nil then
         return false
     end
     local inputs, outputs = funcTable.Parse(inputPath, unpack(matchResults))
-    return AreInputsNewer(inputs, outputs)
+    MarkOutputsLive(outputs)
+    return AreInputsNewer(inputs, nil, outputs)
+end
+
+local function GetGlobOutput(rule, path)
+    if rule.Output then
+        return rule.Output(path)
+    end
+    return path
+end
+
+local function GetGlobIterator(rule)
+    local iter = nil
+    return function()
+        -- The pattern isn't expanded until the paths are needed.
+        if not iter then
+            local count
+            iter, count = ExpandGlob(rule.Glob)
+            ExpectPaths(count)
+        end
+        local path = iter()
+        while path ~= nil do
+            local output = GetGlobOutput(rule, path)
+            if output ~= nil then
+                return output
+            end
+            path = iter()
+        end
+        return nil
+    end
+end
+
+local function ConcatIterators(iters)
+    local index = 1
+    return function()
+        while iters[index] do
+            local value = iters[index]()
+            if value ~= nil then
+                return value
+            end
+            index = index + 1
+        end
+        return nil
+    end
 end
 
 local function GetManifestIterator()
-    return io.lines(GetManifestPath())
+    local iters = {}
+    if GetManifestPath() then
+        -- Fall back to reading the text manifest directly if the binary
+        -- manifest can't be used (in which case its size isn't known).
+        local iter, count = ManifestIterator()
+        if iter then
+            ExpectPaths(count)
+        else
+            iter = io.lines(GetManifestPath())
+        end
+        iters[#iters+1] = iter
+    end
+    for _, rule in ipairs(GetManifestGlobs()) do
+        iters[#iters+1] = GetGlobIterator(rule)
+    end
+    return ConcatIterators(iters)
 end
 
 local function GetArrayIterator(paths)
@@ -64,17 +160,93 @@ local function GetArrayIterator(paths)
     end
 end
 
-local function OnSuccess(inputs, additionalInputs, outputs)
+-- The paths that took longest to build last time (inputs included) are
+-- started first, so that the build doesn't end waiting on one of them.
+--
+-- The window is a deliberate limit, not a tuning knob: only this many paths
+-- are held at once, so that a large manifest is streamed rather than read
+-- into memory, and the first job can start before the whole manifest has
+-- been read. The cost is that a slow path can only overtake the paths that
+-- are in the window with it, so one near the end of a huge manifest still
+-- starts late. Listing the slowest assets early in the manifest avoids that.
+local PRIORITY_WINDOW_SIZE = 1024
+
+-- Ties go to the path that was reached first, so that the order is kept when
+-- nothing is known about the paths.
+local function IsHigherPriority(a, b)
+    if a.priority ~= b.priority then
+        return a.priority > b.priority
+    end
+    return a.index < b.index
+end
+
+local function HeapPush(heap, item)
+    local i = #heap + 1
+    heap[i] = item
+    while i > 1 do
+        local parent = math.floor(i / 2)
+        if not IsHigherPriority(heap[i], heap[parent]) then
+            break
+        end
+        heap[i], heap[parent] = heap[parent], heap[i]
+        i = parent
+    end
+end
+
+local function HeapPop(heap)
+    local top = heap[1]
+    local n = #heap
+    heap[1] = heap[n]
+    heap[n] = nil
+    n = n - 1
+    local i = 1
+    while true do
+        local best = i
+        for child = i * 2, math.min(i * 2 + 1, n) do
+            if IsHigherPriority(heap[child], heap[best]) then
+                best = child
+            end
+        end
+        if best == i then
+            break
+        end
+        heap[i], heap[best] = heap[best], heap[i]
+        i = best
+    end
+    return top
+end
+
+local function GetPriorityIterator(iter)
+    local heap = {}
+    local index = 0
+    return function()
+        -- N.B. iter is dropped once it's done, as io.lines() raises an error
+        -- if it's called again.
+        while iter and #heap < PRIORITY_WINDOW_SIZE do
+            local path = iter()
+            if path == nil then
+                iter = nil
+            else
+                index = index + 1
+                HeapPush(heap, { path = path, priority = GetBuildPriority(path),
+                                 index = index })
+            end
+        end
+        if #heap == 0 then
+            return nil
+        end
+        return HeapPop(heap).path
+    end
+end
+
+local function OnSuccess(inputs, additionalInputs, outputs, unchanged)
     ClearCompileError(inputs, additionalInputs, outputs)
     for _, output in ipairs(outputs) do
-        NotifyAssetCompile(output)
-        ClearDependencies(output)
-        for _, input in ipairs(inputs) do
-            RecordDependency(output, input)
-        end
-        for _, additionalInput in ipairs(additionalInputs) do
-            RecordDependency(output, additionalInput)
+        -- There's nothing new to load if the tool left the outputs alone.
+        if not unchanged then
+            NotifyAssetCompile(output)
         end
+        SetDependencies(output, inputs, additionalInputs)
     end
 end
 
@@ -134,81 +306,372 @@ local function GetAdditionalInputsDoNotExistMessage(paths)
     return result
 end
 
+-- The most stacks of paths that can be waiting for other jobs at once.
+local MAX_WAITING_STACKS = 64
+-- How many other jobs can start ahead of one that's waiting for CPU or
+-- memory, before nothing new is taken from the manifest until it has run.
+local MAX_PASSED_OVER = 8
+
+-- Returns the name of the rule that builds the path, or "" if there isn't
+-- one.
+local function GetRuleName(path, mapRules)
+    local funcTable = Map(path, mapRules)
+    if funcTable == nil then
+        return ""
+    end
+    return funcTable.Name
+end
+
+-- A stack of paths, each of which is an input of the path below it.
+local function NewStack(path, mapRules)
+    local stack = {
+        paths = List:New(),
+        -- The rule for the path at the bottom, for the build status.
+        rule = GetRuleName(path, mapRules),
+        -- The job for the path on top, if it's only waiting for resources.
+        job = nil,
+        -- The parsed rule for the path on top, if it's waiting for inputs
+        -- (see ParsePath()).
+        parsed = nil,
+        waitingForCapacity = false,
+        nPassedOver = 0,
+    }
+    stack.paths:InsertTail(path)
+    return stack
+end
+
+-- Parses the path's rule and finds its auxiliary inputs. The results are kept
+-- on the stack while the path waits for its inputs, so that the rule isn't
+-- parsed again every time a job finishes. Returns nil if there's no rule.
+local function ParsePath(path, mapRules)
+    local funcTable, matchResults = Map(path, mapRules)
+    if funcTable == nil then
+        return nil
+    end
+    local inputs, outputs, closure = funcTable.Parse(path, unpack(matchResults))
+    MarkOutputsLive(outputs)
+    local parsed = {
+        path = path,
+        funcTable = funcTable,
+        inputs = inputs,
+        outputs = outputs,
+        closure = closure,
+        -- The inputs whose jobs were running when the path was last looked at.
+        waitingFor = {},
+    }
+    if closure then
+        parsed.auxiliaryInputs, parsed.failedPaths = GetAuxiliaryInputs(inputs, closure)
+    end
+    return parsed
+end
+
+local function IsStarved(stack)
+    return stack ~= nil and stack.waitingForCapacity and
+           stack.nPassedOver >= MAX_PASSED_OVER
+end
+
 BuildSystem = {}
 
 BuildSystem.fileIter = nil
 BuildSystem.nextPath = nil
-BuildSystem.stack = List:New()
+BuildSystem.stacks = {}
+BuildSystem.compiled = {}
+-- The paths whose jobs are running.
+BuildSystem.running = {}
+-- The running jobs, by the ID of the process that each is waiting for.
+BuildSystem.jobs = {}
+BuildSystem.nRunning = 0
 
-function BuildSystem:Setup(paths)
-    if paths == nil then
-        self.fileIter = GetManifestIterator()
-    else
-        self.fileIter = GetArrayIterator(paths)
+function BuildSystem:Setup(paths, mapRules)
+    assert(self.nRunning == 0)
+    -- The build status says how far through the paths the build is. Their
+    -- number is known as soon as the manifest (or a glob) is opened, but
+    -- their rules aren't until they're mapped, which is left until each one
+    -- is started. Inputs aren't known until they're parsed, so they don't
+    -- count.
+    if paths then
+        ExpectPaths(#paths)
     end
-    self.nextPath = self.fileIter()
-    self.stack = List:New()
+    local iter = paths and GetArrayIterator(paths) or GetManifestIterator()
+    self.fileIter = GetPriorityIterator(iter)
+    self:NextPath()
+    self.stacks = {}
+    self.compiled = {}
+    self.running = {}
+    self.jobs = {}
 end
 
-function BuildSystem:CompileNext(mapRules)
-    local done = false
-    local success = false
+function BuildSystem:NextPath()
+    self.nextPath = self.fileIter()
+    if self.nextPath == nil then
+        AllPathsPlanned()
+    end
+end
 
-    while (not done) and (not (self.stack:IsEmpty() and self.nextPath == nil)) do
-        if self.stack:IsEmpty() then
-            self.stack:InsertTail(self.nextPath)
-            self.nextPath = self.fileIter()
+-- Returns the outputs of the manifest's glob rules that match the path.
+function BuildSystem:GetManifestGlobOutputs(path)
+    local outputs = {}
+    for _, rule in ipairs(GetManifestGlobs()) do
+        if MatchGlob(rule.Glob, path) then
+            local output = GetGlobOutput(rule, path)
+            if output ~= nil then
+                outputs[#outputs+1] = output
+            end
         end
+    end
+    return outputs
+end
 
-        local path = self.stack:PeekTail()
+-- Records an error for each of the paths, which can't be built now that one
+-- of their inputs has been removed.
+function BuildSystem:InvalidateOutputs(paths, removedPath, mapRules)
+    local message = string.format("Input file '%s' has been removed.\n", removedPath)
+    for _, path in ipairs(paths) do
         local funcTable, matchResults = Map(path, mapRules)
-        if funcTable == nil then
-            print(string.format("Warning: no compilation rule found for '%s'", path))
-            self.stack:RemoveTail()
+        if funcTable ~= nil then
+            local inputs, outputs = funcTable.Parse(path, unpack(matchResults))
+            OnFailure(inputs, nil, outputs, message)
+        end
+    end
+end
+
+-- Resumes the job's Execute function, which runs until it either returns
+-- or has started a process. Returns "finished" and whether the job succeeded
+-- if it returned, otherwise "started".
+function BuildSystem:ResumeJob(job, ...)
+    local results = { coroutine.resume(job.co, ...) }
+    if not results[1] then
+        error(results[2], 0)
+    end
+    if coroutine.status(job.co) == "suspended" then
+        local processID = results[2]
+        assert(type(processID) == "number", "Execute yielded without running a process")
+        self.jobs[processID] = job
+        self.nRunning = self.nRunning + 1
+        return "started"
+    end
+    return "finished", self:FinishJob(job, results[2], results[3])
+end
+
+function BuildSystem:StartJob(job)
+    -- With Restat, outputs that the tool leaves untouched are recorded as
+    -- clean, so that they don't count as having changed, and aren't rebuilt
+    -- next time.
+    if job.funcTable.Restat then
+        job.outputTimestamps = GetTimestamps(job.outputs)
+    end
+    self.running[job.path] = true
+    job.statusID = JobStarted(job.funcTable.Name, job.path)
+    job.cpuMs = 0
+    job.maxRssKB = 0
+    job.co = coroutine.create(job.funcTable.Execute)
+    return self:ResumeJob(job, job.inputs, job.outputs)
+end
+
+function BuildSystem:FinishJob(job, success, errorMessage)
+    local wallMs = JobFinished(job.statusID)
+    ReleaseJobResources(job.funcTable.Resources)
+    self.running[job.path] = nil
+    self.compiled[job.path] = true
+    if success then
+        local unchanged = false
+        if job.outputTimestamps then
+            unchanged = not HaveFilesChanged(job.outputs, job.outputTimestamps)
+            local stamp = 0
+            if unchanged then
+                stamp = GetLatestTimestamp(job.inputs, job.auxiliaryInputs)
+            end
+            SetCleanStamps(job.outputs, stamp)
+        end
+        OnSuccess(job.inputs, job.auxiliaryInputs, job.outputs, unchanged)
+        RecordAssetCost(job.path, job.inputs, job.auxiliaryInputs, wallMs,
+                        job.cpuMs, job.maxRssKB)
+    else
+        OnFailure(job.inputs, job.auxiliaryInputs, job.outputs, errorMessage)
+    end
+    return success
+end
+
+-- Blocks until one of the running jobs has finished, or has moved on to its
+-- next process. Returns the same as ResumeJob().
+function BuildSystem:WaitForJob()
+    local processID, status, stdout, stderr, cpuMs, maxRssKB = WaitForProcess()
+    local job = self.jobs[processID]
+    self.jobs[processID] = nil
+    job.cpuMs = job.cpuMs + cpuMs
+    job.maxRssKB = math.max(job.maxRssKB, maxRssKB)
+    self.nRunning = self.nRunning - 1
+    return self:ResumeJob(job, status, stdout, stderr)
+end
+
+function BuildSystem:TryStartJob(stack)
+    local acquired, waitingFor = AcquireJobResources(stack.job.funcTable.Resources)
+    if not acquired then
+        stack.waitingForCapacity = (waitingFor == "capacity")
+        return "waiting"
+    end
+    local oldest = self.stacks[1]
+    if oldest and oldest ~= stack and oldest.waitingForCapacity then
+        oldest.nPassedOver = oldest.nPassedOver + 1
+    end
+    local job = stack.job
+    stack.job = nil
+    stack.waitingForCapacity = false
+    stack.nPassedOver = 0
+    stack.paths:RemoveTail()
+    return self:StartJob(job)
+end
+
+-- Works down the stack until an asset has been compiled, a job has been
+-- started, or the path on top has to wait for other jobs. Returns "finished"
+-- and whether the asset compiled successfully, "started", "waiting", or
+-- "empty".
+function BuildSystem:WorkOnStack(stack, mapRules)
+    local paths = stack.paths
+    while not paths:IsEmpty() do
+        local path = paths:PeekTail()
+        if self.compiled[path] then
+            -- (Another stack may have got to it first.)
+            paths:RemoveTail()
+            stack.job = nil
+            stack.parsed = nil
+            stack.waitingForCapacity = false
+        elseif self.running[path] then
+            return "waiting"
+        elseif stack.job then
+            local status, success = self:TryStartJob(stack)
+            if status ~= "started" then
+                return status, success
+            end
         else
-            local inputs, outputs, closure = funcTable.Parse(path, unpack(matchResults))
-            local auxiliaryInputs = nil
-            local failedPaths = nil
-            if closure then
-                auxiliaryInputs, failedPaths = GetAuxiliaryInputs(inputs, closure)
-            end
-            if failedPaths then
-                self.stack:RemoveTail()
-                local message = GetAdditionalInputsDoNotExistMessage(failedPaths)
-                OnFailure(inputs, auxiliaryInputs, outputs, message)
-                done = true
-                success = false
+            local parsed = stack.parsed
+            if parsed == nil or parsed.path ~= path then
+                parsed = ParsePath(path, mapRules)
+                stack.parsed = parsed
             else
-                local mustCompileInputs = false
-                for _, input in ipairs(inputs) do
-                    if InputNeedsCompile(input, mapRules) then
-                        self.stack:InsertTail(input)
-                        mustCompileInputs = true
+                for _, input in ipairs(parsed.waitingFor) do
+                    if self.running[input] then
+                        return "waiting"
                     end
                 end
-                if auxiliaryInputs then
-                    for _, input in ipairs(auxiliaryInputs) do
-                        if InputNeedsCompile(input, mapRules) then
-                            self.stack:InsertTail(input)
+                -- The inputs that have been compiled since can change what
+                -- the closure finds.
+                if parsed.closure then
+                    parsed.auxiliaryInputs, parsed.failedPaths =
+                        GetAuxiliaryInputs(parsed.inputs, parsed.closure)
+                end
+            end
+            if parsed == nil then
+                print(string.format("Warning: no compilation rule found for '%s'", path))
+                paths:RemoveTail()
+            else
+                local inputs = parsed.inputs
+                local outputs = parsed.outputs
+                local auxiliaryInputs = parsed.auxiliaryInputs
+                if parsed.failedPaths then
+                    paths:RemoveTail()
+                    stack.parsed = nil
+                    self.compiled[path] = true
+                    local message = GetAdditionalInputsDoNotExistMessage(parsed.failedPaths)
+                    OnFailure(inputs, auxiliaryInputs, outputs, message)
+                    return "finished", false
+                end
+                local mustCompileInputs = false
+                parsed.waitingFor = {}
+                local allInputs = { inputs, auxiliaryInputs or {} }
+                for _, inputList in ipairs(allInputs) do
+                    for _, input in ipairs(inputList) do
+                        if self.running[input] then
+                            parsed.waitingFor[#parsed.waitingFor+1] = input
+                        elseif InputNeedsCompile(input, mapRules, self.compiled) then
+                            paths:InsertTail(input)
                             mustCompileInputs = true
                         end
                     end
                 end
                 if not mustCompileInputs then
-                    self.stack:RemoveTail()
+                    if #parsed.waitingFor > 0 then
+                        return "waiting"
+                    end
+                    stack.parsed = nil
                     if AreInputsNewer(inputs, auxiliaryInputs, outputs) then
-                        success, errorMessage = funcTable.Execute(inputs, outputs)
-                        if success then
-                            OnSuccess(inputs, auxiliaryInputs, outputs)
-                        else
-                            OnFailure(inputs, auxiliaryInputs, outputs, errorMessage)
+                        stack.job = {
+                            path = path,
+                            funcTable = parsed.funcTable,
+                            inputs = inputs,
+                            auxiliaryInputs = auxiliaryInputs,
+                            outputs = outputs,
+                        }
+                        local status, success = self:TryStartJob(stack)
+                        if status ~= "started" then
+                            return status, success
                         end
-                        done = true
+                    else
+                        paths:RemoveTail()
                     end
                 end
             end
         end
     end
+    return "empty"
+end
 
-    return done, success
+-- Starts as many jobs as the rules' resources allow, and returns when one of
+-- them has finished. Returns whether there was an asset to compile, and if
+-- so, whether it compiled successfully.
+function BuildSystem:CompileNext(mapRules)
+    while true do
+        -- The waiting stacks get the first pick of whatever the last job
+        -- freed up.
+        local i = 1
+        while i <= #self.stacks do
+            local stack = self.stacks[i]
+            local status, success = self:WorkOnStack(stack, mapRules)
+            if stack.paths:IsEmpty() then
+                table.remove(self.stacks, i)
+                PathDone(stack.rule)
+            else
+                i = i + 1
+            end
+            if status == "finished" then
+                return true, success
+            end
+        end
+
+        -- Smaller jobs can fill in around one that's waiting for CPU or
+        -- memory, but not for ever, or it might never get to run.
+        while self.nextPath ~= nil and #self.stacks < MAX_WAITING_STACKS and
+              CanStartJob() and not IsStarved(self.stacks[1]) do
+            local stack = NewStack(self.nextPath, mapRules)
+            PlanPaths(stack.rule, 1)
+            self:NextPath()
+            local status, success = self:WorkOnStack(stack, mapRules)
+            if stack.paths:IsEmpty() then
+                PathDone(stack.rule)
+            else
+                self.stacks[#self.stacks+1] = stack
+            end
+            if status == "finished" then
+                return true, success
+            end
+        end
+
+        -- With nothing running, every stack will have been worked through.
+        if self.nRunning == 0 then
+            assert(#self.stacks == 0 and self.nextPath == nil)
+            return false, false
+        end
+
+        local status, success = self:WaitForJob()
+        if status == "finished" then
+            return true, success
+        end
+    end
+end
+
+-- Waits for the jobs that are still running when the build stops early.
+function BuildSystem:FinishRunningJobs()
+    while self.nRunning > 0 do
+        self:WaitForJob()
+    end
 end
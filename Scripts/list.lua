@@ -1,7 +1,7 @@
 List = {}
 
 function List:New()
-    list = { first = 0, last = -1 }
+    local list = { first = 0, last = -1 }
     setmetatable(list, self)
     self.__index = self
     return list
@@ -12,30 +12,30 @@ function List:IsEmpty()
 end
 
 function List:PeekHead()
-    return list[self.first]
+    return self[self.first]
 end
 
 function List:PeekTail()
-    return list[self.last]
+    return self[self.last]
 end
 
 function List:InsertHead(value)
     local first = self.first - 1
     self.first = first
-    list[first] = value
+    self[first] = value
 end
 
 function List:InsertTail(value)
     local last = self.last + 1
     self.last = last
-    list[last] = value
+    self[last] = value
 end
 
 function List:RemoveHead()
     local first = self.first
     if first > self.last then error("list is empty") end
-    local value = list[first]
-    list[first] = nil        -- to allow garbage collection
+    local value = self[first]
+    self[first] = nil        -- to allow garbage collection
     self.first = first + 1
     return value
 end
@@ -43,8 +43,8 @@ end
 function List:RemoveTail()
     local last = self.last
     if self.first > last then error("list is empty") end
-    local value = list[last]
-    list[last] = nil         -- to allow garbage collection
+    local value = self[last]
+    self[last] = nil         -- to allow garbage collection
     self.last = last - 1
     return value
 end